@@ -8,6 +8,7 @@ COMPAT_SRCS :=					    \
 	compat/inet_aton.c			    \
 
 DEBUG_SRCS :=					    \
+	debug/AsyncLogWriter.cc		\
 	debug/DebugUtils.cc			    \
 	debug/DebugDumpBuf.cc			\
 	debug/FatalSignals.cc			\
@@ -22,6 +23,7 @@ DEBUG_SRCS :=					    \
 
 IO_SRCS :=					        \
 	io/BufferedIO.cc			    \
+	io/DatagramBatch.cc		\
 	io/FdIOClient.cc			    \
 	io/FileIOClient.cc			    \
 	io/FileUtils.cc				    \
@@ -30,6 +32,7 @@ IO_SRCS :=					        \
 	io/IPSocket.cc				    \
 	io/NetUtils.cc				    \
 	io/PrettyPrintBuffer.cc			\
+	io/Reactor.cc			\
 	io/TCPClient.cc				    \
 	io/TCPServer.cc				    \
 	io/UDPClient.cc				    \
@@ -67,9 +70,12 @@ SMTP_SRCS :=                        \
 
 STORAGE_SRCS :=						\
 	storage/BerkeleyDBStore.cc		\
+	storage/CacheKey.cc		\
 	storage/DurableStore.cc         \
 	storage/DurableStoreImpl.cc		\
 	storage/FileSystemStore.cc		\
+	storage/GroupCommitter.cc	\
+	storage/LogStore.cc		\
 	storage/MemoryStore.cc          \
     storage/ODBCMySQL.cc			\
     storage/ODBCSQLite.cc			\
@@ -83,12 +89,18 @@ TCLCMD_SRCS :=					    \
 	tclcmd/TclCommand.cc			\
 
 THREAD_SRCS :=					    \
+	thread/AdaptiveLock.cc			    \
+	thread/Epoch.cc				    \
+	thread/EventNotifier.cc		\
+	thread/LockStats.cc			    \
 	thread/Mutex.cc				    \
 	thread/NoLock.cc			    \
 	thread/Notifier.cc			    \
 	thread/SpinLock.cc			    \
 	thread/Thread.cc			    \
+	thread/ThreadPool.cc			    \
 	thread/Timer.cc				    \
+	thread/TimerWheel.cc		\
 
 UTIL_SRCS :=					    \
 	util/CRC32.cc				    \
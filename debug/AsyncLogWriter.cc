@@ -0,0 +1,428 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "AsyncLogWriter.h"
+#include "FatalSignals.h"
+
+namespace oasys {
+
+// like Log.cc, we can't use the ASSERT from DebugUtils.h since it logs
+#undef ASSERT
+#define ASSERT(x) __log_assert(x, #x, __FILE__, __LINE__)
+
+/// Upper bound on iovecs per writev(), two per ring
+#define ASYNC_LOG_MAX_IOV 64
+
+AsyncLogWriter* AsyncLogWriter::instance_ = 0;
+
+#if HAVE_PTHREAD_SETSPECIFIC
+static pthread_key_t  ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+//----------------------------------------------------------------------
+static void
+ring_thread_exit(void* arg)
+{
+    // the writer frees the ring once it has written out the rest
+    static_cast<AsyncLogWriter::Ring*>(arg)->orphaned_ = true;
+}
+
+//----------------------------------------------------------------------
+static void
+ring_key_create()
+{
+    pthread_key_create(&ring_key, ring_thread_exit);
+}
+#endif
+
+//----------------------------------------------------------------------
+AsyncLogWriter::Ring::Ring(size_t size)
+    : head_(0), tail_(0), dropped_(0), orphaned_(false)
+{
+    size_t cap = 1024;
+    while (cap < size && cap < (1U << 30)) {
+        cap <<= 1;
+    }
+    mask_ = cap - 1;
+    buf_  = static_cast<char*>(malloc(cap));
+    ASSERT(buf_ != 0);
+}
+
+//----------------------------------------------------------------------
+AsyncLogWriter::Ring::~Ring()
+{
+    free(buf_);
+}
+
+//----------------------------------------------------------------------
+bool
+AsyncLogWriter::Ring::write(const struct iovec* iov, int iovcnt, size_t len)
+{
+    u_int32_t head = head_.value;
+    if (len > capacity() - (head - tail_.value)) {
+        return false;
+    }
+
+    for (int i = 0; i < iovcnt; ++i) {
+        const char* src = static_cast<const char*>(iov[i].iov_base);
+        size_t n = iov[i].iov_len;
+        while (n > 0) {
+            size_t off   = head & mask_;
+            size_t chunk = capacity() - off;
+            if (chunk > n) {
+                chunk = n;
+            }
+            memcpy(buf_ + off, src, chunk);
+            src  += chunk;
+            n    -= chunk;
+            head += chunk;
+        }
+    }
+
+    // the locked add publishes the data before the new head
+    atomic_add(&head_, len);
+    return true;
+}
+
+//----------------------------------------------------------------------
+size_t
+AsyncLogWriter::Ring::peek(struct iovec* iov, int* iovcnt)
+{
+    u_int32_t tail = tail_.value;
+    size_t len = head_.value - tail;
+    if (len == 0) {
+        *iovcnt = 0;
+        return 0;
+    }
+
+    size_t off   = tail & mask_;
+    size_t first = capacity() - off;
+    iov[0].iov_base = buf_ + off;
+    if (first >= len) {
+        iov[0].iov_len = len;
+        *iovcnt = 1;
+    } else {
+        iov[0].iov_len  = first;
+        iov[1].iov_base = buf_;
+        iov[1].iov_len  = len - first;
+        *iovcnt = 2;
+    }
+    return len;
+}
+
+//----------------------------------------------------------------------
+AsyncLogWriter::AsyncLogWriter(Log* log)
+    : log_(log),
+      policy_(Log::ASYNC_DROP),
+      ring_size_(0),
+      flush_interval_ms_(0),
+      running_(false),
+      thread_(0),
+      writer_id_(),
+      notifier_("/log/async", true),
+      kicked_(0),
+      total_dropped_(0)
+{
+#if HAVE_PTHREAD_SETSPECIFIC
+    pthread_once(&ring_key_once, ring_key_create);
+#endif
+}
+
+//----------------------------------------------------------------------
+AsyncLogWriter::~AsyncLogWriter()
+{
+    ASSERT(! running_);
+    if (instance_ == this) {
+        instance_ = 0;
+    }
+    // rings still attached to live threads are left alone
+}
+
+//----------------------------------------------------------------------
+void
+AsyncLogWriter::start(size_t ring_size, Log::async_policy_t policy,
+                      int flush_interval_ms)
+{
+    ASSERT(! running_);
+
+    static bool hook_added = false;
+    if (! hook_added) {
+        FatalSignals::add_crash_hook(crash_flush);
+        hook_added = true;
+    }
+
+    // rings created under an earlier start() keep their size
+    ring_size_         = ring_size;
+    policy_            = policy;
+    flush_interval_ms_ = flush_interval_ms;
+    instance_          = this;
+    reap_orphans();
+
+    running_ = true;
+    thread_  = new WriterThread(this);
+    thread_->start();
+}
+
+//----------------------------------------------------------------------
+void
+AsyncLogWriter::stop()
+{
+    if (! running_) {
+        return;
+    }
+
+    // the writer checks running_ rather than should_stop(), since the
+    // latter is reset when the thread first runs, which may well be
+    // after this on a loaded machine
+    running_ = false;
+    notifier_.try_notify(1);
+    thread_->join();
+    delete thread_;
+    thread_ = 0;
+
+    // anything appended after the writer's last pass
+    drain();
+    reap_orphans();
+}
+
+//----------------------------------------------------------------------
+AsyncLogWriter::Ring*
+AsyncLogWriter::thread_ring()
+{
+#if HAVE_PTHREAD_SETSPECIFIC
+    Ring* ring = static_cast<Ring*>(pthread_getspecific(ring_key));
+    if (ring != 0) {
+        return ring;
+    }
+
+    ring = new Ring(ring_size_);
+    rings_lock_.lock("AsyncLogWriter::thread_ring");
+    rings_.push_back(ring);
+    rings_lock_.unlock();
+
+    pthread_setspecific(ring_key, ring);
+    return ring;
+#else
+    return 0;
+#endif
+}
+
+//----------------------------------------------------------------------
+void
+AsyncLogWriter::kick()
+{
+    // only one wakeup needs to be pending at a time
+    if (atomic_cmpxchg32(&kicked_, 0, 1) == 0) {
+        notifier_.try_notify(1);
+    }
+}
+
+//----------------------------------------------------------------------
+bool
+AsyncLogWriter::append(const struct iovec* iov, int iovcnt, size_t len)
+{
+    if (! running_ || Thread::id_equal(Thread::current(), writer_id_)) {
+        return false;
+    }
+
+    Ring* ring = thread_ring();
+    if (ring == 0 || len > ring->capacity()) {
+        return false;
+    }
+
+    size_t half   = ring->capacity() / 2;
+    size_t before = ring->used();
+
+    while (! ring->write(iov, iovcnt, len)) {
+        if (policy_ == Log::ASYNC_DROP) {
+            atomic_incr(&ring->dropped_);
+            return true;
+        }
+
+        // the writer needs the output lock, so if we hold it (say
+        // in Log::rotate), waiting would deadlock
+        if (! running_ || log_->output_lock_->is_locked_by_me()) {
+            return false;
+        }
+
+        kick();
+        usleep(1000);
+        before = 0;
+    }
+
+    if (before < half && before + len >= half) {
+        kick();
+    }
+
+    return true;
+}
+
+//----------------------------------------------------------------------
+size_t
+AsyncLogWriter::drain()
+{
+    // snapshot the rings so that no lock is held while writing; only
+    // the writer (or stop(), once the writer is gone) ever frees one
+    rings_lock_.lock("AsyncLogWriter::drain");
+    std::vector<Ring*> rings(rings_);
+    rings_lock_.unlock();
+
+    struct iovec iov[ASYNC_LOG_MAX_IOV];
+    Ring*  pending[ASYNC_LOG_MAX_IOV / 2];
+    size_t pending_len[ASYNC_LOG_MAX_IOV / 2];
+    int    iovcnt   = 0;
+    int    npending = 0;
+    size_t total    = 0;
+    u_int32_t dropped = 0;
+
+    for (size_t i = 0; i <= rings.size(); ++i) {
+        // write out a full batch, or whatever is left at the end
+        if ((i == rings.size() || iovcnt + 2 > ASYNC_LOG_MAX_IOV) &&
+            iovcnt > 0)
+        {
+            log_->write_out(iov, iovcnt);
+            for (int j = 0; j < npending; ++j) {
+                pending[j]->consume(pending_len[j]);
+            }
+            iovcnt   = 0;
+            npending = 0;
+        }
+
+        if (i == rings.size()) {
+            break;
+        }
+
+        Ring* ring = rings[i];
+        u_int32_t d = ring->dropped_.value;
+        if (d != 0) {
+            atomic_sub(&ring->dropped_, d);
+            dropped += d;
+        }
+
+        int n;
+        size_t len = ring->peek(&iov[iovcnt], &n);
+        if (len != 0) {
+            iovcnt += n;
+            pending[npending]     = ring;
+            pending_len[npending] = len;
+            ++npending;
+            total += len;
+        }
+    }
+
+    if (dropped != 0) {
+        atomic_add(&total_dropped_, dropped);
+        logf("/log", LOG_WARN, "async log buffer full, dropped %u entries",
+             dropped);
+    }
+
+    return total;
+}
+
+//----------------------------------------------------------------------
+void
+AsyncLogWriter::reap_orphans()
+{
+    rings_lock_.lock("AsyncLogWriter::reap_orphans");
+    for (size_t i = 0; i < rings_.size(); ) {
+        Ring* ring = rings_[i];
+        if (ring->orphaned_ && ring->used() == 0) {
+            rings_[i] = rings_.back();
+            rings_.pop_back();
+            delete ring;
+        } else {
+            ++i;
+        }
+    }
+    rings_lock_.unlock();
+}
+
+//----------------------------------------------------------------------
+void
+AsyncLogWriter::flush()
+{
+    if (! running_ || Thread::id_equal(Thread::current(), writer_id_)) {
+        return;
+    }
+
+    // wait until each ring has been drained up to where its head was
+    rings_lock_.lock("AsyncLogWriter::flush");
+    std::vector<Ring*>     rings(rings_);
+    std::vector<u_int32_t> heads;
+    for (size_t i = 0; i < rings.size(); ++i) {
+        u_int32_t head = rings[i]->head_.value;
+        heads.push_back(head);
+    }
+    rings_lock_.unlock();
+
+    kick();
+    for (size_t i = 0; i < rings.size() && running_; ) {
+        if (static_cast<int32_t>(rings[i]->tail_.value - heads[i]) >= 0) {
+            ++i;
+        } else {
+            usleep(1000);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+void
+AsyncLogWriter::crash_flush()
+{
+    AsyncLogWriter* w = instance_;
+    if (w == 0) {
+        return;
+    }
+
+    // no locks: the crashing thread may well be holding one of them
+    int fd = w->log_->logfd_;
+    for (size_t i = 0; i < w->rings_.size(); ++i) {
+        Ring* ring = w->rings_[i];
+        struct iovec iov[2];
+        int iovcnt;
+        size_t len = ring->peek(iov, &iovcnt);
+        if (len != 0 && ::writev(fd, iov, iovcnt) > 0) {
+            ring->consume(len);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+void
+AsyncLogWriter::WriterThread::run()
+{
+    writer_->writer_id_ = Thread::current();
+
+    while (writer_->running_) {
+        writer_->notifier_.wait(NULL, writer_->flush_interval_ms_);
+        atomic_cmpxchg32(&writer_->kicked_, 1, 0);
+        writer_->drain();
+        writer_->reap_orphans();
+    }
+}
+
+} // namespace oasys
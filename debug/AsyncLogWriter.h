@@ -0,0 +1,162 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_ASYNC_LOG_WRITER_H_
+#define _OASYS_ASYNC_LOG_WRITER_H_
+
+#include <vector>
+#include <sys/uio.h>
+
+#include "Log.h"
+#include "../thread/Atomic.h"
+#include "../thread/Notifier.h"
+#include "../thread/SpinLock.h"
+#include "../thread/Thread.h"
+
+namespace oasys {
+
+/**
+ * Backend for Log's asynchronous mode (see Log::start_async).
+ *
+ * Each thread that logs gets its own ring buffer, which it fills
+ * without taking any locks. A background thread wakes up every
+ * flush_interval_ms (or sooner, when a ring passes half full),
+ * gathers whatever has accumulated in all the rings, and writes it
+ * out with as few writev() calls as possible.
+ *
+ * Memory is bounded by ring_size bytes per logging thread. When a
+ * ring is full, ASYNC_DROP discards the entry (the writer later logs
+ * how many were lost) while ASYNC_BLOCK waits for the writer to make
+ * room.
+ *
+ * Entries from one thread always come out in order, but entries from
+ * different threads are only ordered to within a flush interval.
+ *
+ * A crash hook registered with FatalSignals writes out whatever is
+ * still buffered before the process dies.
+ */
+class AsyncLogWriter {
+public:
+    /**
+     * A single-producer, single-consumer byte ring. The owning thread
+     * appends complete log entries, and the writer thread consumes
+     * them, so an entry is never split between two writes.
+     */
+    class Ring {
+    public:
+        Ring(size_t size);
+        ~Ring();
+
+        /// Copy the data in. Returns false if it doesn't fit.
+        bool write(const struct iovec* iov, int iovcnt, size_t len);
+
+        /// Fill in (up to two) iovecs covering everything buffered
+        /// and return the number of bytes they cover
+        size_t peek(struct iovec* iov, int* iovcnt);
+
+        /// Release len bytes that have been written out
+        void consume(size_t len) { atomic_add(&tail_, len); }
+
+        size_t used()     { return head_.value - tail_.value; }
+        size_t capacity() { return mask_ + 1; }
+
+        char*     buf_;
+        u_int32_t mask_;
+        char      pad0_[64];
+        atomic_t  head_;        ///< advanced by the owning thread
+        char      pad1_[64];
+        atomic_t  tail_;        ///< advanced by the writer
+        atomic_t  dropped_;     ///< entries that didn't fit
+        volatile bool orphaned_;///< owning thread has exited
+    };
+
+    AsyncLogWriter(Log* log);
+    ~AsyncLogWriter();
+
+    /**
+     * Start the writer thread.
+     */
+    void start(size_t ring_size, Log::async_policy_t policy,
+               int flush_interval_ms);
+
+    /**
+     * Stop the writer thread and write out everything that's left.
+     */
+    void stop();
+
+    /// Is the writer running
+    bool running() { return running_; }
+
+    /**
+     * Queue an entry for the calling thread.
+     *
+     * @return false if the caller should write it out synchronously
+     * instead (e.g. from the writer thread itself)
+     */
+    bool append(const struct iovec* iov, int iovcnt, size_t len);
+
+    /**
+     * Wait until everything that was buffered at the time of the
+     * call has been written.
+     */
+    void flush();
+
+    /// Total number of entries dropped so far
+    u_int32_t dropped() { return total_dropped_.value; }
+
+    /**
+     * Write everything buffered straight to the log descriptor,
+     * without taking any locks. Registered as a FatalSignals crash
+     * hook.
+     */
+    static void crash_flush();
+
+protected:
+    class WriterThread : public Thread {
+    public:
+        WriterThread(AsyncLogWriter* writer)
+            : Thread("AsyncLogWriter", CREATE_JOINABLE), writer_(writer) {}
+    protected:
+        void run();
+        AsyncLogWriter* writer_;
+    };
+    friend class WriterThread;
+
+    Ring* thread_ring();
+    size_t drain();
+    void reap_orphans();
+    void kick();
+
+    Log*                  log_;
+    Log::async_policy_t   policy_;
+    size_t                ring_size_;
+    int                   flush_interval_ms_;
+    volatile bool         running_;
+    WriterThread*         thread_;
+    ThreadId_t            writer_id_;
+    Notifier              notifier_;
+    atomic_t              kicked_;      ///< a wakeup is pending
+    SpinLock              rings_lock_;  ///< protects rings_
+    std::vector<Ring*>    rings_;
+    atomic_t              total_dropped_;
+
+    static AsyncLogWriter* instance_;   ///< for crash_flush()
+};
+
+} // namespace oasys
+
+#endif /* _OASYS_ASYNC_LOG_WRITER_H_ */
@@ -35,6 +35,11 @@ const char* FatalSignals::appname_  = "(unknown app)";
 const char* FatalSignals::core_dir_ = NULL;
 bool        FatalSignals::in_abort_handler_ = false;
 
+FatalSignals::crash_hook_t
+            FatalSignals::crash_hooks_[FatalSignals::MAX_CRASH_HOOKS];
+int         FatalSignals::num_crash_hooks_ = 0;
+bool        FatalSignals::crash_hooks_run_ = false;
+
 void
 FatalSignals::init(const char* appname)
 {
@@ -93,6 +98,7 @@ FatalSignals::handler(int sig)
         chdir(core_dir_);   
     }
 
+    run_crash_hooks();
     StackTrace::print_current_trace(true);
     fflush(stderr);
 
@@ -143,6 +149,7 @@ void
 FatalSignals::die()
 {
     Breaker::break_here();
+    run_crash_hooks();
     StackTrace::print_current_trace(false);
     if (core_dir_ != NULL) {
         fprintf(stderr, "fatal handler chdir'ing to core dir '%s'\n",
@@ -154,5 +161,28 @@ FatalSignals::die()
     ::abort();
 }
 
+void
+FatalSignals::add_crash_hook(crash_hook_t hook)
+{
+    if (num_crash_hooks_ == MAX_CRASH_HOOKS) {
+        fprintf(stderr, "FatalSignals: too many crash hooks\n");
+        return;
+    }
+    crash_hooks_[num_crash_hooks_++] = hook;
+}
+
+void
+FatalSignals::run_crash_hooks()
+{
+    if (crash_hooks_run_) {
+        return;
+    }
+    crash_hooks_run_ = true;
+    
+    for (int i = 0; i < num_crash_hooks_; ++i) {
+        (*crash_hooks_[i])();
+    }
+}
+
 
 } // namespace oasys
@@ -45,10 +45,36 @@ public:
      */
     static void die() __attribute__((noreturn));
 
+    /// Type for functions to be run when the process dies
+    typedef void (*crash_hook_t)();
+
+    /**
+     * Register a function to be called (once) from the fatal signal
+     * handler or die(), before the stack trace is printed. Hooks run
+     * in signal context with arbitrary locks held, so they must not
+     * lock or allocate.
+     */
+    static void add_crash_hook(crash_hook_t hook);
+
 protected:
     /// Fatal signal handler.
     static void handler(int sig);
 
+    /// Run all the crash hooks, unless that's already been done
+    static void run_crash_hooks();
+
+    /// Maximum number of crash hooks
+    static const int MAX_CRASH_HOOKS = 8;
+
+    /// Registered crash hooks
+    static crash_hook_t crash_hooks_[MAX_CRASH_HOOKS];
+
+    /// Number of registered crash hooks
+    static int num_crash_hooks_;
+
+    /// Flag set once the crash hooks have been run
+    static bool crash_hooks_run_;
+
     /// The app name to put in the stack trace printout
     static const char* appname_;
     
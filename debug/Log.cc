@@ -30,10 +30,12 @@
 #include <algorithm>
 #include <limits.h>
 
+#include "AsyncLogWriter.h"
 #include "DebugUtils.h"
 #include "Log.h"
 #include "compat/inttypes.h"
 #include "io/IO.h"
+#include "thread/Epoch.h"
 #include "thread/SpinLock.h"
 #include "thread/Timer.h"
 #include "util/StringBuffer.h"
@@ -92,15 +94,18 @@ Log* Log::instance_;
 bool Log::inited_   = false;
 bool Log::shutdown_ = false;
 bool Log::__debug_no_panic_on_overflow = false;
+volatile u_int32_t Log::generation_ = 1;
 
 //----------------------------------------------------------------------
 Log::Log()
     : output_flags_(OUTPUT_PATH | OUTPUT_TIME | OUTPUT_LEVEL),
       logfd_(-1),
-      default_threshold_(LOG_DEFAULT_THRESHOLD)
+      default_threshold_(LOG_DEFAULT_THRESHOLD),
+      async_writer_(NULL)
 {
     output_lock_ = new SpinLock();
-    rule_list_   = &rule_lists_[1];
+    rule_list_   = new RuleList();
+    rule_epoch_  = new Epoch();
 }
 
 //----------------------------------------------------------------------
@@ -149,6 +154,7 @@ Log::do_init(const char* logfile, log_level_t defaultlvl,
 #endif
     
     default_threshold_ = defaultlvl;
+    bump_generation();
     parse_debug_file(debug_path);
 
     inited_ = true;
@@ -159,11 +165,14 @@ void
 Log::fini()
 {
     log_debug_p("/log", "shutting down");
+    stop_async();
     close(logfd_);
     logfd_ = -1;
 
-    rule_lists_[0].clear();
-    rule_lists_[1].clear();
+    // free the lists retired by reparsing; the current one is left
+    // (empty) in case anything still logs
+    rule_epoch_->synchronize();
+    rule_list_->clear();
 
     delete output_lock_;
 }
@@ -197,14 +206,6 @@ Log::parse_debug_file(const char* debug_path)
     if (debug_path[0] == '\0')
         return;
     
-    // handle double buffering for the rule lists
-    RuleList* old_rule_list = rule_list_;
-    RuleList* new_rule_list = (rule_list_ == &rule_lists_[0]) ?
-                              &rule_lists_[1] : &rule_lists_[0];
-
-    ASSERT(new_rule_list != old_rule_list);
-    new_rule_list->clear();
-
     // handle ~/ in the debug_path
     if ((debug_path[0] == '~') && (debug_path[1] == '/')) {
         char path[256];
@@ -233,6 +234,11 @@ Log::parse_debug_file(const char* debug_path)
         return;
     }
 
+    // Readers never lock the rule list, so rather than changing the
+    // current one, build a new one, switch the pointer over to it and
+    // leave the old one for the epoch to free once no one is using it.
+    RuleList* new_rule_list = new RuleList();
+
     char buf[1024];
     int linenum = 0;
     
@@ -333,7 +339,21 @@ Log::parse_debug_file(const char* debug_path)
              (int)new_rule_list->size());
     }
 
-    rule_list_ = new_rule_list;
+    RuleList* old_rule_list = rule_list_;
+    Epoch::publish(&rule_list_, new_rule_list);
+    rule_epoch_->retire(old_rule_list);
+    bump_generation();
+}
+
+//----------------------------------------------------------------------
+void
+Log::bump_generation()
+{
+    // a single reparse or rotate happens at a time, so there's no
+    // need for an atomic increment, just for skipping zero (which
+    // Logger uses to mean "not cached")
+    u_int32_t gen = (generation_ + 1) & 0x0fffffff;
+    generation_ = (gen == 0) ? 1 : gen;
 }
 
 //----------------------------------------------------------------------
@@ -356,6 +376,7 @@ Log::dump_rules(StringBuffer* buf)
 {
     ASSERT(inited_);
 
+    ScopeEpoch e(rule_epoch_);
     RuleList* rule_list = rule_list_;
     RuleList::iterator iter = rule_list->begin();
     for (iter = rule_list->begin(); iter != rule_list->end(); iter++) {
@@ -462,6 +483,8 @@ Log::rotate()
     }
     
     output_lock_->unlock();
+
+    bump_generation();
 }
 
 //----------------------------------------------------------------------
@@ -500,6 +523,7 @@ Log::add_reparse_handler(int sig)
 log_level_t
 Log::log_level(const char *path)
 {
+    ScopeEpoch e(rule_epoch_);
     Rule *r = find_rule(path);
 
     if (r) {
@@ -672,8 +696,12 @@ Log::log(const std::string& path, log_level_t level,
     {
         // lock the log file so that all lines appear next to each
         // other (the lock is reentrant, so this won't cause a
-        // deadlock in output())
-        output_lock_->lock("Log::log");
+        // deadlock in output()). in async mode the lines all go into
+        // this thread's buffer, which keeps them together anyway.
+        bool async = is_async();
+        if (! async) {
+            output_lock_->lock("Log::log");
+        }
 
         size_t beg = 0;
         size_t end;
@@ -710,7 +738,9 @@ Log::log(const std::string& path, log_level_t level,
         // output what's in the iovecs and unlock
         rval += this->output(iov, iovcnt);
         
-        output_lock_->unlock();
+        if (! async) {
+            output_lock_->unlock();
+        }
     }
     else
     {
@@ -760,6 +790,20 @@ Log::output(const struct iovec* iov, int iovcnt)
     }
 #endif
 
+    if (async_writer_ != NULL && async_writer_->running()) {
+        size_t size = IO::iovec_size(iov, iovcnt);
+        if (async_writer_->append(iov, iovcnt, size)) {
+            return size;
+        }
+    }
+
+    return write_out(iov, iovcnt);
+}
+
+//----------------------------------------------------------------------
+int
+Log::write_out(const struct iovec* iov, int iovcnt)
+{
     const int save_errno = errno;
     
     // do the write, making sure to drain the buffer. since stdout was
@@ -786,6 +830,54 @@ Log::output(const struct iovec* iov, int iovcnt)
     return size;
 }
 
+//----------------------------------------------------------------------
+void
+Log::start_async(size_t ring_size, async_policy_t policy,
+                 int flush_interval_ms)
+{
+    if (async_writer_ == NULL) {
+        // never deleted, since other threads may still be holding
+        // rings that point back at it
+        async_writer_ = new AsyncLogWriter(this);
+    }
+
+    if (! async_writer_->running()) {
+        async_writer_->start(ring_size, policy, flush_interval_ms);
+    }
+}
+
+//----------------------------------------------------------------------
+void
+Log::stop_async()
+{
+    if (async_writer_ != NULL) {
+        async_writer_->stop();
+    }
+}
+
+//----------------------------------------------------------------------
+bool
+Log::is_async()
+{
+    return async_writer_ != NULL && async_writer_->running();
+}
+
+//----------------------------------------------------------------------
+void
+Log::flush()
+{
+    if (async_writer_ != NULL) {
+        async_writer_->flush();
+    }
+}
+
+//----------------------------------------------------------------------
+u_int32_t
+Log::async_dropped()
+{
+    return async_writer_ == NULL ? 0 : async_writer_->dropped();
+}
+
 //----------------------------------------------------------------------
 int
 Log::vlogf(const char* path, log_level_t level,
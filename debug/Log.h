@@ -95,6 +95,7 @@
 #include <cstring>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/types.h>
 #include <string>
 #include <vector>
 #include <strings.h>
@@ -162,6 +163,8 @@ void __log_assert(bool x, const char* what, const char* file, int line);
 extern "C" int log_vsnprintf(char *str, size_t strsz, const char *fmt0, va_list ap);
 extern "C" int log_snprintf(char *str, size_t strsz, const char *fmt, ...);
 
+class AsyncLogWriter;
+class Epoch;
 class SpinLock;
 class StringBuffer;
 
@@ -274,6 +277,13 @@ public:
      */
     log_level_t log_level(const char *path);
 
+    /**
+     * Counter that's bumped whenever the rules change (or the log is
+     * rotated), so that cached levels (see Logger::log_enabled) know
+     * when they need to be looked up again. Never zero.
+     */
+    static u_int32_t generation() { return generation_; }
+
     /**
      * Parse the debug file and repopulate the rule list. Called from
      * init or from an external handler to reparse the file. If
@@ -324,8 +334,51 @@ public:
      */
     static bool __debug_no_panic_on_overflow;
 
+    /**
+     * What an asynchronous logging thread does when its buffer is
+     * full.
+     */
+    typedef enum {
+        ASYNC_DROP,     ///< Discard the entry (and count it)
+        ASYNC_BLOCK     ///< Wait for the writer to make room
+    } async_policy_t;
+
+    /**
+     * Switch to asynchronous output. From then on, each logging
+     * thread formats its entries into a private ring buffer of
+     * ring_size bytes and returns immediately, and a background
+     * thread writes out the contents of all the rings with batched
+     * writev() calls, at least every flush_interval_ms.
+     *
+     * Entries that were still buffered when the process crashes are
+     * written out by a FatalSignals crash hook.
+     */
+    void start_async(size_t ring_size         = 256 * 1024,
+                     async_policy_t policy    = ASYNC_DROP,
+                     int flush_interval_ms    = 50);
+
+    /**
+     * Write out everything buffered and go back to synchronous
+     * output. Entries logged by other threads while this is running
+     * may be left in their buffers until the next start_async().
+     */
+    void stop_async();
+
+    /// Whether asynchronous output is enabled
+    bool is_async();
+
+    /**
+     * In asynchronous mode, wait until everything logged so far has
+     * been written out. A no-op otherwise.
+     */
+    void flush();
+
+    /// Number of entries dropped under ASYNC_DROP
+    u_int32_t async_dropped();
+
 protected:
     friend class LogCommand;
+    friend class AsyncLogWriter;
     
     Log();
 
@@ -341,6 +394,17 @@ protected:
      */
     static Log* instance_;
 
+    /**
+     * Rule generation counter, kept to 28 bits so Logger can pack it
+     * together with a level in a single word.
+     */
+    static volatile u_int32_t generation_;
+
+    /**
+     * Bump the generation counter.
+     */
+    static void bump_generation();
+
     /**
      * @brief Outputs @p data to the log file
      *
@@ -352,6 +416,12 @@ protected:
      */
     int output(const struct iovec* iov, int iovcnt);
 
+    /**
+     * Write the data straight to the log file, bypassing any
+     * asynchronous buffering.
+     */
+    int write_out(const struct iovec* iov, int iovcnt);
+
 private:
     /**
      * Structure used to store a log rule as parsed from the debug
@@ -445,7 +515,8 @@ private:
                       const char* classname, const void* obj) const;
 
     /**
-     * Find a rule given a path.
+     * Find a rule given a path. The caller has to be in a read
+     * section of rule_epoch_ for as long as it uses the rule.
      */
     Rule *find_rule(const char *path);
 
@@ -454,12 +525,13 @@ private:
     std::string logfile_;	///< Log output file (- for stdout)
     int logfd_;			///< Output file descriptor
     bool stdio_redirected_;	///< Flag to redirect std{out,err}
-    RuleList* rule_list_;	///< Pointer to current list of logging rules
-    RuleList  rule_lists_[2];	///< Double-buffered rule lists for reparsing
+    RuleList* volatile rule_list_; ///< Current list of logging rules
+    Epoch* rule_epoch_;		///< Readers of rule_list_, to free old lists
     SpinLock* output_lock_;	///< Lock for write calls and rotating
     std::string debug_path_;    ///< Path to the debug file
     std::string prefix_;	///< String to prefix log messages
     log_level_t default_threshold_; ///< The default threshold for log messages
+    AsyncLogWriter* async_writer_; ///< Backend for asynchronous output
 };
 
 /**
@@ -535,6 +607,18 @@ log_enabled(log_level_t level, const char* path)
 
 } // namespace oasys
 
+/**
+ * Log levels below LOG_MIN_LEVEL are compiled out of the log_*()
+ * macros altogether, so defining it (e.g. -DLOG_MIN_LEVEL=3 to keep
+ * only notice and above) takes both the formatting and the level
+ * check off of hot paths. By default everything is compiled in.
+ */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+#define LOG_LEVEL_COMPILED(_lvl) ((int)(_lvl) >= LOG_MIN_LEVEL)
+
 /**
  * The set of macros below are implemented for more efficient
  * implementation of logging functions. As noted in the comment above,
@@ -551,6 +635,9 @@ log_enabled(log_level_t level, const char* path)
  * any non-Logger contexts.
  *
  * The log_debug_p() variant should be used in global contexts.
+ *
+ * Each macro first tests LOG_LEVEL_COMPILED() on a constant, so levels
+ * below LOG_MIN_LEVEL reduce to dead code.
  */
 
 // compile out all log_debug calls when not debugging
@@ -559,62 +646,76 @@ inline int log_nop() { return 0; }
 #define log_debug(args...)   log_nop()
 #define log_debug_p(args...) log_nop()
 #else
-#define log_debug(args...)                                                      \
-     (this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_DEBUG) ?     \
+#define log_debug(args...)                                                    \
+     ((LOG_LEVEL_COMPILED(oasys::LOG_DEBUG) &&                                \
+       this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_DEBUG)) ? \
       this->logf(oasys::LOG_DEBUG, ## args) : 0)
 
-#define log_debug_p(p, args...)                         \
-    ((oasys::log_enabled(oasys::LOG_DEBUG, (p))) ?      \
+#define log_debug_p(p, args...)                    \
+    ((LOG_LEVEL_COMPILED(oasys::LOG_DEBUG) &&      \
+      oasys::log_enabled(oasys::LOG_DEBUG, (p))) ? \
      oasys::logf((p), oasys::LOG_DEBUG, ## args) : 0)
 
 #endif // NDEBUG
 
-#define log_info(args...)                                                        \
-     (this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_INFO) ?       \
+#define log_info(args...)                                                    \
+     ((LOG_LEVEL_COMPILED(oasys::LOG_INFO) &&                                \
+       this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_INFO)) ? \
       this->logf(oasys::LOG_INFO, ## args) : 0)
 
-#define log_info_p(p, args...)                                 \
-    ((oasys::log_enabled(oasys::LOG_INFO, (p))) ?                      \
+#define log_info_p(p, args...)                    \
+    ((LOG_LEVEL_COMPILED(oasys::LOG_INFO) &&      \
+      oasys::log_enabled(oasys::LOG_INFO, (p))) ? \
      oasys::logf((p), oasys::LOG_INFO, ## args) : 0)
 
-#define log_notice(args...)                                                        \
-     (this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_NOTICE) ?       \
+#define log_notice(args...)                                                    \
+     ((LOG_LEVEL_COMPILED(oasys::LOG_NOTICE) &&                                \
+       this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_NOTICE)) ? \
       this->logf(oasys::LOG_NOTICE, ## args) : 0)
 
-#define log_notice_p(p, args...)                                 \
-    ((oasys::log_enabled(oasys::LOG_NOTICE, (p))) ?                      \
+#define log_notice_p(p, args...)                    \
+    ((LOG_LEVEL_COMPILED(oasys::LOG_NOTICE) &&      \
+      oasys::log_enabled(oasys::LOG_NOTICE, (p))) ? \
      oasys::logf((p), oasys::LOG_NOTICE, ## args) : 0)
 
-#define log_warn(args...)                                                        \
-     (this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_WARN) ?       \
+#define log_warn(args...)                                                    \
+     ((LOG_LEVEL_COMPILED(oasys::LOG_WARN) &&                                \
+       this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_WARN)) ? \
       this->logf(oasys::LOG_WARN, ## args) : 0)
 
-#define log_warn_p(p, args...)                                 \
-    ((oasys::log_enabled(oasys::LOG_WARN, (p))) ?                      \
+#define log_warn_p(p, args...)                    \
+    ((LOG_LEVEL_COMPILED(oasys::LOG_WARN) &&      \
+      oasys::log_enabled(oasys::LOG_WARN, (p))) ? \
      oasys::logf((p), oasys::LOG_WARN, ## args) : 0)
 
-#define log_err(args...)                                                        \
-     (this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_ERR) ?       \
+#define log_err(args...)                                                    \
+     ((LOG_LEVEL_COMPILED(oasys::LOG_ERR) &&                                \
+       this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_ERR)) ? \
       this->logf(oasys::LOG_ERR, ## args) : 0)
 
-#define log_err_p(p, args...)                                 \
-    ((oasys::log_enabled(oasys::LOG_ERR, (p))) ?                      \
+#define log_err_p(p, args...)                    \
+    ((LOG_LEVEL_COMPILED(oasys::LOG_ERR) &&      \
+      oasys::log_enabled(oasys::LOG_ERR, (p))) ? \
      oasys::logf((p), oasys::LOG_ERR, ## args) : 0)
 
-#define log_crit(args...)                                                        \
-     (this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_CRIT) ?       \
+#define log_crit(args...)                                                    \
+     ((LOG_LEVEL_COMPILED(oasys::LOG_CRIT) &&                                \
+       this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_CRIT)) ? \
       this->logf(oasys::LOG_CRIT, ## args) : 0)
 
-#define log_crit_p(p, args...)                                 \
-    ((oasys::log_enabled(oasys::LOG_CRIT, (p))) ?                      \
+#define log_crit_p(p, args...)                    \
+    ((LOG_LEVEL_COMPILED(oasys::LOG_CRIT) &&      \
+      oasys::log_enabled(oasys::LOG_CRIT, (p))) ? \
      oasys::logf((p), oasys::LOG_CRIT, ## args) : 0)
 
-#define log_always(args...)                                                        \
-     (this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_ALWAYS) ?       \
+#define log_always(args...)                                                    \
+     ((LOG_LEVEL_COMPILED(oasys::LOG_ALWAYS) &&                                \
+       this->log_enabled((Can_Only_Be_Called_By_A_Logger)oasys::LOG_ALWAYS)) ? \
       this->logf(oasys::LOG_ALWAYS, ## args) : 0)
 
-#define log_always_p(p, args...)                                 \
-    ((oasys::log_enabled(oasys::LOG_ALWAYS, (p))) ?                      \
+#define log_always_p(p, args...)                    \
+    ((LOG_LEVEL_COMPILED(oasys::LOG_ALWAYS) &&      \
+      oasys::log_enabled(oasys::LOG_ALWAYS, (p))) ? \
      oasys::logf((p), oasys::LOG_ALWAYS, ## args) : 0)
 
 
@@ -82,7 +82,7 @@ public:
      * @param logpath The logpath string.
      */
     Logger(const char* classname, const std::string& logpath)
-        : classname_(classname)
+        : classname_(classname), level_cache_(0)
     {
         set_logpath(logpath.c_str());
     }
@@ -134,11 +134,18 @@ public:
      * Also, all Logger instances store the class name of the
      * implementation, and logging can be enabled/disabled on that
      * target as well, so we check the class name as well.
+     *
+     * The resulting threshold is cached, so the rules are only
+     * consulted again after the logpath changes or the Log generation
+     * is bumped (i.e. the debug file is reparsed).
      */
     inline bool log_enabled(log_level_t level) const
     {
-        return oasys::log_enabled(level, logpath_) ||
-            oasys::log_enabled(level, classname_);
+        u_int32_t cache = level_cache_;
+        if ((cache >> 4) != Log::generation()) {
+            cache = update_level_cache();
+        }
+        return level >= static_cast<log_level_t>(cache & 0xf);
     }
 
     /**
@@ -192,14 +199,24 @@ public:
     const char* logpath() const { return logpath_; }
 
 protected:
+    /**
+     * Look up the threshold for the logpath and class name and store
+     * it in level_cache_.
+     */
+    inline u_int32_t update_level_cache() const;
+
     const char* classname_;
     char logpath_[LOG_MAX_PATHLEN];
     size_t baselen_;
+
+    /// Log generation (upper 28 bits) and cached threshold (lower 4
+    /// bits) in one word so that readers can't see a torn update
+    mutable volatile u_int32_t level_cache_;
 };
 
 //----------------------------------------------------------------------
 Logger::Logger(const char* classname, const char* fmt, ...)
-    : classname_(classname)
+    : classname_(classname), level_cache_(0)
 {
     va_list ap;
     va_start(ap, fmt);
@@ -234,6 +251,7 @@ Logger::vlogpathf(const char* fmt, va_list ap)
     
     // update the length of the logpath_
     baselen_ = strlen(logpath_);
+    level_cache_ = 0;
 }
 
 //----------------------------------------------------------------------
@@ -255,6 +273,27 @@ Logger::logpath_appendf(const char* fmt, ...)
     log_vsnprintf(&logpath_[baselen_], sizeof(logpath_) - baselen_, fmt, ap);
     va_end(ap);
     // baselen_ is not updated here on purpose
+    level_cache_ = 0;
+}
+
+//----------------------------------------------------------------------
+u_int32_t
+Logger::update_level_cache() const
+{
+    // read the generation first, so a concurrent reparse leaves a
+    // stale generation behind and the next call looks again
+    u_int32_t gen = Log::generation();
+    log_level_t level = Log::instance()->log_level(logpath_);
+    if (classname_ != NULL) {
+        log_level_t class_level = Log::instance()->log_level(classname_);
+        if (class_level < level) {
+            level = class_level;
+        }
+    }
+
+    u_int32_t cache = (gen << 4) | (static_cast<u_int32_t>(level) & 0xf);
+    level_cache_ = cache;
+    return cache;
 }
 
 //----------------------------------------------------------------------
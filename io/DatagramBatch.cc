@@ -0,0 +1,141 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <netinet/udp.h>
+#endif
+
+#include "DatagramBatch.h"
+#include "../debug/DebugUtils.h"
+
+namespace oasys {
+
+/// Per-entry room for ancillary data (only a UDP_GRO int for now)
+#define DATAGRAM_CONTROL_SIZE 64
+
+//----------------------------------------------------------------------
+DatagramBatch::DatagramBatch(size_t capacity, size_t bufsize)
+    : capacity_(capacity),
+      bufsize_(bufsize),
+      size_(0),
+      msgs_(capacity),
+      iovs_(capacity),
+      addrs_(capacity)
+{
+    ASSERT(capacity > 0);
+    bufs_    = static_cast<char*>(malloc(capacity * bufsize));
+    control_ = static_cast<char*>(malloc(capacity * DATAGRAM_CONTROL_SIZE));
+    ASSERT(bufs_ != 0 && control_ != 0);
+
+    memset(&msgs_[0],  0, capacity * sizeof(msgs_[0]));
+    memset(&addrs_[0], 0, capacity * sizeof(addrs_[0]));
+    for (size_t i = 0; i < capacity; ++i) {
+        iovs_[i].iov_base = data(i);
+        iovs_[i].iov_len  = bufsize;
+        msgs_[i].msg_hdr.msg_iov    = &iovs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+//----------------------------------------------------------------------
+DatagramBatch::~DatagramBatch()
+{
+    free(bufs_);
+    free(control_);
+}
+
+//----------------------------------------------------------------------
+int
+DatagramBatch::add(const char* bp, size_t len,
+                   in_addr_t addr, u_int16_t port)
+{
+    if (size_ == capacity_ || len > bufsize_) {
+        return -1;
+    }
+
+    size_t i = size_++;
+    memcpy(data(i), bp, len);
+    iovs_[i].iov_len = len;
+
+    struct msghdr* hdr = &msgs_[i].msg_hdr;
+    if (addr == INADDR_NONE) {
+        hdr->msg_name    = 0;
+        hdr->msg_namelen = 0;
+    } else {
+        addrs_[i].sin_family      = AF_INET;
+        addrs_[i].sin_addr.s_addr = addr;
+        addrs_[i].sin_port        = htons(port);
+        hdr->msg_name    = &addrs_[i];
+        hdr->msg_namelen = sizeof(addrs_[i]);
+    }
+    hdr->msg_control    = 0;
+    hdr->msg_controllen = 0;
+    hdr->msg_flags      = 0;
+    msgs_[i].msg_len    = len;
+
+    return 0;
+}
+
+//----------------------------------------------------------------------
+void
+DatagramBatch::prepare_recv()
+{
+    size_ = 0;
+    for (size_t i = 0; i < capacity_; ++i) {
+        struct msghdr* hdr = &msgs_[i].msg_hdr;
+        iovs_[i].iov_len    = bufsize_;
+        hdr->msg_name       = &addrs_[i];
+        hdr->msg_namelen    = sizeof(addrs_[i]);
+        hdr->msg_control    = control_ + (i * DATAGRAM_CONTROL_SIZE);
+        hdr->msg_controllen = DATAGRAM_CONTROL_SIZE;
+        hdr->msg_flags      = 0;
+        msgs_[i].msg_len    = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+int
+DatagramBatch::segment_size(size_t i) const
+{
+#if defined(UDP_GRO)
+    struct msghdr* hdr = const_cast<struct msghdr*>(&msgs_[i].msg_hdr);
+    if (hdr->msg_control == 0) {
+        return 0;
+    }
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != 0;
+         cmsg = CMSG_NXTHDR(hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gso_size;
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            return gso_size;
+        }
+    }
+#else
+    (void)i;
+#endif
+    return 0;
+}
+
+} // namespace oasys
@@ -0,0 +1,115 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_DATAGRAM_BATCH_H_
+#define _OASYS_DATAGRAM_BATCH_H_
+
+#include <vector>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "IO.h"
+
+namespace oasys {
+
+/**
+ * A reusable vector of datagram buffers and message headers for
+ * IPSocket::sendmmsg() and IPSocket::recvmmsg().
+ *
+ * All of the memory (one buffer of bufsize bytes per entry, plus the
+ * addresses, iovecs and headers) is allocated once in the
+ * constructor, so a batch can be kept around and reused for every
+ * send or receive on a socket without touching the allocator.
+ *
+ * To send, clear() the batch and add() up to capacity() datagrams.
+ * After a receive, size() is the number of datagrams that arrived,
+ * and data(), len(), addr() and port() describe each one.
+ */
+class DatagramBatch {
+private:
+    DatagramBatch(const DatagramBatch&); ///< Prohibited constructor
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param capacity Maximum number of datagrams in the batch
+     * @param bufsize  Size of each datagram buffer
+     */
+    DatagramBatch(size_t capacity, size_t bufsize = 2048);
+    ~DatagramBatch();
+
+    /// Maximum number of datagrams
+    size_t capacity() const { return capacity_; }
+
+    /// Size of each datagram buffer
+    size_t bufsize() const { return bufsize_; }
+
+    /// Number of datagrams in the batch
+    size_t size() const { return size_; }
+
+    /// Remove all datagrams
+    void clear() { size_ = 0; }
+
+    /**
+     * Copy a datagram into the next free buffer. If addr is
+     * INADDR_NONE, it goes to the peer of a connected socket.
+     *
+     * @return 0 on success, -1 if the batch is full or the datagram is
+     * bigger than bufsize().
+     */
+    int add(const char* bp, size_t len,
+            in_addr_t addr = INADDR_NONE, u_int16_t port = 0);
+
+    /// @{ Accessors for datagram i
+    char*     data(size_t i) { return bufs_ + (i * bufsize_); }
+    size_t    len(size_t i)  const { return msgs_[i].msg_len; }
+    in_addr_t addr(size_t i) const { return addrs_[i].sin_addr.s_addr; }
+    u_int16_t port(size_t i) const { return ntohs(addrs_[i].sin_port); }
+    /// @}
+
+    /**
+     * With UDP_GRO enabled on the socket, the kernel may coalesce
+     * several datagrams from the same sender into one entry.
+     *
+     * @return The size of the original datagrams if entry i was
+     * coalesced this way, 0 otherwise.
+     */
+    int segment_size(size_t i) const;
+
+    /// @{ Used by IPSocket to drive the system calls
+    struct mmsghdr* msgs() { return &msgs_[0]; }
+    void prepare_recv();
+    void set_size(size_t n) { size_ = n; }
+    /// @}
+
+protected:
+    size_t capacity_;
+    size_t bufsize_;
+    size_t size_;
+    char*  bufs_;
+    char*  control_;
+
+    std::vector<struct mmsghdr>     msgs_;
+    std::vector<struct iovec>       iovs_;
+    std::vector<struct sockaddr_in> addrs_;
+};
+
+} // namespace oasys
+
+#endif /* _OASYS_DATAGRAM_BATCH_H_ */
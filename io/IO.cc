@@ -24,6 +24,11 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
 
 #include "IO.h"
 
@@ -593,6 +598,152 @@ IO::sendmsg(int fd, const struct msghdr* msg, int flags,
                   intr, false, log);
 }
 
+//----------------------------------------------------------------------------
+int
+IO::sendfile(int fd, int in_fd, off_t* offset, size_t len,
+             Notifier* intr, const char* log)
+{
+    RwDataExtraArgs args;
+    args.sendfile.in_fd  = in_fd;
+    args.sendfile.offset = offset;
+    args.sendfile.len    = len;
+
+    return rwdata(SENDFILE, fd, 0, 0, 0, -1, &args, 0, intr, false, log);
+}
+
+//----------------------------------------------------------------------------
+ssize_t
+IO::sendfileall(int fd, int in_fd, off_t* offset, size_t len,
+                Notifier* intr, const char* log)
+{
+    return rwfileall(SENDFILE, fd, in_fd, offset, len, 0, -1, 0, intr,
+                     "sendfileall", log);
+}
+
+//----------------------------------------------------------------------------
+int
+IO::timeout_sendfile(int fd, int in_fd, off_t* offset, size_t len,
+                     int timeout_ms, Notifier* intr, const char* log)
+{
+    RwDataExtraArgs args;
+    args.sendfile.in_fd  = in_fd;
+    args.sendfile.offset = offset;
+    args.sendfile.len    = len;
+
+    struct timeval start;
+    gettimeofday(&start, 0);
+
+    return rwdata(SENDFILE, fd, 0, 0, 0, timeout_ms, &args, &start,
+                  intr, false, log);
+}
+
+//----------------------------------------------------------------------------
+ssize_t
+IO::timeout_sendfileall(int fd, int in_fd, off_t* offset, size_t len,
+                        int timeout_ms, Notifier* intr, const char* log)
+{
+    struct timeval start;
+    gettimeofday(&start, 0);
+
+    return rwfileall(SENDFILE, fd, in_fd, offset, len, 0, timeout_ms, &start,
+                     intr, "timeout_sendfileall", log);
+}
+
+//----------------------------------------------------------------------------
+int
+IO::splice(int fd, int in_fd, off_t* in_offset, size_t len, int flags,
+           Notifier* intr, const char* log)
+{
+    RwDataExtraArgs args;
+    args.sendfile.in_fd  = in_fd;
+    args.sendfile.offset = in_offset;
+    args.sendfile.len    = len;
+
+    return rwdata(SPLICE, fd, 0, 0, flags, -1, &args, 0, intr, false, log);
+}
+
+//----------------------------------------------------------------------------
+ssize_t
+IO::spliceall(int fd, int in_fd, off_t* in_offset, size_t len, int flags,
+              Notifier* intr, const char* log)
+{
+    return rwfileall(SPLICE, fd, in_fd, in_offset, len, flags, -1, 0, intr,
+                     "spliceall", log);
+}
+
+//----------------------------------------------------------------------------
+int
+IO::timeout_splice(int fd, int in_fd, off_t* in_offset, size_t len,
+                   int flags, int timeout_ms, Notifier* intr, const char* log)
+{
+    RwDataExtraArgs args;
+    args.sendfile.in_fd  = in_fd;
+    args.sendfile.offset = in_offset;
+    args.sendfile.len    = len;
+
+    struct timeval start;
+    gettimeofday(&start, 0);
+
+    return rwdata(SPLICE, fd, 0, 0, flags, timeout_ms, &args, &start,
+                  intr, false, log);
+}
+
+//----------------------------------------------------------------------------
+ssize_t
+IO::timeout_spliceall(int fd, int in_fd, off_t* in_offset, size_t len,
+                      int flags, int timeout_ms, Notifier* intr,
+                      const char* log)
+{
+    struct timeval start;
+    gettimeofday(&start, 0);
+
+    return rwfileall(SPLICE, fd, in_fd, in_offset, len, flags, timeout_ms,
+                     &start, intr, "timeout_spliceall", log);
+}
+
+//----------------------------------------------------------------------------
+int
+IO::sendmmsg(int fd, struct mmsghdr* msgs, unsigned int vlen, int flags,
+             Notifier* intr, const char* log)
+{
+    RwDataExtraArgs args;
+    args.mmsg.msgs = msgs;
+    args.mmsg.vlen = vlen;
+
+    return rwdata(SENDMMSG, fd, 0, 0, flags, -1, &args, 0, 
+                  intr, false, log);
+}
+
+//----------------------------------------------------------------------------
+int
+IO::recvmmsg(int fd, struct mmsghdr* msgs, unsigned int vlen, int flags,
+             Notifier* intr, const char* log)
+{
+    RwDataExtraArgs args;
+    args.mmsg.msgs = msgs;
+    args.mmsg.vlen = vlen;
+
+    return rwdata(RECVMMSG, fd, 0, 0, flags, -1, &args, 0, 
+                  intr, false, log);
+}
+
+//----------------------------------------------------------------------------
+int
+IO::timeout_recvmmsg(int fd, struct mmsghdr* msgs, unsigned int vlen,
+                     int flags, int timeout_ms, Notifier* intr,
+                     const char* log)
+{
+    RwDataExtraArgs args;
+    args.mmsg.msgs = msgs;
+    args.mmsg.vlen = vlen;
+
+    struct timeval start;
+    gettimeofday(&start, 0);
+
+    return rwdata(RECVMMSG, fd, 0, 0, flags, timeout_ms, &args, &start,
+                  intr, false, log);
+}
+
 //----------------------------------------------------------------------------
 int
 IO::poll_single(int fd, short events, short* revents, int timeout_ms, 
@@ -840,6 +991,115 @@ IO::poll_with_notifier(
     NOTREACHED;
 }
     
+//----------------------------------------------------------------------------
+/**
+ * Copy data from in_fd to fd with pread() and write(), for when the
+ * kernel can't do it for us. Only as much as was actually written is
+ * consumed from in_fd, so this behaves like a short sendfile().
+ */
+static int
+sendfile_copy(int fd, int in_fd, off_t* offset, size_t len)
+{
+    char buf[16 * 1024];
+    
+    off_t pos;
+    if (offset != 0) {
+        pos = *offset;
+    } else {
+        pos = ::lseek(in_fd, 0, SEEK_CUR);
+        if (pos == (off_t)-1) {
+            return -1;
+        }
+    }
+
+    if (len > sizeof(buf)) {
+        len = sizeof(buf);
+    }
+    
+    int cc = ::pread(in_fd, buf, len, pos);
+    if (cc <= 0) {
+        return cc;
+    }
+
+    cc = ::write(fd, buf, cc);
+    if (cc <= 0) {
+        return cc;
+    }
+
+    if (offset != 0) {
+        *offset = pos + cc;
+    } else {
+        ::lseek(in_fd, pos + cc, SEEK_SET);
+    }
+
+    return cc;
+}
+
+//----------------------------------------------------------------------------
+static int
+sendfile_internal(int fd, int in_fd, off_t* offset, size_t len)
+{
+#if defined(__linux__)
+    int cc = ::sendfile(fd, in_fd, offset, len);
+    if (cc >= 0 || (errno != EINVAL && errno != ENOSYS)) {
+        return cc;
+    }
+#endif
+    return sendfile_copy(fd, in_fd, offset, len);
+}
+
+//----------------------------------------------------------------------------
+static int
+sendmmsg_internal(int fd, struct mmsghdr* msgs, unsigned int vlen, int flags)
+{
+#ifdef OASYS_HAVE_MMSG
+    int cc = ::sendmmsg(fd, msgs, vlen, flags);
+    if (cc >= 0 || errno != ENOSYS) {
+        return cc;
+    }
+#endif
+
+    unsigned int i;
+    for (i = 0; i < vlen; ++i) {
+        int cc = ::sendmsg(fd, &msgs[i].msg_hdr, flags);
+        if (cc < 0) {
+            if (i == 0) {
+                return -1;
+            }
+            break;
+        }
+        msgs[i].msg_len = cc;
+    }
+    return i;
+}
+
+//----------------------------------------------------------------------------
+static int
+recvmmsg_internal(int fd, struct mmsghdr* msgs, unsigned int vlen, int flags)
+{
+#ifdef OASYS_HAVE_MMSG
+    int cc = ::recvmmsg(fd, msgs, vlen, flags | MSG_WAITFORONE, 0);
+    if (cc >= 0 || errno != ENOSYS) {
+        return cc;
+    }
+#endif
+
+    // only wait for the first one
+    unsigned int i;
+    for (i = 0; i < vlen; ++i) {
+        int cc = ::recvmsg(fd, &msgs[i].msg_hdr,
+                           (i == 0) ? flags : (flags | MSG_DONTWAIT));
+        if (cc < 0) {
+            if (i == 0) {
+                return -1;
+            }
+            break;
+        }
+        msgs[i].msg_len = cc;
+    }
+    return i;
+}
+
 //----------------------------------------------------------------------------
 int 
 IO::rwdata(
@@ -864,16 +1124,21 @@ IO::rwdata(
               (iovcnt != 1 || args == 0)));
     ASSERT(! ((op == RECVMSG || op == SENDMSG) && 
               (iov != 0 && args == 0)));
+    ASSERT(! ((op == SENDFILE || op == SPLICE) && 
+              (iov != 0 || args == 0)));
+    ASSERT(! ((op == SENDMMSG || op == RECVMMSG) && 
+              (iov != 0 || args == 0 || args->mmsg.vlen == 0)));
     ASSERT(timeout >= -1);
     ASSERT(! (timeout > -1 && start_time == 0));
 
     struct pollfd poll_fd;
     poll_fd.fd = fd;
     switch (op) {
-    case READV: case RECV: case RECVFROM: case RECVMSG:
+    case READV: case RECV: case RECVFROM: case RECVMSG: case RECVMMSG:
         poll_fd.events = POLLIN | POLLPRI; 
         break;
     case WRITEV: case SEND: case SENDTO: case SENDMSG:
+    case SENDFILE: case SPLICE: case SENDMMSG:
         poll_fd.events = POLLOUT; 
         break;
     default:
@@ -933,6 +1198,46 @@ IO::rwdata(
             if (log) log_debug_p(log, "::sendmsg() fd %d %p cc %d", 
                                  fd, args->sendmsg_hdr, cc);
             break;
+        case SENDFILE:
+            cc = sendfile_internal(fd, args->sendfile.in_fd,
+                                   args->sendfile.offset,
+                                   args->sendfile.len);
+            if (log) log_debug_p(log, "::sendfile() fd %d in_fd %d %zu cc %d",
+                                 fd, args->sendfile.in_fd,
+                                 args->sendfile.len, cc);
+            break;
+        case SPLICE:
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+        {
+            loff_t off = 0;
+            if (args->sendfile.offset) {
+                off = *args->sendfile.offset;
+            }
+            cc = ::splice(args->sendfile.in_fd,
+                          args->sendfile.offset ? &off : 0,
+                          fd, 0, args->sendfile.len, flags);
+            if (cc > 0 && args->sendfile.offset) {
+                *args->sendfile.offset = off;
+            }
+        }
+#else
+            errno = ENOSYS;
+            cc = -1;
+#endif
+            if (log) log_debug_p(log, "::splice() fd %d in_fd %d %zu cc %d",
+                                 fd, args->sendfile.in_fd,
+                                 args->sendfile.len, cc);
+            break;
+        case SENDMMSG:
+            cc = sendmmsg_internal(fd, args->mmsg.msgs, args->mmsg.vlen, flags);
+            if (log) log_debug_p(log, "::sendmmsg() fd %d %p/%u cc %d",
+                                 fd, args->mmsg.msgs, args->mmsg.vlen, cc);
+            break;
+        case RECVMMSG:
+            cc = recvmmsg_internal(fd, args->mmsg.msgs, args->mmsg.vlen, flags);
+            if (log) log_debug_p(log, "::recvmmsg() fd %d %p/%u cc %d",
+                                 fd, args->mmsg.msgs, args->mmsg.vlen, cc);
+            break;
         default:
             PANIC("Unknown IO type");
         }
@@ -1016,6 +1321,63 @@ IO::rwvall(
     return total_bytes;
 }
 
+//----------------------------------------------------------------------------
+ssize_t
+IO::rwfileall(
+    IO_Op_t               op,
+    int                   fd,
+    int                   in_fd,
+    off_t*                offset,
+    size_t                len,
+    int                   flags,
+    int                   timeout,
+    const struct timeval* start,
+    Notifier*             intr,
+    const char*           fcn_name,
+    const char*           log
+    )
+{
+    (void)fcn_name;
+    ASSERT(op == SENDFILE || op == SPLICE);
+    ASSERT(! (timeout != -1 && start == 0));
+
+    RwDataExtraArgs args;
+    args.sendfile.in_fd  = in_fd;
+    args.sendfile.offset = offset;
+
+    size_t left = len;
+    while (left > 0) {
+        args.sendfile.len = left;
+        int cc = rwdata(op, fd, 0, 0, flags, timeout, &args, start, 
+                        intr, true, log);
+        if (cc < 0) {
+            if (log && cc != IOTIMEOUT && cc != IOINTR) {
+                log_debug_p(log, "%s %s %s", 
+                            fcn_name, ioerr2str(cc), strerror(errno));
+            }
+            return cc;
+        } else if (cc == 0) {
+            if (log) {
+                log_debug_p(log, "%s eof with %zu bytes left",
+                            fcn_name, left);
+            }
+            return IOEOF;
+        } else {
+            left -= cc;
+            if (log) {
+                log_debug_p(log, "%s %d bytes %zu left %zu total",
+                            fcn_name, cc, left, len);
+            }
+            
+            if (timeout > 0) {
+                timeout = adjust_timeout(timeout, start);
+            }
+        }
+    }
+
+    return len;
+}
+
 //----------------------------------------------------------------------------
 int
 IO::adjust_timeout(int timeout, const struct timeval* start)
@@ -28,10 +28,27 @@
 #include "../debug/DebugUtils.h"
 #include "../thread/Notifier.h"
 
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define OASYS_HAVE_MMSG 1
+#endif
+
 namespace oasys {
 
 class IOMonitor;
 
+#ifndef OASYS_HAVE_MMSG
+/**
+ * Stand-in for the Linux struct mmsghdr on systems without
+ * sendmmsg/recvmmsg, so the batch functions below have the same
+ * signature everywhere. They fall back to one sendmsg/recvmsg per
+ * entry there.
+ */
+struct mmsghdr {
+    struct msghdr msg_hdr;      ///< message header
+    unsigned int  msg_len;      ///< bytes sent or received
+};
+#endif
+
 /**
  * Return code values for the timeout enabled functions such as
  * timeout_read() and timeout_accept(). Note that the functions return
@@ -59,6 +76,10 @@ struct IO {
         SEND,
         SENDTO,
         SENDMSG,
+        SENDFILE,
+        SPLICE,
+        SENDMMSG,
+        RECVMMSG,
 
         CONNECT,
         ACCEPT,
@@ -185,6 +206,89 @@ struct IO {
                        Notifier* intr = 0, const char* log = 0);
     //! @}
 
+    /**
+     * @{ Copy up to len bytes from in_fd to fd inside the kernel,
+     * without passing the data through a user buffer.
+     *
+     * The sendfile variants read in_fd starting at *offset and
+     * advance *offset by the amount sent; if offset is NULL, the
+     * current file position of in_fd is used and updated instead.
+     * Where the kernel can't do the copy (non-Linux systems, or file
+     * types sendfile doesn't support), the data is bounced through a
+     * small buffer with pread() so that callers see the same
+     * semantics either way.
+     *
+     * The splice variants require one of the two descriptors to be a
+     * pipe, and pass flags (e.g. SPLICE_F_MOVE | SPLICE_F_MORE)
+     * through to splice(2). They are only available on Linux and
+     * fail with ENOSYS elsewhere.
+     *
+     * Only fd is polled for writability when a timeout or notifier is
+     * given; in_fd is assumed to be a file, or a pipe that already
+     * has data in it.
+     *
+     * The single-call variants return the number of bytes moved.
+     * The "all" variants keep going until len bytes have been moved
+     * and return len (as an ssize_t, since it can be more than fits
+     * in an int), or IOEOF if in_fd ran out first. All of them
+     * can also return IOERROR, IOTIMEOUT, IOINTR and IOAGAIN like the
+     * corresponding write functions.
+     */
+    static int sendfile(int fd, int in_fd, off_t* offset, size_t len,
+                        Notifier* intr = 0, const char* log = 0);
+
+    static ssize_t sendfileall(int fd, int in_fd, off_t* offset, size_t len,
+                               Notifier* intr = 0, const char* log = 0);
+
+    static int timeout_sendfile(int fd, int in_fd, off_t* offset,
+                                size_t len, int timeout_ms,
+                                Notifier* intr = 0, const char* log = 0);
+
+    static ssize_t timeout_sendfileall(int fd, int in_fd, off_t* offset,
+                                       size_t len, int timeout_ms,
+                                       Notifier* intr = 0,
+                                       const char* log = 0);
+
+    static int splice(int fd, int in_fd, off_t* in_offset, size_t len,
+                      int flags, Notifier* intr = 0, const char* log = 0);
+
+    static ssize_t spliceall(int fd, int in_fd, off_t* in_offset,
+                             size_t len, int flags, Notifier* intr = 0,
+                             const char* log = 0);
+
+    static int timeout_splice(int fd, int in_fd, off_t* in_offset,
+                              size_t len, int flags, int timeout_ms,
+                              Notifier* intr = 0, const char* log = 0);
+
+    static ssize_t timeout_spliceall(int fd, int in_fd, off_t* in_offset,
+                                     size_t len, int flags, int timeout_ms,
+                                     Notifier* intr = 0, const char* log = 0);
+    //! @}
+
+    /**
+     * @{ Send or receive up to vlen datagrams with a single system
+     * call where the kernel supports it (sendmmsg/recvmmsg), or with
+     * one sendmsg/recvmsg per datagram where it doesn't. msg_len of
+     * each entry is set to the number of bytes sent or received.
+     *
+     * The receive functions wait for the first datagram only, then
+     * pick up whatever else is already queued (MSG_WAITFORONE).
+     *
+     * @return The number of entries sent or received, which may be
+     * less than vlen, or IOERROR, IOTIMEOUT, IOINTR or IOAGAIN if
+     * nothing could be sent or received.
+     */
+    static int sendmmsg(int fd, struct mmsghdr* msgs, unsigned int vlen,
+                        int flags, Notifier* intr = 0, const char* log = 0);
+
+    static int recvmmsg(int fd, struct mmsghdr* msgs, unsigned int vlen,
+                        int flags, Notifier* intr = 0, const char* log = 0);
+
+    static int timeout_recvmmsg(int fd, struct mmsghdr* msgs,
+                                unsigned int vlen, int flags, int timeout_ms,
+                                Notifier* intr = 0, const char* log = 0);
+    //! @}
+
     //! @return IOTIMEOUT, IOINTR, 1 indicates readiness, otherwise
     //! it's an error.
     static int poll_single(int fd, short events, short* revents, 
@@ -242,6 +346,17 @@ struct IO {
             struct sockaddr* from;
             socklen_t* fromlen;
         } recvfrom;
+
+        struct {
+            int in_fd;
+            off_t* offset;
+            size_t len;
+        } sendfile;             ///< also used for splice
+
+        struct {
+            struct mmsghdr* msgs;
+            unsigned int vlen;
+        } mmsg;
     };
 
     //! This is the do all function which will (depending on the flags
@@ -269,6 +384,19 @@ struct IO {
                       const char*           fcn_name, 
                       const char*           log);
     
+    //! Do all function for sendfile/splice
+    static ssize_t rwfileall(IO_Op_t               op,
+                             int                   fd,
+                             int                   in_fd,
+                             off_t*                offset,
+                             size_t                len,
+                             int                   flags,
+                             int                   timeout,
+                             const struct timeval* start,
+                             Notifier*             intr,
+                             const char*           fcn_name,
+                             const char*           log);
+    
     //! Adjust the timeout value given a particular start time
     static int adjust_timeout(int timeout, const struct timeval* start);
 }; // class IO
@@ -19,6 +19,7 @@
 #endif
 
 #include "IPSocket.h"
+#include "DatagramBatch.h"
 #include "NetUtils.h"
 #include "debug/Log.h"
 #include "debug/DebugUtils.h"
@@ -34,6 +35,9 @@
 #include <sys/poll.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#if defined(__linux__)
+#include <netinet/udp.h>
+#endif
 #include <arpa/inet.h>
 
 namespace oasys {
@@ -319,6 +323,32 @@ IPSocket::configure()
         }
     }
 
+    if (socktype_ == SOCK_DGRAM && params_.udp_segment_ > 0) {
+#ifdef UDP_SEGMENT
+        int size = params_.udp_segment_;
+        logf(LOG_DEBUG, "setting UDP_SEGMENT to %d", size);
+        if (::setsockopt(fd_, SOL_UDP, UDP_SEGMENT, &size, sizeof size) != 0) {
+            logf(LOG_WARN, "error setting UDP_SEGMENT: %s",
+                 strerror(errno));
+        }
+#else
+        logf(LOG_WARN, "error setting UDP_SEGMENT: not implemented");
+#endif
+    }
+
+    if (socktype_ == SOCK_DGRAM && params_.udp_gro_) {
+#ifdef UDP_GRO
+        int y = 1;
+        logf(LOG_DEBUG, "setting UDP_GRO");
+        if (::setsockopt(fd_, SOL_UDP, UDP_GRO, &y, sizeof y) != 0) {
+            logf(LOG_WARN, "error setting UDP_GRO: %s",
+                 strerror(errno));
+        }
+#else
+        logf(LOG_WARN, "error setting UDP_GRO: not implemented");
+#endif
+    }
+
     if (params_.recv_bufsize_ > 0) {
         logf(LOG_DEBUG, "setting SO_RCVBUF to %d",
              params_.recv_bufsize_);
@@ -479,6 +509,43 @@ IPSocket::recvmsg(struct msghdr* msg, int flags)
     return IO::recvmsg(fd_, msg, flags, get_notifier(), logpath_);
 }
 
+int
+IPSocket::sendmmsg(DatagramBatch* batch, int flags)
+{
+    size_t sent = 0;
+    while (sent < batch->size()) {
+        int cc = IO::sendmmsg(fd_, batch->msgs() + sent, batch->size() - sent,
+                              flags, get_notifier(), logpath_);
+        if (cc < 0) {
+            if (cc != IOINTR && cc != IOAGAIN)
+                logf(LOG_ERR, "error in sendmmsg(): %s", strerror(errno));
+            if (sent == 0)
+                return cc;
+            break;
+        }
+        sent += cc;
+    }
+
+    return sent;
+}
+
+int
+IPSocket::recvmmsg(DatagramBatch* batch, int flags)
+{
+    batch->prepare_recv();
+    
+    int cc = IO::recvmmsg(fd_, batch->msgs(), batch->capacity(), flags,
+                          get_notifier(), logpath_);
+    if (cc < 0) {
+        if (cc != IOINTR && cc != IOAGAIN)
+            logf(LOG_ERR, "error in recvmmsg(): %s", strerror(errno));
+        return cc;
+    }
+
+    batch->set_size(cc);
+    return cc;
+}
+
 int
 IPSocket::poll_sockfd(int events, int* revents, int timeout_ms)
 {
@@ -31,6 +31,8 @@
 
 namespace oasys {
 
+class DatagramBatch;
+
 /**
  * The maximum length of a UDP packet. This isn't really accurate as a
  * maximum payload size since it doesn't take into account the space
@@ -87,6 +89,26 @@ public:
 
     //@}
 
+    /**
+     * Send all the datagrams in the batch, using as few system calls
+     * as the platform allows (see IO::sendmmsg).
+     *
+     * @return The number of datagrams sent, which is only less than
+     * batch->size() if an error occurred part way through, or an
+     * IOTimeoutReturn_t code if nothing was sent.
+     */
+    virtual int sendmmsg(DatagramBatch* batch, int flags);
+
+    /**
+     * Receive up to batch->capacity() datagrams into the batch,
+     * waiting only for the first one. batch->size() is set to the
+     * number received.
+     *
+     * @return The number of datagrams received, or an
+     * IOTimeoutReturn_t code.
+     */
+    virtual int recvmmsg(DatagramBatch* batch, int flags);
+
     /// In case connect() was called on a nonblocking socket and
     /// returned EINPROGRESS, this fn returns the errno result of the
     /// connect attempt. It also sets the socket state appropriately
@@ -125,7 +147,9 @@ public:
             multicast_    (false),
             mcast_ttl_    (1),
             recv_bufsize_ (0),
-            send_bufsize_ (0)
+            send_bufsize_ (0),
+            udp_segment_  (0),
+            udp_gro_      (false)
         {
         }
         
@@ -139,6 +163,15 @@ public:
 
         int recv_bufsize_;	// default: system setting
         int send_bufsize_;	// default: system setting
+
+        /// If nonzero, have the kernel split each datagram that is
+        /// sent into segments of this size (UDP_SEGMENT), so one
+        /// large buffer goes out as many datagrams. Linux only.
+        int udp_segment_;	// default: 0 (off)
+
+        /// Let the kernel coalesce received datagrams (UDP_GRO); see
+        /// DatagramBatch::segment_size(). Linux only.
+        bool udp_gro_;		// default: off
     } params_;
     
     /// The socket file descriptor
@@ -0,0 +1,422 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Reactor.h"
+#include "FdIOClient.h"
+#include "IO.h"
+#include "IPSocket.h"
+#include "../thread/Notifier.h"
+#include "../thread/OnOffNotifier.h"
+#include "../thread/Timer.h"
+
+namespace oasys {
+
+//----------------------------------------------------------------------
+void
+Reactor::InternalHandler::handle_event(int fd, short revents)
+{
+    (void)revents;
+    if (fd == wakeup_->read_fd()) {
+        wakeup_->clear();
+    }
+}
+
+//----------------------------------------------------------------------
+Reactor::Reactor(const char* logpath, TimerSystem* timers)
+    : Logger("Reactor", "%s", logpath),
+      timers_(timers),
+      timer_ms_(0),
+      wakeup_(logpath),
+      internal_handler_(&wakeup_),
+      should_stop_(false),
+      count_(0),
+      internal_(0),
+      next_gen_(0)
+{
+#ifdef OASYS_REACTOR_EPOLL
+#ifdef EPOLL_CLOEXEC
+    epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+#else
+    epfd_ = ::epoll_create(64);
+    if (epfd_ >= 0) {
+        fcntl(epfd_, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    if (epfd_ < 0) {
+        PANIC("can't create epoll descriptor: %s", strerror(errno));
+    }
+    ready_.resize(64);
+    log_debug("created epoll fd %d", epfd_);
+#endif
+
+    if (add(wakeup_.read_fd(), POLLIN, &internal_handler_) != 0) {
+        PANIC("can't register wakeup notifier");
+    }
+    ++internal_;
+
+    if (timers_ != 0) {
+        if (add(timers_->notifier()->read_fd(), POLLIN,
+                &internal_handler_) != 0)
+        {
+            PANIC("can't register timer notifier");
+        }
+        ++internal_;
+    }
+}
+
+//----------------------------------------------------------------------
+Reactor::~Reactor()
+{
+#ifdef OASYS_REACTOR_EPOLL
+    close(epfd_);
+#endif
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::ctl_add(int fd, short events, trigger_t mode)
+{
+#ifdef OASYS_REACTOR_EPOLL
+    return ctl_mod(fd, events, mode);
+#else
+    (void)mode;
+    struct pollfd pfd;
+    pfd.fd      = fd;
+    pfd.events  = events;
+    pfd.revents = 0;
+    entries_[fd].pollidx_ = pollfds_.size();
+    pollfds_.push_back(pfd);
+    return 0;
+#endif
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::ctl_mod(int fd, short events, trigger_t mode)
+{
+#ifdef OASYS_REACTOR_EPOLL
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.data.u64 = ((u_int64_t)entries_[fd].gen_ << 32) | (u_int32_t)fd;
+    if (events & POLLIN)  ev.events |= EPOLLIN;
+    if (events & POLLPRI) ev.events |= EPOLLPRI;
+    if (events & POLLOUT) ev.events |= EPOLLOUT;
+    if (mode == EDGE_TRIGGERED) {
+        ev.events |= EPOLLET;
+    }
+
+    // ctl_add() comes through here before the entry is filled in
+    int op = (entries_[fd].handler_ == 0) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (::epoll_ctl(epfd_, op, fd, &ev) != 0) {
+        log_err("error in epoll_ctl(%s) for fd %d: %s",
+                (op == EPOLL_CTL_ADD) ? "add" : "mod", fd, strerror(errno));
+        return -1;
+    }
+    return 0;
+#else
+    (void)mode;
+    ASSERT(entries_[fd].pollidx_ >= 0);
+    pollfds_[entries_[fd].pollidx_].events = events;
+    return 0;
+#endif
+}
+
+//----------------------------------------------------------------------
+void
+Reactor::ctl_del(int fd)
+{
+#ifdef OASYS_REACTOR_EPOLL
+    // a descriptor that was already closed has been dropped by the
+    // kernel, so EBADF and ENOENT aren't worth complaining about
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    if (::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, &ev) != 0 &&
+        errno != EBADF && errno != ENOENT)
+    {
+        log_err("error in epoll_ctl(del) for fd %d: %s",
+                fd, strerror(errno));
+    }
+#else
+    // swap the last pollfd into the hole
+    int idx = entries_[fd].pollidx_;
+    ASSERT(idx >= 0);
+    int last = pollfds_.size() - 1;
+    if (idx != last) {
+        pollfds_[idx] = pollfds_[last];
+        entries_[pollfds_[idx].fd].pollidx_ = idx;
+    }
+    pollfds_.pop_back();
+    entries_[fd].pollidx_ = -1;
+#endif
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::add(int fd, short events, Handler* handler, trigger_t mode)
+{
+    ASSERT(handler != 0);
+
+    if (fd < 0) {
+        log_err("can't add invalid fd %d", fd);
+        errno = EBADF;
+        return -1;
+    }
+
+    if ((size_t)fd >= entries_.size()) {
+        entries_.resize(fd + 1);
+    }
+
+    if (entries_[fd].handler_ != 0) {
+        log_err("fd %d is already registered", fd);
+        errno = EEXIST;
+        return -1;
+    }
+
+    // zero is left for unregistered entries
+    if (++next_gen_ == 0) {
+        ++next_gen_;
+    }
+    entries_[fd].gen_ = next_gen_;
+
+    if (ctl_add(fd, events, mode) != 0) {
+        entries_[fd].gen_ = 0;
+        return -1;
+    }
+
+    Entry* e    = &entries_[fd];
+    e->handler_ = handler;
+    e->events_  = events;
+    e->mode_    = mode;
+    ++count_;
+
+    log_debug("added fd %d events 0x%x%s", fd, events,
+              (mode == EDGE_TRIGGERED) ? " (edge triggered)" : "");
+    return 0;
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::add(IPSocket* sock, short events, Handler* handler, trigger_t mode)
+{
+    return add(sock->fd(), events, handler, mode);
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::add(FdIOClient* client, short events, Handler* handler,
+             trigger_t mode)
+{
+    return add(client->fd(), events, handler, mode);
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::add(Notifier* notifier, Handler* handler)
+{
+    // one byte per notify(), so the handler is expected to call
+    // drain_pipe(); keep it level triggered so nothing is missed
+    return add(notifier->read_fd(), POLLIN, handler, LEVEL_TRIGGERED);
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::add(OnOffNotifier* notifier, Handler* handler)
+{
+    return add(notifier->read_fd(), POLLIN, handler, LEVEL_TRIGGERED);
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::modify(int fd, short events)
+{
+    if (! is_registered(fd)) {
+        log_err("can't modify unregistered fd %d", fd);
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (ctl_mod(fd, events, entries_[fd].mode_) != 0) {
+        return -1;
+    }
+    entries_[fd].events_ = events;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::remove(int fd)
+{
+    if (! is_registered(fd)) {
+        log_err("can't remove unregistered fd %d", fd);
+        errno = ENOENT;
+        return -1;
+    }
+
+    ctl_del(fd);
+    entries_[fd] = Entry();
+    ASSERT(count_ > 0);
+    --count_;
+
+    log_debug("removed fd %d", fd);
+    return 0;
+}
+
+//----------------------------------------------------------------------
+bool
+Reactor::is_registered(int fd)
+{
+    return fd >= 0 && (size_t)fd < entries_.size() &&
+        entries_[fd].handler_ != 0;
+}
+
+//----------------------------------------------------------------------
+bool
+Reactor::dispatch(int fd, u_int32_t gen, short revents)
+{
+    // the descriptor may have been removed by an earlier handler in
+    // the same pass, and maybe added again for something else
+    if ((size_t)fd >= entries_.size() || entries_[fd].handler_ == 0 ||
+        entries_[fd].gen_ != gen)
+    {
+        return false;
+    }
+
+    Handler* handler = entries_[fd].handler_;
+    handler->handle_event(fd, revents);
+    return handler != &internal_handler_;
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::wait_and_dispatch(int timeout_ms)
+{
+#ifdef OASYS_REACTOR_EPOLL
+    int cc = ::epoll_wait(epfd_, &ready_[0], ready_.size(), timeout_ms);
+#else
+    int cc = ::poll(&pollfds_[0], pollfds_.size(), timeout_ms);
+#endif
+    if (cc < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        log_err("error waiting for events: %s", strerror(errno));
+        return IOERROR;
+    }
+
+    if (cc == 0) {
+        return IOTIMEOUT;
+    }
+
+    int handled = 0;
+
+#ifdef OASYS_REACTOR_EPOLL
+    for (int i = 0; i < cc; ++i) {
+        u_int32_t ev = ready_[i].events;
+        short revents = 0;
+        if (ev & EPOLLIN)  revents |= POLLIN;
+        if (ev & EPOLLPRI) revents |= POLLPRI;
+        if (ev & EPOLLOUT) revents |= POLLOUT;
+        if (ev & EPOLLERR) revents |= POLLERR;
+        if (ev & EPOLLHUP) revents |= POLLHUP;
+
+        u_int64_t data = ready_[i].data.u64;
+        if (dispatch((int)(data & 0xffffffff), (u_int32_t)(data >> 32),
+                     revents))
+        {
+            ++handled;
+        }
+    }
+
+    // if the array filled up there are probably more waiting
+    if ((size_t)cc == ready_.size()) {
+        ready_.resize(ready_.size() * 2);
+    }
+#else
+    // handlers may change pollfds_ under us, so snapshot what's ready
+    ready_.clear();
+    for (size_t i = 0; i < pollfds_.size() && (int)ready_.size() < cc; ++i) {
+        if (pollfds_[i].revents != 0) {
+            Ready r;
+            r.fd_      = pollfds_[i].fd;
+            r.revents_ = pollfds_[i].revents;
+            r.gen_     = entries_[r.fd_].gen_;
+            ready_.push_back(r);
+        }
+    }
+
+    for (size_t i = 0; i < ready_.size(); ++i) {
+        if (dispatch(ready_[i].fd_, ready_[i].gen_, ready_[i].revents_)) {
+            ++handled;
+        }
+    }
+#endif
+
+    return handled;
+}
+
+//----------------------------------------------------------------------
+int
+Reactor::run_once(int timeout_ms)
+{
+    // Timers run at the end of each pass, so a timer that fires can't
+    // be followed by an unbounded wait for some unrelated event. The
+    // next timeout is then a little stale by the time the following
+    // pass waits, which only errs on the side of waking up early.
+    if (timers_ != 0 && timer_ms_ >= 0 &&
+        (timeout_ms < 0 || timer_ms_ < timeout_ms))
+    {
+        timeout_ms = timer_ms_;
+    }
+
+    int cc = wait_and_dispatch(timeout_ms);
+
+    if (timers_ != 0) {
+        timer_ms_ = timers_->run_expired_timers();
+    }
+
+    return cc;
+}
+
+//----------------------------------------------------------------------
+void
+Reactor::run()
+{
+    while (! should_stop_) {
+        if (run_once() == IOERROR) {
+            PANIC("fatal error in reactor loop");
+        }
+    }
+    should_stop_ = false;
+}
+
+//----------------------------------------------------------------------
+void
+Reactor::stop()
+{
+    should_stop_ = true;
+    wakeup_.signal();
+}
+
+} // namespace oasys
@@ -0,0 +1,236 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_REACTOR_H_
+#define _OASYS_REACTOR_H_
+
+#ifndef OASYS_CONFIG_STATE
+#error "MUST INCLUDE oasys-config.h before including this file"
+#endif
+
+#include <vector>
+#include <sys/poll.h>
+
+#if defined(__linux__)
+#define OASYS_REACTOR_EPOLL 1
+#include <sys/epoll.h>
+#endif
+
+#include "../debug/Logger.h"
+#include "../thread/EventNotifier.h"
+
+namespace oasys {
+
+class FdIOClient;
+class IPSocket;
+class Notifier;
+class OnOffNotifier;
+class TimerSystem;
+
+/**
+ * A single-threaded event loop that dispatches readiness callbacks
+ * for a set of file descriptors.
+ *
+ * Unlike IO::poll_multiple(), which builds a pollfd array and hands
+ * the whole set to the kernel on every call, descriptors are
+ * registered once and the cost of a wakeup only depends on the number
+ * of descriptors that are actually ready. On Linux this uses epoll;
+ * elsewhere it falls back to poll() over a persistent pollfd array.
+ *
+ * Events are the usual poll() bits. Handlers are passed POLLIN,
+ * POLLOUT, POLLERR and POLLHUP as reported by the kernel.
+ *
+ * A descriptor registered EDGE_TRIGGERED is only reported when it
+ * becomes ready, so its handler must keep reading (or writing) until
+ * it gets EAGAIN. The poll() fallback treats it as level triggered,
+ * which such a handler copes with just the same.
+ *
+ * If a TimerSystem is given, its notifier is registered too, and
+ * run_once() calls run_expired_timers() at the end of every pass and
+ * uses the result to bound the next wait. A thread driving a reactor
+ * usually wants to bind the same timer system with
+ * TimerSystem::set_thread_local() so that timers it schedules land on
+ * its own loop.
+ *
+ * All methods except stop() must be called from the thread that runs
+ * the loop (or before it starts). Handlers may add and remove
+ * descriptors, including their own, from within a callback. Each
+ * registration gets a new generation number that goes along with its
+ * events, so if a handler closes a descriptor and the number is
+ * reused for a new one, events still pending for the old one aren't
+ * handed to the new handler.
+ */
+class Reactor : public Logger {
+public:
+    /// Triggering mode for a descriptor
+    typedef enum {
+        LEVEL_TRIGGERED,
+        EDGE_TRIGGERED
+    } trigger_t;
+
+    /**
+     * Callback interface for readiness events.
+     */
+    class Handler {
+    public:
+        virtual ~Handler() {}
+
+        /**
+         * Called when fd is ready. revents is a mask of POLLIN,
+         * POLLOUT, POLLERR and POLLHUP.
+         */
+        virtual void handle_event(int fd, short revents) = 0;
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param logpath Logging path
+     * @param timers  Optional timer system to drive from the loop
+     */
+    Reactor(const char* logpath, TimerSystem* timers = 0);
+
+    /**
+     * Destructor. Registered descriptors are not closed.
+     */
+    virtual ~Reactor();
+
+    /**
+     * Register fd for the given events.
+     *
+     * @return 0 on success, -1 on error (e.g. if fd is already
+     * registered)
+     */
+    int add(int fd, short events, Handler* handler,
+            trigger_t mode = LEVEL_TRIGGERED);
+
+    /// @{ Convenience wrappers to register the descriptor of an object
+    int add(IPSocket* sock, short events, Handler* handler,
+            trigger_t mode = LEVEL_TRIGGERED);
+    int add(FdIOClient* client, short events, Handler* handler,
+            trigger_t mode = LEVEL_TRIGGERED);
+    int add(Notifier* notifier, Handler* handler);
+    int add(OnOffNotifier* notifier, Handler* handler);
+    /// @}
+
+    /**
+     * Change the events of interest for a registered descriptor.
+     *
+     * @return 0 on success, -1 on error
+     */
+    int modify(int fd, short events);
+
+    /**
+     * Unregister fd. Any events for it that are still pending in the
+     * current pass are dropped.
+     *
+     * @return 0 on success, -1 if fd wasn't registered
+     */
+    int remove(int fd);
+
+    /**
+     * @return True if fd is registered.
+     */
+    bool is_registered(int fd);
+
+    /**
+     * @return Number of registered descriptors, not counting the
+     * internal wakeup and timer notifiers.
+     */
+    size_t size() { return count_ - internal_; }
+
+    /**
+     * Wait for at most timeout_ms milliseconds (-1 for no limit) or
+     * until the next timer is due, dispatch whatever is ready, then
+     * run any expired timers.
+     *
+     * @return The number of handlers called, IOTIMEOUT if nothing was
+     * ready, or IOERROR.
+     */
+    int run_once(int timeout_ms = -1);
+
+    /**
+     * Loop on run_once() until stop() is called.
+     */
+    void run();
+
+    /**
+     * Ask run() to return after the current pass. Safe to call from
+     * any thread.
+     */
+    void stop();
+
+private:
+    /// Per-descriptor registration
+    struct Entry {
+        Entry() : handler_(0), events_(0), mode_(LEVEL_TRIGGERED),
+                  gen_(0), pollidx_(-1) {}
+
+        Handler*  handler_;
+        short     events_;
+        trigger_t mode_;
+        u_int32_t gen_;       ///< which registration of the fd this is
+        int       pollidx_;   ///< index in pollfds_ (poll fallback)
+    };
+
+#ifndef OASYS_REACTOR_EPOLL
+    /// An event snapshotted from pollfds_ before dispatching
+    struct Ready {
+        int       fd_;
+        short     revents_;
+        u_int32_t gen_;
+    };
+#endif
+
+    /// Handler for the internal notifiers. The wakeup notifier is
+    /// cleared here; the timer notifier is cleared by
+    /// run_expired_timers() at the start of the next pass.
+    class InternalHandler : public Handler {
+    public:
+        InternalHandler(EventNotifier* wakeup) : wakeup_(wakeup) {}
+        void handle_event(int fd, short revents);
+        EventNotifier* wakeup_;
+    };
+
+    int  ctl_add(int fd, short events, trigger_t mode);
+    int  ctl_mod(int fd, short events, trigger_t mode);
+    void ctl_del(int fd);
+    int  wait_and_dispatch(int timeout_ms);
+    bool dispatch(int fd, u_int32_t gen, short revents);
+
+    TimerSystem*       timers_;
+    int                timer_ms_;   ///< time to the next timer
+    EventNotifier      wakeup_;
+    InternalHandler    internal_handler_;
+    volatile bool      should_stop_;
+    std::vector<Entry> entries_;    ///< indexed by fd
+    size_t             count_;      ///< registered descriptors
+    size_t             internal_;   ///< how many of those are ours
+    u_int32_t          next_gen_;   ///< generation of the next add()
+
+#ifdef OASYS_REACTOR_EPOLL
+    int                epfd_;
+    std::vector<struct epoll_event> ready_;
+#else
+    std::vector<struct pollfd> pollfds_;
+    std::vector<Ready>         ready_;
+#endif
+};
+
+} // namespace oasys
+
+#endif /* _OASYS_REACTOR_H_ */
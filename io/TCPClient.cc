@@ -121,4 +121,20 @@ TCPClient::timeout_connect(in_addr_t remote_addr, u_int16_t remote_port,
     return ret;
 }
 
+ssize_t
+TCPClient::send_file(int fd, off_t offset, size_t len, int timeout_ms)
+{
+    ssize_t cc;
+    if (timeout_ms < 0) {
+        cc = IO::sendfileall(fd_, fd, &offset, len,
+                             get_notifier(), logpath_);
+    } else {
+        cc = IO::timeout_sendfileall(fd_, fd, &offset, len, timeout_ms,
+                                     get_notifier(), logpath_);
+    }
+    monitor(IO::SENDFILE, 0);
+
+    return cc;
+}
+
 } // namespace oasys
@@ -45,7 +45,18 @@ public:
      */
     virtual int timeout_connect(in_addr_t remote_attr, u_int16_t remote_port,
                                 int timeout_ms, int* errp = 0);
-    
+
+    /**
+     * Send len bytes of the file open on fd, starting at offset,
+     * without copying them through a user buffer (see
+     * IO::sendfileall). The socket's notifier interrupts the send as
+     * it does for the other write calls. The file position of fd is
+     * left alone.
+     *
+     * @return len on success, IOEOF if the file is shorter than
+     * offset + len, or IOERROR, IOTIMEOUT or IOINTR.
+     */
+    ssize_t send_file(int fd, off_t offset, size_t len, int timeout_ms = -1);
     
 protected:
     int internal_connect(in_addr_t remote_attr, u_int16_t remote_port);
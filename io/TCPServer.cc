@@ -22,8 +22,11 @@
 #include "TCPServer.h"
 #include "debug/DebugUtils.h"
 #include "debug/Log.h"
+#include "thread/ThreadPool.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -80,6 +83,52 @@ TCPServer::accept(int *fd, in_addr_t *addr, u_int16_t *port)
     return 0;
 }
 
+//----------------------------------------------------------------------
+int
+TCPServer::accept4(int *fd, in_addr_t *addr, u_int16_t *port, int flags)
+{
+    ASSERTF(state_ == LISTENING,
+            "accept4() expected state LISTENING, not %s", statetoa(state_));
+    
+    struct sockaddr_in sa;
+    socklen_t sl = sizeof(sa);
+    memset(&sa, 0, sizeof(sa));
+
+#if defined(__linux__) && defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+    int sock_flags = 0;
+    if (flags & ACCEPT_NONBLOCK) sock_flags |= SOCK_NONBLOCK;
+    if (flags & ACCEPT_CLOEXEC)  sock_flags |= SOCK_CLOEXEC;
+    int ret = ::accept4(fd_, (sockaddr*)&sa, &sl, sock_flags);
+#else
+    int ret = ::accept(fd_, (sockaddr*)&sa, &sl);
+#endif
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return IOAGAIN;
+        }
+        if (errno != EINTR)
+            logf(LOG_ERR, "error in accept(): %s", strerror(errno));
+        return -1;
+    }
+
+#if !(defined(__linux__) && defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC))
+    if (flags & ACCEPT_NONBLOCK) {
+        IO::set_nonblocking(ret, true);
+    }
+    if (flags & ACCEPT_CLOEXEC) {
+        fcntl(ret, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    
+    *fd = ret;
+    *addr = sa.sin_addr.s_addr;
+    *port = ntohs(sa.sin_port);
+
+    monitor(IO::ACCEPT, 0);
+
+    return 0;
+}
+
 //----------------------------------------------------------------------
 int
 TCPServer::timeout_accept(int *fd, in_addr_t *addr, u_int16_t *port,
@@ -101,11 +150,68 @@ TCPServer::timeout_accept(int *fd, in_addr_t *addr, u_int16_t *port,
     return 0; 
 }
 
+/**
+ * An additional listening socket and thread for TCPServerThread,
+ * which hands its connections to the owner's accepted().
+ */
+class TCPServerThread::Acceptor : public TCPServer, public Thread {
+public:
+    Acceptor(TCPServerThread* owner)
+        : TCPServer(owner->logpath()),
+          Thread("TCPServerThread::Acceptor"),
+          owner_(owner)
+    {
+        set_notifier(new Notifier(logpath()));
+        params_ = owner->params_;
+    }
+
+    void run() { owner_->accept_loop(this, this); }
+
+    /// Interrupt the thread and wait for it to exit
+    bool stop_and_wait();
+
+    TCPServerThread* owner_;
+};
+
+//----------------------------------------------------------------------
+/**
+ * Tell a server thread to stop, interrupt its poll() and wait for up
+ * to 10 seconds (i.e. 20 sleep periods) for it to exit.
+ */
+static bool
+stop_server_thread(Thread* thread, IOHandlerBase* io)
+{
+    thread->set_should_stop();
+    if (thread->is_stopped()) {
+        return true;
+    }
+    
+    io->interrupt_from_io();
+    for (int i = 0; i < 20; ++i) {
+        if (thread->is_stopped())
+            return true;
+        usleep(500000);
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------
+bool
+TCPServerThread::Acceptor::stop_and_wait()
+{
+    return stop_server_thread(this, this);
+}
+
 //----------------------------------------------------------------------
 TCPServerThread::TCPServerThread(const char* name,
                                  const char* logbase,
                                  int         flags)
-    : TCPServer(logbase), Thread(name, flags)
+    : TCPServer(logbase), Thread(name, flags),
+      num_acceptors_(1),
+      accept_batch_(1),
+      accept_flags_(0),
+      pool_(NULL),
+      outstanding_(0)
 {
     // assign the notifier to be used for interrupt in the
     // IOHandlerBase
@@ -120,77 +226,161 @@ TCPServerThread::~TCPServerThread()
 
 //----------------------------------------------------------------------
 void
-TCPServerThread::run()
+TCPServerThread::set_accept_options(int num_acceptors, int batch,
+                                    int accept_flags)
+{
+    ASSERT(num_acceptors >= 1);
+    ASSERT(batch >= 1);
+    
+    num_acceptors_ = num_acceptors;
+    accept_batch_  = batch;
+    accept_flags_  = accept_flags;
+
+    if (num_acceptors_ > 1) {
+        params_.reuseport_ = true;
+    }
+}
+
+/**
+ * Pool task that hands one connection to accepted(). The server
+ * counts it in outstanding_ until it's done, so stop() can wait for
+ * it.
+ */
+class TCPServerThread::AcceptedTask : public ThreadPoolTask {
+public:
+    AcceptedTask(TCPServerThread* server,
+                 int fd, in_addr_t addr, u_int16_t port)
+        : server_(server), fd_(fd), addr_(addr), port_(port)
+    {
+        atomic_incr(&server_->outstanding_);
+    }
+
+    void run()
+    {
+        server_->accepted(fd_, addr_, port_);
+        atomic_decr(&server_->outstanding_);
+    }
+
+private:
+    TCPServerThread* server_;
+    int              fd_;
+    in_addr_t        addr_;
+    u_int16_t        port_;
+};
+
+//----------------------------------------------------------------------
+int
+TCPServerThread::accept_batch(TCPServer* server)
 {
     int fd;
     in_addr_t addr;
     u_int16_t port;
 
-    log_debug("server thread %p running", this);
+    int count = 0;
+    while (count < accept_batch_) {
+        int ret = server->accept4(&fd, &addr, &port, accept_flags_);
+
+        if (ret == IOAGAIN) {
+            break;
+        }
+        
+        if (ret != 0) {
+            // the peer may have given up while it sat in the backlog
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            
+            logf(LOG_ERR, "error %d in accept(): %d %s",
+                 ret, errno, strerror(errno));
+            return -1;
+        }
+
+        logf(LOG_DEBUG, "accepted connection fd %d from %s:%d",
+             fd, intoa(addr), port);
+
+        // Nothing runs the tasks of a pool that hasn't been started,
+        // and stop() would wait for them forever
+        if (pool_ != NULL && pool_->started()) {
+            pool_->submit(new AcceptedTask(this, fd, addr, port));
+        } else {
+            accepted(fd, addr, port);
+        }
+        ++count;
+    }
+
+    return count;
+}
+
+//----------------------------------------------------------------------
+void
+TCPServerThread::accept_loop(TCPServer* server, Thread* thread)
+{
+    log_debug("server thread %p running", thread);
+
+    // draining the backlog needs accept() to return EAGAIN
+    if (accept_batch_ > 1) {
+        IO::set_nonblocking(server->fd(), true);
+    }
 
     while (1) {
         // check if someone has told us to quit by setting the
         // should_stop flag. if so, we're all done
-        if (should_stop())
+        if (thread->should_stop())
             break;
 
         // now call poll() to wait forever for a new connection to
         // accept or an indication that we should stop
         short revents = 0;
-        int ret = IO::poll_single(TCPServer::fd(), POLLIN, &revents, -1,
-                                  get_notifier(), logpath());
+        int ret = IO::poll_single(server->fd(), POLLIN, &revents, -1,
+                                  server->get_notifier(), logpath());
         
         if (ret == IOINTR) {
-            ASSERT(should_stop());
+            ASSERT(thread->should_stop());
             break;
         }
 
         if (ret <= 0) {
             logf(LOG_ERR, "error %d in poll(): %d %s",
                  ret, errno, strerror(errno));
-            close();
+            server->close();
             break;
         }
-                
-        ret = accept(&fd, &addr, &port);
 
-        if (ret != 0) {
-            if (errno == EINTR)
-                continue;
-            
-            logf(LOG_ERR, "error %d in accept(): %d %s",
-                 ret, errno, strerror(errno));
-            close();
+        if (accept_batch(server) < 0) {
+            server->close();
             break;
         }
-
-        logf(LOG_DEBUG, "accepted connection fd %d from %s:%d",
-             fd, intoa(addr), port);
-
-        accepted(fd, addr, port);
     }
 
-    log_debug("server thread %p exiting", this);
+    log_debug("server thread %p exiting", thread);
+}
+
+//----------------------------------------------------------------------
+void
+TCPServerThread::run()
+{
+    accept_loop(this, this);
 }
 
 //----------------------------------------------------------------------
 void
 TCPServerThread::stop()
 {
-    bool finished = false;
-    
-    set_should_stop();
+    bool finished = stop_server_thread(this, this);
 
-    if (is_stopped()) {
-        finished = true;
-    } else {
-        interrupt_from_io();
+    for (size_t i = 0; i < acceptors_.size(); ++i) {
+        if (acceptors_[i]->stop_and_wait()) {
+            delete acceptors_[i];
+        } else {
+            finished = false;
+        }
+    }
+    acceptors_.clear();
 
-        // wait for 10 seconds (i.e. 20 sleep periods)
-        for (int i = 0; i < 20; ++i) {
-            if ((finished = is_stopped()))
-                break;
-            usleep(500000);
+    // nothing more can be submitted, but the tasks already on the
+    // pool still call accepted() on this object
+    if (finished) {
+        while (atomic_add_ret(&outstanding_, 0) != 0) {
+            usleep(10000);
         }
     }
 
@@ -212,8 +402,31 @@ TCPServerThread::bind_listen_start(in_addr_t local_addr,
     
     if (listen() != 0)
         return -1;
+
+    if (num_acceptors_ > 1) {
+        if (local_port == 0) {
+            log_err("multiple acceptors need an explicit port");
+            return -1;
+        }
+
+        for (int i = 1; i < num_acceptors_; ++i) {
+            Acceptor* a = new Acceptor(this);
+            if (a->bind(local_addr, local_port) != 0 || a->listen() != 0) {
+                delete a;
+                for (size_t j = 0; j < acceptors_.size(); ++j) {
+                    delete acceptors_[j];
+                }
+                acceptors_.clear();
+                return -1;
+            }
+            acceptors_.push_back(a);
+        }
+    }
     
     start();
+    for (size_t i = 0; i < acceptors_.size(); ++i) {
+        acceptors_[i]->start();
+    }
     
     return 0;
 }
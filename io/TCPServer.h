@@ -18,11 +18,16 @@
 #ifndef _OASYS_TCP_SERVER_H_
 #define _OASYS_TCP_SERVER_H_
 
+#include <vector>
+
 #include "IPSocket.h"
+#include "../thread/Atomic.h"
 #include "../thread/Thread.h"
 
 namespace oasys {
 
+class ThreadPool;
+
 /**
  * \class TCPServer
  *
@@ -30,6 +35,12 @@ namespace oasys {
  */
 class TCPServer : public IPSocket {
 public:
+    /// Flags for accept4()
+    enum {
+        ACCEPT_NONBLOCK = 1 << 0, ///< accepted socket is nonblocking
+        ACCEPT_CLOEXEC  = 1 << 1, ///< accepted socket is close-on-exec
+    };
+    
     TCPServer(const char* logbase = "/oasys/tcpserver");
 
     //@{
@@ -38,6 +49,18 @@ public:
     int accept(int *fd, in_addr_t *addr, u_int16_t *port);
     //@}
 
+    /**
+     * @brief Accept a connection, setting the given ACCEPT_* flags on
+     * the new socket (atomically, where accept4() is available).
+     *
+     * Unlike accept(), EAGAIN is not logged as an error, so this can
+     * be used to drain the backlog of a nonblocking listening socket.
+     *
+     * @return 0 on success, IOAGAIN if the socket is nonblocking and
+     * no connection is pending, -1 on error
+     */
+    int accept4(int *fd, in_addr_t *addr, u_int16_t *port, int flags);
+
     /**
      * @brief Try to accept a new connection, but don't block for more
      * than the timeout milliseconds.
@@ -54,6 +77,21 @@ public:
  * Simple class that implements a thread of control that loops,
  * blocking on accept(), and issuing the accepted() callback when new
  * connections arrive.
+ *
+ * To keep up with bursts of incoming connections, the loop can be
+ * configured with set_accept_options() to accept a batch of pending
+ * connections per wakeup, and/or to run several acceptor threads,
+ * each with its own SO_REUSEPORT listening socket on the same port so
+ * that the kernel spreads connections across them.
+ *
+ * Rather than calling accepted() from the accept loop, the thread can
+ * also be given a ThreadPool with set_thread_pool(), in which case
+ * each accepted() call is a task on the pool. That keeps a slow
+ * accepted() (or one that serves the whole connection) from holding
+ * up the accept loop without a thread per connection. Those tasks
+ * point back at the server, so stop() waits for the ones still queued
+ * or running before it returns. A subclass using a pool has to call
+ * stop() from its own destructor, since accepted() is its method.
  */
 class TCPServerThread : public TCPServer, public Thread {
 public:
@@ -75,6 +113,33 @@ public:
      */
     virtual void accepted(int fd, in_addr_t addr, u_int16_t port) = 0;
 
+    /**
+     * Configure the accept loop. Must be called before
+     * bind_listen_start() (or before bind() and run() when not using
+     * it).
+     *
+     * @param num_acceptors Number of listening sockets and threads.
+     *     Anything over one needs SO_REUSEPORT and an explicit port in
+     *     bind_listen_start(), and means accepted() may be called
+     *     from several threads at once.
+     * @param batch Maximum number of connections to accept each time
+     *     the listening socket becomes readable. Anything over one
+     *     makes the listening socket nonblocking.
+     * @param accept_flags TCPServer::ACCEPT_* flags for the accepted
+     *     sockets.
+     */
+    void set_accept_options(int num_acceptors,
+                            int batch        = 1,
+                            int accept_flags = 0);
+
+    /**
+     * Call accepted() on the given pool's threads instead of in the
+     * accept loop, which means it may be called from several threads
+     * at once. The pool must outlive the server thread. Until it has
+     * been started, or with NULL, accepted() is called directly.
+     */
+    void set_thread_pool(ThreadPool* pool) { pool_ = pool; }
+
     /**
      * Loop forever, issuing blocking calls to TCPServer::accept(),
      * then calling the accepted() function when new connections
@@ -88,7 +153,9 @@ public:
 
     /**
      * Stop the thread by posting on the notifier, which causes it to
-     * wake up from poll and then exit.
+     * wake up from poll and then exit. With a thread pool, this then
+     * waits for the accepted() calls already handed to the pool, so
+     * it mustn't be called from accepted().
      */
     void stop();
 
@@ -109,6 +176,30 @@ public:
      * @return -1 on error, 0 otherwise.
      */
     int bind_listen_start(in_addr_t local_addr, u_int16_t local_port);
+
+protected:
+    /**
+     * Loop accepting connections on the given socket until the given
+     * thread is told to stop. Used by run() and by the additional
+     * acceptor threads.
+     */
+    void accept_loop(TCPServer* server, Thread* thread);
+
+    /**
+     * Accept up to accept_batch_ connections on the given socket.
+     *
+     * @return The number accepted, or -1 on a fatal error
+     */
+    int accept_batch(TCPServer* server);
+
+    class Acceptor;
+    class AcceptedTask;
+    std::vector<Acceptor*> acceptors_;  ///< additional acceptor threads
+    int num_acceptors_;
+    int accept_batch_;
+    int accept_flags_;
+    ThreadPool* pool_;                  ///< pool to run accepted() on
+    atomic_t    outstanding_;           ///< AcceptedTasks not yet done
 };
 
 } // namespace oasys
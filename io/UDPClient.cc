@@ -22,6 +22,7 @@
 #include <sys/poll.h>
 
 #include "UDPClient.h"
+#include "DatagramBatch.h"
 #include "NetUtils.h"
 #include "debug/DebugUtils.h"
 #include "debug/Log.h"
@@ -33,4 +34,23 @@ UDPClient::UDPClient(const char* logbase)
 {
 }
 
+int
+UDPClient::timeout_recvmmsg(DatagramBatch* batch, int timeout_ms)
+{
+    batch->prepare_recv();
+    
+    int cc = IO::timeout_recvmmsg(fd_, batch->msgs(), batch->capacity(), 0,
+                                  timeout_ms, get_notifier(), logpath_);
+    monitor(IO::RECVMMSG, 0);
+
+    if (cc < 0) {
+        if (cc == IOERROR)
+            logf(LOG_ERR, "error in recvmmsg(): %s", strerror(errno));
+        return cc;
+    }
+
+    batch->set_size(cc);
+    return cc;
+}
+
 } // namespace oasys
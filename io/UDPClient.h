@@ -30,6 +30,14 @@ private:
     
 public:
     UDPClient(const char* logbase = "/udpclient");
+
+    /**
+     * Like recvmmsg(), but give up after timeout_ms milliseconds.
+     *
+     * @return The number of datagrams received, IOTIMEOUT, IOINTR or
+     * IOERROR.
+     */
+    int timeout_recvmmsg(DatagramBatch* batch, int timeout_ms);
 };
 
 } // namespace oasys
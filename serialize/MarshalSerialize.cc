@@ -340,7 +340,11 @@ Unmarshal::process(const char*            name,
         return;
     }
 
-    carrier->set_buf(next_slice(len), len, false);
+    if (options_ & BORROW_BUFFERS) {
+        carrier->set_view(next_slice(len), len);
+    } else {
+        carrier->set_buf(next_slice(len), len, false);
+    }
     if (log_ && carrier->len() != 0) 
     {
         std::string s;
@@ -378,7 +382,11 @@ Unmarshal::process(const char*            name,
         ++len;
     } while (*c != terminator);
 
-    carrier->set_buf(cbuf, len + 1, false); // include the terminator
+    if (options_ & BORROW_BUFFERS) {
+        carrier->set_view(cbuf, len + 1); // include the terminator
+    } else {
+        carrier->set_buf(cbuf, len + 1, false);
+    }
 }
 
 //----------------------------------------------------------------------------
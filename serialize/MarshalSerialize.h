@@ -87,6 +87,10 @@ private:
  * 
  * INVARIANT: The length of the buffer must be the length of the serialized
  * buffer.
+ *
+ * With the BORROW_BUFFERS option, byte buffers come back as views
+ * into buf, so objects that use BufferCarrier::take_view() skip the
+ * copy but have to be done with them before buf goes away.
  */
 class Unmarshal : public BufferedSerializeAction {
 public:
@@ -64,7 +64,11 @@ public:
 
     /** Options for un/marshaling. */
     enum {
-        USE_CRC = 1 << 0,
+        USE_CRC        = 1 << 0,
+        /// Unmarshal byte buffers as views into the source buffer
+        /// (see BufferCarrier::take_view()), rather than copies. The
+        /// source has to outlive the unmarshalled object.
+        BORROW_BUFFERS = 1 << 1,
     };
 
     /** Options for un/marshaling process() methods */
@@ -33,6 +33,7 @@
 #include <serialize/TypeShims.h>
 
 #include "BerkeleyDBStore.h"
+#include "GroupCommitter.h"
 #include "StorageConfig.h"
 #include "util/InitSequencer.h"
 
@@ -40,6 +41,10 @@
 
 #define NO_TX  0 // for easily going back and changing TX id's later
 
+/// Smallest bulk iterator buffer, and bytes to allow per element
+#define BDB_BULK_MIN_LEN     (64 * 1024)
+#define BDB_BULK_ELEMENT_LEN 512
+
 namespace oasys {
 /******************************************************************************
  *
@@ -50,7 +55,8 @@ const std::string BerkeleyDBStore::META_TABLE_NAME("___META_TABLE___");
 //----------------------------------------------------------------------------
 BerkeleyDBStore::BerkeleyDBStore(const char* logpath)
     : DurableStoreImpl("BerkeleyDBStore", logpath),
-      init_(false)
+      init_(false),
+      group_commit_(0)
 {}
 
 //----------------------------------------------------------------------------
@@ -190,6 +196,18 @@ BerkeleyDBStore::init(const StorageConfig& cfg)
             log_crit("DB: %s, cannot set flags", db_strerror(err));
             return DS_ERR;
         }
+
+        // with group commit, commits don't flush the log themselves:
+        // every put and del waits on the GroupCommitter instead,
+        // which flushes it once for a whole batch (see sync())
+        if (cfg.group_commit_) {
+            err = dbenv_->set_flags(dbenv_, DB_TXN_NOSYNC, 1);
+            if (err != 0) 
+            {
+                log_crit("DB: %s, cannot set flags", db_strerror(err));
+                return DS_ERR;
+            }
+        }
     }
 
     err = dbenv_->set_paniccall(dbenv_, BerkeleyDBStore::db_panic);
@@ -269,6 +287,19 @@ BerkeleyDBStore::end_transaction(void *txid, bool be_durable)
     return ret;
 }
 
+//----------------------------------------------------------------------------
+int
+BerkeleyDBStore::sync()
+{
+    int err = dbenv_->log_flush(dbenv_, NULL);
+    if (err != 0) {
+        log_err("DB: %s, cannot flush log", db_strerror(err));
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
 //----------------------------------------------------------------------------
 void *
 BerkeleyDBStore::get_underlying()
@@ -687,17 +718,7 @@ BerkeleyDBTable::get(const SerializableObject& key,
         return DS_ERR;
     }
 
-    u_char* bp = (u_char*)d->data;
-    size_t  sz = d->size;
-    
-    Unmarshal unmarshaller(Serialize::CONTEXT_LOCAL, bp, sz);
-    
-    if (unmarshaller.action(data) != 0) {
-        log_err("DB: error unserializing data object");
-        return DS_ERR;
-    }
-
-    return 0;
+    return unflatten((u_char*)d->data, d->size, data);
 }
 
 //----------------------------------------------------------------------------
@@ -731,9 +752,119 @@ BerkeleyDBTable::get(const SerializableObject&   key,
         return DS_ERR;
     }
 
-    u_char* bp = (u_char*)d->data;
-    size_t  sz = d->size;
+    return unflatten((u_char*)d->data, d->size, data, allocator);
+}
+
+//----------------------------------------------------------------------------
+int
+BerkeleyDBTable::get_view_common(const SerializableObject& key,
+                                 DurableView*              view)
+{
+    view->release();
+
+    ScratchBuffer<u_char*, 256> key_buf;
+    size_t key_buf_len = flatten(key, &key_buf);
+    if (key_buf_len == 0) 
+    {
+        log_err("zero or too long key length");
+        return DS_ERR;
+    }
+
+    DBTRef k(key_buf.buf(), key_buf_len);
+    DBTRef d;
+    d->flags = DB_DBT_MALLOC;
+
+    int err = db_->get(db_, NO_TX, k.dbt(), d.dbt(), 0);
+     
+    if (err == DB_NOTFOUND) 
+    {
+        return DS_NOTFOUND;
+    }
+    else if (err != 0)
+    {
+        log_err("DB: %s", db_strerror(err));
+        return DS_ERR;
+    }
+
+    size_t size = d->size;
+    view->set(static_cast<u_char*>(d.take()), size, &free_view, NULL);
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+void
+BerkeleyDBTable::free_view(const u_char* buf, void* cookie)
+{
+    (void)cookie;
+    free(const_cast<u_char*>(buf));
+}
+
+//----------------------------------------------------------------------------
+int
+BerkeleyDBTable::get_view(const SerializableObject& key,
+                          SerializableObject*       data,
+                          DurableView*              view)
+{
+    ASSERTF(!multitype_, "single-type get called for multi-type table");
+
+    int err = get_view_common(key, view);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    err = unflatten(const_cast<u_char*>(view->buf()), view->len(), data,
+                    Serialize::BORROW_BUFFERS);
+    if (err != DS_OK) {
+        view->release();
+    }
+    return err;
+}
+
+//----------------------------------------------------------------------------
+int
+BerkeleyDBTable::get_view(const SerializableObject&   key,
+                          SerializableObject**        data,
+                          TypeCollection::Allocator_t allocator,
+                          DurableView*                view)
+{
+    ASSERTF(multitype_, "multi-type get called for single-type table");
+
+    int err = get_view_common(key, view);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    err = unflatten(const_cast<u_char*>(view->buf()), view->len(), data,
+                    allocator, Serialize::BORROW_BUFFERS);
+    if (err != DS_OK) {
+        view->release();
+    }
+    return err;
+}
+
+//----------------------------------------------------------------------------
+int
+BerkeleyDBTable::unflatten(u_char* bp, size_t sz, SerializableObject* data,
+                           int options)
+{
+    Unmarshal unmarshaller(Serialize::CONTEXT_LOCAL, bp, sz, options);
+    
+    if (unmarshaller.action(data) != 0) {
+        log_err("DB: error unserializing data object");
+        return DS_ERR;
+    }
+
+    return 0;
+}
 
+//----------------------------------------------------------------------------
+int
+BerkeleyDBTable::unflatten(u_char*                     bp,
+                           size_t                      sz,
+                           SerializableObject**        data,
+                           TypeCollection::Allocator_t allocator,
+                           int                         options)
+{
     TypeCollection::TypeCode_t typecode;
     size_t typecode_sz = MarshalSize::get_size(&typecode);
 
@@ -751,7 +882,7 @@ BerkeleyDBTable::get(const SerializableObject&   key,
     bp += typecode_sz;
     sz -= typecode_sz;
 
-    err = allocator(typecode, data);
+    int err = allocator(typecode, data);
     if (err != 0) {
         *data = NULL;
         return DS_ERR;
@@ -759,7 +890,7 @@ BerkeleyDBTable::get(const SerializableObject&   key,
 
     ASSERT(*data != NULL);
 
-    Unmarshal unmarshaller(Serialize::CONTEXT_LOCAL, bp, sz);
+    Unmarshal unmarshaller(Serialize::CONTEXT_LOCAL, bp, sz, options);
     
     if (unmarshaller.action(*data) != 0) {
         log_err("DB: error unserializing data object");
@@ -855,6 +986,10 @@ BerkeleyDBTable::put(const SerializableObject&  key,
         return DS_ERR;
     }
 
+    if (store_->group_commit_ != 0) {
+        return store_->group_commit_->commit();
+    }
+
     return 0;
 }
 
@@ -886,6 +1021,10 @@ BerkeleyDBTable::del(const SerializableObject& key)
         return DS_ERR;
     }
 
+    if (store_->group_commit_ != 0) {
+        return store_->group_commit_->commit();
+    }
+
     return 0;
 }
 
@@ -942,6 +1081,20 @@ BerkeleyDBTable::itr()
     return new BerkeleyDBIterator(this);
 }
 
+//----------------------------------------------------------------------------
+DurableIterator*
+BerkeleyDBTable::bulk_itr(size_t batch)
+{
+    // guess at the bytes for a batch; the buffer has to be a
+    // multiple of 1024, and at least a page
+    size_t len = BDB_BULK_MIN_LEN;
+    if (batch * BDB_BULK_ELEMENT_LEN > len) {
+        len = (batch * BDB_BULK_ELEMENT_LEN + 1023) & ~1023;
+    }
+
+    return new BerkeleyDBIterator(this, len);
+}
+
 //----------------------------------------------------------------------------
 int 
 BerkeleyDBTable::key_exists(const void* key, size_t key_len)
@@ -968,10 +1121,17 @@ BerkeleyDBTable::key_exists(const void* key, size_t key_len)
  * BerkeleyDBIterator
  *
  *****************************************************************************/
-BerkeleyDBIterator::BerkeleyDBIterator(BerkeleyDBTable* t)
+BerkeleyDBIterator::BerkeleyDBIterator(BerkeleyDBTable* t, size_t bulk_len)
     : Logger("BerkeleyDBIterator", "%s/iter", t->logpath()),
-      cur_(0), valid_(false)
+      table_(t), cur_(0), valid_(false), bulk_ptr_(0)
 {
+    memset(&bulk_, 0, sizeof(bulk_));
+    if (bulk_len != 0) {
+        bulk_.data  = malloc(bulk_len);
+        bulk_.ulen  = bulk_len;
+        bulk_.flags = DB_DBT_USERMEM;
+    }
+
     int err = t->db_->cursor(t->db_, NO_TX, &cur_, 0);
     if (err != 0) {
         log_err("DB: cannot create a DB iterator, err=%s", db_strerror(err));
@@ -996,6 +1156,8 @@ BerkeleyDBIterator::~BerkeleyDBIterator()
             log_err("Unable to close cursor, %s", db_strerror(err));
         }
     }
+
+    free(bulk_.data);
 }
 
 //----------------------------------------------------------------------------
@@ -1007,6 +1169,10 @@ BerkeleyDBIterator::next()
     memset(&key_, 0, sizeof(key_));
     memset(&data_, 0, sizeof(data_));
 
+    if (bulk_.data != NULL) {
+        return next_bulk();
+    }
+
     int err = cur_->c_get(cur_, key_.dbt(), data_.dbt(), DB_NEXT);
 
     if (err == DB_NOTFOUND) {
@@ -1022,6 +1188,65 @@ BerkeleyDBIterator::next()
     return 0;
 }
 
+//----------------------------------------------------------------------------
+int
+BerkeleyDBIterator::next_bulk()
+{
+    for (;;) {
+        if (bulk_ptr_ != NULL) {
+            void*     key;
+            void*     data;
+            u_int32_t key_len, data_len;
+            DB_MULTIPLE_KEY_NEXT(bulk_ptr_, &bulk_, key, key_len,
+                                 data, data_len);
+            if (bulk_ptr_ != NULL) {
+                key_->data  = key;
+                key_->size  = key_len;
+                data_->data = data;
+                data_->size = data_len;
+                return 0;
+            }
+        }
+
+        // The key is only used as a position by the cursor, which
+        // returns the keys in the buffer
+        DBTRef k;
+        int err = cur_->c_get(cur_, k.dbt(), &bulk_,
+                              DB_NEXT | DB_MULTIPLE_KEY);
+
+#ifdef DB_BUFFER_SMALL
+        if (err == DB_BUFFER_SMALL) {
+#else
+        if (err == ENOMEM) {
+#endif
+            // a single pair doesn't fit, so grow the buffer to what
+            // it says it needs
+            u_int32_t len = (bulk_.size + 1023) & ~1023;
+            if (len <= bulk_.ulen) {
+                len = bulk_.ulen * 2;
+            }
+            log_debug("growing bulk buffer from %u to %u bytes",
+                      bulk_.ulen, len);
+            free(bulk_.data);
+            bulk_.data = malloc(len);
+            bulk_.ulen = len;
+            continue;
+        }
+
+        if (err == DB_NOTFOUND) {
+            valid_ = false;
+            return DS_NOTFOUND;
+        } 
+        else if (err != 0) {
+            log_err("next() DB: %s", db_strerror(err));
+            valid_ = false;
+            return DS_ERR;
+        }
+
+        DB_MULTIPLE_INIT(bulk_ptr_, &bulk_);
+    }
+}
+
 //----------------------------------------------------------------------------
 int
 BerkeleyDBIterator::get_key(SerializableObject* key)
@@ -1038,6 +1263,30 @@ BerkeleyDBIterator::get_key(SerializableObject* key)
     return 0;
 }
 
+//----------------------------------------------------------------------------
+int
+BerkeleyDBIterator::get_data(SerializableObject* data)
+{
+    ASSERTF(!table_->multitype_,
+            "single-type get_data called for multi-type table");
+    ASSERT(data != NULL);
+
+    return table_->unflatten(static_cast<u_char*>(data_->data),
+                             data_->size, data);
+}
+
+//----------------------------------------------------------------------------
+int
+BerkeleyDBIterator::get_data(SerializableObject**        data,
+                             TypeCollection::Allocator_t allocator)
+{
+    ASSERTF(table_->multitype_,
+            "multi-type get_data called for single-type table");
+
+    return table_->unflatten(static_cast<u_char*>(data_->data),
+                             data_->size, data, allocator);
+}
+
 } // namespace oasys
 
 #endif // LIBDB_ENABLED
@@ -70,6 +70,15 @@ public:
     int   begin_transaction(void **txid);
     int   end_transaction(void *txid, bool be_durable);
 
+    //! Flush the transaction log
+    int   sync();
+
+    //! Make autocommitted writes wait on the committer
+    void  set_group_committer(GroupCommitter* committer)
+    {
+        group_commit_ = committer;
+    }
+
     //! Allow access to the underlying DB implementation
     void* get_underlying();
 
@@ -81,6 +90,9 @@ public:
     int del_table(const std::string& name);
     int get_table_names(StringVector* names);
     std::string get_info() const;
+
+    //! Handles are only free threaded when locking is on
+    bool concurrent_reads() const { return deadlock_timer_ != NULL; }
     /// @}
 
 private:
@@ -88,6 +100,7 @@ private:
     std::string db_name_;     ///< Name of the database file
     DB_ENV*     dbenv_;       ///< database environment for all tables
     bool	sharefile_;   ///< share a single db file
+    GroupCommitter* group_commit_; ///< flushes the log for writes, if set
 
     SpinLock    ref_count_lock_;
     RefCountMap ref_count_;   ///< Ref. count for open tables.
@@ -157,6 +170,17 @@ public:
     int get(const SerializableObject& key,
             SerializableObject** data,
             TypeCollection::Allocator_t allocator);
+
+    /// The database mallocs the data and the view takes it over, so
+    /// the object's buffers skip the copy out of it
+    int get_view(const SerializableObject& key,
+                 SerializableObject*       data,
+                 DurableView*              view);
+
+    int get_view(const SerializableObject&   key,
+                 SerializableObject**        data,
+                 TypeCollection::Allocator_t allocator,
+                 DurableView*                view);
     
     int put(const SerializableObject& key,
             TypeCollection::TypeCode_t typecode,
@@ -168,6 +192,9 @@ public:
     size_t size() const;
     
     DurableIterator* itr();
+
+    /// Reads the table with a DB_MULTIPLE_KEY bulk cursor
+    DurableIterator* bulk_itr(size_t batch = 0);
     /// @}
 
 private:
@@ -184,6 +211,21 @@ private:
 
     /// Whether a specific key exists in the table.
     int key_exists(const void* key, size_t key_len);
+
+    /// @{ Unserialize a value as written by put(), allocating the
+    /// object first for a multi-type table
+    int unflatten(u_char* bp, size_t sz, SerializableObject* data,
+                  int options = 0);
+    int unflatten(u_char* bp, size_t sz, SerializableObject** data,
+                  TypeCollection::Allocator_t allocator,
+                  int options = 0);
+
+    /// Read the data for key into a malloc'd buffer held by the view
+    int get_view_common(const SerializableObject& key, DurableView* view);
+
+    /// Frees a view's buffer (a DurableView::Release_t)
+    static void free_view(const u_char* buf, void* cookie);
+    /// @}
 };
 
 /**
@@ -224,6 +266,15 @@ public:
     /// Return a pointer to the underlying DBT structure
     DBT* dbt() { return &dbt_; }
 
+    /// Take over the data that the database malloc'd, which the
+    /// destructor then leaves alone
+    void* take()
+    {
+        void* data = dbt_.data;
+        dbt_.data = NULL;
+        return data;
+    }
+
     /// Convenience operator overload
     DBT* operator->() { return &dbt_; }
 
@@ -233,6 +284,11 @@ protected:
 
 /**
  * Iterator class for Berkeley DB tables.
+ *
+ * A bulk iterator reads with DB_NEXT | DB_MULTIPLE_KEY into a buffer
+ * of bulk_len bytes, so each cursor call returns as many key/data
+ * pairs as fit (the buffer grows if a single pair doesn't), and the
+ * data comes along with every key.
  */
 class BerkeleyDBIterator : public DurableIterator, public Logger {
     friend class BerkeleyDBTable;
@@ -242,7 +298,7 @@ private:
      * Create an iterator for table t. These should not be called
      * except by BerkeleyDBTable.
      */
-    BerkeleyDBIterator(BerkeleyDBTable* t);
+    BerkeleyDBIterator(BerkeleyDBTable* t, size_t bulk_len = 0);
 
 public:
     virtual ~BerkeleyDBIterator();
@@ -250,14 +306,24 @@ public:
     /// @{ virtual from DurableIteratorImpl
     int next();
     int get_key(SerializableObject* key);
+    int get_data(SerializableObject* data);
+    int get_data(SerializableObject**        data,
+                 TypeCollection::Allocator_t allocator);
     /// @}
 
 protected:
+    BerkeleyDBTable* table_;
     DBC* cur_;          ///< Current database cursor
     bool valid_;        ///< Status of the iterator
 
     DBTRef key_;	///< Current element key
     DBTRef data_;	///< Current element data
+
+    DBT   bulk_;        ///< Bulk buffer (user memory), if any
+    void* bulk_ptr_;    ///< Position in bulk_ of the next pair
+
+    /// next() for a bulk iterator
+    int next_bulk();
 };
 
 }; // namespace oasys
@@ -0,0 +1,296 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <stdlib.h>
+
+#include "CacheKey.h"
+#include "../debug/DebugUtils.h"
+#include "../util/StringUtils.h"
+#include "../util/jenkins_hash.h"
+
+namespace oasys {
+
+//----------------------------------------------------------------------------
+void
+CacheKey::init(const u_char* buf, size_t len)
+{
+    len_  = len;
+    hash_ = jenkins_hash(const_cast<u_int8_t*>(buf), len, 0);
+
+    if (is_inline()) {
+        memcpy(inline_, buf, len);
+    } else {
+        ptr_ = buf;
+    }
+}
+
+//----------------------------------------------------------------------------
+std::string
+CacheKey::str() const
+{
+    return hex2str(data(), len_);
+}
+
+//----------------------------------------------------------------------------
+CacheKeyEncoder::CacheKeyEncoder(ExpandableBuffer* buf)
+    : SerializeAction(Serialize::MARSHAL, Serialize::CONTEXT_LOCAL),
+      buf_(buf)
+{
+    buf_->set_len(0);
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyEncoder::process(const char* name, u_int64_t* i)
+{
+    (void)name;
+    append(i, sizeof(*i));
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyEncoder::process(const char* name, u_int32_t* i)
+{
+    (void)name;
+    append(i, sizeof(*i));
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyEncoder::process(const char* name, u_int16_t* i)
+{
+    (void)name;
+    append(i, sizeof(*i));
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyEncoder::process(const char* name, u_int8_t* i)
+{
+    (void)name;
+    append(i, sizeof(*i));
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyEncoder::process(const char* name, bool* b)
+{
+    (void)name;
+    u_int8_t val = *b ? 1 : 0;
+    append(&val, sizeof(val));
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyEncoder::process(const char* name, u_char* bp, u_int32_t len)
+{
+    (void)name;
+    append(bp, len);
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyEncoder::process(const char*            name,
+                         BufferCarrier<u_char>* carrier)
+{
+    (void)name;
+    u_int32_t len = carrier->len();
+    append(&len, sizeof(len));
+    append(carrier->buf(), len);
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyEncoder::process(const char*            name,
+                         BufferCarrier<u_char>* carrier,
+                         u_char                 terminator)
+{
+    (void)name;
+    u_int32_t len = 0;
+    while (carrier->buf()[len] != terminator) {
+        ++len;
+    }
+    append(&len, sizeof(len));
+    append(carrier->buf(), len);
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyEncoder::process(const char* name, std::string* s)
+{
+    (void)name;
+    u_int32_t len = s->length();
+    append(&len, sizeof(len));
+    append(s->data(), len);
+}
+
+//----------------------------------------------------------------------------
+CacheKeyArena::CacheKeyArena()
+    : cur_(0), left_(0), bytes_(0)
+{
+    for (int i = 0; i < NUM_CLASSES; ++i) {
+        free_[i] = 0;
+    }
+}
+
+//----------------------------------------------------------------------------
+CacheKeyArena::~CacheKeyArena()
+{
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        free(blocks_[i]);
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyArena::store(CacheKey* key)
+{
+    if (key->is_inline()) {
+        return;
+    }
+
+    size_t  len = key->len();
+    u_char* buf;
+
+    if (len > NUM_CLASSES * ALIGN) {
+        buf = static_cast<u_char*>(malloc(len));
+        ASSERT(buf != 0);
+    } else {
+        size_t cls = size_class(len);
+        bytes_ += (cls + 1) * ALIGN;
+
+        if (free_[cls] != 0) {
+            buf = reinterpret_cast<u_char*>(free_[cls]);
+            free_[cls] = free_[cls]->next_;
+        } else {
+            size_t chunk = (cls + 1) * ALIGN;
+            if (left_ < chunk) {
+                // the tail of the old block is lost, which is at most
+                // one of the bigger chunks
+                cur_  = static_cast<u_char*>(malloc(BLOCK_SIZE));
+                ASSERT(cur_ != 0);
+                left_ = BLOCK_SIZE;
+                blocks_.push_back(cur_);
+            }
+            buf    = cur_;
+            cur_  += chunk;
+            left_ -= chunk;
+        }
+    }
+
+    memcpy(buf, key->data(), len);
+    key->ptr_ = buf;
+}
+
+//----------------------------------------------------------------------------
+void
+CacheKeyArena::release(const CacheKey& key)
+{
+    if (key.is_inline()) {
+        return;
+    }
+
+    u_char* buf = const_cast<u_char*>(key.ptr_);
+    if (key.len() > NUM_CLASSES * ALIGN) {
+        free(buf);
+        return;
+    }
+
+    size_t cls = size_class(key.len());
+    bytes_ -= (cls + 1) * ALIGN;
+
+    FreeChunk* chunk = reinterpret_cast<FreeChunk*>(buf);
+    chunk->next_ = free_[cls];
+    free_[cls]   = chunk;
+}
+
+//----------------------------------------------------------------------------
+CacheFrequencySketch::CacheFrequencySketch(size_t width)
+    : additions_(0)
+{
+    size_t w = 16;
+    while (w < width) {
+        w *= 2;
+    }
+    mask_     = w - 1;
+    reset_at_ = w * RESET_RATIO;
+
+    for (int i = 0; i < ROWS; ++i) {
+        rows_[i] = static_cast<u_int8_t*>(calloc(w, 1));
+        ASSERT(rows_[i] != 0);
+    }
+}
+
+//----------------------------------------------------------------------------
+CacheFrequencySketch::~CacheFrequencySketch()
+{
+    for (int i = 0; i < ROWS; ++i) {
+        free(rows_[i]);
+    }
+}
+
+//----------------------------------------------------------------------------
+size_t
+CacheFrequencySketch::index(int row, u_int32_t hash) const
+{
+    static const u_int32_t seeds[ROWS] = {
+        0x9E3779B1U, 0x85EBCA77U, 0xC2B2AE3DU, 0x27D4EB2FU
+    };
+
+    u_int32_t h = hash * seeds[row];
+    return (h ^ (h >> 15)) & mask_;
+}
+
+//----------------------------------------------------------------------------
+void
+CacheFrequencySketch::increment(u_int32_t hash)
+{
+    for (int i = 0; i < ROWS; ++i) {
+        u_int8_t* c = &rows_[i][index(i, hash)];
+        if (*c < MAX_COUNT) {
+            ++(*c);
+        }
+    }
+
+    if (++additions_ >= reset_at_) {
+        for (int i = 0; i < ROWS; ++i) {
+            for (size_t j = 0; j <= mask_; ++j) {
+                rows_[i][j] >>= 1;
+            }
+        }
+        additions_ /= 2;
+    }
+}
+
+//----------------------------------------------------------------------------
+u_int32_t
+CacheFrequencySketch::estimate(u_int32_t hash) const
+{
+    u_int32_t ret = MAX_COUNT;
+    for (int i = 0; i < ROWS; ++i) {
+        u_int32_t c = rows_[i][index(i, hash)];
+        if (c < ret) {
+            ret = c;
+        }
+    }
+    return ret;
+}
+
+} // namespace oasys
@@ -0,0 +1,221 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef __CACHE_KEY_H__
+#define __CACHE_KEY_H__
+
+#include <sys/types.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../compat/inttypes.h"
+#include "../serialize/Serialize.h"
+#include "../util/ExpandableBuffer.h"
+
+namespace oasys {
+
+/**
+ * The key for an entry in a DurableObjectCache: the binary (marshalled)
+ * encoding of a SerializableObject key, along with its hash.
+ *
+ * Short keys, which covers integer keys, are kept inline. Longer ones
+ * point at a buffer, which is either the caller's (for a key that's
+ * only used to look something up) or a copy in a CacheKeyArena (for a
+ * key that's stored in the cache).
+ *
+ * CacheKeys are plain values, so copies of a stored key share its
+ * arena space, which the owner has to give back exactly once.
+ */
+struct CacheKey {
+    enum { INLINE_LEN = 16 };
+
+    CacheKey() : hash_(0), len_(0) {}
+
+    /// Set up the key for the given encoding, computing its hash. A
+    /// long key refers to buf, which has to outlive it.
+    void init(const u_char* buf, size_t len);
+
+    /// @return the encoded key
+    const u_char* data() const
+    {
+        return is_inline() ? inline_ : ptr_;
+    }
+
+    size_t len()  const { return len_; }
+    u_int32_t hash() const { return hash_; }
+    bool is_inline() const { return len_ <= INLINE_LEN; }
+
+    bool operator==(const CacheKey& other) const
+    {
+        return hash_ == other.hash_ &&
+               len_  == other.len_  &&
+               memcmp(data(), other.data(), len_) == 0;
+    }
+
+    /// @return the key in hex, for log messages
+    std::string str() const;
+
+    u_int32_t hash_;
+    u_int32_t len_;
+    union {
+        u_char        inline_[INLINE_LEN];
+        const u_char* ptr_;
+    };
+};
+
+/**
+ * Flattens a key into the binary form used by CacheKey. Integers are
+ * copied as they are and everything else is prefixed by its length,
+ * which is all a key that never leaves this process needs.
+ *
+ * Unlike Marshal there's no logging or byte swapping, and nothing to
+ * set up, which matters since every cache lookup does this.
+ */
+class CacheKeyEncoder : public SerializeAction {
+public:
+    CacheKeyEncoder(ExpandableBuffer* buf);
+
+    /// We can tolerate a const object
+    int action(const SerializableObject* const_object)
+    {
+        return SerializeAction::action(
+            const_cast<SerializableObject*>(const_object));
+    }
+
+    /// @{ Virtual functions inherited from SerializeAction
+    void process(const char* name, u_int64_t* i);
+    void process(const char* name, u_int32_t* i);
+    void process(const char* name, u_int16_t* i);
+    void process(const char* name, u_int8_t* i);
+    void process(const char* name, bool* b);
+    void process(const char* name, u_char* bp, u_int32_t len);
+    void process(const char*            name, 
+                 BufferCarrier<u_char>* carrier);
+    void process(const char*            name,
+                 BufferCarrier<u_char>* carrier,
+                 u_char                 terminator);
+    void process(const char* name, std::string* s);
+    /// @}
+
+private:
+    ExpandableBuffer* buf_;
+
+    void append(const void* bp, size_t len)
+    {
+        buf_->reserve(buf_->len() + len);
+        memcpy(buf_->end(), bp, len);
+        buf_->set_len(buf_->len() + len);
+    }
+};
+
+/// Hash function for CacheKeys, which just returns the stored hash
+struct CacheKeyHash {
+    size_t operator()(const CacheKey& key) const { return key.hash(); }
+};
+
+/// Equality function for CacheKeys
+struct CacheKeyEquals {
+    bool operator()(const CacheKey& a, const CacheKey& b) const
+    {
+        return a == b;
+    }
+};
+
+/**
+ * Storage for the encodings of long CacheKeys. Space is carved out of
+ * large blocks and recycled through free lists of a few size classes,
+ * so keys don't each cost a trip through malloc. Keys too big for any
+ * of the classes are allocated on their own.
+ *
+ * Not thread safe; the cache's lock covers it.
+ */
+class CacheKeyArena {
+public:
+    CacheKeyArena();
+    ~CacheKeyArena();
+
+    /// Copy a long key's encoding into the arena, and point the key
+    /// at the copy. Inline keys are left as they are.
+    void store(CacheKey* key);
+
+    /// Give back the space for a key that was passed to store()
+    void release(const CacheKey& key);
+
+    /// Bytes handed out to keys (rounded up to their size class)
+    size_t bytes() const { return bytes_; }
+
+private:
+    enum {
+        ALIGN       = 16,           ///< size class granularity
+        NUM_CLASSES = 16,           ///< classes up to 256 bytes
+        BLOCK_SIZE  = 16 * 1024,
+    };
+
+    /// A chunk on one of the free lists
+    struct FreeChunk {
+        FreeChunk* next_;
+    };
+
+    std::vector<u_char*> blocks_;
+    u_char*    cur_;                ///< unused space in the last block
+    size_t     left_;
+    FreeChunk* free_[NUM_CLASSES];
+    size_t     bytes_;
+
+    static size_t size_class(size_t len) { return (len - 1) / ALIGN; }
+};
+
+/**
+ * A count-min sketch of how often keys have been seen, for the
+ * TinyLFU-style admission policy in DurableObjectCache. Each key
+ * (by its hash) bumps one small counter in each of four rows, and its
+ * estimate is the smallest of them. Once enough keys have been added,
+ * every counter is halved so that old popularity fades.
+ *
+ * Not thread safe; the cache shard's lock covers it.
+ */
+class CacheFrequencySketch {
+public:
+    /// The width is rounded up to a power of two
+    CacheFrequencySketch(size_t width);
+    ~CacheFrequencySketch();
+
+    /// Count another occurrence of the key
+    void increment(u_int32_t hash);
+
+    /// @return the (over)estimated number of recent occurrences
+    u_int32_t estimate(u_int32_t hash) const;
+
+private:
+    enum {
+        ROWS        = 4,
+        MAX_COUNT   = 15,
+        RESET_RATIO = 10,   ///< halve after this many adds per counter
+    };
+
+    u_int8_t* rows_[ROWS];
+    size_t    mask_;
+    size_t    additions_;
+    size_t    reset_at_;
+
+    size_t index(int row, u_int32_t hash) const;
+};
+
+} // namespace oasys
+
+#endif /* __CACHE_KEY_H__ */
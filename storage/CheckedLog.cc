@@ -2,6 +2,9 @@
 #include <oasys-config.h>
 #endif
 
+#include <string.h>
+
+#include "../debug/DebugUtils.h"
 #include "../util/ExpandableBuffer.h"
 #include "../util/CRC32.h"
 #include "../storage/FileBackedObject.h"
@@ -21,28 +24,56 @@ CheckedLogWriter::CheckedLogWriter(FdIOClient* fd)
 void
 CheckedLogWriter::write_record(const char* buf, u_int32_t len)
 {
-    char ignore = '*';
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(buf);
+    iov.iov_len  = len;
+    write_record(&iov, 1);
+}
+
+//----------------------------------------------------------------------------
+int
+CheckedLogWriter::write_record(const struct iovec* iov, int iovcnt)
+{
+    ASSERT(iovcnt > 0 && iovcnt <= MAX_IOV);
+
+    u_int32_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        len += iov[i].iov_len;
+    }
+
+    char hdr[HEADER_LEN];
+    hdr[0] = '*';
+    hdr[5] = (len >> 24) & 0xFF;
+    hdr[6] = (len >> 16) & 0xFF;
+    hdr[7] = (len >> 8)  & 0xFF;
+    hdr[8] = len         & 0xFF;
+
     CRC32 crc;
-    
-    char len_buf[4];
-    len_buf[0] = (len >> 24) & 0xFF;
-    len_buf[1] = (len >> 16) & 0xFF;
-    len_buf[2] = (len >> 8)  & 0xFF;
-    len_buf[3] = len         & 0xFF;
-
-    crc.update(len_buf, 4);
-    crc.update(buf, len);
-
-    char crc_buf[4];
-    crc_buf[0] = (crc.value() >> 24) & 0xFF;
-    crc_buf[1] = (crc.value() >> 16) & 0xFF;
-    crc_buf[2] = (crc.value() >> 8)  & 0xFF;
-    crc_buf[3] = crc.value()         & 0xFF;
-
-    fd_->write(&ignore, 1);
-    fd_->write(crc_buf, 4);
-    fd_->write(len_buf, 4);
-    fd_->write(buf, len);
+    crc.update(&hdr[5], 4);
+    for (int i = 0; i < iovcnt; ++i) {
+        crc.update(static_cast<const u_char*>(iov[i].iov_base),
+                   iov[i].iov_len);
+    }
+
+    hdr[1] = (crc.value() >> 24) & 0xFF;
+    hdr[2] = (crc.value() >> 16) & 0xFF;
+    hdr[3] = (crc.value() >> 8)  & 0xFF;
+    hdr[4] = crc.value()         & 0xFF;
+
+    // the header and data go out together, so that a crash can only
+    // leave a partial record at the end of the log
+    struct iovec all[MAX_IOV + 1];
+    all[0].iov_base = hdr;
+    all[0].iov_len  = HEADER_LEN;
+    for (int i = 0; i < iovcnt; ++i) {
+        all[i + 1] = iov[i];
+    }
+
+    int cc = fd_->writevall(all, iovcnt + 1);
+    if (cc != static_cast<int>(HEADER_LEN + len)) {
+        return -1;
+    }
+    return 0;
 }
 
 //----------------------------------------------------------------------------
@@ -55,72 +86,102 @@ CheckedLogWriter::force()
 //----------------------------------------------------------------------------
 CheckedLogReader::CheckedLogReader(FdIOClient* fd)
     : fd_(fd),
-      cur_offset_(0)
+      cur_offset_(0),
+      file_size_(0),
+      rpos_(0)
 {}
 
 //----------------------------------------------------------------------------
-int 
-CheckedLogReader::read_record(ExpandableBuffer* buf)
+bool
+CheckedLogReader::fill(size_t len)
 {
-    struct stat stat_buf;
+    size_t avail = rbuf_.len() - rpos_;
+    if (avail >= len) {
+        return true;
+    }
 
-    fstat(fd_->fd(), &stat_buf);
-    if (cur_offset_ == stat_buf.st_size)
-    {
-        return END;
+    // shift what's left down to the front and read in another chunk
+    if (rpos_ != 0) {
+        memmove(rbuf_.raw_buf(), rbuf_.raw_buf() + rpos_, avail);
+        rbuf_.set_len(avail);
+        rpos_ = 0;
     }
+
+    size_t want = (len > 65536) ? len : 65536;
+    rbuf_.reserve(want);
     
-    char ignore;
-    char crc_buf[sizeof(CRC32::CRC_t)];
-    char len_buf[sizeof(u_int32_t)];
-    
-    int cc = fd_->read(&ignore, 1);
-    if (cc != 1)
-    {
-        return BAD_CRC;
+    while (rbuf_.len() < len) {
+        int cc = fd_->read(rbuf_.raw_buf() + rbuf_.len(),
+                           rbuf_.buf_len() - rbuf_.len());
+        if (cc <= 0) {
+            return false;
+        }
+        rbuf_.incr_len(cc);
     }
-    ++cur_offset_;
 
-    cc = fd_->read(crc_buf, sizeof(CRC32::CRC_t));
-    if (cc != sizeof(CRC32::CRC_t))
+    return true;
+}
+
+//----------------------------------------------------------------------------
+int 
+CheckedLogReader::read_record(ExpandableBuffer* buf)
+{
+    struct stat stat_buf;
+
+    if (cur_offset_ >= file_size_)
     {
-        return BAD_CRC;
+        fstat(fd_->fd(), &stat_buf);
+        file_size_ = stat_buf.st_size;
+        if (cur_offset_ == file_size_)
+        {
+            return END;
+        }
     }
-    cur_offset_ += sizeof(CRC32::CRC_t);
-
-    cc = fd_->read(len_buf, sizeof(u_int32_t));
-    if (cc != sizeof(u_int32_t))
+    
+    if (! fill(CheckedLogWriter::HEADER_LEN))
     {
         return BAD_CRC;
     }
-    cur_offset_ += 4;
 
-    off_t len = (len_buf[0] << 24) | (len_buf[1] << 16) | 
-                (len_buf[2] << 8) | len_buf[3];
+    const u_char* hdr = reinterpret_cast<u_char*>(rbuf_.raw_buf() + rpos_);
+    char ignore = hdr[0];
+    u_int32_t len = (hdr[5] << 24) | (hdr[6] << 16) | (hdr[7] << 8) | hdr[8];
 
     // sanity check so we don't run out of memory due to corruption
-    if (len > stat_buf.st_size - cur_offset_)
+    off_t left = file_size_ - cur_offset_ - CheckedLogWriter::HEADER_LEN;
+    if (static_cast<off_t>(len) > left)
     {
-        return BAD_CRC;
+        fstat(fd_->fd(), &stat_buf);
+        file_size_ = stat_buf.st_size;
+        left = file_size_ - cur_offset_ - CheckedLogWriter::HEADER_LEN;
+        if (static_cast<off_t>(len) > left)
+        {
+            return BAD_CRC;
+        }
     }
     
-    buf->reserve(len);
-    cc = fd_->read(buf->raw_buf(), len);
-    cur_offset_ += cc;
-
-    if (cc != static_cast<int>(len))
+    if (! fill(CheckedLogWriter::HEADER_LEN + len))
     {
         return BAD_CRC;
     }
+    hdr = reinterpret_cast<u_char*>(rbuf_.raw_buf() + rpos_);
 
     CRC32 crc;
-    crc.update(len_buf, 4);
-    crc.update(buf->raw_buf(), len);
+    crc.update(&hdr[5], 4);
+    crc.update(&hdr[CheckedLogWriter::HEADER_LEN], len);
     
-    if (crc.value() != CRC32::from_bytes(reinterpret_cast<u_char*>(crc_buf)))
+    if (crc.value() != CRC32::from_bytes(const_cast<u_char*>(&hdr[1])))
     {
         return BAD_CRC;
-    }    
+    }
+
+    buf->reserve(len == 0 ? 1 : len);
+    memcpy(buf->raw_buf(), &hdr[CheckedLogWriter::HEADER_LEN], len);
+    buf->set_len(len);
+    
+    rpos_       += CheckedLogWriter::HEADER_LEN + len;
+    cur_offset_ += CheckedLogWriter::HEADER_LEN + len;
+
     return (ignore == '!') ? IGNORE : 0;
 }
 
@@ -1,7 +1,10 @@
 #ifndef __CHECKEDLOG_H__
 #define __CHECKEDLOG_H__
 
+#include <sys/uio.h>
+
 #include "../io/FdIOClient.h"
+#include "../util/ExpandableBuffer.h"
 
 namespace oasys {
 
@@ -15,6 +18,11 @@ class FdIOClient;
  */
 class CheckedLogWriter {
 public:
+    enum {
+        HEADER_LEN = 9,         ///< ignore flag, CRC and length
+        MAX_IOV    = 16,        ///< most buffers in one gathered record
+    };
+
     /*!
      * Interpret the object as a checked log and write to it.
      */
@@ -28,6 +36,14 @@ public:
      */
     void write_record(const char* buf, u_int32_t len);
 
+    /*!
+     * Write a single record gathered from up to MAX_IOV buffers, with
+     * one system call. This does _not_ force the log file to disk.
+     *
+     * @return 0 on success, -1 on error or a short write.
+     */
+    int write_record(const struct iovec* iov, int iovcnt);
+
     /*!
      * For all log files written thus far to the disk.
      */ 
@@ -61,10 +77,25 @@ public:
      */
     int read_record(ExpandableBuffer* buf);
 
+    /*!
+     * @return Offset just past the last record that was read without
+     * error, i.e. where the next record starts.
+     */
+    off_t offset() const { return cur_offset_; }
+
 private:
     FdIOClient* fd_;
     
-    off_t cur_offset_;
+    off_t cur_offset_;          ///< end of the last good record
+    off_t file_size_;           ///< size of the file, as last seen
+
+    /// The file is read in large chunks, which records are parsed out of
+    ExpandableBuffer rbuf_;
+    size_t           rpos_;     ///< start of unparsed data in rbuf_
+
+    /// Make sure there are len bytes buffered. @return false if the
+    /// file ends first.
+    bool fill(size_t len);
 };
 
 } // namespace oasys
@@ -58,6 +58,36 @@ public:
      * Unserialize the current element into the given key object.
      */
     virtual int get_key(SerializableObject* key) = 0;
+
+    /**
+     * Unserialize the current element's data into the given object,
+     * for a single-type table. Iterators that have the data at hand
+     * along with the key (in particular those from
+     * DurableTableImpl::bulk_itr()) implement this, which saves a
+     * separate get() for every key when loading a whole table.
+     *
+     * @return DS_OK, DS_NOTFOUND if the element has been deleted
+     * since the iterator passed it, DS_UNSUPPORTED if the iterator
+     * can't return data (use get() instead), DS_ERR if an error
+     * occurred.
+     */
+    virtual int get_data(SerializableObject* data)
+    {
+        (void)data;
+        return DS_UNSUPPORTED;
+    }
+
+    /**
+     * Multi-type version of get_data(), calling the allocator to
+     * create the object once the type code is known.
+     */
+    virtual int get_data(SerializableObject**        data,
+                         TypeCollection::Allocator_t allocator)
+    {
+        (void)data;
+        (void)allocator;
+        return DS_UNSUPPORTED;
+    }
 };
 
 //----------------------------------------------------------------------------
@@ -93,7 +123,80 @@ public:
     {
         return itr_->get_key(key);
     }
+
+    int get_data(SerializableObject* data)
+    {
+        return itr_->get_data(data);
+    }
+
+    int get_data(SerializableObject**        data,
+                 TypeCollection::Allocator_t allocator)
+    {
+        return itr_->get_data(data, allocator);
+    }
     
 private:
     DurableIterator* itr_;
 };
+
+//----------------------------------------------------------------------------
+/*!
+ * Iterator over one of several parts of a table, for reading it from
+ * several threads at once: part p of n passes through every nth
+ * element of the wrapped iterator, starting at the pth. It owns the
+ * wrapped iterator.
+ *
+ * Every part still walks the whole table, so this only splits up the
+ * work of unserializing the data; stores that can do better override
+ * DurableTableImpl::part_itr().
+ */
+class DurablePartIterator : public DurableIterator {
+public:
+    DurablePartIterator(DurableIterator* itr, size_t part, size_t nparts)
+        : itr_(itr), part_(part), nparts_(nparts), first_(true)
+    {
+        ASSERT(part < nparts);
+    }
+
+    ~DurablePartIterator()
+    {
+        delete itr_;
+    }
+
+    // virtual from DurableIterator
+    int next()
+    {
+        size_t skip = first_ ? part_ : nparts_ - 1;
+        first_ = false;
+
+        for (size_t i = 0; i <= skip; ++i) {
+            int ret = itr_->next();
+            if (ret != DS_OK) {
+                return ret;
+            }
+        }
+        return DS_OK;
+    }
+
+    int get_key(SerializableObject* key)
+    {
+        return itr_->get_key(key);
+    }
+
+    int get_data(SerializableObject* data)
+    {
+        return itr_->get_data(data);
+    }
+
+    int get_data(SerializableObject**        data,
+                 TypeCollection::Allocator_t allocator)
+    {
+        return itr_->get_data(data, allocator);
+    }
+
+private:
+    DurableIterator* itr_;
+    size_t           part_;
+    size_t           nparts_;
+    bool             first_;
+};
@@ -32,10 +32,27 @@ public:
 
     /**
      * Constructor.
+     *
+     * With no shards (the default) the cache has a single lock and
+     * evicts in exact LRU order. Otherwise it is split by key hash
+     * into the given number of shards (rounded up to a power of two),
+     * each with its own lock and an equal share of the capacity, and
+     * evicts with CLOCK: a hit only sets the object's reference bit
+     * instead of moving it on a list, and eviction skips (and clears)
+     * referenced objects once.
+     *
+     * With admission set, the cache also keeps a TinyLFU-style
+     * frequency sketch of the keys it's asked for. When it's over
+     * capacity, an object that is seen less often than the eviction
+     * victim is the one that gets evicted (once it's released), so a
+     * scan through a table doesn't push out the objects in regular
+     * use.
      */
     DurableObjectCache(const char*   logpath,
                        size_t        capacity,
-                       CachePolicy_t policy = CAP_BY_SIZE);
+                       CachePolicy_t policy    = CAP_BY_SIZE,
+                       size_t        shards    = 0,
+                       bool          admission = false);
 
     /**
      * Destructor.
@@ -82,13 +99,15 @@ public:
     size_t flush();
 
     /// @{
-    /// Accessors
-    size_t size()   const { return size_; }
-    size_t count()  const { return cache_.size(); }
-    size_t live()   const { return cache_.size() - lru_.size(); }
-    int hits()      const { return hits_; }
-    int misses()    const { return misses_; }
-    int evictions() const { return evictions_; }
+    /// Accessors, summed over the shards
+    size_t size()       const;
+    size_t count()      const;
+    size_t live()       const;
+    int    hits()       const;
+    int    misses()     const;
+    int    evictions()  const;
+    int    rejections() const;  ///< newly cached objects evicted first
+    size_t num_shards() const { return shards_.size(); }
     /// @}
 
     /**
@@ -99,81 +118,152 @@ public:
     /**
      * Reset the cache statistics.
      */
-    void reset_stats()
-    {
-        hits_      = 0;
-        misses_    = 0;
-        evictions_ = 0;
-    }
+    void reset_stats();
 
 protected:
+    /// Scratch space for encoding a key
+    typedef ScratchBuffer<u_char*, 64> KeyBuf;
+
     /**
-     * Build a std::string to index the hash map.
-     */
-    void get_cache_key(std::string* cache_key, const SerializableObject& key);
-    
-    /**
-     * @return Whether or not the added item of size puts the cache
-     * over the capacity.
-     */
-    bool is_over_capacity(size_t size);
-    
-    /**
-     * Kick the least recently used element out of the cache.
+     * Build the key to index the hash map, with the key's binary
+     * encoding in buf. Only keys that are stored in the cache need to
+     * be copied into the arena.
      */
-    void evict_last();
+    void get_cache_key(CacheKey* cache_key, KeyBuf* buf,
+                       const SerializableObject& key);
+
+    struct CacheElement;
 
     /**
-     * The LRU list just stores the key for the object in the main
-     * cache table.
+     * The LRU list (when not using CLOCK) of the elements that aren't
+     * live, least recently released first.
      */
-    typedef LRUList<std::string> CacheLRUList;
+    typedef LRUList<CacheElement*> CacheLRUList;
     
     /**
      * Type for the cache table elements. 
      */
     struct CacheElement {
-        CacheElement(const _DataType* object, size_t object_size,
-                     bool live, CacheLRUList::iterator lru_iter)
-            
-            : object_(object),
+        CacheElement(const CacheKey& key, const _DataType* object,
+                     size_t object_size)
+            : key_(key),
+              object_(object),
               object_size_(object_size),
-              live_(live),
-              lru_iter_(lru_iter) {}
+              live_(true),
+              ref_(true),
+              slot_(0) {}
 
+        CacheKey               key_;    ///< the table's copy of the key
         const _DataType*       object_;
         size_t                 object_size_;
         bool                   live_;
-        CacheLRUList::iterator lru_iter_;
+        bool                   ref_;    ///< CLOCK reference bit
+        size_t                 slot_;   ///< CLOCK position in the ring
+        typename CacheLRUList::iterator lru_iter_;
     };
 
     /**
      * The cache table.
      */
-    class CacheTable : public StringHashMap<CacheElement*> {};
+    class CacheTable : public _std::unordered_map<CacheKey, CacheElement*,
+                                                  CacheKeyHash,
+                                                  CacheKeyEquals> {};
     typedef std::pair<typename CacheTable::iterator, bool> CacheInsertRet;
 
-    size_t size_;	///< The current size of the cache
+    /**
+     * One independently locked part of the cache. Without sharding
+     * there's just the one.
+     */
+    struct Shard {
+        Shard()
+            : size_(0), live_(0), hits_(0), misses_(0), evictions_(0),
+              rejections_(0), hand_(0), sketch_(0) {}
+        ~Shard() { delete sketch_; }
+
+        SpinLock      lock_;    ///< Lock to protect the shard
+        CacheTable    cache_;   ///< The object cache table
+        CacheKeyArena arena_;   ///< Holds the keys in cache_
+        CacheLRUList  lru_;     ///< The LRU list of objects
+
+        size_t size_;           ///< The current size of the shard
+        size_t live_;           ///< Number of live objects
+        int    hits_;           ///< Number of times the cache hits
+        int    misses_;         ///< Number of times the cache misses
+        int    evictions_;      ///< Number of times the cache evicted an object
+        int    rejections_;     ///< Number of times admission evicted
+                                ///  the newer object
+
+        /// The CLOCK ring of all the elements, with NULL holes
+        std::vector<CacheElement*> ring_;
+        std::vector<size_t>        free_slots_;
+        size_t                     hand_;
+
+        CacheFrequencySketch* sketch_; ///< Only used for admission
+    };
+
+    /// @return the shard for the given key
+    Shard* get_shard(const CacheKey& key)
+    {
+        if (shard_shift_ == 32) {
+            return shards_[0];
+        }
+        return shards_[(key.hash() * 0x9E3779B1U) >> shard_shift_];
+    }
+    
+    /**
+     * @return Whether or not the added item of size puts the shard
+     * over its share of the capacity.
+     */
+    bool is_over_capacity(Shard* shard, size_t size);
+    
+    /**
+     * @return the next element to evict from the shard, or NULL if
+     * everything is live.
+     */
+    CacheElement* find_victim(Shard* shard);
+
+    /**
+     * Take an element out of the shard, deleting the object if
+     * delete_object is set.
+     */
+    void erase(Shard* shard, CacheElement* cache_elem, bool delete_object);
+
+    /**
+     * Evict an element that isn't live.
+     */
+    void evict(Shard* shard, CacheElement* cache_elem);
+
+    /// @return whether admission prefers evicting candidate to victim
+    bool colder(Shard* shard, CacheElement* candidate, CacheElement* victim);
+
     size_t capacity_;	///< The maximum size of the cache
-    int hits_;		///< Number of times the cache hits
-    int misses_;	///< Number of times the cache misses
-    int evictions_;	///< Number of times the cache evicted an object
-    CacheLRUList lru_;	///< The LRU List of objects
-    CacheTable cache_;	///< The object cache table
-    SpinLock* lock_;	///< Lock to protect the in-memory cache
+    size_t shard_capacity_; ///< The maximum size of each shard
     CachePolicy_t policy_; ///< Cache policy (see enum above)
+    bool clock_;        ///< Evict with CLOCK instead of LRU
+    bool admission_;    ///< Use the frequency sketch to pick victims
+    std::vector<Shard*> shards_; ///< The shards
+    u_int32_t shard_shift_;	///< Shift of a hash to get its shard
 
 public:
+    class iterator;
+    friend class iterator;
+
     /**
      * Class to represent a cache iterator and still hide the
      * implementation details of the cache table structure.
      */
     class iterator {
     public:
-        iterator() {}
-        iterator(const typename CacheTable::iterator& i) : iter_(i) {}
+        iterator() : cache_(0), shard_(0) {}
         
-        const std::string& key()         { return iter_->first; }
+        /// The binary encoding of the key
+        std::string key()
+        {
+            return std::string(reinterpret_cast<const char*>(
+                                   iter_->first.data()),
+                               iter_->first.len());
+        }
+
         bool               live()        { return iter_->second->live_; }
         const _DataType*   object()      { return iter_->second->object_; }
         size_t             object_size() { return iter_->second->object_size_; }
@@ -181,34 +271,59 @@ public:
         const iterator& operator++()
         {
             iter_++;
+            skip_empty();
             return *this;
         }
 
         bool operator==(const iterator& other)
         {
-            return iter_ == other.iter_;
+            return shard_ == other.shard_ &&
+                (shard_ == cache_->shards_.size() || iter_ == other.iter_);
         }
         
         bool operator!=(const iterator& other)
         {
-            return iter_ != other.iter_;
+            return ! (*this == other);
         }
         
     protected:
         friend class DurableObjectCache;
+
+        iterator(DurableObjectCache* cache, size_t shard)
+            : cache_(cache), shard_(shard)
+        {
+            if (shard_ < cache_->shards_.size()) {
+                iter_ = cache_->shards_[shard_]->cache_.begin();
+                skip_empty();
+            }
+        }
+
+        /// Move on past the end of each shard's table
+        void skip_empty()
+        {
+            while (iter_ == cache_->shards_[shard_]->cache_.end()) {
+                if (++shard_ == cache_->shards_.size()) {
+                    break;
+                }
+                iter_ = cache_->shards_[shard_]->cache_.begin();
+            }
+        }
+
+        DurableObjectCache*           cache_;
+        size_t                        shard_;
         typename CacheTable::iterator iter_;
     };
 
     /// Return an iterator at the beginning of the cache.
     iterator begin()
     {
-        return iterator(cache_.begin());
+        return iterator(this, 0);
     }
     
     /// Return an iterator at the end of the cache.
     iterator end()
     {
-        return iterator(cache_.end());
+        return iterator(this, shards_.size());
     }
 
 };
@@ -23,25 +23,49 @@
 template <typename _DataType>
 DurableObjectCache<_DataType>::DurableObjectCache(const char*   logpath,
                                                   size_t        capacity,
-                                                  CachePolicy_t policy)
+                                                  CachePolicy_t policy,
+                                                  size_t        shards,
+                                                  bool          admission)
     : Logger("DurableObjectCache", logpath),
-      size_(0), 
       capacity_(capacity),
-      hits_(0), 
-      misses_(0), 
-      evictions_(0), 
-      lock_(new SpinLock()),
-      policy_(policy)
+      policy_(policy),
+      clock_(shards != 0),
+      admission_(admission),
+      shard_shift_(32)
 {
-    log_debug("init capacity=%zu", capacity);
+    size_t nshards = 1;
+    while (nshards < shards) {
+        nshards *= 2;
+        --shard_shift_;
+    }
+
+    shard_capacity_ = capacity / nshards;
+    if (shard_capacity_ == 0) {
+        shard_capacity_ = 1;
+    }
+
+    for (size_t i = 0; i < nshards; ++i) {
+        Shard* shard = new Shard();
+        if (admission_) {
+            // count capacity is a fair guess at how many keys to track
+            shard->sketch_ = new CacheFrequencySketch(
+                policy_ == CAP_BY_COUNT ? 2 * shard_capacity_ : 4096);
+        }
+        shards_.push_back(shard);
+    }
+
+    log_debug("init capacity=%zu shards=%zu%s%s", capacity, nshards,
+              clock_ ? " clock" : "", admission_ ? " admission" : "");
 }
 
 //----------------------------------------------------------------------------
 template <typename _DataType>
 DurableObjectCache<_DataType>::~DurableObjectCache()
 {
-    delete(lock_);
-    lock_ = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        delete shards_[i];
+    }
+    shards_.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -61,34 +85,78 @@ DurableObjectCache<_DataType>::get_stats(StringBuffer* buf)
                  hits(),
                  misses(),
                  evictions());
+
+    if (admission_) {
+        buf->appendf(" -- %u rejections", rejections());
+    }
+}
+
+//----------------------------------------------------------------------------
+template <typename _DataType>
+void
+DurableObjectCache<_DataType>::reset_stats()
+{
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        ScopeLock l(&shards_[i]->lock_, "DurableObjectCache::reset_stats");
+        shards_[i]->hits_       = 0;
+        shards_[i]->misses_     = 0;
+        shards_[i]->evictions_  = 0;
+        shards_[i]->rejections_ = 0;
+    }
+}
+
+//----------------------------------------------------------------------------
+// The stats are kept per shard, under its lock, so each shard's are
+// exact and the sums are exact whenever the cache is quiet.
+#define DURABLE_OBJECT_CACHE_SUM(_type, _fn, _expr)     \
+template <typename _DataType>                           \
+_type                                                   \
+DurableObjectCache<_DataType>::_fn() const              \
+{                                                       \
+    _type total = 0;                                    \
+    for (size_t i = 0; i < shards_.size(); ++i) {       \
+        const Shard* shard = shards_[i];                \
+        total += _expr;                                 \
+    }                                                   \
+    return total;                                       \
 }
+
+DURABLE_OBJECT_CACHE_SUM(size_t, size,       shard->size_)
+DURABLE_OBJECT_CACHE_SUM(size_t, count,      shard->cache_.size())
+DURABLE_OBJECT_CACHE_SUM(size_t, live,       shard->live_)
+DURABLE_OBJECT_CACHE_SUM(int,    hits,       shard->hits_)
+DURABLE_OBJECT_CACHE_SUM(int,    misses,     shard->misses_)
+DURABLE_OBJECT_CACHE_SUM(int,    evictions,  shard->evictions_)
+DURABLE_OBJECT_CACHE_SUM(int,    rejections, shard->rejections_)
+
+#undef DURABLE_OBJECT_CACHE_SUM
                                              
 //----------------------------------------------------------------------------
 template <typename _DataType>
 void
-DurableObjectCache<_DataType>::get_cache_key(std::string* cache_key,
+DurableObjectCache<_DataType>::get_cache_key(CacheKey* cache_key,
+                                             KeyBuf* buf,
                                              const SerializableObject& key)
 {
-    StringSerialize serialize(Serialize::CONTEXT_LOCAL,
-                              StringSerialize::DOT_SEPARATED);
-    if (serialize.action(&key) != 0) {
-        PANIC("error sizing key");
+    CacheKeyEncoder encoder(buf);
+    if (encoder.action(&key) != 0) {
+        PANIC("error encoding key");
     }
 
-    cache_key->assign(serialize.buf().data(), serialize.buf().length());
+    cache_key->init(buf->buf(), buf->len());
 }
 
 //----------------------------------------------------------------------------
 template <typename _DataType>
 bool 
-DurableObjectCache<_DataType>::is_over_capacity(size_t size)
+DurableObjectCache<_DataType>::is_over_capacity(Shard* shard, size_t size)
 {
     switch (policy_) 
     {
     case CAP_BY_SIZE:
-        return (size_ + size) > capacity_;
+        return (shard->size_ + size) > shard_capacity_;
     case CAP_BY_COUNT:
-        return (count() + 1) > capacity_;
+        return (shard->cache_.size() + 1) > shard_capacity_;
     }
     
     NOTREACHED;
@@ -96,41 +164,98 @@ DurableObjectCache<_DataType>::is_over_capacity(size_t size)
 
 //----------------------------------------------------------------------------
 template <typename _DataType>
-void
-DurableObjectCache<_DataType>::evict_last()
+typename DurableObjectCache<_DataType>::CacheElement*
+DurableObjectCache<_DataType>::find_victim(Shard* shard)
 {
-    typename CacheTable::iterator cache_iter;
-    CacheLRUList::iterator lru_iter;
+    ASSERT(shard->lock_.is_locked_by_me());
+
+    if (! clock_) {
+        return shard->lru_.empty() ? NULL : shard->lru_.front();
+    }
 
-    ASSERT(lock_->is_locked_by_me());
+    // Two trips around the ring will clear every reference bit, so
+    // if there's nothing by then, everything is live
+    std::vector<CacheElement*>& ring = shard->ring_;
+    for (size_t n = 0; n < 2 * ring.size(); ++n) {
+        if (shard->hand_ >= ring.size()) {
+            shard->hand_ = 0;
+        }
 
-    ASSERT(!lru_.empty());
-    
-    lru_iter = lru_.begin();
-    ASSERT(lru_iter != lru_.end());
+        CacheElement* cache_elem = ring[shard->hand_++];
+        if (cache_elem == NULL || cache_elem->live_) {
+            continue;
+        }
+        if (cache_elem->ref_) {
+            cache_elem->ref_ = false;
+            continue;
+        }
+        return cache_elem;
+    }
 
-    cache_iter = cache_.find(*lru_iter);
-    ASSERT(cache_iter != cache_.end());
+    return NULL;
+}
 
-    CacheElement* cache_elem = cache_iter->second;
+//----------------------------------------------------------------------------
+template <typename _DataType>
+bool
+DurableObjectCache<_DataType>::colder(Shard*        shard,
+                                      CacheElement* candidate,
+                                      CacheElement* victim)
+{
+    return admission_ &&
+        shard->sketch_->estimate(candidate->key_.hash()) <
+        shard->sketch_->estimate(victim->key_.hash());
+}
+
+//----------------------------------------------------------------------------
+template <typename _DataType>
+void
+DurableObjectCache<_DataType>::erase(Shard*        shard,
+                                     CacheElement* cache_elem,
+                                     bool          delete_object)
+{
+    ASSERT(shard->lock_.is_locked_by_me());
+
+    typename CacheTable::iterator cache_iter =
+        shard->cache_.find(cache_elem->key_);
+    ASSERT(cache_iter != shard->cache_.end());
+    ASSERT(cache_iter->second == cache_elem);
+    shard->cache_.erase(cache_iter);
+
+    if (clock_) {
+        shard->ring_[cache_elem->slot_] = NULL;
+        shard->free_slots_.push_back(cache_elem->slot_);
+    } else if (! cache_elem->live_) {
+        shard->lru_.erase(cache_elem->lru_iter_);
+    }
+
+    if (cache_elem->live_) {
+        --shard->live_;
+    }
+    shard->size_ -= cache_elem->object_size_;
+    shard->arena_.release(cache_elem->key_);
+
+    if (delete_object) {
+        delete cache_elem->object_;
+    }
+    delete cache_elem;
+}
+
+//----------------------------------------------------------------------------
+template <typename _DataType>
+void
+DurableObjectCache<_DataType>::evict(Shard* shard, CacheElement* cache_elem)
+{
     ASSERT(cache_elem->object_ != NULL);
-    ASSERT(cache_elem->lru_iter_ == lru_iter);
     ASSERT(!cache_elem->live_);
 
     log_debug("cache (capacity %zu/%zu) -- "
               "evicting key '%s' object %p size %zu",
-              size_, capacity_, lru_iter->c_str(),
+              shard->size_, shard_capacity_, cache_elem->key_.str().c_str(),
               cache_elem->object_, cache_elem->object_size_);
     
-    cache_.erase(cache_iter);
-    lru_.pop_front();
-
-    size_ -= cache_elem->object_size_;
-    
-    evictions_++;
-    
-    delete cache_elem->object_;
-    delete cache_elem;
+    shard->evictions_++;
+    erase(shard, cache_elem, true);
 }
 
 //----------------------------------------------------------------------------
@@ -140,35 +265,39 @@ DurableObjectCache<_DataType>::put(const SerializableObject& key,
                                    const _DataType* object,
                                    int flags)
 {
-    ScopeLock l(lock_, "DurableObjectCache::put");
+    KeyBuf key_buf;
+    CacheKey cache_key;
+    get_cache_key(&cache_key, &key_buf, key);
+
+    Shard* shard = get_shard(cache_key);
+    ScopeLock l(&shard->lock_, "DurableObjectCache::put");
     
     CacheElement* cache_elem;
     
-    typename CacheTable::iterator cache_iter;
-    CacheLRUList::iterator lru_iter;
-    
-    std::string cache_key;
-    get_cache_key(&cache_key, key);
+    if (admission_) {
+        shard->sketch_->increment(cache_key.hash());
+    }
 
     // first check if the object exists in the cache
-    cache_iter = cache_.find(cache_key);
+    typename CacheTable::iterator cache_iter = shard->cache_.find(cache_key);
     
-    if (cache_iter != cache_.end()) {
+    if (cache_iter != shard->cache_.end()) {
         cache_elem = cache_iter->second;
 
         if (flags & DS_EXCL) {
             log_debug("put(%s): object already exists and DS_EXCL set",
-                      cache_key.c_str());
+                      cache_key.str().c_str());
             return DS_EXISTS;
         }
         
         if (cache_elem->object_ == object) {
-            log_debug("put(%s): object already exists", cache_key.c_str());
+            log_debug("put(%s): object already exists",
+                      cache_key.str().c_str());
             return DS_OK;
 
         } else {
             PANIC("put(%s): cannot handle different objects %p %p for same key",
-                  cache_key.c_str(), object, cache_elem->object_);
+                  cache_key.str().c_str(), object, cache_elem->object_);
         }
     }
 
@@ -184,26 +313,32 @@ DurableObjectCache<_DataType>::put(const SerializableObject& key,
     size_t object_size = sizer.size();
 
     log_debug("put(%s): object %p size %zu",
-              cache_key.c_str(), object, object_size);
+              cache_key.str().c_str(), object, object_size);
+
+    cache_elem = new CacheElement(cache_key, object, object_size);
+    shard->arena_.store(&cache_elem->key_);
 
     // now try to evict elements if the new object will put us over
     // the cache capacity
-    while (is_over_capacity(object_size)) 
+    while (is_over_capacity(shard, object_size)) 
     {
-        if (lru_.empty()) 
+        CacheElement* victim = find_victim(shard);
+        if (victim == NULL) 
         {
             switch (policy_) {
             case CAP_BY_SIZE:
                 log_warn("cache already at capacity "
                          "(size %zu, object_size %zu, capacity %zu) "
                          "but all %zu elements are live",
-                         size_, object_size, capacity_, cache_.size());
+                         shard->size_, object_size, shard_capacity_,
+                         shard->cache_.size());
                 break;
             case CAP_BY_COUNT:
                 log_warn("cache already at capacity "
                          "(count %zu, capacity %zu) "
                          "but all %zu elements are live",
-                         count(), capacity_, cache_.size());
+                         shard->cache_.size(), shard_capacity_,
+                         shard->cache_.size());
                 break;
             default:
                 NOTREACHED;
@@ -211,20 +346,38 @@ DurableObjectCache<_DataType>::put(const SerializableObject& key,
             break;
         }
 
-        evict_last();
+        if (colder(shard, cache_elem, victim)) {
+            // leave the victim be, and let the new object go as soon
+            // as it's released
+            log_debug("put(%s): over capacity but keeping key '%s'",
+                      cache_key.str().c_str(), victim->key_.str().c_str());
+            break;
+        }
+
+        evict(shard, victim);
     }
 
-    // now cons up an element linking to the object and put it in the
-    // cache, but not the LRU list since the object is assumed to be
-    // live
-    cache_elem = new CacheElement(object, object_size, true, lru_iter);
-    typename CacheTable::value_type val(cache_key, cache_elem);
-    CacheInsertRet ret = cache_.insert(val);
+    // now put the element in the cache, but not the LRU list since
+    // the object is assumed to be live
+    typename CacheTable::value_type val(cache_elem->key_, cache_elem);
+    CacheInsertRet ret = shard->cache_.insert(val);
 
     ASSERT(ret.second == true);
-    ASSERT(cache_.find(cache_key) != cache_.end());
+    ASSERT(shard->cache_.find(cache_key) != shard->cache_.end());
 
-    size_ += object_size;
+    if (clock_) {
+        if (shard->free_slots_.empty()) {
+            cache_elem->slot_ = shard->ring_.size();
+            shard->ring_.push_back(cache_elem);
+        } else {
+            cache_elem->slot_ = shard->free_slots_.back();
+            shard->free_slots_.pop_back();
+            shard->ring_[cache_elem->slot_] = cache_elem;
+        }
+    }
+
+    shard->size_ += object_size;
+    ++shard->live_;
 
     return DS_OK;
 }
@@ -235,33 +388,43 @@ int
 DurableObjectCache<_DataType>::get(const SerializableObject& key,
                                    _DataType** objectp)
 {
-    ScopeLock l(lock_, "DurableObjectCache::get");
+    KeyBuf key_buf;
+    CacheKey cache_key;
+    get_cache_key(&cache_key, &key_buf, key);
+
+    Shard* shard = get_shard(cache_key);
+    ScopeLock l(&shard->lock_, "DurableObjectCache::get");
 
-    std::string cache_key;
-    get_cache_key(&cache_key, key);
+    if (admission_) {
+        shard->sketch_->increment(cache_key.hash());
+    }
 
-    typename CacheTable::iterator cache_iter = cache_.find(cache_key);
+    typename CacheTable::iterator cache_iter = shard->cache_.find(cache_key);
     
-    if (cache_iter == cache_.end()) {
-        log_debug("get(%s): no match", cache_key.c_str());
-        ++misses_;
+    if (cache_iter == shard->cache_.end()) {
+        log_debug("get(%s): no match", cache_key.str().c_str());
+        ++shard->misses_;
         return DS_NOTFOUND;
     } 
 
-    ++hits_;
+    ++shard->hits_;
 
     CacheElement* cache_elem = cache_iter->second;
+    cache_elem->ref_ = true;
 
     if (! cache_elem->live_) {
         cache_elem->live_ = true;
-        CacheLRUList::iterator lru_iter = cache_elem->lru_iter_;
-        ASSERT(lru_iter != lru_.end());
-        ASSERT(*lru_iter == cache_key);
-        lru_.erase(lru_iter);
+        ++shard->live_;
+        if (! clock_) {
+            typename CacheLRUList::iterator lru_iter = cache_elem->lru_iter_;
+            ASSERT(lru_iter != shard->lru_.end());
+            ASSERT(*lru_iter == cache_elem);
+            shard->lru_.erase(lru_iter);
+        }
     }
     
     *objectp = const_cast<_DataType*>(cache_elem->object_);
-    log_debug("get(%s): match %p", cache_key.c_str(), *objectp);
+    log_debug("get(%s): match %p", cache_key.str().c_str(), *objectp);
 
     return DS_OK;
 }
@@ -271,24 +434,26 @@ template <typename _DataType>
 bool
 DurableObjectCache<_DataType>::is_live(const SerializableObject& key)
 {
-    ScopeLock l(lock_, "DurableObjectCache::is_live");
-    
-    std::string cache_key;
-    get_cache_key(&cache_key, key);
+    KeyBuf key_buf;
+    CacheKey cache_key;
+    get_cache_key(&cache_key, &key_buf, key);
 
-    typename CacheTable::iterator cache_iter = cache_.find(cache_key);
+    Shard* shard = get_shard(cache_key);
+    ScopeLock l(&shard->lock_, "DurableObjectCache::is_live");
+    
+    typename CacheTable::iterator cache_iter = shard->cache_.find(cache_key);
     
-    if (cache_iter == cache_.end()) {
-        log_debug("is_live(%s): no element", cache_key.c_str());
+    if (cache_iter == shard->cache_.end()) {
+        log_debug("is_live(%s): no element", cache_key.str().c_str());
         return false;
     } 
 
     CacheElement* cache_elem = cache_iter->second;
     if (cache_elem->live_) {
-        log_debug("is_live(%s): live", cache_key.c_str());
+        log_debug("is_live(%s): live", cache_key.str().c_str());
         return true;
     } else {
-        log_debug("is_live(%s): not live", cache_key.c_str());
+        log_debug("is_live(%s): not live", cache_key.str().c_str());
         return false;
     }
 }
@@ -299,16 +464,18 @@ int
 DurableObjectCache<_DataType>::release(const SerializableObject& key,
                                        const _DataType* data)
 {
-    ScopeLock l(lock_, "DurableObjectCache::release");
+    KeyBuf key_buf;
+    CacheKey cache_key;
+    get_cache_key(&cache_key, &key_buf, key);
 
-    std::string cache_key;
-    get_cache_key(&cache_key, key);
+    Shard* shard = get_shard(cache_key);
+    ScopeLock l(&shard->lock_, "DurableObjectCache::release");
     
-    typename CacheTable::iterator cache_iter = cache_.find(cache_key);
+    typename CacheTable::iterator cache_iter = shard->cache_.find(cache_key);
 
-    if (cache_iter == cache_.end()) {
+    if (cache_iter == shard->cache_.end()) {
         log_err("release(%s): no match for object %p",
-                cache_key.c_str(), data);
+                cache_key.str().c_str(), data);
         return DS_ERR;
     }
 
@@ -317,22 +484,33 @@ DurableObjectCache<_DataType>::release(const SerializableObject& key,
 
     if (! cache_elem->live_) {
         log_err("release(%s): release object %p already on LRU list!!",
-                cache_key.c_str(), data);
+                cache_key.str().c_str(), data);
 	Breaker::break_here();
-        lru_.move_to_back(cache_elem->lru_iter_);
+        if (! clock_) {
+            shard->lru_.move_to_back(cache_elem->lru_iter_);
+        }
     } else {
-        log_debug("release(%s): release object %p", cache_key.c_str(), data);
-        lru_.push_back(cache_key);
+        log_debug("release(%s): release object %p",
+                  cache_key.str().c_str(), data);
         cache_elem->live_ = false;
-        cache_elem->lru_iter_ = --lru_.end();
-        ASSERT(*cache_elem->lru_iter_ == cache_key);
+        --shard->live_;
+        if (! clock_) {
+            shard->lru_.push_back(cache_elem);
+            cache_elem->lru_iter_ = --shard->lru_.end();
+            ASSERT(*cache_elem->lru_iter_ == cache_elem);
+        }
     }
 
-    if (is_over_capacity(0)) 
+    if (is_over_capacity(shard, 0)) 
     {
         log_debug("release while over capacity, evicting stale object");
-        // ASSERT(lru_.size() == 1);
-        evict_last();
+        CacheElement* victim = find_victim(shard);
+        ASSERT(victim != NULL);
+        if (victim != cache_elem && colder(shard, cache_elem, victim)) {
+            ++shard->rejections_;
+            victim = cache_elem;
+        }
+        evict(shard, victim);
     }
     
     return DS_OK;
@@ -343,15 +521,17 @@ template <typename _DataType>
 int
 DurableObjectCache<_DataType>::del(const SerializableObject& key)
 {
-    ScopeLock l(lock_, "DurableObjectCache::del");
+    KeyBuf key_buf;
+    CacheKey cache_key;
+    get_cache_key(&cache_key, &key_buf, key);
 
-    std::string cache_key;
-    get_cache_key(&cache_key, key);
+    Shard* shard = get_shard(cache_key);
+    ScopeLock l(&shard->lock_, "DurableObjectCache::del");
     
-    typename CacheTable::iterator cache_iter = cache_.find(cache_key);
+    typename CacheTable::iterator cache_iter = shard->cache_.find(cache_key);
 
-    if (cache_iter == cache_.end()) {
-        log_debug("del(%s): no match for key", cache_key.c_str());
+    if (cache_iter == shard->cache_.end()) {
+        log_debug("del(%s): no match for key", cache_key.str().c_str());
         return DS_NOTFOUND;
     }
     
@@ -359,22 +539,16 @@ DurableObjectCache<_DataType>::del(const SerializableObject& key)
     
     if (cache_elem->live_) {
         log_err("del(%s): can't remove live object %p size %zu from cache",
-                cache_key.c_str(), cache_elem->object_,
+                cache_key.str().c_str(), cache_elem->object_,
                 cache_elem->object_size_);
         return DS_ERR;
-        
-    } else {
-        lru_.erase(cache_elem->lru_iter_);
-        log_debug("del(%s): removing non-live object %p size %zu from cache",
-                  cache_key.c_str(), cache_elem->object_,
-                  cache_elem->object_size_);
     }
-    
-    cache_.erase(cache_iter);
-    size_ -= cache_elem->object_size_;
 
-    delete cache_elem->object_;
-    delete cache_elem;
+    log_debug("del(%s): removing non-live object %p size %zu from cache",
+              cache_key.str().c_str(), cache_elem->object_,
+              cache_elem->object_size_);
+    
+    erase(shard, cache_elem, true);
     return DS_OK;
 }
 
@@ -386,36 +560,28 @@ DurableObjectCache<_DataType>::remove(const SerializableObject& key,
 {
     (void)data;
     
-    ScopeLock l(lock_, "DurableObjectCache::remove");
+    KeyBuf key_buf;
+    CacheKey cache_key;
+    get_cache_key(&cache_key, &key_buf, key);
 
-    std::string cache_key;
-    get_cache_key(&cache_key, key);
+    Shard* shard = get_shard(cache_key);
+    ScopeLock l(&shard->lock_, "DurableObjectCache::remove");
     
-    typename CacheTable::iterator cache_iter = cache_.find(cache_key);
+    typename CacheTable::iterator cache_iter = shard->cache_.find(cache_key);
 
-    if (cache_iter == cache_.end()) {
-        log_debug("remove(%s): no match for key", cache_key.c_str());
+    if (cache_iter == shard->cache_.end()) {
+        log_debug("remove(%s): no match for key", cache_key.str().c_str());
         return DS_NOTFOUND;
     }
     
     CacheElement* cache_elem = cache_iter->second;
     
-    if (cache_elem->live_) {
-        log_debug("del(%s): removing live object %p size %zu from cache",
-                  cache_key.c_str(), cache_elem->object_,
-                  cache_elem->object_size_);
-        
-    } else {
-        lru_.erase(cache_elem->lru_iter_);
-        log_debug("del(%s): removing non-live object %p size %zu from cache",
-                  cache_key.c_str(), cache_elem->object_,
-                  cache_elem->object_size_);
-    }
+    log_debug("del(%s): removing %s object %p size %zu from cache",
+              cache_key.str().c_str(), 
+              cache_elem->live_ ? "live" : "non-live",
+              cache_elem->object_, cache_elem->object_size_);
     
-    cache_.erase(cache_iter);
-    size_ -= cache_elem->object_size_;
-
-    delete cache_elem;
+    erase(shard, cache_elem, false);
     return DS_OK;
 }
 
@@ -424,12 +590,26 @@ template <typename _DataType>
 size_t
 DurableObjectCache<_DataType>::flush()
 {
-    ScopeLock l(lock_, "DurableObjectCache::flush");
     size_t count = 0;
-    while (!lru_.empty()) {
-        evict_last();
-        ++count;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        Shard* shard = shards_[i];
+        ScopeLock l(&shard->lock_, "DurableObjectCache::flush");
+
+        if (! clock_) {
+            while (!shard->lru_.empty()) {
+                evict(shard, shard->lru_.front());
+                ++count;
+            }
+            continue;
+        }
+
+        for (size_t j = 0; j < shard->ring_.size(); ++j) {
+            CacheElement* cache_elem = shard->ring_[j];
+            if (cache_elem != NULL && ! cache_elem->live_) {
+                evict(shard, cache_elem);
+                ++count;
+            }
+        }
     }
     return count;
 }
-
@@ -31,8 +31,11 @@
 #include "ODBCSQLite.h"
 #include "ODBCStore.h"
 #include "FileSystemStore.h"
+#include "GroupCommitter.h"
+#include "LogStore.h"
 #include "MemoryStore.h"
 #include "StorageConfig.h"
+#include "../thread/Thread.h"
 
 namespace oasys {
 
@@ -41,9 +44,20 @@ DurableStore* Singleton<DurableStore, false>::instance_ = NULL;
 
 DurableStore::~DurableStore()
 { 
+    if (group_commit_ != 0) {
+        impl_->set_group_committer(0);
+    }
+    delete group_commit_;
+    group_commit_ = 0;
+
     delete impl_; 
     impl_ = 0;
 
+    // allow a new store to be created after this one goes away
+    if (instance_ == this) {
+        instance_ = NULL;
+    }
+
     if (clean_shutdown_file_ != "") {
         // try to remove it if it exists
         unlink(clean_shutdown_file_.c_str());
@@ -85,6 +99,12 @@ DurableStore::create_store(const StorageConfig& config,
         impl_ = new MemoryStore(logpath_);
     }
 
+    // log structured store
+    else if (config.type_ == "logdb")
+    {
+        impl_ = new LogStore(logpath_);
+    }
+
 #if LIBDB_ENABLED
     // berkeley db
     else if (config.type_ == "berkeleydb")
@@ -137,6 +157,13 @@ DurableStore::create_store(const StorageConfig& config,
         return DS_ERR;
     }
 
+    if (config.group_commit_) {
+        group_commit_ = new GroupCommitter(logpath_, impl_,
+                                           config.group_commit_latency_ms_,
+                                           config.group_commit_max_batch_);
+        impl_->set_group_committer(group_commit_);
+    }
+
     if (config.leave_clean_file_) {
         clean_shutdown_file_ = config.dbdir_;
         clean_shutdown_file_ += "/.ds_clean";
@@ -235,7 +262,16 @@ DurableStore::end_transaction()
     	log_debug("DurableStore::EndTranaction: Committing this time.");
     }
 
-    ret = impl_->end_transaction(open_txid_, durably_close_next_transaction_);
+    if (durably_close_next_transaction_ && group_commit_ != 0) {
+        // close it lazily and let the committer batch the flush with
+        // other threads' commits
+        ret = impl_->end_transaction(open_txid_, false);
+        if (ret == DS_OK) {
+            ret = group_commit_->commit();
+        }
+    } else {
+        ret = impl_->end_transaction(open_txid_, durably_close_next_transaction_);
+    }
     open_txid_ = NULL;
     log_debug("DurableStore::end_transaction - releasing transaction lock.");
     // transaction_lock_.unlock();
@@ -252,6 +288,18 @@ DurableStore::end_transaction()
 
 }
 
+//----------------------------------------------------------------------------
+int
+DurableStore::sync()
+{
+    ASSERT(impl_ != NULL);
+
+    if (group_commit_ != 0) {
+        return group_commit_->commit();
+    }
+    return impl_->sync();
+}
+
 //----------------------------------------------------------------------------
 int
 DurableStore::is_transaction_open()
@@ -306,6 +354,121 @@ DurableStore::get_info() const
     return impl_->get_info();
 }
 
+//----------------------------------------------------------------------------
+/**
+ * A worker for DurableStore::load_tables(). The workers share a list
+ * of (loader, part) tasks and keep taking the next one off it until
+ * there are none left.
+ */
+class DurableStoreLoadThread : public Thread {
+public:
+    struct Task {
+        DurableTableLoader* loader_;
+        size_t              part_;
+    };
+    typedef std::vector<Task> TaskVector;
+
+    DurableStoreLoadThread(const TaskVector* tasks, atomic_t* next,
+                           atomic_t* failed)
+        : Thread("DurableStoreLoadThread", CREATE_JOINABLE),
+          tasks_(tasks), next_(next), failed_(failed) {}
+
+    /// Run a single task. @return true if it succeeded
+    static bool run_task(const Task& task)
+    {
+        DurableTableLoader* loader = task.loader_;
+        DurableIterator* iter = (loader->parts() == 1) ?
+                                loader->table()->bulk_itr() :
+                                loader->table()->part_itr(task.part_,
+                                                          loader->parts());
+        int err = loader->load(iter);
+        delete iter;
+        return err == DS_OK;
+    }
+
+protected:
+    void run()
+    {
+        while (true) {
+            u_int32_t i = atomic_incr_ret(next_) - 1;
+            if (i >= tasks_->size()) {
+                return;
+            }
+            if (! run_task((*tasks_)[i])) {
+                atomic_incr(failed_);
+            }
+        }
+    }
+
+    const TaskVector* tasks_;
+    atomic_t*         next_;
+    atomic_t*         failed_;
+};
+
+//----------------------------------------------------------------------------
+int
+DurableStore::load_tables(const std::vector<DurableTableLoader*>& loaders,
+                          size_t nthreads)
+{
+    ASSERT(impl_ != NULL);
+
+    DurableStoreLoadThread::TaskVector tasks;
+    u_int32_t errors_before = 0;
+    for (size_t i = 0; i < loaders.size(); ++i) {
+        errors_before += loaders[i]->errors();
+        for (size_t part = 0; part < loaders[i]->parts(); ++part) {
+            DurableStoreLoadThread::Task task;
+            task.loader_ = loaders[i];
+            task.part_   = part;
+            tasks.push_back(task);
+        }
+    }
+
+    if (! impl_->concurrent_reads()) {
+        nthreads = 1;
+    }
+    if (nthreads > tasks.size()) {
+        nthreads = tasks.size();
+    }
+
+    log_debug("load_tables: %zu tables in %zu parts, %zu threads",
+              loaders.size(), tasks.size(), nthreads);
+
+    atomic_t next(0);
+    atomic_t failed(0);
+    if (nthreads <= 1) {
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            if (! DurableStoreLoadThread::run_task(tasks[i])) {
+                atomic_incr(&failed);
+            }
+        }
+    } else {
+        std::vector<DurableStoreLoadThread*> threads;
+        for (size_t i = 0; i < nthreads; ++i) {
+            threads.push_back(
+                new DurableStoreLoadThread(&tasks, &next, &failed));
+            threads.back()->start();
+        }
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i]->join();
+            delete threads[i];
+        }
+    }
+
+    u_int32_t errors = 0;
+    for (size_t i = 0; i < loaders.size(); ++i) {
+        errors += loaders[i]->errors();
+    }
+
+    if (failed.value != 0 || errors != errors_before) {
+        log_err("load_tables: %u parts failed, %u objects unreadable",
+                failed.value, errors - errors_before);
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
 //----------------------------------------------------------------------------
 void
 DurableStore::make_transaction_durable()
@@ -21,6 +21,7 @@
 #include <list>
 #include <stack>
 #include <string>
+#include <vector>
 
 
 #include "../debug/Log.h"
@@ -31,6 +32,7 @@
 #include "../serialize/StringSerialize.h"
 #include "../serialize/TypeCollection.h"
 
+#include "../thread/Atomic.h"
 #include "../thread/SpinLock.h"
 
 #include "../util/LRUList.h"
@@ -38,19 +40,23 @@
 #include "../util/ScratchBuffer.h"
 #include "../util/Singleton.h"
 
+#include "CacheKey.h"
 #include "DurableStoreKey.h"
+#include "DurableView.h"
 
 namespace oasys {
 
 // forward decls
 class DurableStore;
 class DurableStoreImpl;
+class GroupCommitter;
 template <typename _Type> class DurableTable;
 template <typename _Type> class SingleTypeDurableTable;
 template <typename _Type, typename _Collection> class MultiTypeDurableTable;
 template <typename _Type> class DurableObjectCache;
 class DurableTableImpl;
 class DurableIterator;
+class DurableTableLoader;
 
 /*!
  * Enumeration for error return codes from the datastore functions
@@ -62,6 +68,7 @@ enum DurableStoreResult_t {
     DS_BUSY      = -3,          ///< Table is still open, can't delete.
     DS_EXISTS    = -4,          ///< Key already exists
     DS_BADTYPE   = -5,          ///< Error in type collection
+    DS_UNSUPPORTED = -6,        ///< Not supported by this implementation
     DS_ERR       = -1000,       ///< XXX/bowei placeholder for now
 };
 
@@ -108,8 +115,10 @@ enum DurableStoreFlags_t {
 #include "DurableIterator.h"
 #include "DurableTable.h"
 #include "DurableObjectCache.h"
+#include "DurableTableLoader.h"
 #include "DurableTable.tcc"
 #include "DurableObjectCache.tcc"
+#include "DurableTableLoader.tcc"
 #undef   __OASYS_DURABLE_STORE_INTERNAL_HEADER__
 
 /**
@@ -125,7 +134,8 @@ public:
      */
     DurableStore(const char* logpath)
         : Logger("DurableStore", "%s", logpath), open_txid_(NULL),
-          have_seen_transaction_(false), tx_counter_(0), impl_(0)
+          have_seen_transaction_(false), tx_counter_(0),
+          group_commit_(0), impl_(0)
     { 
         log_debug("DurableStore instantiated (%p)", this);
 		set_instance(this);
@@ -173,6 +183,18 @@ public:
      */
     int end_transaction();
 
+    /**
+     * Block until every update made so far is durable. With group
+     * commit configured, concurrent callers share a single sync of
+     * the underlying store.
+     *
+     * @return DS_OK or DS_ERR
+     */
+    int sync();
+
+    /// The group commit layer, or NULL if it isn't configured
+    GroupCommitter* group_committer() { return group_commit_; }
+
     /**
      * @return true if a transaction is open, otherwise false
      * transaction_lock_.is_locked
@@ -251,6 +273,22 @@ public:
      */
     std::string get_info() const;
 
+    /**
+     * Read the contents of a set of (already open) tables, running
+     * each loader's parts on a pool of nthreads threads. Objects are
+     * unmarshalled in the worker threads and handed to the loaders'
+     * callbacks as they are read, in no particular order.
+     *
+     * If the store can't be read from more than one thread at a time
+     * (see DurableStoreImpl::concurrent_reads()), or nthreads is at
+     * most one, everything is read in the calling thread instead.
+     *
+     * @return DS_OK, or DS_ERR if any of the loaders failed or hit
+     *     objects that couldn't be read
+     */
+    int load_tables(const std::vector<DurableTableLoader*>& loaders,
+                    size_t nthreads);
+
     /**
      * Called to cause the next transaction closure to be durable.
      */
@@ -290,6 +328,8 @@ private:
     int max_nondurable_transactions_;     // Maximum allowed # of non-durable
                                           // transactions.
 
+    GroupCommitter* group_commit_;        // Coalesces durable commits
+
     /**
      * Typedef for the list of objects passed to the implementation to
      * initialize the table.
@@ -60,6 +60,13 @@ DurableStoreImpl::end_transaction(void *txid, bool be_durable)
     return(DS_OK);
 }
 
+int
+DurableStoreImpl::sync()
+{
+    log_debug("DurableStoreImpl::sync not implemented.");
+    return(DS_OK);
+}
+
 void *
 DurableStoreImpl::get_underlying()
 {
@@ -148,6 +155,31 @@ DurableTableImpl::get(const SerializableObject&   key,
           "multi-type tables");
 }
 
+int
+DurableTableImpl::get_view(const SerializableObject& key,
+                           SerializableObject*       data,
+                           DurableView*              view)
+{
+    view->release();
+    return get(key, data);
+}
+
+int
+DurableTableImpl::get_view(const SerializableObject&   key,
+                           SerializableObject**        data,
+                           TypeCollection::Allocator_t allocator,
+                           DurableView*                view)
+{
+    view->release();
+    return get(key, data, allocator);
+}
+
+DurableIterator*
+DurableTableImpl::part_itr(size_t part, size_t nparts, size_t batch)
+{
+    return new DurablePartIterator(bulk_itr(batch), part, nparts);
+}
+
 size_t
 DurableTableImpl::flatten(const SerializableObject& key, 
                           u_char* key_buf, size_t size)
@@ -81,6 +81,24 @@ public:
      */
     virtual int end_transaction(void *txid, bool be_durable = false);
 
+    /**
+     * Force everything written so far out to stable storage. Used by
+     * the group commit layer in DurableStore, which calls it once for
+     * a whole batch of commits. The default does nothing, for stores
+     * with nothing to sync.
+     */
+    virtual int sync();
+
+    /**
+     * Hand over the committer DurableStore created for group commit,
+     * for stores whose plain writes have to wait on it to be
+     * durable. The default ignores it.
+     */
+    virtual void set_group_committer(GroupCommitter* committer)
+    {
+        (void)committer;
+    }
+
     /*
      * Return a pointer to the 'Base' of the underlying database
      * implementation.  For BekeleyDB, for example, this would be
@@ -112,6 +130,13 @@ public:
      */
     virtual bool aux_tables_available();
 
+    /**
+     * Whether tables can be read by several threads at once, which
+     * DurableStore::load_tables() needs to spread the work out. The
+     * default is no.
+     */
+    virtual bool concurrent_reads() const { return false; }
+
 protected:
 
     /**
@@ -173,6 +198,29 @@ public:
     virtual int get(const SerializableObject&   key,
                     SerializableObject**        data,
                     TypeCollection::Allocator_t allocator);
+
+    /**
+     * Get the data for key without copying it where the store can,
+     * unmarshalling it with Serialize::BORROW_BUFFERS straight out of
+     * the data that view is left holding. The object's borrowed byte
+     * buffers are only valid until the view is released.
+     *
+     * The default just calls get(), which leaves the view empty and
+     * the object with its own copies.
+     *
+     * @return DS_OK, DS_NOTFOUND if key is not found, DS_ERR
+     */
+    virtual int get_view(const SerializableObject& key,
+                         SerializableObject*       data,
+                         DurableView*              view);
+
+    /**
+     * Multi-type version of get_view().
+     */
+    virtual int get_view(const SerializableObject&   key,
+                         SerializableObject**        data,
+                         TypeCollection::Allocator_t allocator,
+                         DurableView*                view);
                     
     /**
      * Put data for key in the database
@@ -206,6 +254,37 @@ public:
      */
     virtual DurableIterator* itr() = 0;
 
+    /**
+     * Get an iterator for reading the whole table, keys and data
+     * together (through DurableIterator::get_data()). Where the store
+     * can, it fetches the elements in batches of about the given
+     * number (zero picks a default) in whatever order is cheapest to
+     * read, rather than seeking for each one.
+     *
+     * The default is just itr(), whose get_data() may not be
+     * supported.
+     *
+     * @return The new iterator. Caller deletes this pointer.
+     */
+    virtual DurableIterator* bulk_itr(size_t batch = 0)
+    {
+        (void)batch;
+        return itr();
+    }
+
+    /**
+     * Get a bulk iterator over part of the table: the iterators for
+     * parts 0 to nparts - 1 each return a different set of elements,
+     * which together make up the whole table (as long as it doesn't
+     * change in the meantime).
+     *
+     * The default takes every nparts'th element of a bulk_itr().
+     *
+     * @return The new iterator. Caller deletes this pointer.
+     */
+    virtual DurableIterator* part_itr(size_t part, size_t nparts,
+                                      size_t batch = 0);
+
     /**
      * Return the name of this table.
      */
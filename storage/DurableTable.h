@@ -56,6 +56,16 @@ public:
      */
     DurableIterator* itr() { return impl_->itr(); }
 
+    /**
+     * Return a newly allocated iterator that also returns the data
+     * for each element, fetching it in batches where the store can.
+     * See DurableTableImpl::bulk_itr().
+     */
+    DurableIterator* bulk_itr(size_t batch = 0)
+    {
+        return impl_->bulk_itr(batch);
+    }
+
     /**
      * Return the underlying table implementation.
      */
@@ -134,6 +144,21 @@ public:
      */
     int get_copy(const SerializableObject& key,
                  _DataType* data);
+
+    /**
+     * Get variant that reads into a blank object without copying
+     * the stored data where the store can. See
+     * DurableTableImpl::get_view() for the lifetime rules; the cache
+     * is bypassed, since its objects outlive any view.
+     *
+     * @return DS_OK, DS_NOTFOUND if key is not found, DS_ERR
+     */
+    int get_view(const SerializableObject& key,
+                 _DataType*                data,
+                 DurableView*              view)
+    {
+        return this->impl_->get_view(key, data, view);
+    }
     
 private:
     // Not implemented on purpose -- can't copy
@@ -190,6 +215,17 @@ public:
             _BaseType**               data,
             bool*                     from_cache = 0);
 
+    /**
+     * Get the data for key into a new object without copying the
+     * stored data where the store can, as with
+     * SingleTypeDurableTable::get_view(). The object isn't cached.
+     *
+     * @return DS_OK, DS_NOTFOUND if key is not found, DS_ERR
+     */
+    int get_view(const SerializableObject& key,
+                 _BaseType**               data,
+                 DurableView*              view);
+
     /**
      * Object allocation callback that is handed to the implementation
      * to allow it to properly create an object once it extracts the
@@ -190,6 +190,27 @@ MultiTypeDurableTable<_BaseType, _Collection>::get(
     return DS_OK;
 }
 
+//----------------------------------------------------------------------------
+template <typename _BaseType, typename _Collection>
+inline int
+MultiTypeDurableTable<_BaseType, _Collection>::get_view(
+    const SerializableObject& key,
+    _BaseType**               data,
+    DurableView*              view)
+{
+    SerializableObject* generic_data = NULL;
+    int err = this->impl_->get_view(key, &generic_data, &new_object, view);
+    if (err != DS_OK) {
+        *data = NULL;
+        return err;
+    }
+
+    *data = dynamic_cast<_BaseType*>(generic_data);
+    ASSERT(*data != NULL);
+
+    return DS_OK;
+}
+
 //----------------------------------------------------------------------------
 template <typename _BaseType, typename _Collection>
 inline int
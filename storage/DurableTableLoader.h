@@ -0,0 +1,104 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef __OASYS_DURABLE_STORE_INTERNAL_HEADER__
+#error DurableTableLoader.h must only be included from within DurableStore.h
+#endif
+
+/**
+ * Reads every object in a table on behalf of
+ * DurableStore::load_tables(), handing each one to a callback.
+ *
+ * A loader may be split into several parts, each of which scans a
+ * part_itr() of the table. The parts can run in different threads at
+ * the same time, so the callback has to be thread safe when parts > 1
+ * (or when it shares state with other loaders).
+ */
+class DurableTableLoader {
+public:
+    /**
+     * @param table  The table to read, which has to stay open until
+     *               the load is done
+     * @param parts  How many pieces to split the table into
+     */
+    DurableTableLoader(DurableTableImpl* table, size_t parts = 1)
+        : table_(table), parts_(parts == 0 ? 1 : parts),
+          count_(0), errors_(0) {}
+
+    virtual ~DurableTableLoader() {}
+
+    /**
+     * Read all the objects from the iterator (which the caller
+     * deletes).
+     *
+     * @return DS_OK or DS_ERR
+     */
+    virtual int load(DurableIterator* iter) = 0;
+
+    /// @{ Accessors
+    DurableTableImpl* table() { return table_; }
+    size_t   parts()  const { return parts_; }
+    u_int32_t count()  const { return count_.value; }
+    u_int32_t errors() const { return errors_.value; }
+    /// @}
+
+protected:
+    DurableTableImpl* table_;
+    size_t   parts_;
+    atomic_t count_;    ///< objects handed to the callback
+    atomic_t errors_;   ///< objects that couldn't be read
+};
+
+/**
+ * Loader for a SingleTypeDurableTable.
+ */
+template <typename _Key, typename _DataType>
+class SingleTypeTableLoader : public DurableTableLoader {
+public:
+    SingleTypeTableLoader(SingleTypeDurableTable<_DataType>* table,
+                          size_t parts = 1)
+        : DurableTableLoader(table->impl(), parts) {}
+
+    int load(DurableIterator* iter);
+
+protected:
+    /**
+     * Called (from a load thread) with each object, which the
+     * callback now owns.
+     */
+    virtual void loaded(const _Key& key, _DataType* data) = 0;
+};
+
+/**
+ * Loader for a MultiTypeDurableTable.
+ */
+template <typename _Key, typename _BaseType, typename _Collection>
+class MultiTypeTableLoader : public DurableTableLoader {
+public:
+    MultiTypeTableLoader(MultiTypeDurableTable<_BaseType, _Collection>* table,
+                         size_t parts = 1)
+        : DurableTableLoader(table->impl(), parts) {}
+
+    int load(DurableIterator* iter);
+
+protected:
+    /**
+     * Called (from a load thread) with each object, which the
+     * callback now owns.
+     */
+    virtual void loaded(const _Key& key, _BaseType* data) = 0;
+};
@@ -0,0 +1,110 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+/*
+ * Implementation of the table loader templates, included from
+ * DurableStore.h.
+ *
+ * Iterators that can't return data themselves (DS_UNSUPPORTED) are
+ * covered by falling back to a get() on the table. An element that
+ * disappears between next() and reading its data (DS_NOTFOUND) was
+ * deleted in the meantime and is just skipped.
+ */
+
+//----------------------------------------------------------------------------
+template <typename _Key, typename _DataType>
+int
+SingleTypeTableLoader<_Key, _DataType>::load(DurableIterator* iter)
+{
+    int ret;
+    while ((ret = iter->next()) == DS_OK) {
+        Builder b;
+        _Key key(b);
+        if (iter->get_key(&key) != DS_OK) {
+            atomic_incr(&errors_);
+            continue;
+        }
+
+        _DataType* data = new _DataType(b);
+        int err = iter->get_data(data);
+        if (err == DS_UNSUPPORTED) {
+            err = table_->get(key, data);
+        }
+
+        if (err != DS_OK) {
+            delete data;
+            if (err != DS_NOTFOUND) {
+                atomic_incr(&errors_);
+            }
+            continue;
+        }
+
+        atomic_incr(&count_);
+        loaded(key, data);
+    }
+
+    return (ret == DS_NOTFOUND) ? DS_OK : DS_ERR;
+}
+
+//----------------------------------------------------------------------------
+template <typename _Key, typename _BaseType, typename _Collection>
+int
+MultiTypeTableLoader<_Key, _BaseType, _Collection>::load(
+    DurableIterator* iter)
+{
+    typedef MultiTypeDurableTable<_BaseType, _Collection> Table;
+
+    int ret;
+    while ((ret = iter->next()) == DS_OK) {
+        Builder b;
+        _Key key(b);
+        if (iter->get_key(&key) != DS_OK) {
+            atomic_incr(&errors_);
+            continue;
+        }
+
+        SerializableObject* generic = NULL;
+        int err = iter->get_data(&generic, &Table::new_object);
+        if (err == DS_UNSUPPORTED) {
+            delete generic;
+            generic = NULL;
+            err = table_->get(key, &generic, &Table::new_object);
+        }
+
+        if (err != DS_OK) {
+            // the object may have been allocated before the read or
+            // unserialize failed
+            delete generic;
+            if (err != DS_NOTFOUND) {
+                atomic_incr(&errors_);
+            }
+            continue;
+        }
+
+        _BaseType* data = dynamic_cast<_BaseType*>(generic);
+        if (data == NULL) {
+            delete generic;
+            atomic_incr(&errors_);
+            continue;
+        }
+
+        atomic_incr(&count_);
+        loaded(key, data);
+    }
+
+    return (ret == DS_NOTFOUND) ? DS_OK : DS_ERR;
+}
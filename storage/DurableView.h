@@ -0,0 +1,97 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef __DURABLE_VIEW_H__
+#define __DURABLE_VIEW_H__
+
+#include <sys/types.h>
+
+#include "../debug/DebugUtils.h"
+
+namespace oasys {
+
+/**
+ * Holds on to the serialized form of an object that was read with
+ * DurableTableImpl::get_view(). The object is unmarshalled with
+ * Serialize::BORROW_BUFFERS, so its byte buffers can point straight
+ * into the stored data rather than into a copy of it.
+ *
+ * The contract is that the view must outlive every use of those
+ * buffers: once the view is released (or destroyed), the object's
+ * borrowed buffers are dangling. A view can be reused for another
+ * get_view(), which releases what it held before.
+ *
+ * The store that fills in a view says how to give the data back
+ * with a release function, e.g. dropping a reference or calling
+ * free() on a buffer that the database handed over.
+ */
+class DurableView {
+public:
+    /// Function to give back the data, called with the cookie
+    typedef void (*Release_t)(const u_char* buf, void* cookie);
+
+    DurableView()
+        : buf_(0), len_(0), release_(0), cookie_(0) {}
+
+    ~DurableView() { release(); }
+
+    /// The stored data, or NULL if the view is empty
+    const u_char* buf() const { return buf_; }
+    size_t        len() const { return len_; }
+    bool          empty() const { return buf_ == 0; }
+
+    /**
+     * Called by the store to hand over the data, releasing anything
+     * the view already held. The release function may be NULL if
+     * the data doesn't need to be given back.
+     */
+    void set(const u_char* buf, size_t len,
+             Release_t release, void* cookie)
+    {
+        this->release();
+        buf_     = buf;
+        len_     = len;
+        release_ = release;
+        cookie_  = cookie;
+    }
+
+    /// Give the data back, invalidating any borrowed buffers
+    void release()
+    {
+        if (buf_ != 0 && release_ != 0) {
+            (*release_)(buf_, cookie_);
+        }
+        buf_     = 0;
+        len_     = 0;
+        release_ = 0;
+        cookie_  = 0;
+    }
+
+private:
+    const u_char* buf_;
+    size_t        len_;
+    Release_t     release_;
+    void*         cookie_;
+
+    // Not implemented on purpose -- can't copy
+    DurableView(const DurableView&);
+    DurableView& operator=(const DurableView&);
+};
+
+} // namespace oasys
+
+#endif /* __DURABLE_VIEW_H__ */
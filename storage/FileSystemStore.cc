@@ -27,6 +27,9 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <algorithm>
 
 #include "../util/ExpandableBuffer.h"
 #include "../serialize/KeySerialize.h"
@@ -34,14 +37,87 @@
 #include "../io/FileUtils.h"
 #include "../io/IO.h"
 
+#if defined(__linux__) && defined(__GLIBC__)
+#  if __GLIBC_PREREQ(2, 14)
+#    define FS_STORE_HAVE_SYNCFS
+#  endif
+#endif
+
+/// Subdirectory names are at most this many hex digits (65536)
+#define FS_STORE_MAX_FANOUT_WIDTH 4
+
+/// Appended to a key moved out of the way of a subdirectory
+/// with the same name while a table is laid out
+#define FS_STORE_ASIDE_SUFFIX ".aside"
+
+/// Files read ahead at a time by default by bulk_itr()
+#define FS_STORE_ITR_BATCH 128
 
 namespace oasys {
 
+//----------------------------------------------------------------------------
+static u_int32_t
+fs_store_hash(const char* key)
+{
+    // FNV-1a. This decides where files go on disk, so it mustn't
+    // change from one build (or platform) to the next.
+    u_int32_t h = 2166136261U;
+    for (const u_char* p = reinterpret_cast<const u_char*>(key); *p; ++p) {
+        h ^= *p;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+//----------------------------------------------------------------------------
+static int
+fs_store_sync_dir(const std::string& dir)
+{
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int err = fsync(fd);
+    IO::close(fd);
+    return err;
+}
+
+//----------------------------------------------------------------------------
+/// Read all of the given file into data.
+/// @return DS_OK, DS_NOTFOUND or DS_ERR (with errno set)
+static int
+fs_store_read_file(const std::string& path, std::string* data)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return (errno == ENOENT) ? DS_NOTFOUND : DS_ERR;
+    }
+
+    struct stat st;
+    int err = fstat(fd, &st);
+    if (err == 0) {
+        data->resize(st.st_size);
+        if (st.st_size != 0 &&
+            IO::readall(fd, &(*data)[0], st.st_size) != st.st_size)
+        {
+            err = -1;
+        }
+    }
+
+    IO::close(fd);
+    return (err == 0) ? DS_OK : DS_ERR;
+}
+
 //----------------------------------------------------------------------------
 FileSystemStore::FileSystemStore(const char* logpath)
     : DurableStoreImpl("FileSystemStore", logpath),
       db_dir_("INVALID"),
       tables_dir_("INVALID"),
+      fanout_(0),
+      fanout_width_(0),
+      atomic_put_(false),
+      sync_puts_(false),
+      tmp_seq_(0),
       default_perm_(S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IXGRP),
       fd_cache_(0)
 {}
@@ -107,6 +183,32 @@ FileSystemStore::init(const StorageConfig& cfg)
         fd_cache_ = new FdCache(logpath_, cfg.fs_fd_cache_size_);
     }
 
+    if (cfg.fs_fanout_ > 0) {
+        fanout_       = 16;
+        fanout_width_ = 1;
+        while (fanout_ < cfg.fs_fanout_ &&
+               fanout_width_ < FS_STORE_MAX_FANOUT_WIDTH)
+        {
+            fanout_ *= 16;
+            ++fanout_width_;
+        }
+    }
+
+    atomic_put_ = cfg.fs_atomic_put_;
+    sync_puts_  = cfg.fs_sync_puts_;
+
+    if (atomic_put_) {
+        tmp_dir_ = tables_dir_ + ".tmp";
+        int err = mkdir(tmp_dir_.c_str(), default_perm_);
+        if (err != 0 && errno != EEXIST) {
+            log_err("can't create %s: %s", tmp_dir_.c_str(), strerror(errno));
+            return -1;
+        }
+
+        // anything in here is from a put that never finished
+        FileUtils::rm_all_from_dir(tmp_dir_.c_str());
+    }
+
     log_info("init() done");
     init_ = true;
 
@@ -123,12 +225,60 @@ FileSystemStore::end_transaction(void *txid, bool be_durable)
 
     if (be_durable)
     {
-        fd_cache_->sync_all();
+        return sync();
     }
 
     return DS_OK;
 }
 
+//----------------------------------------------------------------------------
+int
+FileSystemStore::sync()
+{
+    int ret = DS_OK;
+
+    std::set<std::string> dirs;
+    dirty_lock_.lock("FileSystemStore::sync");
+    dirs.swap(dirty_dirs_);
+    dirty_lock_.unlock();
+
+    if (fd_cache_ != 0) {
+        if (fd_cache_->sync_all() != 0) {
+            ret = DS_ERR;
+        }
+
+        // and the entries for files that were created or renamed
+        for (std::set<std::string>::iterator i = dirs.begin();
+             i != dirs.end(); ++i)
+        {
+            if (fs_store_sync_dir(*i) != 0) {
+                log_err("can't sync directory %s: %s",
+                        i->c_str(), strerror(errno));
+                ret = DS_ERR;
+            }
+        }
+    }
+    else if (! sync_puts_)
+    {
+        // no record of which files were written, so sync them all
+#ifdef FS_STORE_HAVE_SYNCFS
+        int fd = open(tables_dir_.c_str(), O_RDONLY);
+        if (fd < 0 || syncfs(fd) != 0) {
+            log_err("syncfs of %s failed: %s",
+                    tables_dir_.c_str(), strerror(errno));
+            ret = DS_ERR;
+        }
+        if (fd >= 0) {
+            IO::close(fd);
+        }
+#else
+        ::sync();
+#endif
+    }
+
+    return ret;
+}
+
 //----------------------------------------------------------------------------
 int 
 FileSystemStore::get_table(DurableTableImpl** table,
@@ -164,13 +314,17 @@ FileSystemStore::get_table(DurableTableImpl** table,
     } else if (err == 0 && (flags & DS_EXCL)) {
         return DS_EXISTS;
     }
+
+    if (layout_table(dir_path) != 0) {
+        return DS_ERR;
+    }
     
     FileSystemTable* table_ptr =
         new FileSystemTable(logpath_, 
                             name, 
                             dir_path, 
                             flags & DS_MULTITYPE, 
-                            fd_cache_);
+                            this);
     ASSERT(table_ptr);
     
     *table = table_ptr;
@@ -189,7 +343,7 @@ FileSystemStore::del_table(const std::string& name)
     dir_path.append("/");
     dir_path.append(name);
     
-    FileUtils::rm_all_from_dir(dir_path.c_str());
+    FileUtils::rm_all_from_dir(dir_path.c_str(), true);
 
     // clean out the directory
     int err;
@@ -284,16 +438,237 @@ FileSystemStore::tidy_database()
     system(cmd);
 }
 
+//----------------------------------------------------------------------------
+int
+FileSystemStore::layout_table(const std::string& dir_path)
+{
+    if (fanout_ == 0) {
+        return 0;
+    }
+
+    DIR* dir = opendir(dir_path.c_str());
+    if (dir == 0) {
+        log_err("can't open table directory %s: %s",
+                dir_path.c_str(), strerror(errno));
+        return -1;
+    }
+
+    // Anything other than our subdirectories is either a key from a
+    // flat table or a subdirectory for a different fanout
+    std::vector<std::string> strays;
+    int subdirs = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != 0) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        struct stat st;
+        std::string path = dir_path + "/" + ent->d_name;
+        if (is_subdir_name(ent->d_name) &&
+            lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            ++subdirs;
+        } else {
+            strays.push_back(ent->d_name);
+        }
+    }
+    closedir(dir);
+
+    if (strays.empty() && subdirs == fanout_) {
+        return 0;
+    }
+
+    // Keys of a flat table can have the same name as a subdirectory
+    // (a u_int16_t key with a fanout width of 4, say), so those are
+    // moved out of the way first. They are filed away with the rest
+    // below, which also picks up any left over from a crash.
+    for (size_t i = 0; i < strays.size(); ++i) {
+        if (! is_subdir_name(strays[i].c_str())) {
+            continue;
+        }
+
+        std::string path  = dir_path + "/" + strays[i];
+        std::string aside = path + FS_STORE_ASIDE_SUFFIX;
+        if (rename(path.c_str(), aside.c_str()) != 0) {
+            log_err("can't move %s to %s: %s",
+                    path.c_str(), aside.c_str(), strerror(errno));
+            return -1;
+        }
+        strays[i] += FS_STORE_ASIDE_SUFFIX;
+    }
+
+    for (int i = 0; i < fanout_; ++i) {
+        std::string path = dir_path + "/" + subdir_name(i);
+        if (mkdir(path.c_str(), default_perm_) == 0) {
+            continue;
+        }
+
+        struct stat st;
+        if (errno != EEXIST || stat(path.c_str(), &st) != 0) {
+            log_err("can't create %s: %s", path.c_str(), strerror(errno));
+            return -1;
+        }
+        if (! S_ISDIR(st.st_mode)) {
+            log_err("can't create %s: not a directory", path.c_str());
+            return -1;
+        }
+    }
+
+    if (strays.empty()) {
+        return 0;
+    }
+
+    // Each file is moved with a single rename(), so a crash part way
+    // through just leaves the rest to be moved on the next open.
+    log_notice("moving %zu entries in %s into %d subdirectories",
+               strays.size(), dir_path.c_str(), fanout_);
+
+    for (size_t i = 0; i < strays.size(); ++i) {
+        std::string path = dir_path + "/" + strays[i];
+
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) {
+            log_err("can't stat %s: %s", path.c_str(), strerror(errno));
+            return -1;
+        }
+
+        if (! S_ISDIR(st.st_mode)) {
+            std::string key = strays[i];
+            size_t suffix = key.size() - strlen(FS_STORE_ASIDE_SUFFIX);
+            if (key.size() > strlen(FS_STORE_ASIDE_SUFFIX) &&
+                key.compare(suffix, std::string::npos,
+                            FS_STORE_ASIDE_SUFFIX) == 0 &&
+                is_subdir_name(key.substr(0, suffix).c_str()))
+            {
+                key.erase(suffix);
+            }
+
+            if (move_to_subdir(dir_path, dir_path, strays[i].c_str(),
+                               key.c_str()) != 0)
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        DIR* sub = opendir(path.c_str());
+        if (sub == 0) {
+            log_err("can't open %s: %s", path.c_str(), strerror(errno));
+            return -1;
+        }
+        while ((ent = readdir(sub)) != 0) {
+            if (strcmp(ent->d_name, ".") == 0 ||
+                strcmp(ent->d_name, "..") == 0)
+            {
+                continue;
+            }
+            if (move_to_subdir(dir_path, path, ent->d_name) != 0) {
+                closedir(sub);
+                return -1;
+            }
+        }
+        closedir(sub);
+
+        if (rmdir(path.c_str()) != 0) {
+            log_warn("can't remove old subdirectory %s: %s",
+                     path.c_str(), strerror(errno));
+        }
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+FileSystemStore::move_to_subdir(const std::string& table_path,
+                                const std::string& dir,
+                                const char*        name,
+                                const char*        key)
+{
+    if (key == 0) {
+        key = name;
+    }
+
+    std::string from = dir + "/" + name;
+    std::string to   = table_path + "/" + subdir_name(subdir_of(key)) +
+                       "/" + key;
+
+    if (rename(from.c_str(), to.c_str()) != 0) {
+        log_err("can't move %s to %s: %s",
+                from.c_str(), to.c_str(), strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+FileSystemStore::subdir_of(const char* key) const
+{
+    ASSERT(fanout_ != 0);
+    return fs_store_hash(key) & (fanout_ - 1);
+}
+
+//----------------------------------------------------------------------------
+std::string
+FileSystemStore::subdir_name(int subdir) const
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%0*x", fanout_width_, subdir);
+    return buf;
+}
+
+//----------------------------------------------------------------------------
+bool
+FileSystemStore::is_subdir_name(const char* name) const
+{
+    int len;
+    for (len = 0; name[len] != 0; ++len) {
+        if (! isdigit(name[len]) && ! (name[len] >= 'a' && name[len] <= 'f')) {
+            return false;
+        }
+    }
+
+    return len == fanout_width_;
+}
+
+//----------------------------------------------------------------------------
+std::string
+FileSystemStore::tmp_path()
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "/%u.%u",
+             (u_int)getpid(), (u_int)atomic_incr_ret(&tmp_seq_));
+    return tmp_dir_ + buf;
+}
+
+//----------------------------------------------------------------------------
+void
+FileSystemStore::dirty_dir(const std::string& dir)
+{
+    // Without the fd cache sync() does the whole file system, and
+    // with sync_puts_ the puts took care of it themselves
+    if (fd_cache_ == 0 || sync_puts_) {
+        return;
+    }
+
+    ScopeLock l(&dirty_lock_, "FileSystemStore::dirty_dir");
+    dirty_dirs_.insert(dir);
+}
+
 //----------------------------------------------------------------------------
 FileSystemTable::FileSystemTable(const char*               logpath,
                                  const std::string&        table_name,
                                  const std::string&        path,
                                  bool                      multitype,
-                                 FileSystemStore::FdCache* cache)
+                                 FileSystemStore*          store)
     : DurableTableImpl(table_name, multitype),
       Logger("FileSystemTable", "%s/%s", logpath, table_name.c_str()),
       path_(path),
-      cache_(cache)
+      store_(store),
+      cache_(store->fd_cache_)
 {}
 
 //----------------------------------------------------------------------
@@ -379,9 +754,16 @@ FileSystemTable::put(const SerializableObject&  key,
         return DS_ERR;
     }
 
-    std::string filename = path_ + "/" + key_str.buf();
+    std::string dir      = key_dir(key_str.buf());
+    std::string filename = dir + "/" + key_str.buf();
+
+    if (store_->atomic_put_) {
+        return put_atomic(dir, filename, flags, scratch.buf(), scratch.len());
+    }
+
     int data_elt_fd      = -1;
     int open_flags       = O_TRUNC | O_RDWR;
+    bool opened          = false;
 
     if (flags & DS_EXCL) {
         open_flags |= O_EXCL;       
@@ -424,6 +806,7 @@ FileSystemTable::put(const SerializableObject&  key,
                 return DS_ERR;
             }
         }
+        opened = true;
 
         if (cache_) 
         {
@@ -437,7 +820,7 @@ FileSystemTable::put(const SerializableObject&  key,
     } 
     else if (cache_ && (flags & DS_EXCL))
     {
-        cache_->unpin(filename);
+        cache_->unpin(filename, false, data_elt_fd);
         return DS_EXISTS;
     }
 
@@ -453,27 +836,179 @@ FileSystemTable::put(const SerializableObject&  key,
     int cc = IO::writeall(data_elt_fd, 
                           reinterpret_cast<char*>(scratch.buf()), 
                           scratch.len());
-    if (cc != static_cast<int>(scratch.len())) 
+    if (cc != static_cast<int>(scratch.len()) ||
+        (store_->sync_puts_ && fsync(data_elt_fd) != 0))
     {
         log_warn("put() - errors writing to file %s, %d: %s",
                  filename.c_str(), cc, strerror(errno));
         if (cache_) 
         {
-            cache_->unpin(filename);
+            cache_->unpin(filename, false, data_elt_fd);
+        }
+        else
+        {
+            IO::close(data_elt_fd);
         }
         return DS_ERR;
     }
     
     if (cache_)
     {
-        // close(data_elt_fd); XXX/bowei -- fsync?
-        cache_->unpin(filename);
+        // the next sync() takes care of it, unless we just did
+        cache_->unpin(filename, ! store_->sync_puts_, data_elt_fd);
     }
     else
     {
         IO::close(data_elt_fd);
     }
 
+    // the file may be new, in which case so is its directory entry
+    if (opened && (open_flags & O_CREAT))
+    {
+        if (store_->sync_puts_) 
+        {
+            if (fs_store_sync_dir(dir) != 0)
+            {
+                log_warn("put() - can't sync directory %s: %s",
+                         dir.c_str(), strerror(errno));
+                return DS_ERR;
+            }
+        }
+        else
+        {
+            store_->dirty_dir(dir);
+        }
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+FileSystemTable::put_atomic(const std::string& dir,
+                            const std::string& filename,
+                            int                flags,
+                            const u_char*      buf,
+                            size_t             len)
+{
+    if (! (flags & DS_CREATE)) 
+    {
+        if (access(filename.c_str(), F_OK) != 0) 
+        {
+            if (errno == ENOENT) 
+            {
+                log_debug("file not found and DS_CREATE not specified");
+                return DS_NOTFOUND;
+            }
+            log_warn("can't access %s: %s", filename.c_str(), strerror(errno));
+            return DS_ERR;
+        }
+    }
+
+    std::string tmp = store_->tmp_path();
+    int fd = open(tmp.c_str(), O_CREAT | O_EXCL | O_RDWR, 
+                  S_IRUSR | S_IWUSR | S_IRGRP);
+    if (fd == -1) 
+    {
+        log_warn("can't open %s: %s", tmp.c_str(), strerror(errno));
+        return DS_ERR;
+    }
+
+    // The data has to be on disk before the rename, or a crash could
+    // leave the new name pointing at an empty file (e.g. with delayed
+    // allocation), so this fsync can't wait for sync().
+    int cc = IO::writeall(fd, reinterpret_cast<const char*>(buf), len);
+    if (cc != static_cast<int>(len) || fsync(fd) != 0)
+    {
+        log_warn("put() - errors writing to file %s, %d: %s",
+                 tmp.c_str(), cc, strerror(errno));
+        IO::close(fd);
+        unlink(tmp.c_str());
+        return DS_ERR;
+    }
+
+    int ret;
+    if (cache_) 
+    {
+        // Swap in the new fd together with the rename, so that when
+        // two puts of one key race, the cache ends up with the fd of
+        // the file that won. Any cached fd is for the file that was
+        // just replaced; readers still using it keep it until they
+        // unpin.
+        ScopeLock l(&store_->rename_lock_, "FileSystemTable::put_atomic");
+        ret = install_tmp(tmp, filename, flags);
+        if (ret == 0) 
+        {
+            cache_->replace(filename, fd);
+        }
+    } 
+    else 
+    {
+        ret = install_tmp(tmp, filename, flags);
+    }
+
+    if (ret != 0) 
+    {
+        IO::close(fd);
+        unlink(tmp.c_str());
+        return ret;
+    }
+
+    if (store_->sync_puts_ && fs_store_sync_dir(dir) != 0) 
+    {
+        log_warn("put() - can't sync directory %s: %s",
+                 dir.c_str(), strerror(errno));
+        ret = DS_ERR;
+    }
+
+    if (cache_) 
+    {
+        cache_->unpin(filename, false, fd);
+    } 
+    else 
+    {
+        IO::close(fd);
+    }
+
+    if (ret != 0) 
+    {
+        return ret;
+    }
+
+    store_->dirty_dir(dir);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+FileSystemTable::install_tmp(const std::string& tmp,
+                             const std::string& filename,
+                             int                flags)
+{
+    if (flags & DS_EXCL) 
+    {
+        // unlike rename(), link() won't replace an existing file
+        if (link(tmp.c_str(), filename.c_str()) != 0) 
+        {
+            if (errno == EEXIST) 
+            {
+                log_debug("file found and DS_EXCL specified");
+                return DS_EXISTS;
+            }
+            log_warn("can't link %s to %s: %s", 
+                     tmp.c_str(), filename.c_str(), strerror(errno));
+            return DS_ERR;
+        }
+        unlink(tmp.c_str());
+    } 
+    else if (rename(tmp.c_str(), filename.c_str()) != 0) 
+    {
+        log_warn("can't rename %s to %s: %s", 
+                 tmp.c_str(), filename.c_str(), strerror(errno));
+        return DS_ERR;
+    }
+
     return 0;
 }
     
@@ -489,7 +1024,8 @@ FileSystemTable::del(const SerializableObject& key)
         return DS_ERR;
     }
     
-    std::string filename = path_ + "/" + key_str.buf();
+    std::string dir      = key_dir(key_str.buf());
+    std::string filename = dir + "/" + key_str.buf();
 
     if (cache_)
     {
@@ -507,6 +1043,14 @@ FileSystemTable::del(const SerializableObject& key)
                  strerror(errno));
         return DS_ERR;
     }
+
+    if (store_->sync_puts_ && fs_store_sync_dir(dir) != 0) 
+    {
+        log_warn("can't sync directory %s - %s", dir.c_str(), 
+                 strerror(errno));
+        return DS_ERR;
+    }
+    store_->dirty_dir(dir);
     
     return 0;
 }
@@ -515,33 +1059,97 @@ FileSystemTable::del(const SerializableObject& key)
 size_t 
 FileSystemTable::size() const
 {
+    std::vector<std::string> dirs;
+    get_dirs(&dirs);
+
     // XXX/bowei -- be inefficient for now
-    DIR* dir = opendir(path_.c_str());
-    ASSERT(dir != 0);
+    size_t total = 0;
+    for (size_t i = 0; i < dirs.size(); ++i)
+    {
+        DIR* dir = opendir(dirs[i].c_str());
+        ASSERT(dir != 0);
     
-    size_t count;
-    struct dirent* ent;
+        size_t count;
+        struct dirent* ent;
 
-    for (count = 0, ent = readdir(dir); 
-         ent != 0; ent = readdir(dir))
-    {
-        ASSERT(ent != 0);
-        ++count;
-    }
+        for (count = 0, ent = readdir(dir); 
+             ent != 0; ent = readdir(dir))
+        {
+            ASSERT(ent != 0);
+            ++count;
+        }
 
-    closedir(dir);
+        closedir(dir);
 
-    // count always includes '.' and '..'
-    log_debug("table size = %zu", count - 2);
+        // count always includes '.' and '..'
+        total += count - 2;
+    }
+
+    log_debug("table size = %zu", total);
 
-    return count - 2; 
+    return total; 
 }
     
 //----------------------------------------------------------------------------
 DurableIterator* 
 FileSystemTable::itr()
 {
-    return new FileSystemIterator(path_);
+    std::vector<std::string> dirs;
+    get_dirs(&dirs);
+
+    return new FileSystemIterator(logpath_, dirs);
+}
+
+//----------------------------------------------------------------------------
+DurableIterator* 
+FileSystemTable::bulk_itr(size_t batch)
+{
+    std::vector<std::string> dirs;
+    get_dirs(&dirs);
+
+    return new FileSystemIterator(logpath_, dirs,
+                                  batch ? batch : FS_STORE_ITR_BATCH);
+}
+
+//----------------------------------------------------------------------------
+DurableIterator* 
+FileSystemTable::part_itr(size_t part, size_t nparts, size_t batch)
+{
+    ASSERT(part < nparts);
+
+    std::vector<std::string> dirs;
+    get_dirs(&dirs);
+
+    return new FileSystemIterator(logpath_, dirs,
+                                  batch ? batch : FS_STORE_ITR_BATCH,
+                                  part, nparts);
+}
+
+//----------------------------------------------------------------------------
+std::string
+FileSystemTable::key_dir(const char* key) const
+{
+    if (store_->fanout_ == 0) {
+        return path_;
+    }
+
+    return path_ + "/" + store_->subdir_name(store_->subdir_of(key));
+}
+
+//----------------------------------------------------------------------------
+void
+FileSystemTable::get_dirs(std::vector<std::string>* dirs) const
+{
+    dirs->clear();
+
+    if (store_->fanout_ == 0) {
+        dirs->push_back(path_);
+        return;
+    }
+
+    for (int i = 0; i < store_->fanout_; ++i) {
+        dirs->push_back(path_ + "/" + store_->subdir_name(i));
+    }
 }
 
 //----------------------------------------------------------------------------
@@ -557,7 +1165,7 @@ FileSystemTable::get_common(const SerializableObject& key,
     }
     
     std::string file_name(key_str.at(0));
-    std::string file_path = path_ + "/" + file_name;
+    std::string file_path = key_dir(file_name.c_str()) + "/" + file_name;
     log_debug("opening file %s", file_path.c_str());
 
     
@@ -592,23 +1200,23 @@ FileSystemTable::get_common(const SerializableObject& key,
         }
     }
     
-    if (cache_) 
-    {
-        int cc = IO::lseek(fd, 0, SEEK_SET);
-        ASSERT(cc == 0);
-    }
-    
-    int cc;
+    // a cached fd can be pinned by several gets at once, so read at
+    // explicit offsets rather than through the shared file position
+    off_t offset = 0;
+    ssize_t cc;
     do {
         buf->reserve(buf->len() + 4096);
-        cc = IO::read(fd, buf->end(), 4096, 0);
+        do {
+            cc = pread(fd, buf->end(), 4096, offset);
+        } while (cc < 0 && errno == EINTR);
         ASSERTF(cc >= 0, "read failed %s", strerror(errno));
         buf->set_len(buf->len() + cc);
+        offset += cc;
     } while (cc > 0);
 
     if (cache_) 
     {
-        cache_->unpin(file_path);
+        cache_->unpin(file_path, false, fd);
     }
     else
     {
@@ -619,10 +1227,17 @@ FileSystemTable::get_common(const SerializableObject& key,
 }
 
 //----------------------------------------------------------------------------
-FileSystemIterator::FileSystemIterator(const std::string& path)
-    : ent_(0)
+FileSystemIterator::FileSystemIterator(const char*                     logpath,
+                                       const std::vector<std::string>& dirs,
+                                       size_t                          batch,
+                                       size_t                          part,
+                                       size_t                          nparts)
+    : Logger("FileSystemIterator", "%s/iter", logpath),
+      ent_(0), dirs_(dirs), cur_dir_(0),
+      batch_(batch), part_(part), nparts_(nparts), prefetch_pos_(0)
 {
-    dir_ = opendir(path.c_str());
+    ASSERT(! dirs_.empty());
+    dir_ = opendir(dirs_[0].c_str());
     ASSERT(dir_ != 0);
 }
 
@@ -633,18 +1248,52 @@ FileSystemIterator::~FileSystemIterator()
 }
     
 //----------------------------------------------------------------------------
-int 
-FileSystemIterator::next()
+struct dirent*
+FileSystemIterator::read_entry()
 {
+    struct dirent* ent;
+
   skip_dots:
-    ent_ = readdir(dir_);
+    errno = 0;
+    ent = readdir(dir_);
 
-    if (ent_ != 0 && (strcmp(ent_->d_name, ".") == 0 ||
-                      strcmp(ent_->d_name, "..") == 0))
+    if (ent == 0 && errno == 0 && cur_dir_ + 1 < dirs_.size()) 
     {
+        // on to the next subdirectory
+        closedir(dir_);
+        dir_ = opendir(dirs_[++cur_dir_].c_str());
+        ASSERT(dir_ != 0);
         goto skip_dots;
     }
 
+    if (ent != 0 && (strcmp(ent->d_name, ".") == 0 ||
+                     strcmp(ent->d_name, "..") == 0))
+    {
+        goto skip_dots;
+    }
+
+    if (ent != 0 && nparts_ > 1 &&
+        fs_store_hash(ent->d_name) % nparts_ != part_)
+    {
+        goto skip_dots;
+    }
+
+    return ent;
+}
+
+//----------------------------------------------------------------------------
+int 
+FileSystemIterator::next()
+{
+    if (batch_ != 0) {
+        if (prefetch_pos_ + 1 < prefetched_.size()) {
+            ++prefetch_pos_;
+            return 0;
+        }
+        return fill_batch();
+    }
+
+    ent_ = read_entry();
     if (ent_ == 0) 
     {
         if (errno == EBADF) 
@@ -660,13 +1309,113 @@ FileSystemIterator::next()
     return 0;
 }
 
+//----------------------------------------------------------------------------
+/// Orders read ahead files by inode
+struct FileSystemIteratorInodeLess {
+    template <typename _Prefetched>
+    bool operator()(const _Prefetched& a, const _Prefetched& b) const
+    {
+        return a.ino_ < b.ino_;
+    }
+};
+
+//----------------------------------------------------------------------------
+int
+FileSystemIterator::fill_batch()
+{
+    // Every file in a batch may have been deleted since it was read
+    // from the directory, so go on to the next until the directory
+    // runs out
+    bool done = false;
+    do {
+        prefetched_.clear();
+        prefetch_pos_ = 0;
+
+        if (read_batch(&done) != 0) {
+            return DS_ERR;
+        }
+    } while (prefetched_.empty() && ! done);
+
+    if (prefetched_.empty()) {
+        return DS_NOTFOUND;
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+FileSystemIterator::read_batch(bool* done)
+{
+    while (prefetched_.size() < batch_) {
+        struct dirent* ent = read_entry();
+        if (ent == 0) {
+            if (errno != 0) {
+                log_err("error reading %s: %s",
+                        dirs_[cur_dir_].c_str(), strerror(errno));
+                return DS_ERR;
+            }
+            *done = true;
+            break;
+        }
+
+        prefetched_.push_back(Prefetched());
+        Prefetched& p = prefetched_.back();
+        p.ino_  = ent->d_ino;
+        p.dir_  = cur_dir_;
+        p.name_ = ent->d_name;
+    }
+
+    std::sort(prefetched_.begin(), prefetched_.end(),
+              FileSystemIteratorInodeLess());
+
+    // read them all in inode order, dropping any that were deleted
+    // in the meantime
+    size_t n = 0;
+    for (size_t i = 0; i < prefetched_.size(); ++i) {
+        Prefetched& p = prefetched_[i];
+        std::string path = dirs_[p.dir_] + "/" + p.name_;
+
+        int err = fs_store_read_file(path, &p.data_);
+        if (err == DS_NOTFOUND) {
+            continue;
+        } else if (err != DS_OK) {
+            log_err("error reading %s: %s", path.c_str(), strerror(errno));
+            return DS_ERR;
+        }
+
+        if (n != i) {
+            std::swap(prefetched_[n], p);
+        }
+        ++n;
+    }
+    prefetched_.resize(n);
+
+    log_debug("read ahead %zu files", n);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+const char*
+FileSystemIterator::cur_name() const
+{
+    if (batch_ != 0) {
+        ASSERT(prefetch_pos_ < prefetched_.size());
+        return prefetched_[prefetch_pos_].name_.c_str();
+    }
+
+    ASSERT(ent_ != 0);
+    return ent_->d_name;
+}
+
 //----------------------------------------------------------------------------
 int 
 FileSystemIterator::get_key(SerializableObject* key)
 {
-    ASSERT(ent_ != 0);
+    const char* name = cur_name();
     
-    KeyUnmarshal um(ent_->d_name, strlen(ent_->d_name), "-");
+    KeyUnmarshal um(name, strlen(name), "-");
     int err = um.action(key);
     if (err != 0) {
         return DS_ERR;
@@ -675,4 +1424,74 @@ FileSystemIterator::get_key(SerializableObject* key)
     return 0;
 }
 
+//----------------------------------------------------------------------------
+int
+FileSystemIterator::cur_data(const std::string** data)
+{
+    if (batch_ != 0) {
+        ASSERT(prefetch_pos_ < prefetched_.size());
+        *data = &prefetched_[prefetch_pos_].data_;
+        return DS_OK;
+    }
+
+    ASSERT(ent_ != 0);
+    std::string path = dirs_[cur_dir_] + "/" + ent_->d_name;
+    int err = fs_store_read_file(path, &data_);
+    if (err == DS_ERR) {
+        log_err("error reading %s: %s", path.c_str(), strerror(errno));
+    }
+    *data = &data_;
+    return err;
+}
+
+//----------------------------------------------------------------------------
+int
+FileSystemIterator::get_data(SerializableObject* data)
+{
+    const std::string* buf;
+    int err = cur_data(&buf);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    Unmarshal um(Serialize::CONTEXT_LOCAL,
+                 reinterpret_cast<const u_char*>(buf->data()),
+                 buf->length());
+    if (um.action(data) != 0) {
+        log_err("error unserializing data object");
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+int
+FileSystemIterator::get_data(SerializableObject**        data,
+                             TypeCollection::Allocator_t allocator)
+{
+    const std::string* buf;
+    int err = cur_data(&buf);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    Unmarshal um(Serialize::CONTEXT_LOCAL,
+                 reinterpret_cast<const u_char*>(buf->data()),
+                 buf->length());
+
+    TypeCollection::TypeCode_t typecode;
+    um.process("typecode", &typecode);
+
+    if (allocator(typecode, data) != 0) {
+        return DS_ERR;
+    }
+    if (um.action(*data) != 0) {
+        log_err("error unserializing data object");
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
 } // namespace oasys
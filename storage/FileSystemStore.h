@@ -20,8 +20,12 @@
 
 #include <sys/types.h>
 #include <dirent.h>
+#include <set>
+#include <vector>
 
 #include "../debug/Logger.h"
+#include "../thread/Atomic.h"
+#include "../thread/AdaptiveLock.h"
 #include "../thread/SpinLock.h"
 #include "../util/ScratchBuffer.h"
 #include "../util/OpenFdCache.h"
@@ -43,6 +47,23 @@ class FileSystemIterator;
  * directly.
  *
  * NEW: Now with a level of indirection!
+ *
+ * Each table is a directory with one file per key. With fs_fanout_
+ * set, the files are spread over a fixed set of hashed subdirectories
+ * so that no one directory gets too big; an existing flat table is
+ * moved into the subdirectories the first time it is opened.
+ *
+ * With fs_atomic_put_, a put writes the whole value to a temporary
+ * file, fsyncs it and renames it over the old one, so a crash never
+ * leaves a half written value behind. That costs an fsync per put
+ * even without fs_sync_puts_, though the rename itself is still
+ * only made durable by the next sync().
+ *
+ * Unless fs_sync_puts_ is set, puts aren't synced when they return.
+ * Instead a durable commit (sync()) syncs everything written since
+ * the last one in a single pass: the dirty files in the fd cache plus
+ * the directories they were created in, or the whole file system
+ * with syncfs() when there is no fd cache.
  */
 class FileSystemStore : public DurableStoreImpl {
     friend class FileSystemTable;
@@ -67,6 +88,7 @@ public:
     int del_table(const std::string& name);
     int get_table_names(StringVector* names);
     std::string get_info() const;
+    bool concurrent_reads() const { return true; }
 
     //! FileSystemStore doesn't really do transactions, so
     //! begin_transaction is not implemented, but
@@ -74,12 +96,26 @@ public:
     //! file descriptors used for tables (in the cache_).
     //! get_underlying can't return anything useful either.
     int end_transaction (void *txid, bool be_durable);
+
+    //! Also fsyncs the cached file descriptors.
+    int sync();
     //! @}
 
 private:
     bool        init_;
     std::string db_dir_;     //!< parent directory for the db
     std::string tables_dir_; //!< directory where the tables are stored
+    std::string tmp_dir_;    //!< where atomic puts are written first
+
+    int         fanout_;        //!< subdirectories per table, 0 if flat
+    int         fanout_width_;  //!< hex digits in a subdirectory name
+    bool        atomic_put_;    //!< put via a temp file and rename()
+    bool        sync_puts_;     //!< fsync in put() rather than sync()
+    atomic_t    tmp_seq_;       //!< for naming temp files
+
+    AdaptiveLock          rename_lock_; //!< orders atomic puts with the fd cache
+    SpinLock              dirty_lock_;
+    std::set<std::string> dirty_dirs_; //!< changed since the last sync
 
     RefCountMap ref_count_;     // XXX/bowei -- not used for now
     int         default_perm_;  //!< Default permissions on database files
@@ -96,6 +132,30 @@ private:
     //! Wipe the database. @return 0 on no error.
     void tidy_database();
 
+    //! Create the subdirectories of a table, and move any files that
+    //! aren't in the right one (e.g. from a flat table) into place.
+    //! @return 0 on no error.
+    int layout_table(const std::string& dir_path);
+
+    //! Move a file from dir into its subdirectory of the table, under
+    //! the name key if given
+    int move_to_subdir(const std::string& table_path,
+                       const std::string& dir,
+                       const char*        name,
+                       const char*        key = 0);
+
+    /// @{ Which subdirectory a key lives in, and what it's called
+    int         subdir_of(const char* key) const;
+    std::string subdir_name(int subdir) const;
+    bool        is_subdir_name(const char* name) const;
+    /// @}
+
+    //! @return a fresh name in tmp_dir_
+    std::string tmp_path();
+
+    //! Note a directory entry that needs to be synced
+    void dirty_dir(const std::string& dir);
+
     /// @{ Changes the ref count on the tables
     // XXX/bowei -- implement me
     int acquire_table(const std::string& table);
@@ -126,11 +186,19 @@ public:
     size_t size() const;
     
     DurableIterator* itr();
+
+    //! Reads the files a batch at a time, in inode order
+    DurableIterator* bulk_itr(size_t batch = 0);
+
+    //! Splits the files up by the hash of their names
+    DurableIterator* part_itr(size_t part, size_t nparts, size_t batch = 0);
     //! @}
 
 private:
     std::string path_;
 
+    FileSystemStore* store_;
+
     /*!
      * Shared Fd cache.
      */
@@ -140,20 +208,51 @@ private:
                     const std::string&        table_name,
                     const std::string&        path,
                     bool                      multitype,
-                    FileSystemStore::FdCache* cache);
+                    FileSystemStore*          store);
 
     int get_common(const SerializableObject& key,
                    ExpandableBuffer* buf);
+
+    //! Write out the value for an fs_atomic_put_ store
+    int put_atomic(const std::string& dir,
+                   const std::string& filename,
+                   int                flags,
+                   const u_char*      buf,
+                   size_t             len);
+
+    //! Move a written temp file into place for put_atomic()
+    int install_tmp(const std::string& tmp,
+                    const std::string& filename,
+                    int                flags);
+
+    //! @return the directory holding the file for key
+    std::string key_dir(const char* key) const;
+
+    //! Get all of the directories holding the table's files
+    void get_dirs(std::vector<std::string>* dirs) const;
 };
 
-class FileSystemIterator : public DurableIterator {
+class FileSystemIterator : public DurableIterator, public Logger {
     friend class FileSystemTable;
 private:
     /**
-     * Create an iterator for table t. These should not be called
-     * except by FileSystemTable.
+     * Create an iterator over the files in the given directories.
+     * These should not be called except by FileSystemTable.
+     *
+     * With a batch size, the iterator reads that many directory
+     * entries at a time, sorts them by inode number (which on most
+     * file systems is close to disk order) and reads all of their
+     * files before returning the first, instead of leaving each one
+     * to a random read in get_data().
+     *
+     * Given a part of nparts, it skips the files whose names don't
+     * hash to that part.
      */
-    FileSystemIterator(const std::string& directory);
+    FileSystemIterator(const char*                     logpath,
+                       const std::vector<std::string>& dirs,
+                       size_t                          batch  = 0,
+                       size_t                          part   = 0,
+                       size_t                          nparts = 1);
 
 public:
     virtual ~FileSystemIterator();
@@ -161,11 +260,48 @@ public:
     //! @{ virtual from DurableIteratorImpl
     int next();
     int get_key(SerializableObject* key);
+    int get_data(SerializableObject* data);
+    int get_data(SerializableObject**        data,
+                 TypeCollection::Allocator_t allocator);
     //! @}
 
 protected:
-    struct dirent* ent_;
-    DIR*           dir_;
+    /// A file read ahead by a batched iterator
+    struct Prefetched {
+        ino_t       ino_;
+        size_t      dir_;       ///< index into dirs_
+        std::string name_;
+        std::string data_;
+    };
+
+    struct dirent*           ent_;
+    DIR*                     dir_;
+    std::vector<std::string> dirs_;
+    size_t                   cur_dir_;
+
+    size_t                   batch_;
+    size_t                   part_;
+    size_t                   nparts_;
+    std::vector<Prefetched>  prefetched_;
+    size_t                   prefetch_pos_;
+    std::string              data_;      ///< unbatched get_data buffer
+
+    //! @return the next directory entry, moving on through dirs_,
+    //! or NULL at the end (with errno set on error)
+    struct dirent* read_entry();
+
+    //! Read ahead the next batch of files that are still there
+    int fill_batch();
+
+    //! Read ahead up to batch_ files, setting *done at the end of the
+    //! directories
+    int read_batch(bool* done);
+
+    //! The name of the current file
+    const char* cur_name() const;
+
+    //! Get the current file's contents, or DS_NOTFOUND if it's gone
+    int cur_data(const std::string** data);
 };
 
 } // namespace oasys
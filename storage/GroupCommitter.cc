@@ -0,0 +1,114 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include "../util/Time.h"
+
+#include "DurableStore.h"
+#include "GroupCommitter.h"
+
+namespace oasys {
+
+//----------------------------------------------------------------------------
+GroupCommitter::GroupCommitter(const char* logpath, DurableStoreImpl* impl,
+                               int max_latency_ms, int max_batch)
+    : Logger("GroupCommitter", "%s/group_commit", logpath),
+      impl_(impl),
+      max_latency_ms_(max_latency_ms),
+      max_batch_(max_batch > 0 ? max_batch : 1),
+      leader_lock_("/oasys/storage/group_commit", Mutex::TYPE_FAST, true),
+      requested_(0),
+      synced_(0),
+      batch_full_("/oasys/storage/group_commit", true),
+      kicked_(0),
+      commits_(0),
+      syncs_(0)
+{
+}
+
+//----------------------------------------------------------------------------
+GroupCommitter::~GroupCommitter()
+{
+    log_debug("%u commits in %u syncs", commits_.value, syncs_.value);
+}
+
+//----------------------------------------------------------------------------
+int
+GroupCommitter::commit()
+{
+    atomic_incr(&commits_);
+
+    lock_.lock("GroupCommitter::commit");
+    u_int32_t ticket  = ++requested_;
+    u_int32_t pending = requested_ - synced_;
+    lock_.unlock();
+
+    // let a waiting leader know that the batch is full
+    if (pending >= static_cast<u_int32_t>(max_batch_) &&
+        atomic_cmpxchg32(&kicked_, 0, 1) == 0)
+    {
+        batch_full_.try_notify(1);
+    }
+
+    ScopeLock l(&leader_lock_, "GroupCommitter::commit");
+
+    lock_.lock("GroupCommitter::commit");
+    bool done = static_cast<int32_t>(synced_ - ticket) >= 0;
+    lock_.unlock();
+    if (done) {
+        return DS_OK;
+    }
+
+    // this thread leads the next batch, so give others a chance to
+    // join it
+    if (max_latency_ms_ > 0) {
+        Time start = Time::now();
+        while (true) {
+            lock_.lock("GroupCommitter::commit");
+            pending = requested_ - synced_;
+            lock_.unlock();
+
+            int left = max_latency_ms_ - static_cast<int>(start.elapsed_ms());
+            if (pending >= static_cast<u_int32_t>(max_batch_) || left <= 0) {
+                break;
+            }
+
+            batch_full_.wait(NULL, left);
+            atomic_cmpxchg32(&kicked_, 1, 0);
+        }
+    }
+
+    lock_.lock("GroupCommitter::commit");
+    u_int32_t target = requested_;
+    lock_.unlock();
+
+    atomic_incr(&syncs_);
+    if (impl_->sync() != DS_OK) {
+        log_err("sync failed, %u commits not durable", target - synced_);
+        return DS_ERR;
+    }
+
+    lock_.lock("GroupCommitter::commit");
+    synced_ = target;
+    lock_.unlock();
+
+    return DS_OK;
+}
+
+} // namespace oasys
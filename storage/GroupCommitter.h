@@ -0,0 +1,83 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef __GROUP_COMMITTER_H__
+#define __GROUP_COMMITTER_H__
+
+#include "../debug/Logger.h"
+#include "../thread/Atomic.h"
+#include "../thread/Mutex.h"
+#include "../thread/Notifier.h"
+#include "../thread/SpinLock.h"
+
+namespace oasys {
+
+class DurableStoreImpl;
+
+/**
+ * Coalesces durable commits from concurrent callers into a single
+ * DurableStoreImpl::sync().
+ *
+ * Each call to commit() takes a ticket and blocks until a sync that
+ * started after it has finished. The first caller to find no sync in
+ * progress becomes the leader: it waits up to max_latency_ms for
+ * more commits to arrive (or until max_batch are pending), then syncs
+ * once on behalf of all of them. Callers that queued up behind it
+ * find their ticket covered and return without syncing again.
+ *
+ * If a sync fails, the callers it would have covered are not marked
+ * durable, and each retries with a sync of its own.
+ */
+class GroupCommitter : public Logger {
+public:
+    GroupCommitter(const char* logpath, DurableStoreImpl* impl,
+                   int max_latency_ms, int max_batch);
+    ~GroupCommitter();
+
+    /**
+     * Block until everything the store has been given so far is
+     * durable.
+     *
+     * @return DS_OK or DS_ERR
+     */
+    int commit();
+
+    /// @{ Statistics
+    u_int32_t commits() const { return commits_.value; }
+    u_int32_t syncs()   const { return syncs_.value; }
+    /// @}
+
+private:
+    DurableStoreImpl* impl_;
+    int               max_latency_ms_;
+    int               max_batch_;
+
+    Mutex     leader_lock_;     ///< held by the thread doing the sync
+    SpinLock  lock_;            ///< protects requested_ and synced_
+    u_int32_t requested_;       ///< last ticket handed out
+    u_int32_t synced_;          ///< every ticket up to here is durable
+
+    Notifier  batch_full_;      ///< wakes a waiting leader
+    atomic_t  kicked_;          ///< a wakeup is pending
+
+    atomic_t  commits_;
+    atomic_t  syncs_;
+};
+
+} // namespace oasys
+
+#endif /* __GROUP_COMMITTER_H__ */
@@ -0,0 +1,1246 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../debug/DebugUtils.h"
+#include "../io/FileUtils.h"
+#include "../io/IO.h"
+#include "../serialize/MarshalSerialize.h"
+#include "../util/StringBuffer.h"
+
+#include "LogStore.h"
+#include "StorageConfig.h"
+
+namespace oasys {
+
+/// Size of the chunks the log is copied in during compaction
+#define LOG_STORE_COPY_CHUNK (256 * 1024)
+
+//----------------------------------------------------------------------------
+static inline int
+log_store_sync(int fd)
+{
+#ifdef HAVE_FDATASYNC
+    return fdatasync(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+//----------------------------------------------------------------------------
+static int
+log_store_sync_dir(const std::string& dir)
+{
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int err = fsync(fd);
+    close(fd);
+    return err;
+}
+
+//----------------------------------------------------------------------------
+static int
+log_store_write_record(CheckedLogWriter* writer, char op,
+                       const std::string& table, const std::string& key,
+                       TypeCollection::TypeCode_t typecode,
+                       const u_char* data, size_t data_len)
+{
+    ASSERT(table.length() <= 0xFFFF);
+
+    u_char fixed[11];
+    fixed[0]  = op;
+    fixed[1]  = (typecode >> 24) & 0xFF;
+    fixed[2]  = (typecode >> 16) & 0xFF;
+    fixed[3]  = (typecode >> 8)  & 0xFF;
+    fixed[4]  = typecode         & 0xFF;
+    fixed[5]  = (table.length() >> 8) & 0xFF;
+    fixed[6]  = table.length()        & 0xFF;
+    fixed[7]  = (key.length() >> 24) & 0xFF;
+    fixed[8]  = (key.length() >> 16) & 0xFF;
+    fixed[9]  = (key.length() >> 8)  & 0xFF;
+    fixed[10] = key.length()         & 0xFF;
+
+    struct iovec iov[4];
+    int iovcnt = 0;
+    iov[iovcnt].iov_base = fixed;
+    iov[iovcnt].iov_len  = sizeof(fixed);
+    ++iovcnt;
+    iov[iovcnt].iov_base = const_cast<char*>(table.data());
+    iov[iovcnt].iov_len  = table.length();
+    ++iovcnt;
+    iov[iovcnt].iov_base = const_cast<char*>(key.data());
+    iov[iovcnt].iov_len  = key.length();
+    ++iovcnt;
+    if (data_len != 0) {
+        iov[iovcnt].iov_base = const_cast<u_char*>(data);
+        iov[iovcnt].iov_len  = data_len;
+        ++iovcnt;
+    }
+
+    if (writer->write_record(iov, iovcnt) != 0) {
+        return -1;
+    }
+
+    return CheckedLogWriter::HEADER_LEN + sizeof(fixed) +
+        table.length() + key.length() + data_len;
+}
+
+/******************************************************************************
+ *
+ * LogStore
+ *
+ *****************************************************************************/
+LogStore::LogStore(const char* logpath)
+    : DurableStoreImpl("LogStore", logpath),
+      fd_(-1),
+      log_fd_(0),
+      io_(0),
+      writer_(0),
+      written_(0),
+      dead_bytes_(0),
+      sync_lock_("/oasys/storage/log/sync", Mutex::TYPE_FAST, true),
+      synced_(0),
+      sync_dir_(false),
+      sync_(false),
+      compact_lock_("/oasys/storage/log/compact", Mutex::TYPE_FAST, true),
+      compact_min_(0),
+      compact_pct_(0),
+      compact_pending_(false),
+      running_(false),
+      compact_notifier_("/oasys/storage/log/compact", true),
+      compactor_(0)
+{}
+
+//----------------------------------------------------------------------------
+LogStore::~LogStore()
+{
+    if (compactor_ != 0) {
+        running_ = false;
+        compact_notifier_.try_notify(1);
+        compactor_->join();
+        delete compactor_;
+        compactor_ = 0;
+    }
+
+    if (fd_ != -1) {
+        sync_to(written_);
+        delete writer_;
+        delete io_;
+        release_fd(log_fd_);
+    }
+
+    for (TableMap::iterator iter = tables_.begin();
+         iter != tables_.end(); ++iter)
+    {
+        delete iter->second;
+    }
+
+    log_info("db closed");
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::init(const StorageConfig& cfg)
+{
+    if (cfg.dbdir_ == "" || cfg.dbname_ == "") {
+        return DS_ERR;
+    }
+
+    db_dir_ = cfg.dbdir_;
+    FileUtils::abspath(&db_dir_);
+    log_path_ = db_dir_ + "/" + cfg.dbname_ + ".log";
+
+    if (cfg.tidy_) {
+        prune_db_dir(db_dir_.c_str(), cfg.tidy_wait_);
+    }
+
+    bool db_dir_exists;
+    if (check_db_dir(db_dir_.c_str(), &db_dir_exists) != 0) {
+        return DS_ERR;
+    }
+    if (! db_dir_exists) {
+        if (cfg.init_) {
+            if (create_db_dir(db_dir_.c_str()) != 0) {
+                return DS_ERR;
+            }
+        } else {
+            log_crit("DB dir %s does not exist and not told to create!",
+                     db_dir_.c_str());
+            return DS_ERR;
+        }
+    }
+
+    sync_        = cfg.log_sync_;
+    compact_min_ = cfg.log_compact_min_;
+    compact_pct_ = cfg.log_compact_pct_;
+
+    if (open_log(cfg.init_) != 0) {
+        return DS_ERR;
+    }
+
+    if (compact_pct_ > 0) {
+        running_   = true;
+        compactor_ = new CompactThread(this);
+        compactor_->start();
+    }
+
+    log_info("init() done: %zu tables, log %llu bytes (%llu dead)",
+             tables_.size(),
+             static_cast<unsigned long long>(written_),
+             static_cast<unsigned long long>(dead_bytes_));
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::open_log(bool create)
+{
+    int flags = O_RDWR | O_APPEND;
+    if (create) {
+        flags |= O_CREAT;
+    }
+
+    fd_ = open(log_path_.c_str(), flags, 0600);
+    if (fd_ < 0) {
+        log_err("can't open log file %s: %s",
+                log_path_.c_str(), strerror(errno));
+        return DS_ERR;
+    }
+
+    log_fd_ = new LogFd(fd_);
+    io_     = new FdIOClient(fd_, 0, logpath_);
+
+    int err = replay();
+    if (err != 0) {
+        return err;
+    }
+
+    writer_ = new CheckedLogWriter(io_);
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::replay()
+{
+    CheckedLogReader reader(io_);
+    ExpandableBuffer buf;
+    size_t records = 0;
+
+    while (true) {
+        off_t start = reader.offset();
+        int ret = reader.read_record(&buf);
+        if (ret == CheckedLogReader::END) {
+            break;
+        }
+
+        if (ret == CheckedLogReader::BAD_CRC) {
+            // most likely a write that didn't finish before a crash,
+            // and nothing after it can be trusted either
+            struct stat st;
+            fstat(fd_, &st);
+            log_warn("bad record at offset %llu, truncating %llu bytes",
+                     static_cast<unsigned long long>(start),
+                     static_cast<unsigned long long>(st.st_size - start));
+            if (ftruncate(fd_, start) != 0) {
+                log_err("can't truncate log: %s", strerror(errno));
+                return DS_ERR;
+            }
+            break;
+        }
+
+        off_t rec_len = reader.offset() - start;
+        if (ret == CheckedLogReader::IGNORE) {
+            dead_bytes_ += rec_len;
+            continue;
+        }
+
+        const u_char* p = reinterpret_cast<const u_char*>(buf.raw_buf());
+        if (buf.len() < REC_FIXED_LEN) {
+            log_err("short record at offset %llu",
+                    static_cast<unsigned long long>(start));
+            return DS_ERR;
+        }
+
+        char op = p[0];
+        TypeCollection::TypeCode_t typecode =
+            (p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+        size_t name_len = (p[5] << 8) | p[6];
+        size_t key_len  = (p[7] << 24) | (p[8] << 16) | (p[9] << 8) | p[10];
+        if (REC_FIXED_LEN + name_len + key_len > buf.len()) {
+            log_err("malformed record at offset %llu",
+                    static_cast<unsigned long long>(start));
+            return DS_ERR;
+        }
+
+        std::string table(reinterpret_cast<const char*>(p + REC_FIXED_LEN),
+                          name_len);
+        std::string key(reinterpret_cast<const char*>(
+                            p + REC_FIXED_LEN + name_len), key_len);
+        TableMap::iterator titer = tables_.find(table);
+
+        switch (op) {
+        case OP_CREATE:
+            if (titer == tables_.end()) {
+                tables_[table] = new Index();
+            }
+            break;
+
+        case OP_DROP:
+            if (titer != tables_.end()) {
+                Index* index = titer->second;
+                for (Index::iterator iter = index->begin();
+                     iter != index->end(); ++iter)
+                {
+                    dead_bytes_ += iter->second.rec_len_;
+                }
+                delete index;
+                tables_.erase(titer);
+            }
+            dead_bytes_ += rec_len;
+            break;
+
+        case OP_PUT: {
+            if (titer == tables_.end()) {
+                log_warn("put for unknown table %s at offset %llu",
+                         table.c_str(), static_cast<unsigned long long>(start));
+                dead_bytes_ += rec_len;
+                break;
+            }
+
+            Entry entry;
+            entry.offset_   = start;
+            entry.rec_len_  = rec_len;
+            entry.data_len_ = buf.len() - REC_FIXED_LEN - name_len - key_len;
+            entry.typecode_ = typecode;
+
+            Index* index = titer->second;
+            Index::iterator iter = index->find(key);
+            if (iter != index->end()) {
+                dead_bytes_ += iter->second.rec_len_;
+                iter->second = entry;
+            } else {
+                (*index)[key] = entry;
+            }
+            break;
+        }
+
+        case OP_DEL:
+            if (titer != tables_.end()) {
+                Index::iterator iter = titer->second->find(key);
+                if (iter != titer->second->end()) {
+                    dead_bytes_ += iter->second.rec_len_;
+                    titer->second->erase(iter);
+                }
+            }
+            dead_bytes_ += rec_len;
+            break;
+
+        default:
+            log_err("unknown record type 0x%x at offset %llu",
+                    op, static_cast<unsigned long long>(start));
+            return DS_ERR;
+        }
+
+        ++records;
+    }
+
+    written_ = reader.offset();
+    synced_  = written_;
+
+    log_debug("replayed %zu records from %s", records, log_path_.c_str());
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::append(char op, const std::string& table, const std::string& key,
+                 TypeCollection::TypeCode_t typecode,
+                 const u_char* data, size_t data_len, Entry* entry)
+{
+    ASSERT(lock_.is_locked_by_me());
+
+    int rec_len = log_store_write_record(writer_, op, table, key,
+                                         typecode, data, data_len);
+    if (rec_len < 0) {
+        log_err("error appending to log: %s", strerror(errno));
+
+        // don't leave a partial record for later ones to follow
+        if (ftruncate(fd_, written_) != 0) {
+            log_err("can't truncate log: %s", strerror(errno));
+        }
+        return DS_ERR;
+    }
+
+    if (entry != NULL) {
+        entry->offset_   = written_;
+        entry->rec_len_  = rec_len;
+        entry->data_len_ = data_len;
+        entry->typecode_ = typecode;
+    }
+
+    written_ += rec_len;
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+void
+LogStore::release_fd(LogFd* log_fd)
+{
+    if (--log_fd->refs_ == 0) {
+        close(log_fd->fd_);
+        delete log_fd;
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+LogStore::add_dead(off_t bytes)
+{
+    ASSERT(lock_.is_locked_by_me());
+
+    dead_bytes_ += bytes;
+
+    if (compactor_ != 0 && ! compact_pending_ &&
+        dead_bytes_ >= compact_min_ &&
+        dead_bytes_ * 100 >= written_ * compact_pct_)
+    {
+        compact_pending_ = true;
+        compact_notifier_.try_notify(1);
+    }
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::sync_to(off_t end)
+{
+    // whoever gets here first syncs everything written so far, which
+    // usually covers the records of those queued up behind it too
+    ScopeLock l(&sync_lock_, "LogStore::sync_to");
+    if (synced_ >= end) {
+        return 0;
+    }
+
+    lock_.lock("LogStore::sync_to");
+    off_t target = written_;
+    lock_.unlock();
+
+    if (log_store_sync(fd_) != 0) {
+        log_err("error syncing log: %s", strerror(errno));
+        return DS_ERR;
+    }
+
+    // left over from a compaction that couldn't sync its rename
+    if (sync_dir_) {
+        if (log_store_sync_dir(db_dir_) != 0) {
+            log_err("error syncing %s: %s", db_dir_.c_str(), strerror(errno));
+            return DS_ERR;
+        }
+        sync_dir_ = false;
+    }
+
+    synced_ = target;
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::end_transaction(void* txid, bool be_durable)
+{
+    (void)txid;
+
+    if (! be_durable) {
+        return DS_OK;
+    }
+
+    return sync();
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::sync()
+{
+    lock_.lock("LogStore::sync");
+    off_t end = written_;
+    lock_.unlock();
+
+    return (sync_to(end) == 0) ? DS_OK : DS_ERR;
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::get_table(DurableTableImpl** table,
+                    const std::string& name,
+                    int                flags,
+                    PrototypeVector&   prototypes)
+{
+    (void)prototypes;
+
+    Index* index;
+    off_t  end;
+    {
+        ScopeLock l(&lock_, "LogStore::get_table");
+
+        TableMap::iterator iter = tables_.find(name);
+        if (iter == tables_.end()) {
+            if (! (flags & DS_CREATE)) {
+                return DS_NOTFOUND;
+            }
+
+            if (append(OP_CREATE, name, "", 0, NULL, 0, NULL) != 0) {
+                return DS_ERR;
+            }
+
+            index = new Index();
+            tables_[name] = index;
+        } else {
+            if (flags & DS_EXCL) {
+                return DS_EXISTS;
+            }
+
+            index = iter->second;
+        }
+        end = written_;
+    }
+
+    if (sync_ && sync_to(end) != 0) {
+        return DS_ERR;
+    }
+
+    *table = new LogTable(logpath_, this, index, name,
+                          (flags & DS_MULTITYPE) != 0);
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::del_table(const std::string& name)
+{
+    log_info("deleting table %s", name.c_str());
+
+    off_t end;
+    {
+        ScopeLock l(&lock_, "LogStore::del_table");
+
+        TableMap::iterator iter = tables_.find(name);
+        if (iter == tables_.end()) {
+            return DS_NOTFOUND;
+        }
+
+        Entry drop;
+        if (append(OP_DROP, name, "", 0, NULL, 0, &drop) != 0) {
+            return DS_ERR;
+        }
+
+        Index* index = iter->second;
+        off_t dead = drop.rec_len_;
+        for (Index::iterator i = index->begin(); i != index->end(); ++i) {
+            dead += i->second.rec_len_;
+        }
+
+        delete index;
+        tables_.erase(iter);
+        add_dead(dead);
+        end = written_;
+    }
+
+    if (sync_ && sync_to(end) != 0) {
+        return DS_ERR;
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::get_table_names(StringVector* names)
+{
+    ScopeLock l(&lock_, "LogStore::get_table_names");
+
+    names->clear();
+    for (TableMap::const_iterator iter = tables_.begin();
+         iter != tables_.end(); ++iter)
+    {
+        names->push_back(iter->first);
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+std::string
+LogStore::get_info() const
+{
+    StringBuffer desc;
+    desc.appendf("LogStore %s", log_path_.c_str());
+    return std::string(desc.c_str(), desc.length());
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::copy_out(int fd, off_t offset, size_t len, ExpandableBuffer* buf)
+{
+    while (len > 0) {
+        size_t chunk = (len > LOG_STORE_COPY_CHUNK) ?
+                       LOG_STORE_COPY_CHUNK : len;
+        buf->reserve(chunk);
+
+        ssize_t cc = pread(fd_, buf->raw_buf(), chunk, offset);
+        if (cc != static_cast<ssize_t>(chunk)) {
+            log_err("error reading log: %s",
+                    cc < 0 ? strerror(errno) : "short read");
+            return DS_ERR;
+        }
+
+        if (IO::writeall(fd, buf->raw_buf(), chunk) !=
+            static_cast<int>(chunk))
+        {
+            log_err("error writing compacted log: %s", strerror(errno));
+            return DS_ERR;
+        }
+
+        offset += chunk;
+        len    -= chunk;
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::catch_up(int fd, off_t* copied, ExpandableBuffer* buf)
+{
+    while (true) {
+        lock_.lock("LogStore::catch_up");
+        off_t end = written_;
+        lock_.unlock();
+
+        if (end - *copied <= LOG_STORE_COPY_CHUNK) {
+            return 0;
+        }
+
+        if (copy_out(fd, *copied, end - *copied, buf) != 0) {
+            return DS_ERR;
+        }
+        *copied = end;
+    }
+}
+
+//----------------------------------------------------------------------------
+int
+LogStore::compact()
+{
+    ScopeLock c(&compact_lock_, "LogStore::compact");
+
+    // Take a snapshot of where the live records are. Nothing before
+    // the current end of the log ever changes, so they can then be
+    // copied out without holding up puts and gets.
+    std::vector<std::pair<off_t, u_int32_t> > live;
+    StringVector names;
+    off_t snap, dead_at_snap;
+    {
+        ScopeLock l(&lock_, "LogStore::compact");
+        snap         = written_;
+        dead_at_snap = dead_bytes_;
+
+        for (TableMap::iterator titer = tables_.begin();
+             titer != tables_.end(); ++titer)
+        {
+            names.push_back(titer->first);
+            Index* index = titer->second;
+            for (Index::iterator iter = index->begin();
+                 iter != index->end(); ++iter)
+            {
+                live.push_back(std::make_pair(iter->second.offset_,
+                                              iter->second.rec_len_));
+            }
+        }
+    }
+
+    // copy them in log order, so the old log is read sequentially
+    std::sort(live.begin(), live.end());
+
+    std::string tmp_path = log_path_ + ".compact";
+    int fd = open(tmp_path.c_str(),
+                  O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    if (fd < 0) {
+        log_err("can't create %s: %s", tmp_path.c_str(), strerror(errno));
+        return DS_ERR;
+    }
+
+    FdIOClient* io = new FdIOClient(fd, 0, logpath_);
+    CheckedLogWriter* writer = new CheckedLogWriter(io);
+    std::vector<off_t> new_offsets;
+    new_offsets.reserve(live.size());
+    off_t pos = 0;
+    int   err = 0;
+
+    for (size_t i = 0; i < names.size() && err == 0; ++i) {
+        int len = log_store_write_record(writer, OP_CREATE, names[i], "",
+                                         0, NULL, 0);
+        if (len < 0) {
+            log_err("error writing compacted log: %s", strerror(errno));
+            err = DS_ERR;
+        }
+        pos += len;
+    }
+
+    // gather runs of records into one big write
+    ExpandableBuffer out(LOG_STORE_COPY_CHUNK);
+    for (size_t i = 0; i < live.size() && err == 0; ++i) {
+        u_int32_t len = live[i].second;
+        new_offsets.push_back(pos + out.len());
+
+        ssize_t cc = pread(fd_, out.tail_buf(len), len, live[i].first);
+        if (cc != static_cast<ssize_t>(len)) {
+            log_err("error reading log: %s",
+                    cc < 0 ? strerror(errno) : "short read");
+            err = DS_ERR;
+            break;
+        }
+        out.incr_len(len);
+
+        if (out.len() >= LOG_STORE_COPY_CHUNK || i == live.size() - 1) {
+            if (io->writeall(out.raw_buf(), out.len()) !=
+                static_cast<int>(out.len()))
+            {
+                log_err("error writing compacted log: %s", strerror(errno));
+                err = DS_ERR;
+            }
+            pos += out.len();
+            out.clear();
+        }
+    }
+
+    // Catch up with the records appended since the snapshot, still
+    // without the locks, until what's left is small
+    off_t copied = snap;
+    if (err == 0) {
+        err = catch_up(fd, &copied, &out);
+    }
+
+    // Hold off commits, which would otherwise sync the old
+    // descriptor, so synced_ stays put from here on. Everything up to
+    // the current end of the log, which covers whatever a commit has
+    // promised is on disk, is copied and synced while puts and gets
+    // go on.
+    ScopeLock s(&sync_lock_, "LogStore::compact");
+    if (err == 0) {
+        lock_.lock("LogStore::compact");
+        off_t end = written_;
+        lock_.unlock();
+
+        err = copy_out(fd, copied, end - copied, &out);
+        copied = end;
+    }
+
+    if (err == 0 && log_store_sync(fd) != 0) {
+        log_err("error syncing compacted log: %s", strerror(errno));
+        err = DS_ERR;
+    }
+    off_t synced = copied;
+
+    // Catch up again with what was appended during the sync, then
+    // hold off puts while the small rest is copied and the new log is
+    // swapped in. None of that rest has been promised to be on disk,
+    // so a crash at worst leaves a torn tail, which replay() cuts off.
+    if (err == 0) {
+        err = catch_up(fd, &copied, &out);
+    }
+
+    lock_.lock("LogStore::compact");
+
+    off_t tail = written_ - snap;
+    if (err == 0) {
+        err = copy_out(fd, copied, written_ - copied, &out);
+    }
+
+    if (err == 0 && rename(tmp_path.c_str(), log_path_.c_str()) != 0) {
+        log_err("can't rename %s: %s", tmp_path.c_str(), strerror(errno));
+        err = DS_ERR;
+    }
+
+    if (err != 0) {
+        lock_.unlock();
+        delete writer;
+        delete io;
+        close(fd);
+        unlink(tmp_path.c_str());
+        return DS_ERR;
+    }
+
+    // point the index entries into the new log
+    off_t delta = pos - snap;
+    for (TableMap::iterator titer = tables_.begin();
+         titer != tables_.end(); ++titer)
+    {
+        Index* index = titer->second;
+        for (Index::iterator iter = index->begin();
+             iter != index->end(); ++iter)
+        {
+            Entry* entry = &iter->second;
+            if (entry->offset_ >= snap) {
+                entry->offset_ += delta;
+                continue;
+            }
+
+            std::vector<std::pair<off_t, u_int32_t> >::iterator old =
+                std::lower_bound(live.begin(), live.end(),
+                                 std::make_pair(entry->offset_,
+                                                static_cast<u_int32_t>(0)));
+            ASSERT(old != live.end() && old->first == entry->offset_);
+            entry->offset_ = new_offsets[old - live.begin()];
+        }
+    }
+
+    off_t old_size = written_;
+
+    // readers still in the middle of a pread keep the old log open
+    delete writer_;
+    delete io_;
+    release_fd(log_fd_);
+    fd_     = fd;
+    log_fd_ = new LogFd(fd);
+    io_     = io;
+    writer_ = writer;
+
+    written_     = pos + tail;
+    dead_bytes_ -= dead_at_snap;
+    synced      += delta;
+
+    lock_.unlock();
+
+    // Until the rename is on disk, a crash brings back the old log,
+    // so nothing written to the new one may count as synced before.
+    // Puts and gets can go on meanwhile, but commits can't. The new
+    // log is in place either way, so if this fails the next commit
+    // tries again.
+    bool dir_synced = true;
+    if (log_store_sync_dir(db_dir_) != 0) {
+        log_err("error syncing %s after rename: %s",
+                db_dir_.c_str(), strerror(errno));
+        dir_synced = false;
+    }
+    synced_   = dir_synced ? synced : 0;
+    sync_dir_ = ! dir_synced;
+
+    log_info("compacted log from %llu to %llu bytes",
+             static_cast<unsigned long long>(old_size),
+             static_cast<unsigned long long>(pos + tail));
+
+    return dir_synced ? 0 : DS_ERR;
+}
+
+//----------------------------------------------------------------------------
+void
+LogStore::CompactThread::run()
+{
+    while (store_->running_) {
+        store_->compact_notifier_.wait();
+        if (! store_->running_) {
+            break;
+        }
+
+        store_->compact();
+
+        ScopeLock l(&store_->lock_, "LogStore::CompactThread");
+        store_->compact_pending_ = false;
+    }
+}
+
+/******************************************************************************
+ *
+ * LogTable
+ *
+ *****************************************************************************/
+LogTable::LogTable(const char* logpath, LogStore* store, LogStore::Index* index,
+                   const std::string& name, bool multitype)
+    : DurableTableImpl(name, multitype),
+      Logger("LogTable", "%s/%s", logpath, name.c_str()),
+      store_(store),
+      index_(index)
+{
+}
+
+//----------------------------------------------------------------------------
+LogTable::~LogTable()
+{
+}
+
+//----------------------------------------------------------------------------
+int
+LogTable::get_common(const SerializableObject& key,
+                     ScratchBuffer<u_char*, 256>* buf,
+                     TypeCollection::TypeCode_t* typecode)
+{
+    ScratchBuffer<u_char*, 256> key_buf;
+    flatten(key, &key_buf);
+    std::string table_key(reinterpret_cast<char*>(key_buf.buf()),
+                          key_buf.len());
+
+    return read_data(table_key, buf, typecode);
+}
+
+//----------------------------------------------------------------------------
+int
+LogTable::read_data(const std::string& table_key,
+                    ScratchBuffer<u_char*, 256>* buf,
+                    TypeCollection::TypeCode_t* typecode)
+{
+    // Look the key up and pin the log it points into, but read the
+    // data without the lock so that gets don't queue up behind each
+    // other's disk reads.
+    LogStore::Entry  entry;
+    LogStore::LogFd* log_fd;
+    {
+        ScopeLock l(&store_->lock_, "LogTable::get");
+
+        LogStore::Index::iterator iter = index_->find(table_key);
+        if (iter == index_->end()) {
+            return DS_NOTFOUND;
+        }
+
+        entry  = iter->second;
+        log_fd = store_->log_fd_;
+        ++log_fd->refs_;
+    }
+
+    off_t offset = entry.offset_ + entry.rec_len_ - entry.data_len_;
+    ssize_t cc = pread(log_fd->fd_, buf->buf(entry.data_len_),
+                       entry.data_len_, offset);
+    int err = errno;
+
+    {
+        ScopeLock l(&store_->lock_, "LogTable::get");
+        store_->release_fd(log_fd);
+    }
+
+    if (cc != static_cast<ssize_t>(entry.data_len_)) {
+        log_err("error reading %u bytes at offset %llu: %s",
+                entry.data_len_, static_cast<unsigned long long>(offset),
+                cc < 0 ? strerror(err) : "short read");
+        return DS_ERR;
+    }
+    buf->set_len(entry.data_len_);
+    *typecode = entry.typecode_;
+
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+int
+LogTable::get(const SerializableObject& key,
+              SerializableObject*       data)
+{
+    ASSERTF(!multitype_, "single-type get called for multi-type table");
+
+    ScratchBuffer<u_char*, 256> buf;
+    TypeCollection::TypeCode_t typecode;
+    int err = get_common(key, &buf, &typecode);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    Unmarshal unm(Serialize::CONTEXT_LOCAL, buf.buf(), buf.len());
+    if (unm.action(data) != 0) {
+        log_err("error unserializing data object");
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+int
+LogTable::get(const SerializableObject&   key,
+              SerializableObject**        data,
+              TypeCollection::Allocator_t allocator)
+{
+    ASSERTF(multitype_, "multi-type get called for single-type table");
+
+    ScratchBuffer<u_char*, 256> buf;
+    TypeCollection::TypeCode_t typecode;
+    int err = get_common(key, &buf, &typecode);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    err = allocator(typecode, data);
+    if (err != 0) {
+        return DS_ERR;
+    }
+
+    Unmarshal unm(Serialize::CONTEXT_LOCAL, buf.buf(), buf.len());
+    if (unm.action(*data) != 0) {
+        log_err("error unserializing data object");
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+int
+LogTable::put(const SerializableObject& key,
+              TypeCollection::TypeCode_t typecode,
+              const SerializableObject* data,
+              int                       flags)
+{
+    ScratchBuffer<u_char*, 256> key_buf;
+    flatten(key, &key_buf);
+    std::string table_key(reinterpret_cast<char*>(key_buf.buf()),
+                          key_buf.len());
+
+    // serialize before taking the lock
+    ScratchBuffer<u_char*, 1024> data_buf;
+    Marshal m(Serialize::CONTEXT_LOCAL, &data_buf);
+    if (m.action(data) != 0) {
+        log_err("error serializing data object");
+        return DS_ERR;
+    }
+
+    off_t end;
+    {
+        ScopeLock l(&store_->lock_, "LogTable::put");
+
+        LogStore::Index::iterator iter = index_->find(table_key);
+        if (iter == index_->end()) {
+            if (! (flags & DS_CREATE)) {
+                return DS_NOTFOUND;
+            }
+        } else if (flags & DS_EXCL) {
+            return DS_EXISTS;
+        }
+
+        LogStore::Entry entry;
+        if (store_->append(LogStore::OP_PUT, table_name_, table_key, typecode,
+                           data_buf.buf(), data_buf.len(), &entry) != 0)
+        {
+            return DS_ERR;
+        }
+
+        if (iter != index_->end()) {
+            store_->add_dead(iter->second.rec_len_);
+            iter->second = entry;
+        } else {
+            (*index_)[table_key] = entry;
+        }
+        end = store_->written_;
+    }
+
+    if (store_->sync_ && store_->sync_to(end) != 0) {
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+int
+LogTable::del(const SerializableObject& key)
+{
+    ScratchBuffer<u_char*, 256> key_buf;
+    flatten(key, &key_buf);
+    std::string table_key(reinterpret_cast<char*>(key_buf.buf()),
+                          key_buf.len());
+
+    off_t end;
+    {
+        ScopeLock l(&store_->lock_, "LogTable::del");
+
+        LogStore::Index::iterator iter = index_->find(table_key);
+        if (iter == index_->end()) {
+            return DS_NOTFOUND;
+        }
+
+        LogStore::Entry entry;
+        if (store_->append(LogStore::OP_DEL, table_name_, table_key, 0,
+                           NULL, 0, &entry) != 0)
+        {
+            return DS_ERR;
+        }
+
+        // the tombstone is only needed until the next compaction
+        store_->add_dead(iter->second.rec_len_ + entry.rec_len_);
+        index_->erase(iter);
+        end = store_->written_;
+    }
+
+    if (store_->sync_ && store_->sync_to(end) != 0) {
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+size_t
+LogTable::size() const
+{
+    ScopeLock l(&store_->lock_, "LogTable::size");
+    return index_->size();
+}
+
+//----------------------------------------------------------------------------
+DurableIterator*
+LogTable::itr()
+{
+    return new LogIterator(this);
+}
+
+//----------------------------------------------------------------------------
+DurableIterator*
+LogTable::part_itr(size_t part, size_t nparts, size_t batch)
+{
+    (void)batch;
+    ASSERT(part < nparts);
+    return new LogIterator(this, part, nparts);
+}
+
+/******************************************************************************
+ *
+ * LogIterator
+ *
+ *****************************************************************************/
+LogIterator::LogIterator(LogTable* table, size_t part, size_t nparts)
+    : table_(table), cur_(0), first_(true)
+{
+    std::vector<std::pair<off_t, const std::string*> > order;
+    ScopeLock l(&table->store_->lock_, "LogIterator");
+
+    order.reserve(table->index_->size());
+    for (LogStore::Index::iterator iter = table->index_->begin();
+         iter != table->index_->end(); ++iter)
+    {
+        order.push_back(std::make_pair(iter->second.offset_, &iter->first));
+    }
+    std::sort(order.begin(), order.end());
+
+    size_t begin = order.size() * part / nparts;
+    size_t end   = order.size() * (part + 1) / nparts;
+    keys_.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+        keys_.push_back(*order[i].second);
+    }
+}
+
+//----------------------------------------------------------------------------
+LogIterator::~LogIterator()
+{
+}
+
+//----------------------------------------------------------------------------
+int
+LogIterator::next()
+{
+    if (first_) {
+        first_ = false;
+    } else {
+        ++cur_;
+    }
+
+    if (cur_ >= keys_.size()) {
+        return DS_NOTFOUND;
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+LogIterator::get_key(SerializableObject* key)
+{
+    ASSERT(key != NULL);
+    ASSERT(cur_ < keys_.size());
+
+    const std::string& str = keys_[cur_];
+    Unmarshal unm(Serialize::CONTEXT_LOCAL,
+                  reinterpret_cast<const u_char*>(str.data()), str.length());
+    if (unm.action(key) != 0) {
+        log_err_p("/oasys/storage/log", "error unmarshalling key");
+        return DS_ERR;
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+LogIterator::get_data(SerializableObject* data)
+{
+    ASSERTF(!table_->multitype_,
+            "single-type get_data called for multi-type table");
+    ASSERT(cur_ < keys_.size());
+
+    ScratchBuffer<u_char*, 256> buf;
+    TypeCollection::TypeCode_t typecode;
+    int err = table_->read_data(keys_[cur_], &buf, &typecode);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    Unmarshal unm(Serialize::CONTEXT_LOCAL, buf.buf(), buf.len());
+    if (unm.action(data) != 0) {
+        log_err_p("/oasys/storage/log", "error unserializing data object");
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+int
+LogIterator::get_data(SerializableObject**        data,
+                      TypeCollection::Allocator_t allocator)
+{
+    ASSERTF(table_->multitype_,
+            "multi-type get_data called for single-type table");
+    ASSERT(cur_ < keys_.size());
+
+    ScratchBuffer<u_char*, 256> buf;
+    TypeCollection::TypeCode_t typecode;
+    int err = table_->read_data(keys_[cur_], &buf, &typecode);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    if (allocator(typecode, data) != 0) {
+        return DS_ERR;
+    }
+
+    Unmarshal unm(Serialize::CONTEXT_LOCAL, buf.buf(), buf.len());
+    if (unm.action(*data) != 0) {
+        log_err_p("/oasys/storage/log", "error unserializing data object");
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+} // namespace oasys
@@ -0,0 +1,303 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef __LOG_STORE_H__
+#define __LOG_STORE_H__
+
+#include <vector>
+
+#include "../debug/Logger.h"
+#include "../io/FdIOClient.h"
+#include "../thread/Mutex.h"
+#include "../thread/Notifier.h"
+#include "../thread/SpinLock.h"
+#include "../thread/Thread.h"
+#include "../util/ScratchBuffer.h"
+#include "../util/StringUtils.h"
+
+#include "CheckedLog.h"
+#include "DurableStore.h"
+
+namespace oasys {
+
+class StorageConfig;
+
+class LogStore;
+class LogTable;
+class LogIterator;
+
+/**
+ * An append-only, log structured store.
+ *
+ * Every change to any table is appended as a CheckedLog record to a
+ * single log file, and an in-memory hash index per table maps each
+ * key to the record holding its current value, which get() reads back
+ * with one pread(). Puts therefore cost one sequential write, and
+ * recovery is a single pass over the log, which stops (and truncates)
+ * at the first torn or corrupt record.
+ *
+ * Writes reach the disk in groups. With log_sync_ set, put() and
+ * del() return once their record is on disk, and all the callers
+ * waiting at the same time share one fdatasync(). Otherwise records
+ * are only forced out by a durable end_transaction() or on close.
+ *
+ * Overwritten and deleted records are dead space. Once there is
+ * enough of it, a background thread copies the live records to a new
+ * log, while puts and gets carry on against the old one. Only the
+ * last few records appended in the meantime (less than a copy chunk)
+ * are copied with puts held off, just before the new log is swapped
+ * in. Commits wait while the new log is synced and put in place.
+ */
+class LogStore : public DurableStoreImpl {
+    friend class LogTable;
+    friend class LogIterator;
+
+public:
+    LogStore(const char* logpath);
+
+    // Can't copy or =, don't implement these
+    LogStore& operator=(const LogStore&);
+    LogStore(const LogStore&);
+
+    ~LogStore();
+
+    //! @{ virtual from DurableStoreImpl
+    int init(const StorageConfig& cfg);
+    int get_table(DurableTableImpl** table,
+                  const std::string& name,
+                  int                flags,
+                  PrototypeVector&   prototypes);
+    int del_table(const std::string& name);
+    int get_table_names(StringVector* names);
+    std::string get_info() const;
+    bool concurrent_reads() const { return true; }
+
+    //! A durable end_transaction forces out everything written so
+    //! far.
+    int end_transaction(void* txid, bool be_durable);
+    int sync();
+    //! @}
+
+    /**
+     * Rewrite the log with only the live records. Normally called
+     * from the compaction thread, but safe to call at any time.
+     *
+     * @return 0 on success, DS_ERR otherwise
+     */
+    int compact();
+
+    /// @{ Accessors, mostly for testing
+    off_t log_size()   const { return written_; }
+    off_t dead_bytes() const { return dead_bytes_; }
+    /// @}
+
+private:
+    /// Record types, the first byte of each log record
+    enum {
+        OP_PUT    = 'P',
+        OP_DEL    = 'D',
+        OP_CREATE = 'C',
+        OP_DROP   = 'X',
+    };
+
+    /// Bytes in each record before the table name: op, typecode,
+    /// table name length and key length
+    enum { REC_FIXED_LEN = 11 };
+
+    /// Where the current value for a key lives in the log
+    struct Entry {
+        off_t                      offset_;   ///< start of the record
+        u_int32_t                  rec_len_;  ///< including the header
+        u_int32_t                  data_len_; ///< data is at the end
+        TypeCollection::TypeCode_t typecode_;
+    };
+
+    /// Index of serialized key to entry, one per table
+    typedef StringHashMap<Entry> Index;
+    typedef StringMap<Index*> TableMap;
+
+    /// The log's descriptor, counted so that get() can read from it
+    /// without holding lock_, even if compact() swaps in a new log
+    struct LogFd {
+        LogFd(int fd) : fd_(fd), refs_(1) {}
+
+        int fd_;
+        int refs_;      ///< protected by lock_, one of them the store's
+    };
+
+    class CompactThread : public Thread {
+    public:
+        CompactThread(LogStore* store)
+            : Thread("LogStore::CompactThread", CREATE_JOINABLE),
+              store_(store) {}
+    protected:
+        void run();
+        LogStore* store_;
+    };
+    friend class CompactThread;
+
+    std::string  db_dir_;       ///< directory holding the log
+    std::string  log_path_;     ///< path of the log file
+    int          fd_;           ///< the log file
+    LogFd*       log_fd_;       ///< fd_ for readers
+    FdIOClient*  io_;
+    CheckedLogWriter* writer_;
+
+    SpinLock     lock_;         ///< protects the indexes and appends
+    TableMap     tables_;
+    off_t        written_;      ///< end of the log
+    off_t        dead_bytes_;   ///< bytes in superseded records
+
+    Mutex        sync_lock_;    ///< serializes (group) commits
+    off_t        synced_;       ///< everything before this is on disk
+    bool         sync_dir_;     ///< db_dir_ needs an fsync as well
+    bool         sync_;         ///< commit every put and del
+
+    Mutex        compact_lock_; ///< one compaction at a time
+    off_t        compact_min_;  ///< dead bytes before compacting
+    int          compact_pct_;  ///< percent of the log that is dead
+    bool         compact_pending_;
+    volatile bool running_;
+    Notifier     compact_notifier_;
+    CompactThread* compactor_;
+
+    /// Open (or create) the log and replay it into the indexes
+    int open_log(bool create);
+
+    /// Rebuild the indexes from the log, truncating a torn tail
+    int replay();
+
+    /**
+     * Append a record, with lock_ held. The data may be NULL.
+     *
+     * @return 0 on success, with the record's place in *entry
+     */
+    int append(char op, const std::string& table, const std::string& key,
+               TypeCollection::TypeCode_t typecode,
+               const u_char* data, size_t data_len, Entry* entry);
+
+    /// Drop a reference to a LogFd, with lock_ held, closing it if
+    /// that was the last one
+    void release_fd(LogFd* log_fd);
+
+    /// Account for a superseded record, with lock_ held, and start a
+    /// compaction if enough of the log is now dead
+    void add_dead(off_t bytes);
+
+    /**
+     * Make sure the log is on disk up to (at least) end. Callers that
+     * wait behind another's fdatasync() are usually covered by it and
+     * return without one of their own.
+     */
+    int sync_to(off_t end);
+
+    /// Copy len bytes at offset in the log to the given descriptor
+    int copy_out(int fd, off_t offset, size_t len,
+                 ExpandableBuffer* buf);
+
+    /// Copy the log from *copied on, until less than a chunk is left
+    int catch_up(int fd, off_t* copied, ExpandableBuffer* buf);
+};
+
+/**
+ * A table in a LogStore. Instances opened on the same table share its
+ * index in the store.
+ */
+class LogTable : public DurableTableImpl, public Logger {
+    friend class LogStore;
+    friend class LogIterator;
+
+public:
+    ~LogTable();
+
+    /// @{ virtual from DurableTableImpl
+    int get(const SerializableObject& key,
+            SerializableObject* data);
+
+    int get(const SerializableObject& key,
+            SerializableObject** data,
+            TypeCollection::Allocator_t allocator);
+
+    int put(const SerializableObject& key,
+            TypeCollection::TypeCode_t typecode,
+            const SerializableObject* data,
+            int flags);
+
+    int del(const SerializableObject& key);
+
+    size_t size() const;
+
+    DurableIterator* itr();
+
+    /// Splits the keys, in log order, into contiguous runs
+    DurableIterator* part_itr(size_t part, size_t nparts, size_t batch = 0);
+    /// @}
+
+private:
+    LogStore*        store_;
+    LogStore::Index* index_;
+
+    //! Only LogStore can create LogTables
+    LogTable(const char* logpath, LogStore* store, LogStore::Index* index,
+             const std::string& name, bool multitype);
+
+    /// Read the data for a key into buf. @return DS_OK, DS_NOTFOUND
+    /// or DS_ERR
+    int get_common(const SerializableObject& key,
+                   ScratchBuffer<u_char*, 256>* buf,
+                   TypeCollection::TypeCode_t* typecode);
+
+    /// get_common() for an already serialized key
+    int read_data(const std::string& table_key,
+                  ScratchBuffer<u_char*, 256>* buf,
+                  TypeCollection::TypeCode_t* typecode);
+};
+
+/**
+ * Iterator over a LogTable. The keys are copied out when the iterator
+ * is created, so changes to the table don't affect it. They come back
+ * in log order, so that reading the data for each one with
+ * get_data() goes through the log sequentially.
+ */
+class LogIterator : public DurableIterator {
+    friend class LogTable;
+
+private:
+    /// Iterate over the given part of the table's keys
+    LogIterator(LogTable* table, size_t part = 0, size_t nparts = 1);
+
+public:
+    virtual ~LogIterator();
+
+    //! @{ virtual from DurableIterator
+    int next();
+    int get_key(SerializableObject* key);
+    int get_data(SerializableObject* data);
+    int get_data(SerializableObject**        data,
+                 TypeCollection::Allocator_t allocator);
+    //! @}
+
+protected:
+    LogTable*                table_;
+    std::vector<std::string> keys_;
+    size_t                   cur_;
+    bool                     first_;
+};
+
+} // namespace oasys
+
+#endif /* __LOG_STORE_H__ */
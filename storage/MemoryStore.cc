@@ -21,6 +21,7 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <unistd.h>
+#include <algorithm>
 
 #include <debug/DebugUtils.h>
 #include <util/StringBuffer.h>
@@ -40,12 +41,14 @@ namespace oasys {
 
 MemoryStore::MemoryStore(const char* logpath) 
     : DurableStoreImpl("MemoryStore", logpath),
-      init_(false)
+      init_(false),
+      shards_(0)
 {}
 
 //----------------------------------------------------------------------------
 MemoryStore::~MemoryStore()
 {
+    clear_tables();
     log_info("db closed");
 }
 
@@ -54,7 +57,12 @@ int
 MemoryStore::init(const StorageConfig& cfg)
 {
     if (cfg.tidy_) {
-        tables_.clear();
+        clear_tables();
+    }
+
+    shards_ = cfg.mem_shards_;
+    if (shards_ > 0) {
+        log_debug("using %d shards per table", shards_);
     }
  
     init_ = true;
@@ -62,6 +70,18 @@ MemoryStore::init(const StorageConfig& cfg)
     return 0;
 }
 
+//----------------------------------------------------------------------------
+void
+MemoryStore::clear_tables()
+{
+    for (TableMap::iterator iter = tables_.begin();
+         iter != tables_.end(); ++iter)
+    {
+        delete iter->second;
+    }
+    tables_.clear();
+}
+
 //----------------------------------------------------------------------------
 int
 MemoryStore::get_table(DurableTableImpl**  table,
@@ -74,24 +94,25 @@ MemoryStore::get_table(DurableTableImpl**  table,
     // XXX/bowei -- || access?
     TableMap::iterator iter = tables_.find(name);
 
-    MemoryTable::ItemMap* items;
+    MemoryTable::Contents* contents;
     
     if (iter == tables_.end()) {
         if (! (flags & DS_CREATE)) {
             return DS_NOTFOUND;
         }
         
-        tables_[name] = MemoryTable::ItemMap();
-        items = &tables_[name];
+        contents = new MemoryTable::Contents(shards_);
+        tables_[name] = contents;
     } else {
         if (flags & DS_EXCL) {
             return DS_EXISTS;
         }
 
-        items = &iter->second;
+        contents = iter->second;
     }
 
-    *table = new MemoryTable(logpath_, items, name, (flags & DS_MULTITYPE) != 0);
+    *table = new MemoryTable(logpath_, contents, name,
+                             (flags & DS_MULTITYPE) != 0);
 
     return DS_OK;
 }
@@ -102,7 +123,11 @@ MemoryStore::del_table(const std::string& name)
 {
     // XXX/bowei -- busy tables?
     log_info("deleting table %s", name.c_str());
-    tables_.erase(name);
+    TableMap::iterator iter = tables_.find(name);
+    if (iter != tables_.end()) {
+        delete iter->second;
+        tables_.erase(iter);
+    }
     return 0;
 }
 
@@ -134,11 +159,72 @@ MemoryStore::get_info() const
  * MemoryTable
  *
  *****************************************************************************/
-MemoryTable::MemoryTable(const char* logpath, ItemMap* items,
+
+/// Most Items a shard keeps around for reuse
+#define MEMORY_SHARD_MAX_FREE 1024
+
+//----------------------------------------------------------------------------
+MemoryTable::Contents::Contents(size_t nshards)
+    : shard_mask_(0), size_(0)
+{
+    if (nshards == 0) {
+        return;
+    }
+
+    size_t n = 1;
+    while (n < nshards) {
+        n <<= 1;
+    }
+    
+    for (size_t i = 0; i < n; ++i) {
+        shards_.push_back(new Shard());
+    }
+    shard_mask_ = n - 1;
+}
+
+//----------------------------------------------------------------------------
+MemoryTable::Contents::~Contents()
+{
+    for (ItemMap::iterator iter = items_.begin();
+         iter != items_.end(); ++iter)
+    {
+        delete iter->second;
+    }
+
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        Shard* shard = shards_[i];
+        for (ItemHash::iterator iter = shard->items_.begin();
+             iter != shard->items_.end(); ++iter)
+        {
+            delete iter->second;
+        }
+        for (size_t j = 0; j < shard->free_.size(); ++j) {
+            delete shard->free_[j];
+        }
+        delete shard;
+    }
+}
+
+//----------------------------------------------------------------------------
+MemoryTable::Shard*
+MemoryTable::Contents::shard(const std::string& key)
+{
+    if (shards_.empty()) {
+        return NULL;
+    }
+
+    // the string hash is weak in the low bits for short, similar
+    // keys, so mix it before picking a shard
+    u_int32_t h = static_cast<u_int32_t>(StringHash()(key)) * 0x9E3779B1U;
+    return shards_[(h ^ (h >> 16)) & shard_mask_];
+}
+
+//----------------------------------------------------------------------------
+MemoryTable::MemoryTable(const char* logpath, Contents* contents,
                          const std::string& name, bool multitype)
     : DurableTableImpl(name, multitype),
       Logger("MemoryTable", "%s/%s", logpath, name.c_str()),
-      items_(items)
+      contents_(contents)
 {
 }
 
@@ -147,6 +233,31 @@ MemoryTable::~MemoryTable()
 {
 }
 
+//----------------------------------------------------------------------------
+void
+MemoryTable::table_key(const SerializableObject& key, std::string* str)
+{
+    StringSerialize serialize(Serialize::CONTEXT_LOCAL,
+                              StringSerialize::DOT_SEPARATED);
+    if (serialize.action(&key) != 0) {
+        PANIC("error sizing key");
+    }
+    str->assign(serialize.buf().data(), serialize.buf().length());
+}
+
+//----------------------------------------------------------------------------
+MemoryTable::Item*
+MemoryTable::find_item(const std::string& key, Shard* shard)
+{
+    if (shard == NULL) {
+        ItemMap::iterator iter = contents_->items_.find(key);
+        return (iter == contents_->items_.end()) ? NULL : iter->second;
+    }
+
+    ItemHash::iterator iter = shard->items_.find(key);
+    return (iter == shard->items_.end()) ? NULL : iter->second;
+}
+
 //----------------------------------------------------------------------------
 int 
 MemoryTable::get(const SerializableObject& key, 
@@ -154,22 +265,22 @@ MemoryTable::get(const SerializableObject& key,
 {
     ASSERTF(!multitype_, "single-type get called for multi-type table");
     
-    StringSerialize serialize(Serialize::CONTEXT_LOCAL,
-                              StringSerialize::DOT_SEPARATED);
-    if (serialize.action(&key) != 0) {
-        PANIC("error sizing key");
+    std::string tkey;
+    table_key(key, &tkey);
+
+    ScopeLock l;
+    Shard* shard = contents_->shard(tkey);
+    if (shard != NULL) {
+        l.set_lock(&shard->lock_, "MemoryTable::get");
     }
-    std::string table_key;
-    table_key.assign(serialize.buf().data(), serialize.buf().length());
 
-    ItemMap::iterator iter = items_->find(table_key);
-    if (iter == items_->end()) {
+    Item* item = find_item(tkey, shard);
+    if (item == NULL) {
         return DS_NOTFOUND;
     }
 
-    Item* item = iter->second;
     Unmarshal unm(Serialize::CONTEXT_LOCAL,
-                  item->data_.buf(), item->data_.len());
+                  item->data_->buf_.buf(), item->data_->buf_.len());
 
     if (unm.action(data) != 0) {
         log_err("error unserializing data object");
@@ -187,20 +298,19 @@ MemoryTable::get(const SerializableObject&   key,
 {
     ASSERTF(multitype_, "multi-type get called for single-type table");
     
-    StringSerialize serialize(Serialize::CONTEXT_LOCAL,
-                              StringSerialize::DOT_SEPARATED);
-    if (serialize.action(&key) != 0) {
-        PANIC("error sizing key");
+    std::string tkey;
+    table_key(key, &tkey);
+
+    ScopeLock l;
+    Shard* shard = contents_->shard(tkey);
+    if (shard != NULL) {
+        l.set_lock(&shard->lock_, "MemoryTable::get");
     }
-    std::string table_key;
-    table_key.assign(serialize.buf().data(), serialize.buf().length());
 
-    ItemMap::iterator iter = items_->find(table_key);
-    if (iter == items_->end()) {
+    Item* item = find_item(tkey, shard);
+    if (item == NULL) {
         return DS_NOTFOUND;
     }
-
-    Item* item = iter->second;
     
     int err = allocator(item->typecode_, data);
     if (err != 0) {
@@ -208,7 +318,7 @@ MemoryTable::get(const SerializableObject&   key,
     }
 
     Unmarshal unm(Serialize::CONTEXT_LOCAL,
-                  item->data_.buf(), item->data_.len());
+                  item->data_->buf_.buf(), item->data_->buf_.len());
 
     if (unm.action(*data) != 0) {
         log_err("error unserializing data object");
@@ -218,6 +328,105 @@ MemoryTable::get(const SerializableObject&   key,
     return DS_OK;
 }
 
+//----------------------------------------------------------------------------
+int
+MemoryTable::pin_data(const SerializableObject&   key,
+                      DurableView*                view,
+                      TypeCollection::TypeCode_t* typecode)
+{
+    std::string tkey;
+    table_key(key, &tkey);
+
+    ScopeLock l;
+    Shard* shard = contents_->shard(tkey);
+    if (shard != NULL) {
+        l.set_lock(&shard->lock_, "MemoryTable::pin_data");
+    }
+
+    Item* item = find_item(tkey, shard);
+    if (item == NULL) {
+        view->release();
+        return DS_NOTFOUND;
+    }
+
+    Data* data = item->data_;
+    atomic_incr(&data->refs_);
+    view->set(data->buf_.buf(), data->buf_.len(), &release_data, data);
+    *typecode = item->typecode_;
+
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+void
+MemoryTable::release_data(const u_char* buf, void* cookie)
+{
+    (void)buf;
+    Data* data = static_cast<Data*>(cookie);
+    if (atomic_decr_test(&data->refs_)) {
+        delete data;
+    }
+}
+
+//----------------------------------------------------------------------------
+int
+MemoryTable::get_view(const SerializableObject& key,
+                      SerializableObject*       data,
+                      DurableView*              view)
+{
+    ASSERTF(!multitype_, "single-type get called for multi-type table");
+
+    TypeCollection::TypeCode_t typecode;
+    int err = pin_data(key, view, &typecode);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    // the reference keeps the data steady, so no need for the lock
+    Unmarshal unm(Serialize::CONTEXT_LOCAL, view->buf(), view->len(),
+                  Serialize::BORROW_BUFFERS);
+    if (unm.action(data) != 0) {
+        log_err("error unserializing data object");
+        view->release();
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+//----------------------------------------------------------------------------
+int
+MemoryTable::get_view(const SerializableObject&   key,
+                      SerializableObject**        data,
+                      TypeCollection::Allocator_t allocator,
+                      DurableView*                view)
+{
+    ASSERTF(multitype_, "multi-type get called for single-type table");
+
+    TypeCollection::TypeCode_t typecode;
+    int err = pin_data(key, view, &typecode);
+    if (err != DS_OK) {
+        return err;
+    }
+
+    if (allocator(typecode, data) != 0) {
+        view->release();
+        return DS_ERR;
+    }
+
+    Unmarshal unm(Serialize::CONTEXT_LOCAL, view->buf(), view->len(),
+                  Serialize::BORROW_BUFFERS);
+    if (unm.action(*data) != 0) {
+        log_err("error unserializing data object");
+        delete *data;
+        *data = NULL;
+        view->release();
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
 //----------------------------------------------------------------------------
 int 
 MemoryTable::put(const SerializableObject& key,
@@ -225,57 +434,78 @@ MemoryTable::put(const SerializableObject& key,
                  const SerializableObject* data,
                  int                       flags)
 {
-    StringSerialize serialize(Serialize::CONTEXT_LOCAL,
-                              StringSerialize::DOT_SEPARATED);
-    if (serialize.action(&key) != 0) {
-        PANIC("error sizing key");
-    }
-    std::string table_key;
-    table_key.assign(serialize.buf().data(), serialize.buf().length());
+    std::string tkey;
+    table_key(key, &tkey);
 
-    ItemMap::iterator iter = items_->find(table_key);
+    ScopeLock l;
+    Shard* shard = contents_->shard(tkey);
+    if (shard != NULL) {
+        l.set_lock(&shard->lock_, "MemoryTable::put");
+    }
 
-    Item* item;
-    if (iter == items_->end()) {
+    Item* item = find_item(tkey, shard);
+    bool created = false;
+    
+    if (item == NULL) {
         if (! (flags & DS_CREATE)) {
             return DS_NOTFOUND;
         }
 
-        item = new Item();
-        (*items_)[table_key] = item;
-
-    } else {
-        if (flags & DS_EXCL) {
-            return DS_EXISTS;
+        if (shard != NULL && ! shard->free_.empty()) {
+            item = shard->free_.back();
+            shard->free_.pop_back();
+        } else {
+            item = new Item();
         }
+        created = true;
 
-        item = iter->second;
-    }
-
-    item->typecode_ = typecode;
-
-    { // first the key
+        // the key only needs to be serialized once, since an
+        // overwrite leaves it as is
         log_debug("put: serializing key");
     
         Marshal m(Serialize::CONTEXT_LOCAL, &item->key_);
         if (m.action(&key) != 0) {
             log_err("error serializing key object");
+            free_item(item, shard);
             return DS_ERR;
         }
+
+    } else {
+        if (flags & DS_EXCL) {
+            return DS_EXISTS;
+        }
     }
 
-    { // then the data
+    { // the data goes into the existing buffer, which only grows,
+      // unless a view still has a hold of it
         log_debug("put: serializing object");
+
+        if (item->data_->refs_.value != 1) {
+            release_data(NULL, item->data_);
+            item->data_ = new Data();
+        }
     
-        Marshal m(Serialize::CONTEXT_LOCAL, &item->data_);
+        Marshal m(Serialize::CONTEXT_LOCAL, &item->data_->buf_);
         if (m.action(data) != 0) {
             log_err("error serializing data object");
+            if (created) {
+                free_item(item, shard);
+            }
             return DS_ERR;
         }
     }
 
     item->typecode_ = typecode;
 
+    if (created) {
+        if (shard == NULL) {
+            contents_->items_[tkey] = item;
+        } else {
+            shard->items_[tkey] = item;
+            atomic_incr(&contents_->size_);
+        }
+    }
+
     return DS_OK;
 }
 
@@ -283,31 +513,56 @@ MemoryTable::put(const SerializableObject& key,
 int 
 MemoryTable::del(const SerializableObject& key)
 { 
-    StringSerialize serialize(Serialize::CONTEXT_LOCAL,
-                              StringSerialize::DOT_SEPARATED);
-    if (serialize.action(&key) != 0) {
-        PANIC("error sizing key");
+    std::string tkey;
+    table_key(key, &tkey);
+
+    ScopeLock l;
+    Shard* shard = contents_->shard(tkey);
+    if (shard == NULL) {
+        ItemMap::iterator iter = contents_->items_.find(tkey);
+        if (iter == contents_->items_.end()) {
+            return DS_NOTFOUND;
+        }
+
+        Item* item = iter->second;
+        contents_->items_.erase(iter);
+        delete item;
+        return DS_OK;
     }
-    std::string table_key;
-    table_key.assign(serialize.buf().data(), serialize.buf().length());
 
-    ItemMap::iterator iter = items_->find(table_key);
-    if (iter == items_->end()) {
+    l.set_lock(&shard->lock_, "MemoryTable::del");
+    ItemHash::iterator iter = shard->items_.find(tkey);
+    if (iter == shard->items_.end()) {
         return DS_NOTFOUND;
     }
 
     Item* item = iter->second;
-    items_->erase(iter);
-    delete item;
+    shard->items_.erase(iter);
+    atomic_decr(&contents_->size_);
+    free_item(item, shard);
     
     return DS_OK;
 }
 
+//----------------------------------------------------------------------------
+void
+MemoryTable::free_item(Item* item, Shard* shard)
+{
+    if (shard != NULL && shard->free_.size() < MEMORY_SHARD_MAX_FREE) {
+        shard->free_.push_back(item);
+    } else {
+        delete item;
+    }
+}
+
 //----------------------------------------------------------------------------
 size_t
 MemoryTable::size() const
 {
-    return items_->size();
+    if (contents_->shards_.empty()) {
+        return contents_->items_.size();
+    }
+    return contents_->size_.value;
 }
 
 //----------------------------------------------------------------------------
@@ -328,6 +583,7 @@ MemoryIterator::MemoryIterator(const char* logpath, MemoryTable* t)
 {
     table_ = t;
     first_ = true;
+    snapshot_pos_ = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -335,18 +591,65 @@ MemoryIterator::~MemoryIterator()
 {
 }
 
+//----------------------------------------------------------------------------
+void
+MemoryIterator::take_snapshot()
+{
+    MemoryTable::Contents* contents = table_->contents_;
+
+    snapshot_.clear();
+    snapshot_.reserve(contents->size_.value);
+    
+    for (size_t i = 0; i < contents->shards_.size(); ++i) {
+        MemoryTable::Shard* shard = contents->shards_[i];
+        ScopeLock l(&shard->lock_, "MemoryIterator::take_snapshot");
+        
+        for (MemoryTable::ItemHash::iterator iter = shard->items_.begin();
+             iter != shard->items_.end(); ++iter)
+        {
+            MemoryTable::Item* item = iter->second;
+            snapshot_.push_back(
+                std::make_pair(iter->first,
+                               std::string(reinterpret_cast<const char*>(
+                                               item->key_.buf()),
+                                           item->key_.len())));
+        }
+    }
+
+    // same order that the unsharded map would give
+    std::sort(snapshot_.begin(), snapshot_.end());
+}
+
 //----------------------------------------------------------------------------
 int
 MemoryIterator::next()
 {
+    MemoryTable::Contents* contents = table_->contents_;
+    
+    if (! contents->shards_.empty()) {
+        if (first_) {
+            first_ = false;
+            take_snapshot();
+            snapshot_pos_ = 0;
+        } else {
+            ++snapshot_pos_;
+        }
+
+        if (snapshot_pos_ >= snapshot_.size()) {
+            return DS_NOTFOUND;
+        }
+        
+        return 0;
+    }
+    
     if (first_) {
         first_ = false;
-        iter_ = table_->items_->begin();
+        iter_ = contents->items_.begin();
     } else {
         ++iter_;
     }
 
-    if (iter_ == table_->items_->end()) {
+    if (iter_ == contents->items_.end()) {
         return DS_NOTFOUND;
     }
 
@@ -359,10 +662,20 @@ MemoryIterator::get_key(SerializableObject* key)
 {
     ASSERT(key != NULL);
 
-    MemoryTable::Item* item = iter_->second;
+    const u_char* buf;
+    size_t        len;
+    if (table_->contents_->shards_.empty()) {
+        MemoryTable::Item* item = iter_->second;
+        buf = item->key_.buf();
+        len = item->key_.len();
+    } else {
+        ASSERT(snapshot_pos_ < snapshot_.size());
+        const std::string& str = snapshot_[snapshot_pos_].second;
+        buf = reinterpret_cast<const u_char*>(str.data());
+        len = str.length();
+    }
     
-    oasys::Unmarshal un(oasys::Serialize::CONTEXT_LOCAL,
-                        item->key_.buf(), item->key_.len());
+    oasys::Unmarshal un(oasys::Serialize::CONTEXT_LOCAL, buf, len);
     
     if (un.action(key) != 0) {
         log_err("error unmarshalling");
@@ -372,5 +685,62 @@ MemoryIterator::get_key(SerializableObject* key)
     return 0;
 }
 
-} // namespace oasys
+//----------------------------------------------------------------------------
+int
+MemoryIterator::get_data(SerializableObject* data)
+{
+    ASSERTF(!table_->multitype_,
+            "single-type get_data called for multi-type table");
+    ASSERT(data != NULL);
+
+    return get_data_common(&data, NULL);
+}
+
+//----------------------------------------------------------------------------
+int
+MemoryIterator::get_data(SerializableObject**        data,
+                         TypeCollection::Allocator_t allocator)
+{
+    ASSERTF(table_->multitype_,
+            "multi-type get_data called for single-type table");
+
+    return get_data_common(data, allocator);
+}
+
+//----------------------------------------------------------------------------
+int
+MemoryIterator::get_data_common(SerializableObject**        data,
+                                TypeCollection::Allocator_t allocator)
+{
+    ScopeLock l;
+    MemoryTable::Item* item;
+    if (table_->contents_->shards_.empty()) {
+        item = iter_->second;
+    } else {
+        // the snapshot only has the keys, so look the item up again
+        ASSERT(snapshot_pos_ < snapshot_.size());
+        const std::string& tkey = snapshot_[snapshot_pos_].first;
+        MemoryTable::Shard* shard = table_->contents_->shard(tkey);
+        l.set_lock(&shard->lock_, "MemoryIterator::get_data");
+
+        item = table_->find_item(tkey, shard);
+        if (item == NULL) {
+            return DS_NOTFOUND;
+        }
+    }
 
+    if (allocator != NULL && allocator(item->typecode_, data) != 0) {
+        return DS_ERR;
+    }
+
+    Unmarshal unm(Serialize::CONTEXT_LOCAL,
+                  item->data_->buf_.buf(), item->data_->buf_.len());
+    if (unm.action(*data) != 0) {
+        log_err("error unserializing data object");
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+} // namespace oasys
@@ -19,9 +19,11 @@
 #define __MEMORY_STORE_H__
 
 #include <map>
+#include <vector>
 
 #include "../debug/Logger.h"
-#include "../thread/SpinLock.h"
+#include "../thread/Atomic.h"
+#include "../thread/AdaptiveLock.h"
 #include "../util/ScratchBuffer.h"
 #include "../util/StringUtils.h"
 
@@ -64,24 +66,99 @@ public:
     size_t size() const;
     
     DurableIterator* itr();
+
+    /// The view holds a reference on the stored data itself, so
+    /// there's no copy at all
+    int get_view(const SerializableObject& key,
+                 SerializableObject*       data,
+                 DurableView*              view);
+
+    int get_view(const SerializableObject&   key,
+                 SerializableObject**        data,
+                 TypeCollection::Allocator_t allocator,
+                 DurableView*                view);
     /// @}
 
 private:
-    SpinLock lock_;
+    /**
+     * The serialized data for an item, which is shared with any
+     * DurableViews on it. A put overwrites it in place when the item
+     * holds the only reference, and otherwise switches the item over
+     * to a new one.
+     */
+    struct Data {
+        Data() : refs_(1) {}
+
+        ScratchBuffer<u_char*> buf_;
+        atomic_t               refs_;
+    };
 
     struct Item {
+        Item() : data_(new Data()) {}
+        ~Item() { release_data(NULL, data_); }
+
         ScratchBuffer<u_char*>	   key_;
-        ScratchBuffer<u_char*>	   data_;
+        Data*                      data_;
         TypeCollection::TypeCode_t typecode_;
     };
 
     typedef StringMap<Item*>   ItemMap;
-    ItemMap* items_;
-    
-    oasys::ScratchBuffer<u_char*> scratch_;
+    typedef StringHashMap<Item*> ItemHash;
+
+    /**
+     * One stripe of a sharded table: a hash index with its own lock,
+     * plus a free list of Items (with their buffers) for later puts
+     * to reuse.
+     */
+    struct Shard {
+        AdaptiveLock       lock_;
+        ItemHash           items_;
+        std::vector<Item*> free_;
+    };
+
+    /**
+     * Everything stored in a table, shared by all the MemoryTable
+     * handles opened on it.
+     *
+     * By default all items are kept in key order in items_, with no
+     * locking. When the store is configured with mem_shards_, they are
+     * spread by key hash over that many independently locked shards
+     * instead, and iteration works from a sorted snapshot.
+     */
+    struct Contents {
+        Contents(size_t nshards);
+        ~Contents();
+
+        /// The shard for the given key, or NULL if unsharded
+        Shard* shard(const std::string& key);
+
+        ItemMap             items_;
+        std::vector<Shard*> shards_;
+        u_int32_t           shard_mask_;
+        atomic_t            size_;
+    };
+
+    /// Serialize the key into its table string form
+    static void table_key(const SerializableObject& key, std::string* str);
+
+    /// Find the item for the given key (with the shard locked)
+    Item* find_item(const std::string& key, Shard* shard);
+
+    /// Point the view at the item's data, taking a reference on it
+    int pin_data(const SerializableObject& key, DurableView* view,
+                 TypeCollection::TypeCode_t* typecode);
+
+    /// Drop a reference on a Data (a DurableView::Release_t)
+    static void release_data(const u_char* buf, void* cookie);
+
+    /// Return an item that's no longer in the table to the shard's
+    /// free list, or delete it
+    void free_item(Item* item, Shard* shard);
+
+    Contents* contents_;
 
     //! Only MemoryStore can create MemoryTables
-    MemoryTable(const char* logpath, ItemMap* items,
+    MemoryTable(const char* logpath, Contents* contents,
                 const std::string& name, bool multitype);
 };
 
@@ -115,6 +192,7 @@ public:
     int del_table(const std::string& name);
     int get_table_names(StringVector* names);
     std::string get_info() const;
+    bool concurrent_reads() const { return true; }
 
     //! Memory Store doesn't do transactions, so
     //! begin_transaction, end_transaction are not implemented.
@@ -123,9 +201,13 @@ public:
 
 private:
     bool init_;        //!< Initialized?
+    int  shards_;      //!< Shards per table (0 for an ordered map)
 
-    typedef StringMap<MemoryTable::ItemMap> TableMap;
+    typedef StringMap<MemoryTable::Contents*> TableMap;
     TableMap tables_;
+
+    /// Delete all the tables
+    void clear_tables();
 };
  
 /**
@@ -147,12 +229,31 @@ public:
     /// @{ virtual from DurableIteratorImpl
     int next();
     int get_key(SerializableObject* key);
+
+    /// The data is already in memory, so any MemoryIterator returns
+    /// it, and bulk_itr() is just the plain scan.
+    int get_data(SerializableObject* data);
+    int get_data(SerializableObject**        data,
+                 TypeCollection::Allocator_t allocator);
     /// @}
 
 protected:
     MemoryTable* table_;
     bool first_;
     MemoryTable::ItemMap::iterator iter_;
+
+    /// For sharded tables, a sorted snapshot of (table key,
+    /// serialized key) pairs, taken by the first call to next()
+    typedef std::vector<std::pair<std::string, std::string> > KeyVector;
+    KeyVector snapshot_;
+    size_t    snapshot_pos_;
+
+    void take_snapshot();
+
+    /// Unserialize the current item's data, allocating the object
+    /// first if an allocator is given
+    int get_data_common(SerializableObject**        data,
+                        TypeCollection::Allocator_t allocator);
 };
 
 }; // namespace oasys
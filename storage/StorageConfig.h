@@ -43,9 +43,31 @@ struct StorageConfig {
     int         max_nondurable_transactions_; // Maximum number of non-durable
                                               // transactions before trying to close
                                               // and save durably.
+    bool        group_commit_;  ///< Share syncs between concurrent commits
+    int         group_commit_latency_ms_;///< Longest a commit waits for
+                                ///  others to join its batch
+    int         group_commit_max_batch_;///< Sync as soon as this many
+                                ///  commits are waiting
     // Filesystem DB Specific options
     int         fs_fd_cache_size_; ///< If > 0, then this # of open
                                    /// fds will be cached
+    int         fs_fanout_;     ///< If > 0, spread each table over this
+                                ///  many hashed subdirectories (rounded
+                                ///  up to a power of 16)
+    bool        fs_atomic_put_; ///< Write puts to a temp file and rename
+    bool        fs_sync_puts_;  ///< Fsync each put before returning,
+                                ///  instead of batching them up for the
+                                ///  next durable commit
+
+    // Memory store specific options
+    int         mem_shards_;    ///< If > 0, spread each table over this
+                                ///  many locked hash shards
+
+    // Log store specific options
+    bool        log_sync_;      ///< Commit each put and del to disk
+    int         log_compact_min_;///< Dead bytes before compacting
+    int         log_compact_pct_;///< Compact once this percentage of
+                                ///  the log is dead (0 to disable)
 
     // Berkeley DB Specific options
     bool        db_mpool_;      ///< Use DB mpool (default true)
@@ -94,8 +116,20 @@ struct StorageConfig {
 
         auto_commit_(true),
         max_nondurable_transactions_(0),
+        group_commit_(false),
+        group_commit_latency_ms_(0),
+        group_commit_max_batch_(64),
 
         fs_fd_cache_size_(0),
+        fs_fanout_(0),
+        fs_atomic_put_(false),
+        fs_sync_puts_(false),
+
+        mem_shards_(0),
+
+        log_sync_(false),
+        log_compact_min_(1024 * 1024),
+        log_compact_pct_(50),
 
         db_mpool_(true),
         db_log_(true),
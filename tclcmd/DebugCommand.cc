@@ -19,6 +19,8 @@
 #endif
 #include "DebugCommand.h"
 #include "../memory/Memory.h"
+#include "../thread/LockStats.h"
+#include "../util/StringBuffer.h"
 
 namespace oasys {
 
@@ -29,6 +31,10 @@ DebugCommand::DebugCommand()
     add_to_help("dump_memory", "Dump memory usage");
     add_to_help("dump_memory_diffs", "Dump memory diff of usage");
 #endif    
+    add_to_help("lock_stats <pattern?>",
+                "Dump contention statistics of the locks that keep them");
+    add_to_help("lock_stats_reset <pattern?>",
+                "Reset lock contention statistics");
 }
 
 int
@@ -52,6 +58,26 @@ DebugCommand::exec(int argc, const char** argv, Tcl_Interp* interp)
         return TCL_OK;
     }
 #endif // OASYS_DEBUG_MEMORY_ENABLED
+
+    // debug lock_stats <pattern?>
+    if (!strcmp(cmd, "lock_stats")) {
+        if (argc > 3) {
+            wrong_num_args(argc, argv, 2, 2, 3);
+            return TCL_ERROR;
+        }
+        StringBuffer buf;
+        LockStats::dump_all(&buf, (argc == 3) ? argv[2] : NULL);
+        set_result(buf.c_str());
+        return TCL_OK;
+
+    } else if (!strcmp(cmd, "lock_stats_reset")) {
+        if (argc > 3) {
+            wrong_num_args(argc, argv, 2, 2, 3);
+            return TCL_ERROR;
+        }
+        LockStats::reset_all((argc == 3) ? argv[2] : NULL);
+        return TCL_OK;
+    }
     
     resultf("unimplemented debug subcommand: %s", cmd);
     return TCL_ERROR;
@@ -0,0 +1,68 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef _OASYS_TEST_BLOB_H_
+#define _OASYS_TEST_BLOB_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "serialize/Serialize.h"
+
+/**
+ * Test object holding a byte buffer, which it uses in place when an
+ * Unmarshal (or a store, through get_view()) lends it one. Shared by
+ * the marshal and durable store tests.
+ */
+class Blob : public oasys::SerializableObject {
+public:
+    Blob(const char* str)
+        : buf_((u_char*)strdup(str)), len_(strlen(str)), view_(false) {}
+    Blob(const oasys::Builder&) : buf_(0), len_(0), view_(false) {}
+
+    ~Blob()
+    {
+        if (! view_) {
+            free(buf_);
+        }
+    }
+
+    void serialize(oasys::SerializeAction* a)
+    {
+        if (a->action_code() == oasys::Serialize::UNMARSHAL) {
+            if (! view_) {
+                free(buf_);
+            }
+            oasys::BufferCarrier<u_char> bc;
+            size_t size;
+            a->process("blob", &bc);
+            buf_ = bc.take_view(&size, &view_);
+            len_ = size;
+        } else {
+            oasys::BufferCarrier<u_char> bc(buf_, len_, false);
+            a->process("blob", &bc);
+        }
+    }
+
+    std::string value() const { return std::string((char*)buf_, len_); }
+
+    u_char*   buf_;
+    u_int32_t len_;
+    bool      view_;
+};
+
+#endif /* _OASYS_TEST_BLOB_H_ */
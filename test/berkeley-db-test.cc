@@ -47,6 +47,8 @@ DECLARE_TEST(DBTestInit) {
     g_config->tidy_             = false;
     g_config->tidy_wait_        = 0;
 
+    g_bench_load_objects = 100000;
+
     StringBuffer cmd("mkdir -p %s", g_config_dir);
     system(cmd.c_str());
 
@@ -69,13 +71,17 @@ DECLARE_TESTER(BerkleyDBTester) {
 
     ADD_TEST(SingleTypePut);
     ADD_TEST(SingleTypeGet);
+    ADD_TEST(GetView);
     ADD_TEST(SingleTypeDelete);
     ADD_TEST(SingleTypeMultiObject);
     ADD_TEST(SingleTypeIterator);
+    ADD_TEST(SingleTypeBulkIterator);
     ADD_TEST(SingleTypeCache);
 
     ADD_TEST(NonTypedTable);
     ADD_TEST(MultiType);
+    ADD_TEST(MultiTypeBulkIterator);
+    ADD_TEST(LoadTables);
     ADD_TEST(MultiTypeCache);
 
     ADD_TEST(DBSwitchToSharedFile);
@@ -88,15 +94,20 @@ DECLARE_TESTER(BerkleyDBTester) {
 
     ADD_TEST(SingleTypePut);
     ADD_TEST(SingleTypeGet);
+    ADD_TEST(GetView);
     ADD_TEST(SingleTypeDelete);
     ADD_TEST(SingleTypeMultiObject);
     ADD_TEST(SingleTypeIterator);
+    ADD_TEST(SingleTypeBulkIterator);
     ADD_TEST(SingleTypeCache);
 
     ADD_TEST(NonTypedTable);
     ADD_TEST(MultiType);
+    ADD_TEST(MultiTypeBulkIterator);
+    ADD_TEST(LoadTables);
     ADD_TEST(MultiTypeCache);
 
+    ADD_TEST(BenchLoadTables);
 }
 
 DECLARE_TEST_FILE(BerkleyDBTester, "berkeley db test");
@@ -0,0 +1,169 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "util/CRC32.h"
+#include "util/Time.h"
+#include "util/UnitTest.h"
+
+using namespace oasys;
+
+CRC32::CRC_t
+crc_of(const char* buf, size_t len)
+{
+    CRC32 crc;
+    crc.update(buf, len);
+    return crc.value();
+}
+
+DECLARE_TEST(KnownValues) {
+    log_notice_p("/test", "default implementation: %s",
+                 CRC32::impl_name(CRC32::impl()));
+
+    // the standard check value, plus a couple from zlib's crc32()
+    CHECK_EQUAL(crc_of("123456789", 9), 0xCBF43926);
+    CHECK_EQUAL(crc_of("", 0), 0);
+    CHECK_EQUAL(crc_of("The quick brown fox jumps over the lazy dog", 43),
+                0x414FA339);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Every implementation has to agree with the byte-at-a-time one for
+ * all lengths and alignments, including when a buffer is fed in
+ * pieces.
+ */
+DECLARE_TEST(CrossCheck) {
+    const size_t size = 4096 + 64;
+    std::vector<u_char> buf(size);
+    for (size_t i = 0; i < size; ++i) {
+        buf[i] = random() & 0xff;
+    }
+
+    int mismatches = 0;
+    for (int impl = CRC32::IMPL_SLICE8; impl < CRC32::IMPL_MAX; ++impl) {
+        CRC32::impl_t im = static_cast<CRC32::impl_t>(impl);
+        if (! CRC32::impl_supported(im)) {
+            log_notice_p("/test", "%s not supported, skipping",
+                         CRC32::impl_name(im));
+            continue;
+        }
+
+        for (size_t offset = 0; offset < 16; ++offset) {
+            for (size_t len = 0; len <= 300; ++len) {
+                CRC32::CRC_t expected =
+                    CRC32::update_impl(CRC32::IMPL_BYTE, 0xffffffff,
+                                       &buf[offset], len);
+                CRC32::CRC_t got =
+                    CRC32::update_impl(im, 0xffffffff, &buf[offset], len);
+                if (got != expected) {
+                    ++mismatches;
+                }
+            }
+        }
+
+        // long buffers, split at odd places
+        CRC32::CRC_t expected =
+            CRC32::update_impl(CRC32::IMPL_BYTE, 0xffffffff, &buf[0], size);
+        for (size_t split = 0; split < size; split += 97) {
+            CRC32::CRC_t got =
+                CRC32::update_impl(im, 0xffffffff, &buf[0], split);
+            got = CRC32::update_impl(im, got, &buf[split], size - split);
+            if (got != expected) {
+                ++mismatches;
+            }
+        }
+
+        log_notice_p("/test", "%s: %d mismatches", CRC32::impl_name(im),
+                     mismatches);
+    }
+    CHECK_EQUAL(mismatches, 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(SetImpl) {
+    const char* data = "The quick brown fox jumps over the lazy dog, "
+                       "and then does it again, and again, and again, "
+                       "for long enough to need folding";
+    size_t len = strlen(data);
+
+    CRC32::impl_t saved = CRC32::impl();
+    CRC32::set_impl(CRC32::IMPL_BYTE);
+    CRC32::CRC_t expected = crc_of(data, len);
+
+    for (int impl = CRC32::IMPL_SLICE8; impl < CRC32::IMPL_MAX; ++impl) {
+        CRC32::impl_t im = static_cast<CRC32::impl_t>(impl);
+        if (CRC32::impl_supported(im)) {
+            CRC32::set_impl(im);
+            CHECK_EQUAL(CRC32::impl(), im);
+            CHECK_EQUAL(crc_of(data, len), expected);
+        }
+    }
+    CRC32::set_impl(saved);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(Bench) {
+    const size_t size  = 64 * 1024;
+    const size_t total = 256 * 1024 * 1024;
+    std::vector<u_char> buf(size);
+    for (size_t i = 0; i < size; ++i) {
+        buf[i] = random() & 0xff;
+    }
+
+    for (int impl = CRC32::IMPL_BYTE; impl < CRC32::IMPL_MAX; ++impl) {
+        CRC32::impl_t im = static_cast<CRC32::impl_t>(impl);
+        if (! CRC32::impl_supported(im)) {
+            continue;
+        }
+
+        // the byte-at-a-time version would take a while
+        size_t bytes = (im == CRC32::IMPL_BYTE) ? total / 8 : total;
+        CRC32::CRC_t crc = 0xffffffff;
+        Time start = Time::now();
+        for (size_t done = 0; done < bytes; done += size) {
+            crc = CRC32::update_impl(im, crc, &buf[0], size);
+        }
+        u_int32_t ms = start.elapsed_ms();
+
+        log_notice_p("/test", "%-8s %4zu MB in %4u ms: %.2f GB/s (crc %08x)",
+                     CRC32::impl_name(im), bytes / (1024 * 1024), ms,
+                     ms ? (bytes / (1024.0 * 1024 * 1024)) / (ms / 1000.0)
+                        : 0.0,
+                     crc);
+    }
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(CRC32Test) {
+    ADD_TEST(KnownValues);
+    ADD_TEST(CrossCheck);
+    ADD_TEST(SetImpl);
+    ADD_TEST(Bench);
+}
+
+DECLARE_TEST_FILE(CRC32Test, "crc32 test");
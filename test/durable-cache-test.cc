@@ -21,6 +21,9 @@
 #include "util/UnitTest.h"
 #include "serialize/TypeShims.h"
 #include "storage/DurableStore.h"
+#include "thread/Thread.h"
+#include "util/StringBuffer.h"
+#include "util/Time.h"
 
 using namespace oasys;
 
@@ -207,6 +210,325 @@ DECLARE_TEST(Flush) {
     return UNIT_TEST_PASSED;
 }
 
+/**
+ * Keys too long to be kept inline go in the arena, and their space
+ * is reused as they come and go.
+ */
+DECLARE_TEST(StringKeys) {
+    DurableObjectCache<StringShim> cache("/test/cache", 100, 
+                                         DurableObjectCache<StringShim>::CAP_BY_COUNT);
+    std::string prefix(40, 'k');
+
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < 50; ++i) {
+            StringBuffer key("%s%d", prefix.c_str(), i);
+            StringShim* s = new StringShim(key.c_str());
+            CHECK(cache.put(StringShim(key.c_str()), s, 0) == DS_OK);
+            CHECK(cache.release(StringShim(key.c_str()), s) == DS_OK);
+        }
+        CHECK_EQUAL(cache.count(), 50);
+
+        // a prefix of the keys doesn't match any of them
+        StringShim* s;
+        CHECK(cache.get(StringShim(prefix.c_str()), &s) == DS_NOTFOUND);
+        
+        for (int i = 0; i < 50; ++i) {
+            StringBuffer key("%s%d", prefix.c_str(), i);
+            CHECK(cache.get(StringShim(key.c_str()), &s) == DS_OK);
+            CHECK_EQUALSTR(s->value().c_str(), key.c_str());
+            CHECK(cache.release(StringShim(key.c_str()), s) == DS_OK);
+        }
+
+        for (int i = 0; i < 50; ++i) {
+            StringBuffer key("%s%d", prefix.c_str(), i);
+            CHECK(cache.del(StringShim(key.c_str())) == DS_OK);
+        }
+        CHECK_EQUAL(cache.count(), 0);
+    }
+
+    // and an int key doesn't match a string key with the same bytes
+    StringShim* s = new StringShim("x");
+    CHECK(cache.put(IntShim(1), s, 0) == DS_OK);
+    CHECK(cache.get(StringShim(std::string("\0\0\0\1", 4)), &s) == DS_NOTFOUND);
+    
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Time lookups of cached objects.
+ */
+DECLARE_TEST(BenchGet) {
+    const int count = 1000;
+    const int loops = 100;
+    DurableObjectCache<StringShim> cache("/test/cache", 2 * count + 1,
+                                         DurableObjectCache<StringShim>::CAP_BY_COUNT);
+    std::string prefix(40, 'k');
+
+    int errors = 0;
+    for (int i = 0; i < count; ++i) {
+        StringShim* s = new StringShim("data");
+        if (cache.put(IntShim(i), s, 0) != DS_OK ||
+            cache.release(IntShim(i), s) != DS_OK)
+        {
+            ++errors;
+        }
+
+        StringBuffer key("%s%d", prefix.c_str(), i);
+        s = new StringShim("data");
+        if (cache.put(StringShim(key.c_str()), s, 0) != DS_OK ||
+            cache.release(StringShim(key.c_str()), s) != DS_OK)
+        {
+            ++errors;
+        }
+    }
+
+    StringShim* s;
+    Time start = Time::now();
+    for (int loop = 0; loop < loops; ++loop) {
+        for (int i = 0; i < count; ++i) {
+            if (cache.get(IntShim(i), &s) != DS_OK ||
+                cache.release(IntShim(i), s) != DS_OK)
+            {
+                ++errors;
+            }
+        }
+    }
+    u_int32_t int_ms = start.elapsed_ms();
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < count; ++i) {
+        keys.push_back(StringBuffer("%s%d", prefix.c_str(), i).c_str());
+    }
+    start = Time::now();
+    for (int loop = 0; loop < loops; ++loop) {
+        for (int i = 0; i < count; ++i) {
+            StringShim key(keys[i]);
+            if (cache.get(key, &s) != DS_OK ||
+                cache.release(key, s) != DS_OK)
+            {
+                ++errors;
+            }
+        }
+    }
+    u_int32_t string_ms = start.elapsed_ms();
+
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(cache.hits(), 2 * count * loops);
+
+    log_notice_p("/test", "%d get/release pairs: %u ms with int keys, "
+                 "%u ms with string keys", count * loops, int_ms, string_ms);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * A sharded cache works the same way, and its stats and iterator
+ * cover all the shards.
+ */
+DECLARE_TEST(Sharded) {
+    DurableObjectCache<StringShim> cache("/test/cache", 100,
+                                         DurableObjectCache<StringShim>::CAP_BY_COUNT,
+                                         4);
+    CHECK_EQUAL(cache.num_shards(), 4);
+
+    StringShim* s;
+    for (int i = 0; i < 40; ++i) {
+        s = new StringShim("data");
+        CHECK(cache.put(IntShim(i), s, 0) == DS_OK);
+        CHECK(cache.put(IntShim(i), s, DS_EXCL) == DS_EXISTS);
+        CHECK(cache.release(IntShim(i), s) == DS_OK);
+    }
+    CHECK_EQUAL(cache.count(), 40);
+    CHECK_EQUAL(cache.live(), 0);
+    CHECK_EQUAL(cache.size(), 40 * 8);
+
+    for (int i = 0; i < 40; ++i) {
+        CHECK(cache.get(IntShim(i), &s) == DS_OK);
+        CHECK_EQUALSTR(s->value().c_str(), "data");
+    }
+    CHECK(cache.get(IntShim(40), &s) == DS_NOTFOUND);
+    CHECK_EQUAL(cache.hits(), 40);
+    CHECK_EQUAL(cache.misses(), 1);
+    CHECK_EQUAL(cache.live(), 40);
+    CHECK(cache.is_live(IntShim(0)));
+
+    int n = 0;
+    DurableObjectCache<StringShim>::iterator iter;
+    for (iter = cache.begin(); iter != cache.end(); ++iter) {
+        CHECK(iter.live());
+        ++n;
+    }
+    CHECK_EQUAL(n, 40);
+
+    for (int i = 0; i < 40; ++i) {
+        CHECK(cache.get(IntShim(i), &s) == DS_OK);
+        CHECK(cache.release(IntShim(i), s) == DS_OK);
+    }
+    CHECK_EQUAL(cache.live(), 0);
+    CHECK(! cache.is_live(IntShim(0)));
+
+    CHECK(cache.del(IntShim(0)) == DS_OK);
+    CHECK(cache.del(IntShim(0)) == DS_NOTFOUND);
+    CHECK_EQUAL(cache.flush(), 39);
+    CHECK_EQUAL(cache.count(), 0);
+    CHECK_EQUAL(cache.size(), 0);
+
+    // overfilling any one shard evicts from it
+    cache.reset_stats();
+    for (int i = 0; i < 1000; ++i) {
+        s = new StringShim("data");
+        CHECK(cache.put(IntShim(i), s, 0) == DS_OK);
+        CHECK(cache.release(IntShim(i), s) == DS_OK);
+    }
+    CHECK(cache.count() < 100);
+    CHECK_EQUAL(cache.evictions(), 1000 - (int)cache.count());
+    
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Touch a hot set of keys, then scan through a lot of keys that are
+ * each used once, and count how many of the hot ones are still cached.
+ */
+int
+scan_survivors(bool admission)
+{
+    const int hot  = 40;
+    DurableObjectCache<StringShim> cache("/test/cache", 100,
+                                         DurableObjectCache<StringShim>::CAP_BY_COUNT,
+                                         1, admission);
+    StringShim* s;
+    for (int i = 0; i < hot; ++i) {
+        s = new StringShim("hot");
+        cache.put(IntShim(i), s, 0);
+        cache.release(IntShim(i), s);
+    }
+    for (int loop = 0; loop < 10; ++loop) {
+        for (int i = 0; i < hot; ++i) {
+            if (cache.get(IntShim(i), &s) == DS_OK) {
+                cache.release(IntShim(i), s);
+            }
+        }
+    }
+
+    for (int i = 1000; i < 1500; ++i) {
+        s = new StringShim("cold");
+        cache.put(IntShim(i), s, 0);
+        cache.release(IntShim(i), s);
+    }
+
+    int survivors = 0;
+    for (int i = 0; i < hot; ++i) {
+        if (cache.get(IntShim(i), &s) == DS_OK) {
+            cache.release(IntShim(i), s);
+            ++survivors;
+        }
+    }
+
+    log_notice_p("/test", "admission %s: %d of %d hot keys survived a scan, "
+                 "%u rejections", admission ? "on" : "off",
+                 survivors, hot, cache.rejections());
+    return survivors;
+}
+
+DECLARE_TEST(Admission) {
+    CHECK(scan_survivors(true) >= 36);
+    CHECK(scan_survivors(false) < 20);
+    
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Thread that repeatedly gets and releases a range of cached keys.
+ * Objects only have one user at a time, so each thread has its own.
+ */
+class GetThread : public Thread {
+public:
+    GetThread(DurableObjectCache<StringShim>* cache,
+              int first, int count, int loops)
+        : Thread("GetThread", CREATE_JOINABLE),
+          cache_(cache), first_(first), count_(count), loops_(loops),
+          errors_(0) {}
+
+    int errors() const { return errors_; }
+
+protected:
+    void run()
+    {
+        StringShim* s;
+        for (int loop = 0; loop < loops_; ++loop) {
+            for (int i = first_; i < first_ + count_; ++i) {
+                if (cache_->get(IntShim(i), &s) != DS_OK ||
+                    cache_->release(IntShim(i), s) != DS_OK)
+                {
+                    ++errors_;
+                }
+            }
+        }
+    }
+
+    DurableObjectCache<StringShim>* cache_;
+    int first_;
+    int count_;
+    int loops_;
+    int errors_;
+};
+
+/**
+ * Time get/release pairs from several threads at once, with one lock
+ * and with the cache split into shards.
+ */
+u_int32_t
+bench_concurrent(size_t shards, int* errors)
+{
+    const int count    = 1000;
+    const int loops    = 50;
+    const int nthreads = 4;
+    DurableObjectCache<StringShim> cache("/test/cache",
+                                         2 * nthreads * count + 1,
+                                         DurableObjectCache<StringShim>::CAP_BY_COUNT,
+                                         shards);
+    for (int i = 0; i < nthreads * count; ++i) {
+        StringShim* s = new StringShim("data");
+        if (cache.put(IntShim(i), s, 0) != DS_OK ||
+            cache.release(IntShim(i), s) != DS_OK)
+        {
+            ++(*errors);
+        }
+    }
+
+    std::vector<GetThread*> threads;
+    Time start = Time::now();
+    for (int i = 0; i < nthreads; ++i) {
+        threads.push_back(new GetThread(&cache, i * count, count, loops));
+        threads.back()->start();
+    }
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i]->join();
+        *errors += threads[i]->errors();
+        delete threads[i];
+    }
+    u_int32_t ms = start.elapsed_ms();
+
+    if (cache.hits() != nthreads * count * loops || cache.live() != 0) {
+        ++(*errors);
+    }
+
+    log_notice_p("/test", "%d threads, %zu shards: %d get/release pairs "
+                 "in %u ms", nthreads, cache.num_shards(),
+                 nthreads * count * loops, ms);
+    return ms;
+}
+
+DECLARE_TEST(BenchConcurrent) {
+    int errors = 0;
+    bench_concurrent(0, &errors);
+    bench_concurrent(16, &errors);
+    CHECK_EQUAL(errors, 0);
+    
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TESTER(CacheTester) {
     ADD_TEST(Init);
     ADD_TEST(Put);
@@ -215,6 +537,11 @@ DECLARE_TESTER(CacheTester) {
     ADD_TEST(PutEvict);
     ADD_TEST(Del);
     ADD_TEST(Flush);
+    ADD_TEST(StringKeys);
+    ADD_TEST(BenchGet);
+    ADD_TEST(Sharded);
+    ADD_TEST(Admission);
+    ADD_TEST(BenchConcurrent);
 }
 
 DECLARE_TEST_FILE(CacheTester, "DurableCache tester");
@@ -30,15 +30,22 @@
 #include "util/UnitTest.h"
 #include "util/StringBuffer.h"
 #include "util/Random.h"
+#include "util/Time.h"
 #include "storage/StorageConfig.h"
 #include "storage/DurableStore.h"
 #include "serialize/TypeShims.h"
 
+#include "Blob.h"
+
 using namespace oasys;
 
 DurableStore*  g_store  = 0;
 StorageConfig* g_config = 0;
 
+// Size of the synthetic store for BenchLoadTables, which slower
+// stores turn down
+int g_bench_load_objects = 1000000;
+
 typedef SingleTypeDurableTable<StringShim> StringDurableTable;
 typedef DurableObjectCache<StringShim> StringDurableCache;
 
@@ -445,6 +452,62 @@ DECLARE_TEST(SingleTypeIterator) {
     return UNIT_TEST_PASSED;    
 }
 
+/**
+ * Read a table back through a bulk iterator, getting the data along
+ * with the keys, with batches that don't divide the table evenly.
+ */
+DECLARE_TEST(SingleTypeBulkIterator) {
+    g_config->tidy_         = true;
+    DurableStore* store;
+
+    store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    StringDurableTable* table;
+    static const int num_objs = 100;
+     
+    CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+    
+    for(int i=0; i<num_objs; ++i) {
+        StaticStringBuffer<256> buf;
+        buf.appendf("data%d", i);
+        StringShim data(buf.c_str());
+        
+        CHECK(table->put(IntShim(i), &data, DS_CREATE | DS_EXCL) == 0);
+    }
+
+    size_t batches[] = { 0, 1, 7, 1000 };
+    for (size_t n = 0; n < sizeof(batches) / sizeof(batches[0]); ++n) {
+        DurableIterator* iter = table->bulk_itr(batches[n]);
+
+        std::bitset<num_objs> found;
+        while(iter->next() == 0) {
+            Builder b;
+            IntShim key(b);
+            StringShim data(b);
+        
+            CHECK(iter->get_key(&key) == DS_OK);
+            CHECK(iter->get_data(&data) == DS_OK);
+            CHECK(found[key.value()] == false);
+            found.set(key.value());
+
+            StaticStringBuffer<256> buf;
+            buf.appendf("data%d", key.value());
+            CHECK_EQUALSTR(data.value().c_str(), buf.c_str());
+        }
+
+        found.flip();
+        CHECK(!found.any());
+
+        delete_z(iter);
+    }
+    
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    return UNIT_TEST_PASSED;    
+}
+
 DECLARE_TEST(KeithMulti) {
     g_config->tidy_         = true;
     DurableStore* store;
@@ -634,6 +697,307 @@ DECLARE_TEST(MultiType) {
     return UNIT_TEST_PASSED;
 }
 
+DECLARE_TEST(MultiTypeBulkIterator) {
+    g_config->tidy_         = true;
+    DurableStore* store;
+
+    store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    ObjDurableTable* table = 0;
+    CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+    CHECK(table != 0);
+
+    Foo foo;
+    Bar bar;
+    CHECK(table->put(StringShim("foo"), Foo::ID, &foo, 
+                     DS_CREATE | DS_EXCL) == 0);
+    CHECK(table->put(StringShim("bar"), Bar::ID, &bar, 
+                     DS_CREATE | DS_EXCL) == 0);
+
+    DurableIterator* iter = table->bulk_itr();
+    int count = 0;
+    while (iter->next() == 0) {
+        Builder b;
+        StringShim key(b);
+        SerializableObject* data = NULL;
+
+        CHECK(iter->get_key(&key) == DS_OK);
+        CHECK(iter->get_data(&data, ObjDurableTable::new_object) == DS_OK);
+
+        Obj* o = dynamic_cast<Obj*>(data);
+        CHECK(o != NULL);
+        CHECK_EQUALSTR(o->name(), key.value().c_str());
+        CHECK_EQUALSTR(o->static_name_.c_str(), key.value().c_str());
+        delete_z(o);
+        ++count;
+    }
+    CHECK_EQUAL(count, 2);
+    delete_z(iter);
+    
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    return UNIT_TEST_PASSED;
+}
+
+typedef SingleTypeDurableTable<Blob> BlobDurableTable;
+
+DECLARE_TEST(GetView) {
+    g_config->tidy_         = true;
+    DurableStore* store;
+
+    store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    BlobDurableTable* table;
+    CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+
+    Blob first("the first value");
+    CHECK(table->put(IntShim(1), &first, DS_CREATE | DS_EXCL) == 0);
+
+    Builder b;
+    Blob blob1(b);
+    DurableView view1;
+    CHECK(table->get_view(IntShim(1), &blob1, &view1) == DS_OK);
+    CHECK_EQUALSTR(blob1.value().c_str(), "the first value");
+
+    // stores that can't lend out their data leave the view empty
+    if (view1.empty()) {
+        CHECK(! blob1.view_);
+    } else {
+        CHECK(blob1.view_);
+        CHECK(blob1.buf_ >= view1.buf());
+        CHECK(blob1.buf_ + blob1.len_ <= view1.buf() + view1.len());
+    }
+
+    // an overwrite doesn't touch the data the view holds
+    Blob second("a second, somewhat longer value");
+    CHECK(table->put(IntShim(1), &second, 0) == 0);
+    CHECK_EQUALSTR(blob1.value().c_str(), "the first value");
+
+    Blob blob2(b);
+    DurableView view2;
+    CHECK(table->get_view(IntShim(1), &blob2, &view2) == DS_OK);
+    CHECK_EQUALSTR(blob2.value().c_str(), "a second, somewhat longer value");
+
+    // reusing a view releases what it held
+    CHECK(table->get_view(IntShim(2), &blob1, &view1) == DS_NOTFOUND);
+    CHECK(view1.empty());
+
+    delete_z(table);
+
+    ObjDurableTable* objs = 0;
+    CHECK(store->get_table(&objs, "objs", DS_CREATE | DS_EXCL) == 0);
+
+    Foo foo;
+    CHECK(objs->put(StringShim("foo"), Foo::ID, &foo, 
+                    DS_CREATE | DS_EXCL) == 0);
+
+    Obj* o = NULL;
+    DurableView view3;
+    CHECK(objs->get_view(StringShim("foo"), &o, &view3) == DS_OK);
+    CHECK(dynamic_cast<Foo*>(o) != NULL);
+    CHECK_EQUALSTR(o->static_name_.c_str(), "foo");
+    delete_z(o);
+
+    CHECK(objs->get_view(StringShim("bar"), &o, &view3) == DS_NOTFOUND);
+    CHECK(o == NULL);
+
+    delete_z(objs);
+    DEL_DS_STORE(store);
+
+    return UNIT_TEST_PASSED;    
+}
+
+/**
+ * Loader for the load_tables() tests, which keeps track of the keys
+ * it has seen (and how many of them were wrong), or just counts them
+ * when there would be too many.
+ */
+class StringLoader : public SingleTypeTableLoader<IntShim, StringShim> {
+public:
+    StringLoader(StringDurableTable* table, size_t parts = 1, int num_objs = 0)
+        : SingleTypeTableLoader<IntShim, StringShim>(table, parts),
+          seen_(num_objs, 0), bad_(0) {}
+
+    void loaded(const IntShim& key, StringShim* data)
+    {
+        if (! seen_.empty()) {
+            StaticStringBuffer<256> buf;
+            buf.appendf("data%d", key.value());
+
+            ScopeLock l(&lock_, "StringLoader::loaded");
+            if (key.value() < 0 || key.value() >= (int)seen_.size() ||
+                seen_[key.value()] != 0 || data->value() != buf.c_str())
+            {
+                ++bad_;
+            } else {
+                seen_[key.value()] = 1;
+            }
+        }
+        delete data;
+    }
+
+    SpinLock          lock_;
+    std::vector<char> seen_;
+    int               bad_;
+};
+
+class ObjLoader : public MultiTypeTableLoader<StringShim, Obj, TestC> {
+public:
+    ObjLoader(ObjDurableTable* table, size_t parts)
+        : MultiTypeTableLoader<StringShim, Obj, TestC>(table, parts),
+          bad_(0) {}
+
+    void loaded(const StringShim& key, Obj* data)
+    {
+        if (key.value() != data->name()) {
+            ScopeLock l(&lock_, "ObjLoader::loaded");
+            ++bad_;
+        }
+        delete data;
+    }
+
+    SpinLock lock_;
+    int      bad_;
+};
+
+DECLARE_TEST(LoadTables) {
+    g_config->tidy_         = true;
+    DurableStore* store;
+
+    store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    StringDurableTable* table1;
+    StringDurableTable* table2;
+    ObjDurableTable*    table3;
+    static const int num_objs = 500;
+     
+    CHECK(store->get_table(&table1, "test1", DS_CREATE | DS_EXCL) == 0);
+    CHECK(store->get_table(&table2, "test2", DS_CREATE | DS_EXCL) == 0);
+    CHECK(store->get_table(&table3, "test3", DS_CREATE | DS_EXCL) == 0);
+    
+    for(int i=0; i<num_objs; ++i) {
+        StaticStringBuffer<256> buf;
+        buf.appendf("data%d", i);
+        StringShim data(buf.c_str());
+        
+        CHECK(table1->put(IntShim(i), &data, DS_CREATE | DS_EXCL) == 0);
+        if (i < num_objs / 10) {
+            CHECK(table2->put(IntShim(i), &data, DS_CREATE | DS_EXCL) == 0);
+        }
+    }
+
+    Foo foo;
+    Bar bar;
+    CHECK(table3->put(StringShim("foo"), Foo::ID, &foo, 
+                      DS_CREATE | DS_EXCL) == 0);
+    CHECK(table3->put(StringShim("bar"), Bar::ID, &bar, 
+                      DS_CREATE | DS_EXCL) == 0);
+
+    size_t threads[] = { 1, 4 };
+    size_t parts[]   = { 1, 3, 7 };
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+        for (size_t p = 0; p < sizeof(parts) / sizeof(parts[0]); ++p) {
+            StringLoader loader1(table1, parts[p], num_objs);
+            StringLoader loader2(table2, 1, num_objs / 10);
+            ObjLoader    loader3(table3, 2);
+
+            std::vector<DurableTableLoader*> loaders;
+            loaders.push_back(&loader1);
+            loaders.push_back(&loader2);
+            loaders.push_back(&loader3);
+            CHECK(store->load_tables(loaders, threads[t]) == DS_OK);
+
+            CHECK_EQUAL(loader1.count(), (u_int32_t)num_objs);
+            CHECK_EQUAL(loader1.bad_, 0);
+            CHECK_EQUAL(loader2.count(), (u_int32_t)num_objs / 10);
+            CHECK_EQUAL(loader2.bad_, 0);
+            CHECK_EQUAL(loader3.count(), 2u);
+            CHECK_EQUAL(loader3.bad_, 0);
+        }
+    }
+    
+    delete_z(table1);
+    delete_z(table2);
+    delete_z(table3);
+    DEL_DS_STORE(store);
+
+    return UNIT_TEST_PASSED;    
+}
+
+/**
+ * Time reading a synthetic store of g_bench_load_objects objects at
+ * startup, spread over three tables, with one thread and then in
+ * parallel.
+ */
+DECLARE_TEST(BenchLoadTables) {
+    g_config->tidy_         = true;
+    DurableStore* store;
+
+    store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    StringDurableTable* tables[3];
+    int counts[3] = { g_bench_load_objects / 2,
+                      g_bench_load_objects / 4,
+                      g_bench_load_objects / 4 };
+    int errors = 0;
+    for (int t = 0; t < 3; ++t) {
+        StaticStringBuffer<32> name("bench%d", t);
+        CHECK(store->get_table(&tables[t], name.c_str(),
+                               DS_CREATE | DS_EXCL) == 0);
+
+        for (int i = 0; i < counts[t]; ++i) {
+            StaticStringBuffer<256> buf;
+            buf.appendf("data%d", i);
+            StringShim data(buf.c_str());
+            if (tables[t]->put(IntShim(i), &data, DS_CREATE) != 0) {
+                ++errors;
+            }
+        }
+    }
+
+    size_t threads[] = { 1, 4 };
+    u_int32_t elapsed[2];
+    for (int run = 0; run < 2; ++run) {
+        StringLoader loader0(tables[0], threads[run]);
+        StringLoader loader1(tables[1]);
+        StringLoader loader2(tables[2]);
+
+        std::vector<DurableTableLoader*> loaders;
+        loaders.push_back(&loader0);
+        loaders.push_back(&loader1);
+        loaders.push_back(&loader2);
+
+        Time start = Time::now();
+        if (store->load_tables(loaders, threads[run]) != DS_OK) {
+            ++errors;
+        }
+        elapsed[run] = start.elapsed_ms();
+
+        if (loader0.count() + loader1.count() + loader2.count() !=
+            (u_int32_t)(counts[0] + counts[1] + counts[2]))
+        {
+            ++errors;
+        }
+    }
+
+    log_notice_p("/test", "load %d objects in 3 tables: "
+                 "1 thread %u ms, %zu threads %u ms",
+                 g_bench_load_objects, elapsed[0], threads[1], elapsed[1]);
+    CHECK_EQUAL(errors, 0);
+
+    for (int t = 0; t < 3; ++t) {
+        delete_z(tables[t]);
+    }
+    DEL_DS_STORE(store);
+
+    return UNIT_TEST_PASSED;    
+}
+
 DECLARE_TEST(NonTypedTable) {
     g_config->tidy_         = true;
     DurableStore* store;
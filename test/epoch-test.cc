@@ -0,0 +1,339 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <new>
+#include <stdlib.h>
+#include <vector>
+
+#include "debug/Log.h"
+#include "thread/Epoch.h"
+#include "thread/SXLock.h"
+#include "thread/Thread.h"
+#include "util/Time.h"
+#include "util/UnitTest.h"
+
+using namespace oasys;
+
+atomic_t g_freed(0);
+
+/*
+ * An object that can tell when it's been used after being freed: the
+ * destructor poisons it (the memory is only really released at the
+ * end of each test, so reading it afterwards is safe).
+ */
+struct Obj {
+    Obj(u_int32_t v) : a_(v), b_(v), alive_(1) {}
+    ~Obj() { alive_ = 0; a_ = 0xdead; atomic_incr(&g_freed); }
+
+    bool ok() const { return alive_ == 1 && a_ == b_; }
+
+    volatile u_int32_t a_;
+    volatile u_int32_t b_;
+    volatile int       alive_;
+};
+
+DECLARE_TEST(Basic) {
+    Epoch e;
+    g_freed = 0;
+
+    // nothing to wait for without readers
+    e.retire(new Obj(1));
+    e.try_reclaim();
+    CHECK_EQUAL(e.pending(), 0);
+    CHECK_EQUAL(g_freed.value, 1);
+
+    // a reader in its section holds off the free, nested or not
+    {
+        ScopeEpoch r1(&e);
+        ScopeEpoch r2(&e);
+        e.retire(new Obj(2));
+        e.try_reclaim();
+        e.try_reclaim();
+        CHECK_EQUAL(e.pending(), 1);
+        CHECK_EQUAL(g_freed.value, 1);
+    }
+
+    e.try_reclaim();
+    CHECK_EQUAL(e.pending(), 0);
+    CHECK_EQUAL(g_freed.value, 2);
+
+    // the destructor frees whatever is left
+    {
+        Epoch e2;
+        {
+            ScopeEpoch r(&e2);
+            e2.retire(new Obj(3));
+        }
+        e2.retire(new Obj(4));
+    }
+    CHECK_EQUAL(g_freed.value, 4);
+
+    return UNIT_TEST_PASSED;
+}
+
+/*
+ * synchronize() has to wait for a reader that was already inside,
+ * but not for one that comes along afterwards.
+ */
+class SlowReader : public Thread {
+public:
+    SlowReader(Epoch* e, int ms)
+        : Thread("SlowReader", CREATE_JOINABLE),
+          inside_(0), e_(e), ms_(ms) {}
+
+    atomic_t inside_;
+
+protected:
+    void run() {
+        ScopeEpoch r(e_);
+        inside_ = 1;
+        usleep(ms_ * 1000);
+    }
+
+    Epoch* e_;
+    int    ms_;
+};
+
+DECLARE_TEST(Synchronize) {
+    Epoch e;
+    g_freed = 0;
+
+    SlowReader t(&e, 300);
+    t.start();
+    while (t.inside_.value == 0) {
+        usleep(1000);
+    }
+
+    Time start = Time::now();
+    e.retire(new Obj(1));
+    CHECK_EQUAL(g_freed.value, 0);
+    e.synchronize();
+    u_int32_t elapsed = start.elapsed_ms();
+    CHECK_EQUAL(g_freed.value, 1);
+    CHECK_GT(elapsed, 100);
+    t.join();
+
+    // with no one inside it returns right away
+    start = Time::now();
+    e.synchronize();
+    CHECK_LT(start.elapsed_ms(), 100);
+
+    return UNIT_TEST_PASSED;
+}
+
+/*
+ * Readers check the current object while a writer keeps replacing
+ * it. A reader that gets hold of an object that's been freed sees
+ * the poison.
+ */
+class CheckReader : public Thread {
+public:
+    CheckReader(Epoch* e, Obj* volatile* cur, volatile bool* done)
+        : Thread("CheckReader", CREATE_JOINABLE),
+          errors_(0), reads_(0), e_(e), cur_(cur), done_(done) {}
+
+    int errors_;
+    int reads_;
+
+protected:
+    void run() {
+        while (! *done_) {
+            ScopeEpoch r(e_);
+            Obj* o = *cur_;
+            if ((reads_ % 64) == 0) {
+                yield();
+            }
+            if (! o->ok()) {
+                ++errors_;
+            }
+            ++reads_;
+        }
+    }
+
+    Epoch*         e_;
+    Obj* volatile* cur_;
+    volatile bool* done_;
+};
+
+void
+destroy(void* obj)
+{
+    static_cast<Obj*>(obj)->~Obj();
+}
+
+DECLARE_TEST(Stress) {
+    Epoch e;
+    g_freed = 0;
+
+    // keep the memory of freed objects around, see Obj
+    std::vector<void*> mem;
+    Obj* volatile cur = new (malloc(sizeof(Obj))) Obj(0);
+    mem.push_back((void*)cur);
+
+    volatile bool done = false;
+    std::vector<CheckReader*> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.push_back(new CheckReader(&e, &cur, &done));
+        readers.back()->start();
+    }
+
+    int nupdates = 20000;
+    for (int i = 1; i <= nupdates; ++i) {
+        void* m = malloc(sizeof(Obj));
+        mem.push_back(m);
+
+        Obj* old = cur;
+        Epoch::publish(&cur, new (m) Obj(i));
+        e.defer(&destroy, old);
+        if ((i % 1000) == 0) {
+            e.synchronize();
+        }
+    }
+
+    done = true;
+    int errors = 0;
+    int reads  = 0;
+    for (size_t i = 0; i < readers.size(); ++i) {
+        readers[i]->join();
+        errors += readers[i]->errors_;
+        reads  += readers[i]->reads_;
+        delete readers[i];
+    }
+
+    e.synchronize();
+    log_notice_p("/test", "%d updates, %d reads, %u freed, epoch %u",
+                 nupdates, reads, g_freed.value, e.epoch());
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(g_freed.value, (u_int32_t)nupdates);
+
+    cur->~Obj();
+    for (size_t i = 0; i < mem.size(); ++i) {
+        free(mem[i]);
+    }
+
+    return UNIT_TEST_PASSED;
+}
+
+/*
+ * Cost of a read section against a shared lock, with a writer
+ * replacing the object now and then.
+ */
+int g_bench_iters = 1000000;
+
+class BenchReader : public Thread {
+public:
+    BenchReader(Epoch* e, SXLock* sx, Obj* volatile* cur)
+        : Thread("BenchReader", CREATE_JOINABLE),
+          errors_(0), e_(e), sx_(sx), cur_(cur) {}
+
+    int errors_;
+
+protected:
+    void run() {
+        for (int i = 0; i < g_bench_iters; ++i) {
+            if (e_) {
+                ScopeEpoch r(e_);
+                check(*cur_);
+            } else {
+                ScopeLock_Shared l(sx_, "BenchReader");
+                check(*cur_);
+            }
+        }
+    }
+
+    void check(Obj* o) {
+        if (o->a_ != o->b_) {
+            ++errors_;
+        }
+    }
+
+    Epoch*         e_;
+    SXLock*        sx_;
+    Obj* volatile* cur_;
+};
+
+int
+bench_reads(const char* what, Epoch* e, SXLock* sx, int nthreads)
+{
+    Obj* volatile cur = new Obj(0);
+
+    std::vector<BenchReader*> threads;
+    Time start = Time::now();
+    for (int i = 0; i < nthreads; ++i) {
+        threads.push_back(new BenchReader(e, sx, &cur));
+        threads.back()->start();
+    }
+
+    // a handful of updates while the readers run
+    for (int i = 1; i <= 10; ++i) {
+        usleep(1000);
+        if (e) {
+            Obj* old = cur;
+            Epoch::publish(&cur, new Obj(i));
+            e->retire(old);
+        } else {
+            ScopeLock_Exclusive l(sx, "bench_reads");
+            delete cur;
+            cur = new Obj(i);
+        }
+    }
+
+    int errors = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i]->join();
+        errors += threads[i]->errors_;
+        delete threads[i];
+    }
+    u_int32_t elapsed = start.elapsed_ms();
+
+    if (e) {
+        e->synchronize();
+    }
+    delete cur;
+
+    log_notice_p("/test", "%-6s %2d threads x %d reads: %u ms, %d errors",
+                 what, nthreads, g_bench_iters, elapsed, errors);
+    return errors;
+}
+
+DECLARE_TEST(BenchReads) {
+    int nthreads[] = { 1, 2, 4, 8 };
+    int errors = 0;
+
+    for (size_t i = 0; i < sizeof(nthreads) / sizeof(nthreads[0]); ++i) {
+        Epoch  e;
+        SXLock sx;
+        errors += bench_reads("Epoch",  &e,   NULL, nthreads[i]);
+        errors += bench_reads("SXLock", NULL, &sx,  nthreads[i]);
+    }
+
+    CHECK_EQUAL(errors, 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(EpochTester) {
+    ADD_TEST(Basic);
+    ADD_TEST(Synchronize);
+    ADD_TEST(Stress);
+    ADD_TEST(BenchReads);
+}
+
+DECLARE_TEST_FILE(EpochTester, "epoch reclamation test");
@@ -18,8 +18,12 @@
 #  include <oasys-config.h>
 #endif
 
+#include <dirent.h>
+#include <fcntl.h>
 #include <string>
 #include "storage/FileSystemStore.h"
+#include "thread/Thread.h"
+#include "util/Time.h"
 
 //
 // globals needed by the generic durable-store-test
@@ -48,12 +52,388 @@ DECLARE_TEST(DBTestInit) {
     g_config->tidy_             = false;
     g_config->tidy_wait_        = 0;
 
+    g_bench_load_objects = 20000;
+
     StringBuffer cmd("mkdir -p %s", g_config_dir);
     system(cmd.c_str());
 
     return 0;
 }
 
+DECLARE_TEST(DBTestInitHashed) {
+    g_config->fs_fanout_        = 256;
+    g_config->fs_atomic_put_    = true;
+    g_config->fs_fd_cache_size_ = 16;
+    return 0;
+}
+
+/**
+ * @return the number of entries in a directory, not counting . and ..
+ */
+int
+count_entries(const std::string& path)
+{
+    DIR* dir = opendir(path.c_str());
+    if (dir == 0) {
+        return -1;
+    }
+
+    int count = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != 0) {
+        if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+            ++count;
+        }
+    }
+    closedir(dir);
+
+    return count;
+}
+
+/**
+ * Reopen a flat table with a fanout, and then with a different one,
+ * and make sure everything is moved to where it can be found.
+ */
+DECLARE_TEST(Migrate) {
+    std::string table_dir = std::string(g_config_dir) + "/" +
+                            g_db_name + "/" + g_db_table;
+    int fanouts[3] = { 0, 16, 256 };
+
+    for (int run = 0; run < 3; ++run) {
+        g_config->tidy_      = (run == 0);
+        g_config->fs_fanout_ = fanouts[run];
+        DurableStore* store = new DurableStore("/test_storage");
+        CHECK(store->create_store(*g_config) == 0);
+
+        StringDurableTable* table;
+        CHECK(store->get_table(&table, g_db_table,
+                               run == 0 ? DS_CREATE | DS_EXCL : 0) == 0);
+        if (run == 0) {
+            for (int i = 0; i < 100; ++i) {
+                StaticStringBuffer<256> buf("data%d", i);
+                StringShim data(buf.c_str());
+                CHECK(table->put(IntShim(i), &data, DS_CREATE) == 0);
+            }
+        }
+
+        CHECK_EQUAL(count_entries(table_dir), run == 0 ? 100 : fanouts[run]);
+        CHECK_EQUAL(table->size(), 100);
+        for (int i = 0; i < 100; ++i) {
+            StringShim* data = NULL;
+            StaticStringBuffer<256> buf("data%d", i);
+            CHECK(table->get(IntShim(i), &data) == 0);
+            CHECK_EQUALSTR(data->value().c_str(), buf.c_str());
+            delete_z(data);
+        }
+
+        int count = 0;
+        DurableIterator* iter = table->itr();
+        while (iter->next() == 0) {
+            ++count;
+        }
+        delete_z(iter);
+        CHECK_EQUAL(count, 100);
+
+        delete_z(table);
+        DEL_DS_STORE(store);
+    }
+
+    g_config->fs_fanout_ = 0;
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Reopen a flat table with a file named just like one of the
+ * subdirectories, and make sure it's moved into place along with
+ * everything else rather than getting in the way.
+ */
+DECLARE_TEST(MigrateCollision) {
+    std::string table_dir = std::string(g_config_dir) + "/" +
+                            g_db_name + "/" + g_db_table;
+    int fanouts[2] = { 0, 256 };
+
+    for (int run = 0; run < 2; ++run) {
+        g_config->tidy_      = (run == 0);
+        g_config->fs_fanout_ = fanouts[run];
+        DurableStore* store = new DurableStore("/test_storage");
+        CHECK(store->create_store(*g_config) == 0);
+
+        StringDurableTable* table;
+        CHECK(store->get_table(&table, g_db_table,
+                               run == 0 ? DS_CREATE | DS_EXCL : 0) == 0);
+        if (run == 0) {
+            for (int i = 0; i < 100; ++i) {
+                StaticStringBuffer<256> buf("data%d", i);
+                StringShim data(buf.c_str());
+                CHECK(table->put(IntShim(i), &data, DS_CREATE) == 0);
+            }
+        }
+
+        for (int i = 0; i < 100; ++i) {
+            StringShim* data = NULL;
+            StaticStringBuffer<256> buf("data%d", i);
+            CHECK(table->get(IntShim(i), &data) == 0);
+            CHECK_EQUALSTR(data->value().c_str(), buf.c_str());
+            delete_z(data);
+        }
+
+        delete_z(table);
+        DEL_DS_STORE(store);
+
+        if (run == 0) {
+            std::string path = table_dir + "/3f";
+            int fd = open(path.c_str(), O_CREAT | O_WRONLY, 0644);
+            CHECK(fd >= 0);
+            close(fd);
+        }
+    }
+
+    CHECK_EQUAL(count_entries(table_dir), 256);
+
+    int found = 0;
+    for (int i = 0; i < 256; ++i) {
+        StaticStringBuffer<256> path("%s/%02x/3f", table_dir.c_str(), i);
+        if (access(path.c_str(), F_OK) == 0) {
+            ++found;
+        }
+    }
+    CHECK_EQUAL(found, 1);
+
+    g_config->fs_fanout_ = 0;
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Delete whole batches of files out from under a bulk iterator, and
+ * make sure it carries on to the ones after them.
+ */
+DECLARE_TEST(BulkIteratorVanished) {
+    std::string table_dir = std::string(g_config_dir) + "/" +
+                            g_db_name + "/" + g_db_table;
+
+    g_config->tidy_ = true;
+    DurableStore* store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    StringDurableTable* table;
+    CHECK(store->get_table(&table, g_db_table, DS_CREATE | DS_EXCL) == 0);
+    for (int i = 0; i < 20; ++i) {
+        StringShim data("data");
+        CHECK(table->put(IntShim(i), &data, DS_CREATE) == 0);
+    }
+
+    // the iterator reads the directory in the same order
+    std::vector<std::string> names;
+    DIR* dir = opendir(table_dir.c_str());
+    CHECK(dir != 0);
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != 0) {
+        if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+            names.push_back(ent->d_name);
+        }
+    }
+    closedir(dir);
+    CHECK_EQUAL(names.size(), (size_t)20);
+
+    DurableIterator* iter = table->bulk_itr(4);
+    CHECK(iter->next() == 0);
+
+    // the next three batches all go away
+    for (size_t i = 4; i < 16; ++i) {
+        std::string path = table_dir + "/" + names[i];
+        CHECK(unlink(path.c_str()) == 0);
+    }
+
+    int count = 1;
+    while (iter->next() == 0) {
+        ++count;
+    }
+    delete_z(iter);
+    CHECK_EQUAL(count, 8);
+
+    delete_z(table);
+    DEL_DS_STORE(store);
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Compare fsyncing every put against syncing them all at the end.
+ */
+DECLARE_TEST(BatchedSync) {
+    const int count = 500;
+    u_int32_t elapsed[2];
+
+    for (int run = 0; run < 2; ++run) {
+        g_config->tidy_         = true;
+        g_config->fs_sync_puts_ = (run == 0);
+        DurableStore* store = new DurableStore("/test_storage");
+        CHECK(store->create_store(*g_config) == 0);
+
+        StringDurableTable* table;
+        CHECK(store->get_table(&table, g_db_table, DS_CREATE | DS_EXCL) == 0);
+
+        int errors = 0;
+        StringShim data("bundle metadata");
+        Time start = Time::now();
+        for (int i = 0; i < count; ++i) {
+            if (table->put(IntShim(i), &data, DS_CREATE) != 0) {
+                ++errors;
+            }
+        }
+        if (store->sync() != 0) {
+            ++errors;
+        }
+        elapsed[run] = start.elapsed_ms();
+
+        CHECK_EQUAL(errors, 0);
+        CHECK_EQUAL(table->size(), (size_t)count);
+        delete_z(table);
+        DEL_DS_STORE(store);
+    }
+    g_config->fs_sync_puts_ = false;
+
+    log_notice_p("/test", "%d durable puts: %u ms synced one at a time, "
+                 "%u ms synced together", count, elapsed[0], elapsed[1]);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Time loading a whole table with a get() per key, and with a bulk
+ * iterator that reads the files ahead in inode order.
+ */
+DECLARE_TEST(BenchLoad) {
+    const int count = 2000;
+    g_config->tidy_ = true;
+    DurableStore* store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    StringDurableTable* table;
+    CHECK(store->get_table(&table, g_db_table, DS_CREATE | DS_EXCL) == 0);
+
+    int errors = 0;
+    StringShim data("bundle metadata");
+    for (int i = 0; i < count; ++i) {
+        if (table->put(IntShim(i), &data, DS_CREATE) != 0) {
+            ++errors;
+        }
+    }
+
+    u_int32_t elapsed[2];
+    for (int run = 0; run < 2; ++run) {
+        Time start = Time::now();
+        DurableIterator* iter = run ? table->bulk_itr() : table->itr();
+        int loaded = 0;
+        while (iter->next() == 0) {
+            Builder b;
+            IntShim key(b);
+            StringShim value(b);
+            if (iter->get_key(&key) != 0) {
+                ++errors;
+                continue;
+            }
+
+            int err;
+            if (run) {
+                err = iter->get_data(&value);
+            } else {
+                err = table->get_copy(key, &value);
+            }
+            if (err != 0 || value.value() != data.value()) {
+                ++errors;
+            }
+            ++loaded;
+        }
+        delete_z(iter);
+        elapsed[run] = start.elapsed_ms();
+        CHECK_EQUAL(loaded, count);
+    }
+
+    CHECK_EQUAL(errors, 0);
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    log_notice_p("/test", "loading %d objects: %u ms with get(), "
+                 "%u ms with bulk_itr()", count, elapsed[0], elapsed[1]);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Puts and gets of one key from several threads. With atomic puts and
+ * an fd cache, every put replaces the cached fd that the gets may
+ * still be reading from.
+ */
+class GetPutThread : public Thread {
+public:
+    GetPutThread(StringDurableTable* table, bool writer, int count)
+        : Thread("GetPutThread", CREATE_JOINABLE),
+          errors_(0), table_(table), writer_(writer), count_(count) {}
+
+    int errors_;
+
+protected:
+    void run() {
+        for (int i = 0; i < count_; ++i) {
+            if (writer_) {
+                StaticStringBuffer<256> buf("value %d", i);
+                StringShim data(buf.c_str());
+                if (table_->put(IntShim(1), &data, DS_CREATE) != 0) {
+                    ++errors_;
+                }
+            } else {
+                StringShim* data = NULL;
+                if (table_->get(IntShim(1), &data) != 0 ||
+                    data->value().compare(0, 6, "value ") != 0)
+                {
+                    ++errors_;
+                }
+                delete_z(data);
+            }
+        }
+    }
+
+    StringDurableTable* table_;
+    bool                writer_;
+    int                 count_;
+};
+
+DECLARE_TEST(ConcurrentGetPut) {
+    g_config->tidy_ = true;
+    DurableStore* store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    StringDurableTable* table;
+    CHECK(store->get_table(&table, g_db_table, DS_CREATE | DS_EXCL) == 0);
+
+    StringShim first("value first");
+    CHECK(table->put(IntShim(1), &first, DS_CREATE) == 0);
+
+    std::vector<GetPutThread*> threads;
+    for (int i = 0; i < 6; ++i) {
+        threads.push_back(new GetPutThread(table, (i % 3) == 0, 2000));
+        threads.back()->start();
+    }
+
+    int errors = 0;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->join();
+        errors += threads[i]->errors_;
+        delete threads[i];
+    }
+    CHECK_EQUAL(errors, 0);
+
+    StringShim* data = NULL;
+    CHECK(table->get(IntShim(1), &data) == 0);
+    CHECK_EQUALSTR(data->value().c_str(), "value 1999");
+    delete_z(data);
+
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TESTER(FilesysDBTester) {
     ADD_TEST(DBTestInit);
 
@@ -65,14 +445,50 @@ DECLARE_TESTER(FilesysDBTester) {
 
     ADD_TEST(SingleTypePut);
     ADD_TEST(SingleTypeGet);
+    ADD_TEST(GetView);
+    ADD_TEST(SingleTypeDelete);
+    ADD_TEST(SingleTypeMultiObject);
+    ADD_TEST(SingleTypeIterator);
+    ADD_TEST(SingleTypeBulkIterator);
+    ADD_TEST(SingleTypeCache);
+
+    ADD_TEST(NonTypedTable);
+    ADD_TEST(MultiType);
+    ADD_TEST(MultiTypeBulkIterator);
+    ADD_TEST(LoadTables);
+    ADD_TEST(MultiTypeCache);
+
+    ADD_TEST(Migrate);
+    ADD_TEST(MigrateCollision);
+    ADD_TEST(BulkIteratorVanished);
+
+    // the same again with hashed subdirectories and atomic puts
+    ADD_TEST(DBTestInitHashed);
+
+    ADD_TEST(DBInit);
+    ADD_TEST(TableCreate);
+    ADD_TEST(TableDelete);
+    ADD_TEST(TableGetNames);
+
+    ADD_TEST(SingleTypePut);
+    ADD_TEST(SingleTypeGet);
+    ADD_TEST(GetView);
     ADD_TEST(SingleTypeDelete);
     ADD_TEST(SingleTypeMultiObject);
     ADD_TEST(SingleTypeIterator);
+    ADD_TEST(SingleTypeBulkIterator);
     ADD_TEST(SingleTypeCache);
 
     ADD_TEST(NonTypedTable);
     ADD_TEST(MultiType);
+    ADD_TEST(MultiTypeBulkIterator);
+    ADD_TEST(LoadTables);
     ADD_TEST(MultiTypeCache);
+    ADD_TEST(ConcurrentGetPut);
+
+    ADD_TEST(BatchedSync);
+    ADD_TEST(BenchLoad);
+    ADD_TEST(BenchLoadTables);
 }
 
 DECLARE_TEST_FILE(FilesysDBTester, "filesystem db test");
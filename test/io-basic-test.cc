@@ -640,6 +640,177 @@ DECLARE_TEST(WriteIntr)        { return UNIT_TEST_PASSED; }
 DECLARE_TEST(WriteTimeout)     { return UNIT_TEST_PASSED; }
 DECLARE_TEST(WriteTimeoutIntr) { return UNIT_TEST_PASSED; }
 
+#define SENDFILE_SIZE (2*1024*1024)
+
+// write the first length bytes of g_testbuf to an unlinked temp file
+int
+make_test_file(size_t length)
+{
+    char path[] = "/tmp/io-basic-test-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path);
+    
+    if (writeall(fd, g_testbuf, length) != (int)length) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+struct SendFileRunner : public PipeIOTester {
+    SendFileRunner() : file_fd_(make_test_file(SENDFILE_SIZE)) {
+        ASSERT(file_fd_ >= 0);
+    }
+    ~SendFileRunner() { close(file_fd_); }
+
+    void run_reader() {
+        size_t offset = 0;
+        offset = verify_readall(fds_[0], SENDFILE_SIZE - 1000, 1000);
+        if (offset != SENDFILE_SIZE) { fail(); }
+    }
+
+    void run_writer() {
+        // the file position is left alone when an offset is given
+        off_t offset = 1000;
+        ssize_t cc = IO::sendfileall(fds_[1], file_fd_, &offset, 
+                                 SENDFILE_SIZE - 1000, 0, "/write");
+        if (cc != SENDFILE_SIZE - 1000) { fail(); }
+        if (offset != SENDFILE_SIZE)    { fail(); }
+        if (::lseek(file_fd_, 0, SEEK_CUR) != SENDFILE_SIZE) { fail(); }
+    }
+
+    int file_fd_;
+};
+
+DECLARE_TEST(SendFile) {
+    reset_data();
+    SendFileRunner r;
+    r.run();
+
+    return r.status();
+}
+
+struct SendFileEOFRunner : public SendFileRunner {
+    void run_reader() {
+        verify_readall(fds_[0], SENDFILE_SIZE, 0);
+    }
+
+    void run_writer() {
+        // no offset, so the file position is used (and it's at the end)
+        ::lseek(file_fd_, 0, SEEK_SET);
+        ssize_t cc = IO::sendfileall(fds_[1], file_fd_, 0,
+                                 SENDFILE_SIZE + 1000, 0, "/write");
+        if (cc != IOEOF) { fail(); }
+        if (::lseek(file_fd_, 0, SEEK_CUR) != SENDFILE_SIZE) { fail(); }
+        close(fds_[1]);
+        fds_[1] = -1;
+    }
+};
+
+DECLARE_TEST(SendFileEOF) {
+    reset_data();
+    SendFileEOFRunner r;
+    r.run();
+
+    return r.status();
+}
+
+struct SendFileTimeoutIntrRunner : public SendFileRunner {
+    SendFileTimeoutIntrRunner() 
+        : intr("SendFileTimeoutIntrRunner") {}
+
+    // nobody reads the pipe, so the writer fills it and then blocks
+    void run_reader() {
+        usleep(500000);
+        intr.notify();
+    }
+
+    void run_writer() {
+        IO::set_nonblocking(fds_[1], true);
+        off_t offset = 0;
+        ssize_t cc = IO::timeout_sendfileall(fds_[1], file_fd_, &offset,
+                                         SENDFILE_SIZE, 100, 0, "/write");
+        if (cc != IOTIMEOUT) { fail(); }
+        if (offset == 0 || offset == SENDFILE_SIZE) { fail(); }
+
+        cc = IO::sendfileall(fds_[1], file_fd_, &offset,
+                             SENDFILE_SIZE, &intr, "/write");
+        if (cc != IOINTR) { fail(); }
+    }
+
+    Notifier intr;
+};
+
+DECLARE_TEST(SendFileTimeoutIntr) {
+    reset_data();
+    SendFileTimeoutIntrRunner r;
+    r.run();
+
+    return r.status();
+}
+
+struct SpliceRunner : public SendFileRunner {
+    void run_reader() {
+        verify_readall(fds_[0], SENDFILE_SIZE, 0);
+    }
+
+    void run_writer() {
+        off_t offset = 0;
+        ssize_t cc = IO::timeout_spliceall(fds_[1], file_fd_, &offset,
+                                       SENDFILE_SIZE, 0, 10000, 0, "/write");
+#if defined(__linux__)
+        if (cc != SENDFILE_SIZE)     { fail(); }
+        if (offset != SENDFILE_SIZE) { fail(); }
+#else
+        if (cc != IOERROR || errno != ENOSYS) { fail(); }
+        IO::sendfileall(fds_[1], file_fd_, &offset, SENDFILE_SIZE);
+#endif
+    }
+};
+
+DECLARE_TEST(Splice) {
+    reset_data();
+    SpliceRunner r;
+    r.run();
+
+    return r.status();
+}
+
+struct TCPSendFileRunner : public SendFileRunner {
+    TCPSendFileRunner() {
+        int err = socketpair(AF_UNIX, SOCK_STREAM, 0, sv_);
+        ASSERT(err == 0);
+    }
+    ~TCPSendFileRunner() { close(sv_[1]); }
+
+    void run_reader() {
+        size_t offset = verify_readall(sv_[1], SENDFILE_SIZE / 2, 
+                                       SENDFILE_SIZE / 4);
+        if (offset != SENDFILE_SIZE * 3 / 4) { fail(); }
+    }
+
+    void run_writer() {
+        TCPClient client(sv_[0], htonl(INADDR_LOOPBACK), 0, "/write");
+        ssize_t cc = client.send_file(file_fd_, SENDFILE_SIZE / 4,
+                                  SENDFILE_SIZE / 2, 10000);
+        if (cc != SENDFILE_SIZE / 2) { fail(); }
+    }
+
+    int sv_[2];
+};
+
+DECLARE_TEST(TCPSendFile) {
+    reset_data();
+    TCPSendFileRunner r;
+    r.run();
+
+    return r.status();
+}
+
 DECLARE_TESTER(IoBasicTester) {
     ADD_TEST(Init);
 
@@ -657,6 +828,12 @@ DECLARE_TESTER(IoBasicTester) {
     ADD_TEST(WriteIntr);
     ADD_TEST(WriteTimeout);
     ADD_TEST(WriteTimeoutIntr);
+
+    ADD_TEST(SendFile);
+    ADD_TEST(SendFileEOF);
+    ADD_TEST(SendFileTimeoutIntr);
+    ADD_TEST(Splice);
+    ADD_TEST(TCPSendFile);
     
     // XXX/bowei test socket receive fcns
 }
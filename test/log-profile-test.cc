@@ -23,6 +23,7 @@
 
 #include "debug/Formatter.h"
 #include "debug/Log.h"
+#include "util/Time.h"
 #include "util/UnitTest.h"
 #include "util/StringBuffer.h"
 #include "thread/Thread.h"
@@ -41,9 +42,34 @@ DECLARE_TEST(Init) {
 DECLARE_TEST(NoOutput) {
     log_always_p("/test", "testing %d iterations with no output", count);
 
+    Time start = Time::now();
     for (int i = 0; i < count; ++i) {
         log_debug_p("/XXX", "don't output me");
     }
+    log_always_p("/test", "%u ms", start.elapsed_ms());
+
+    return UNIT_TEST_PASSED;
+}
+
+class QuietLogger : public Logger {
+public:
+    QuietLogger() : Logger("QuietLogger", "/XXX/quiet/logger") {}
+
+    void run() {
+        for (int i = 0; i < count; ++i) {
+            log_debug("don't output me %d", i);
+        }
+    }
+};
+
+DECLARE_TEST(LoggerNoOutput) {
+    log_always_p("/test", "testing %d iterations of Logger "
+                 "with no output", count);
+
+    QuietLogger logger;
+    Time start = Time::now();
+    logger.run();
+    log_always_p("/test", "%u ms", start.elapsed_ms());
 
     return UNIT_TEST_PASSED;
 }
@@ -68,6 +94,18 @@ DECLARE_TEST(Logf) {
     return UNIT_TEST_PASSED;
 }
 
+DECLARE_TEST(AsyncLogf) {
+    log_always_p("/test", "testing %d iterations of async logf()", count);
+
+    Log::instance()->start_async(1024 * 1024, Log::ASYNC_BLOCK);
+    for (int i = 0; i < count; ++i) {
+        logf("/test", LOG_ALWAYS, "output me %d %s %d", 1, "foo", 2);
+    }
+    Log::instance()->stop_async();
+
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TEST(LogMultiline) {
     log_always_p("/test", "testing %d iterations of log_multiline()", count);
 
@@ -82,8 +120,11 @@ DECLARE_TEST(LogMultiline) {
 
 DECLARE_TESTER(LogProfileTest) {
     ADD_TEST(Init);
+    ADD_TEST(NoOutput);
+    ADD_TEST(LoggerNoOutput);
     ADD_TEST(Log);
     ADD_TEST(Logf);
+    ADD_TEST(AsyncLogf);
     ADD_TEST(LogMultiline);
 }
 
@@ -0,0 +1,536 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#include "storage/GroupCommitter.h"
+#include "storage/LogStore.h"
+#include "thread/Thread.h"
+#include "util/Time.h"
+
+//
+// globals needed by the generic durable-store-test
+//
+#define DEL_DS_STORE(store) delete_z(store)
+
+std::string g_db_name    = "test-db";
+const char* g_config_dir = "output/log-store-test/log-store-test";
+
+//
+// pull in the generic test
+//
+
+#include "durable-store-test.cc"
+
+DECLARE_TEST(DBTestInit) {
+    g_config = new StorageConfig(
+        "storage",              // command name
+        "logdb",                // type
+        g_db_name,              // dbname
+        g_config_dir            // dbdir
+    );
+
+    g_config->init_             = true;
+    g_config->tidy_             = false;
+    g_config->tidy_wait_        = 0;
+
+    g_bench_load_objects = 200000;
+    g_config->leave_clean_file_ = false;
+
+    StringBuffer cmd("mkdir -p %s", g_config_dir);
+    system(cmd.c_str());
+
+    return 0;
+}
+
+/**
+ * Open the store without wiping it.
+ */
+DurableStore*
+reopen_store()
+{
+    g_config->tidy_ = false;
+    DurableStore* store = new DurableStore("/test_storage");
+    if (store->create_store(*g_config) != 0) {
+        delete store;
+        return NULL;
+    }
+    return store;
+}
+
+DECLARE_TEST(Recovery) {
+    g_config->tidy_ = true;
+    DurableStore* store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    StringDurableTable* table;
+    CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+    StringShim x("x"), seven("seven");
+    StringDurableTable* table2;
+    CHECK(store->get_table(&table2, "gone", DS_CREATE | DS_EXCL) == 0);
+    CHECK(table2->put(IntShim(1), &x, DS_CREATE) == 0);
+    delete_z(table2);
+
+    for (int i = 0; i < 100; ++i) {
+        StaticStringBuffer<256> buf("data%d", i);
+        StringShim data(buf.c_str());
+        CHECK(table->put(IntShim(i), &data, DS_CREATE) == 0);
+    }
+    CHECK(table->put(IntShim(7), &seven, 0) == 0);
+    CHECK(table->del(IntShim(8)) == 0);
+    CHECK(store->del_table("gone") == 0);
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    store = reopen_store();
+    CHECK(store != NULL);
+    CHECK(store->get_table(&table, "test", 0) == 0);
+    CHECK(store->get_table(&table2, "gone", 0) == DS_NOTFOUND);
+    CHECK_EQUAL(table->size(), 99);
+
+    StringShim* data = NULL;
+    CHECK(table->get(IntShim(7), &data) == 0);
+    CHECK_EQUALSTR(data->value().c_str(), "seven");
+    delete_z(data);
+    CHECK(table->get(IntShim(8), &data) == DS_NOTFOUND);
+    CHECK(table->get(IntShim(99), &data) == 0);
+    CHECK_EQUALSTR(data->value().c_str(), "data99");
+    delete_z(data);
+
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * A crash in the middle of a write leaves part of a record at the end
+ * of the log, which recovery should cut off.
+ */
+DECLARE_TEST(TornTail) {
+    g_config->tidy_ = true;
+    DurableStore* store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+
+    StringShim one("one"), two("two"), three("three");
+    StringDurableTable* table;
+    CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+    CHECK(table->put(IntShim(1), &one, DS_CREATE) == 0);
+    CHECK(table->put(IntShim(2), &two, DS_CREATE) == 0);
+    off_t good_size = static_cast<LogStore*>(store->impl())->log_size();
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    StringBuffer path("%s/%s.log", g_config_dir, g_db_name.c_str());
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+    CHECK(fd >= 0);
+    CHECK(write(fd, "*\0\0\0\0\0\0\0\x20garbage", 16) == 16);
+    close(fd);
+
+    store = reopen_store();
+    CHECK(store != NULL);
+    CHECK_EQUAL(static_cast<LogStore*>(store->impl())->log_size(), good_size);
+    CHECK(store->get_table(&table, "test", 0) == 0);
+    CHECK_EQUAL(table->size(), 2);
+
+    // and new records go after the good ones
+    CHECK(table->put(IntShim(3), &three, DS_CREATE) == 0);
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    store = reopen_store();
+    CHECK(store != NULL);
+    CHECK(store->get_table(&table, "test", 0) == 0);
+    CHECK_EQUAL(table->size(), 3);
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(Compact) {
+    g_config->tidy_ = true;
+    g_config->log_compact_pct_ = 0;
+    DurableStore* store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+    LogStore* impl = static_cast<LogStore*>(store->impl());
+
+    StringDurableTable* table;
+    CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+    for (int pass = 0; pass < 10; ++pass) {
+        for (int i = 0; i < 100; ++i) {
+            StaticStringBuffer<256> buf("data%d.%d", i, pass);
+            StringShim data(buf.c_str());
+            CHECK(table->put(IntShim(i), &data, DS_CREATE) == 0);
+        }
+    }
+    for (int i = 50; i < 100; ++i) {
+        CHECK(table->del(IntShim(i)) == 0);
+    }
+
+    off_t before = impl->log_size();
+    CHECK(impl->dead_bytes() > before * 9 / 10);
+    CHECK(impl->compact() == 0);
+    CHECK(impl->log_size() < before / 10);
+    CHECK_EQUAL(impl->dead_bytes(), 0);
+    CHECK_EQUAL(table->size(), 50);
+
+    StringShim* data = NULL;
+    CHECK(table->get(IntShim(42), &data) == 0);
+    CHECK_EQUALSTR(data->value().c_str(), "data42.9");
+    delete_z(data);
+
+    StringShim after("after");
+    CHECK(table->put(IntShim(42), &after, 0) == 0);
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    store = reopen_store();
+    CHECK(store != NULL);
+    CHECK(store->get_table(&table, "test", 0) == 0);
+    CHECK_EQUAL(table->size(), 50);
+    CHECK(table->get(IntShim(42), &data) == 0);
+    CHECK_EQUALSTR(data->value().c_str(), "after");
+    delete_z(data);
+    CHECK(table->get(IntShim(7), &data) == 0);
+    CHECK_EQUALSTR(data->value().c_str(), "data7.9");
+    delete_z(data);
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    g_config->log_compact_pct_ = 50;
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Overwrite a small set of keys until the background compaction
+ * kicks in, and make sure the log stays bounded.
+ */
+DECLARE_TEST(BackgroundCompact) {
+    g_config->tidy_ = true;
+    g_config->log_compact_min_ = 64 * 1024;
+    DurableStore* store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+    LogStore* impl = static_cast<LogStore*>(store->impl());
+
+    StringDurableTable* table;
+    CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+
+    int errors = 0;
+    std::string value(100, 'x');
+    StringShim data(value);
+    for (int i = 0; i < 20000; ++i) {
+        if (table->put(IntShim(i % 100), &data, DS_CREATE) != 0) {
+            ++errors;
+        }
+    }
+    CHECK_EQUAL(errors, 0);
+
+    // give the compaction thread a chance to catch up
+    for (int i = 0; i < 100 && impl->log_size() > 256 * 1024; ++i) {
+        usleep(10000);
+    }
+    CHECK(impl->log_size() <= 256 * 1024);
+    CHECK_EQUAL(table->size(), 100);
+
+    delete_z(table);
+    DEL_DS_STORE(store);
+    g_config->log_compact_min_ = 1024 * 1024;
+
+    return UNIT_TEST_PASSED;
+}
+
+class GetThread : public Thread {
+public:
+    GetThread(StringDurableTable* table, volatile bool* done)
+        : Thread("GetThread", CREATE_JOINABLE),
+          table_(table), done_(done), gets_(0), errors_(0) {}
+
+    StringDurableTable* table_;
+    volatile bool*      done_;
+    int                 gets_;
+    int                 errors_;
+
+protected:
+    void run() {
+        while (! *done_) {
+            int i = gets_ % 100;
+            StaticStringBuffer<256> buf("data%d", i);
+            StringShim* data = NULL;
+            if (table_->get(IntShim(i), &data) != 0 ||
+                data->value() != buf.c_str())
+            {
+                ++errors_;
+            }
+            delete_z(data);
+            ++gets_;
+        }
+    }
+};
+
+/**
+ * Gets read the log without holding the store lock, so they have to
+ * keep working while compactions swap the log out from under them.
+ */
+DECLARE_TEST(GetDuringCompact) {
+    g_config->tidy_ = true;
+    g_config->log_compact_pct_ = 0;
+    DurableStore* store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+    LogStore* impl = static_cast<LogStore*>(store->impl());
+
+    StringDurableTable* table;
+    CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+    for (int i = 0; i < 100; ++i) {
+        StaticStringBuffer<256> buf("data%d", i);
+        StringShim data(buf.c_str());
+        CHECK(table->put(IntShim(i), &data, DS_CREATE) == 0);
+    }
+
+    volatile bool done = false;
+    std::vector<GetThread*> threads;
+    for (int i = 0; i < 3; ++i) {
+        threads.push_back(new GetThread(table, &done));
+        threads.back()->start();
+    }
+
+    int errors = 0;
+    for (int pass = 0; pass < 20; ++pass) {
+        for (int i = 0; i < 100; ++i) {
+            StaticStringBuffer<256> buf("data%d", i);
+            StringShim data(buf.c_str());
+            if (table->put(IntShim(i), &data, 0) != 0) {
+                ++errors;
+            }
+        }
+        if (impl->compact() != 0) {
+            ++errors;
+        }
+    }
+
+    done = true;
+    int gets = 0;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->join();
+        errors += threads[i]->errors_;
+        gets   += threads[i]->gets_;
+        delete threads[i];
+    }
+
+    log_notice_p("/test", "%d gets during 20 compactions", gets);
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(impl->dead_bytes(), 0);
+
+    delete_z(table);
+    DEL_DS_STORE(store);
+
+    g_config->log_compact_pct_ = 50;
+    return UNIT_TEST_PASSED;
+}
+
+class PutThread : public Thread {
+public:
+    PutThread(StringDurableTable* table, int base, int count)
+        : Thread("PutThread", CREATE_JOINABLE),
+          table_(table), base_(base), count_(count), errors_(0) {}
+
+    StringDurableTable* table_;
+    int                 base_;
+    int                 count_;
+    int                 errors_;
+
+protected:
+    void run() {
+        StringShim data("bundle metadata");
+        for (int i = 0; i < count_; ++i) {
+            if (table_->put(IntShim(base_ + i), &data, DS_CREATE) != 0) {
+                ++errors_;
+            }
+        }
+    }
+};
+
+/**
+ * With log_sync_ set every put is on disk when it returns. Compare
+ * one thread syncing each put on its own against several threads
+ * whose puts get committed together.
+ */
+DECLARE_TEST(GroupCommit) {
+    const int count = 500;
+    const int nthreads[2] = { 1, 8 };
+    u_int32_t elapsed[2];
+
+    g_config->log_sync_ = true;
+    for (int run = 0; run < 2; ++run) {
+        g_config->tidy_ = true;
+        DurableStore* store = new DurableStore("/test_storage");
+        CHECK(store->create_store(*g_config) == 0);
+
+        StringDurableTable* table;
+        CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+
+        std::vector<PutThread*> threads;
+        for (int i = 0; i < nthreads[run]; ++i) {
+            threads.push_back(new PutThread(table, i * count, count));
+        }
+
+        Time start = Time::now();
+        for (int i = 0; i < nthreads[run]; ++i) {
+            threads[i]->start();
+        }
+        int errors = 0;
+        for (int i = 0; i < nthreads[run]; ++i) {
+            threads[i]->join();
+            errors += threads[i]->errors_;
+            delete threads[i];
+        }
+        elapsed[run] = start.elapsed_ms();
+
+        CHECK_EQUAL(errors, 0);
+        CHECK_EQUAL(table->size(), (size_t)(nthreads[run] * count));
+        delete_z(table);
+        DEL_DS_STORE(store);
+    }
+    g_config->log_sync_ = false;
+
+    log_notice_p("/test", "synced puts: 1 thread %d puts in %u ms, "
+                 "%d threads %d puts in %u ms",
+                 count, elapsed[0],
+                 nthreads[1], nthreads[1] * count, elapsed[1]);
+
+    return UNIT_TEST_PASSED;
+}
+
+class CommitThread : public Thread {
+public:
+    CommitThread(DurableStore* store, StringDurableTable* table,
+                 int base, int count)
+        : Thread("CommitThread", CREATE_JOINABLE),
+          store_(store), table_(table), base_(base), count_(count),
+          errors_(0) {}
+
+    DurableStore*       store_;
+    StringDurableTable* table_;
+    int                 base_;
+    int                 count_;
+    int                 errors_;
+
+protected:
+    void run() {
+        StringShim data("bundle metadata");
+        for (int i = 0; i < count_; ++i) {
+            if (table_->put(IntShim(base_ + i), &data, DS_CREATE) != 0 ||
+                store_->sync() != 0)
+            {
+                ++errors_;
+            }
+        }
+    }
+};
+
+/**
+ * Commit through the DurableStore group commit layer from several
+ * threads at once, and check that they ended up sharing syncs.
+ */
+DECLARE_TEST(DurableGroupCommit) {
+    const int count    = 100;
+    const int nthreads = 8;
+
+    g_config->tidy_                    = true;
+    g_config->group_commit_            = true;
+    g_config->group_commit_latency_ms_ = 5;
+    g_config->group_commit_max_batch_  = nthreads;
+    DurableStore* store = new DurableStore("/test_storage");
+    CHECK(store->create_store(*g_config) == 0);
+    CHECK(store->group_committer() != NULL);
+
+    StringDurableTable* table;
+    CHECK(store->get_table(&table, "test", DS_CREATE | DS_EXCL) == 0);
+
+    std::vector<CommitThread*> threads;
+    for (int i = 0; i < nthreads; ++i) {
+        threads.push_back(new CommitThread(store, table, i * count, count));
+    }
+
+    Time start = Time::now();
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i]->start();
+    }
+    int errors = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i]->join();
+        errors += threads[i]->errors_;
+        delete threads[i];
+    }
+    u_int32_t elapsed = start.elapsed_ms();
+
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(table->size(), (size_t)(nthreads * count));
+
+    GroupCommitter* gc = store->group_committer();
+    CHECK_EQUAL(gc->commits(), (u_int32_t)(nthreads * count));
+    CHECK(gc->syncs() < gc->commits());
+    log_notice_p("/test", "group commit: %u commits, %u syncs in %u ms",
+                 gc->commits(), gc->syncs(), elapsed);
+
+    delete_z(table);
+    DEL_DS_STORE(store);
+    g_config->group_commit_ = false;
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(LogStoreTester) {
+    ADD_TEST(DBTestInit);
+
+    ADD_TEST(DBInit);
+    ADD_TEST(DBTidy);
+    ADD_TEST(TableCreate);
+    ADD_TEST(TableDelete);
+    ADD_TEST(TableGetNames);
+
+    ADD_TEST(SingleTypePut);
+    ADD_TEST(SingleTypeGet);
+    ADD_TEST(GetView);
+    ADD_TEST(SingleTypeDelete);
+    ADD_TEST(SingleTypeMultiObject);
+    ADD_TEST(SingleTypeIterator);
+    ADD_TEST(SingleTypeBulkIterator);
+    ADD_TEST(SingleTypeCache);
+
+    ADD_TEST(NonTypedTable);
+    ADD_TEST(MultiType);
+    ADD_TEST(MultiTypeBulkIterator);
+    ADD_TEST(LoadTables);
+    ADD_TEST(MultiTypeCache);
+
+    ADD_TEST(Recovery);
+    ADD_TEST(TornTail);
+    ADD_TEST(Compact);
+    ADD_TEST(BackgroundCompact);
+    ADD_TEST(GetDuringCompact);
+    ADD_TEST(GroupCommit);
+    ADD_TEST(DurableGroupCommit);
+    ADD_TEST(BenchLoadTables);
+}
+
+DECLARE_TEST_FILE(LogStoreTester, "log store test");
@@ -19,7 +19,9 @@
 #endif
 
 #include <sys/stat.h>
+#include <sys/wait.h>
 
+#include "debug/FatalSignals.h"
 #include "debug/Formatter.h"
 #include "debug/Log.h"
 #include "io/FileIOClient.h"
@@ -491,6 +493,64 @@ DECLARE_TEST(ReparseTest) {
     return UNIT_TEST_PASSED;
 }
 
+/*
+ * Threads look up a level as fast as they can while the rules are
+ * reparsed underneath them. The lookups don't lock, so they'd read
+ * freed rules if an old list went away too soon.
+ */
+class LevelThread : public Thread {
+public:
+    LevelThread()
+        : Thread("LevelThread", CREATE_JOINABLE),
+          lookups_(0), errors_(0) {}
+
+    static volatile bool stop_;
+    int lookups_;
+    int errors_;
+
+protected:
+    void run() {
+        while (! stop_) {
+            log_level_t level =
+                Log::instance()->log_level("/log-test/thread/level");
+            if (level != LOG_INFO && level != LOG_WARN) {
+                ++errors_;
+            }
+            ++lookups_;
+        }
+    }
+};
+
+volatile bool LevelThread::stop_ = false;
+
+DECLARE_TEST(ReparseStressTest) {
+    LevelThread t1, t2, t3;
+    t1.start();
+    t2.start();
+    t3.start();
+
+    for (int i = 0; i < 200; ++i) {
+        Log::instance()->parse_debug_file(
+            (i % 2) ? path2.c_str() : path1.c_str());
+        if ((i % 16) == 0) {
+            Thread::yield();
+        }
+    }
+
+    LevelThread::stop_ = true;
+    t1.join();
+    t2.join();
+    t3.join();
+
+    log_notice_p("/test", "%d lookups during reparsing",
+                 t1.lookups_ + t2.lookups_ + t3.lookups_);
+    CHECK_EQUAL(t1.errors_ + t2.errors_ + t3.errors_, 0);
+    CHECK_EQUAL(Log::instance()->log_level("/log-test/thread/level"),
+                LOG_WARN);
+
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TEST(ErrnoTest) {
     errno = EINVAL;
     CHECK_EQUAL(errno, EINVAL);
@@ -578,6 +638,217 @@ DECLARE_TEST(MultilineTest) {
 }
 
 
+DECLARE_TEST(LevelCacheTest) {
+    Log::instance()->parse_debug_file(path2.c_str());
+
+    Logger logger("LevelCacheTest", "/log-test/thread/cache");
+    CHECK(! logger.log_enabled(LOG_INFO));
+    CHECK(logger.log_enabled(LOG_WARN));
+
+    // reparsing bumps the generation, so the cached level is redone
+    u_int32_t gen = Log::generation();
+    Log::instance()->parse_debug_file(path1.c_str());
+    CHECK(Log::generation() != gen);
+    CHECK(logger.log_enabled(LOG_INFO));
+    CHECK(! logger.log_enabled(LOG_DEBUG));
+
+    // as does changing the path
+    logger.set_logpath("/log-test");
+    CHECK(logger.log_enabled(LOG_DEBUG));
+    logger.logpath_appendf("/thread");
+    CHECK(! logger.log_enabled(LOG_DEBUG));
+    logger.logpathf("/log-test/cache");
+    CHECK(logger.log_enabled(LOG_DEBUG));
+
+    // nothing is compiled out by default
+    CHECK(LOG_LEVEL_COMPILED(LOG_DEBUG));
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Point stdout (and therefore the log) at a scratch file for the
+ * async tests, so the output can be checked.
+ */
+class CaptureStdout {
+public:
+    CaptureStdout(const char* tag) {
+        path_.appendf("/tmp/log-test-%s-%s-%d", getenv("USER"), tag, getpid());
+        fflush(stdout);
+        saved_ = dup(1);
+        int fd = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                      S_IRUSR | S_IWUSR);
+        dup2(fd, 1);
+        close(fd);
+    }
+
+    ~CaptureStdout() {
+        restore();
+        unlink(path_.c_str());
+    }
+
+    void restore() {
+        if (saved_ != -1) {
+            dup2(saved_, 1);
+            close(saved_);
+            saved_ = -1;
+        }
+    }
+
+    /// Read back the captured output
+    std::string contents() {
+        std::string ret;
+        char buf[4096];
+        int fd = open(path_.c_str(), O_RDONLY);
+        int cc;
+        while ((cc = read(fd, buf, sizeof(buf))) > 0) {
+            ret.append(buf, cc);
+        }
+        close(fd);
+        return ret;
+    }
+
+    StringBuffer path_;
+    int saved_;
+};
+
+/**
+ * Count the "async-line <thread> <seq>" entries in the output,
+ * checking that each thread's entries appear in order.
+ */
+int
+count_async_lines(const std::string& output, int nthreads, bool* ordered)
+{
+    std::vector<int> next(nthreads, 0);
+    int total = 0;
+    *ordered = true;
+
+    size_t pos = 0;
+    while ((pos = output.find("async-line ", pos)) != std::string::npos) {
+        int thread, seq;
+        if (sscanf(output.c_str() + pos, "async-line %d %d",
+                   &thread, &seq) == 2 && thread < nthreads)
+        {
+            if (seq < next[thread]) {
+                *ordered = false;
+            }
+            next[thread] = seq + 1;
+            ++total;
+        }
+        ++pos;
+    }
+
+    return total;
+}
+
+class AsyncLoggerThread : public Thread, public Logger {
+public:
+    AsyncLoggerThread(int id, int count)
+        : Thread("AsyncLoggerThread", CREATE_JOINABLE),
+          Logger("AsyncLoggerThread", "/log-test/async/%d", id),
+          id_(id), count_(count) {}
+
+    virtual void run() {
+        for (int i = 0; i < count_; ++i) {
+            log_notice("async-line %d %d", id_, i);
+        }
+    }
+
+    int id_;
+    int count_;
+};
+
+DECLARE_TEST(AsyncTest) {
+    const int nthreads = 4;
+    const int count    = 20000;
+
+    CaptureStdout capture("async");
+    Log::instance()->start_async(16 * 1024, Log::ASYNC_BLOCK, 10);
+    CHECK(Log::instance()->is_async());
+
+    std::vector<AsyncLoggerThread*> threads;
+    for (int i = 0; i < nthreads; ++i) {
+        threads.push_back(new AsyncLoggerThread(i, count));
+        threads.back()->start();
+    }
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i]->join();
+        delete threads[i];
+    }
+
+    Log::instance()->flush();
+    std::string output = capture.contents();
+    Log::instance()->stop_async();
+    CHECK(! Log::instance()->is_async());
+    capture.restore();
+
+    // nothing is dropped under ASYNC_BLOCK, and flush() means it's
+    // all been written before stop_async()
+    bool ordered;
+    CHECK_EQUAL(count_async_lines(output, nthreads, &ordered),
+                nthreads * count);
+    CHECK(ordered);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(AsyncDropTest) {
+    const int count = 2000;
+
+    CaptureStdout capture("async-drop");
+    u_int32_t dropped_before = Log::instance()->async_dropped();
+
+    // a tiny ring and a writer that never wakes up on its own
+    Log::instance()->start_async(1024, Log::ASYNC_DROP, 60 * 1000);
+    for (int i = 0; i < count; ++i) {
+        log_notice_p("/log-test/async", "async-line 0 %d", i);
+    }
+    Log::instance()->stop_async();
+    capture.restore();
+
+    u_int32_t dropped = Log::instance()->async_dropped() - dropped_before;
+    bool ordered;
+    int written = count_async_lines(capture.contents(), 1, &ordered);
+
+    log_notice_p("/test", "async drop: %d written, %u dropped",
+                 written, dropped);
+    CHECK(dropped > 0);
+    CHECK_EQUAL(written + (int)dropped, count);
+    CHECK(ordered);
+    CHECK(capture.contents().find("dropped") != std::string::npos);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(AsyncCrashTest) {
+    CaptureStdout capture("async-crash");
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // the stack trace from die() would just be noise
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 2);
+
+        // nothing gets written unless the crash hook does it
+        Log::instance()->start_async(64 * 1024, Log::ASYNC_DROP, 60 * 1000);
+        for (int i = 0; i < 10; ++i) {
+            log_notice_p("/log-test/async", "async-line 0 %d", i);
+        }
+        FatalSignals::die();
+    }
+
+    int status;
+    CHECK_EQUAL(waitpid(pid, &status, 0), pid);
+    CHECK(WIFSIGNALED(status));
+    capture.restore();
+
+    bool ordered;
+    CHECK_EQUAL(count_async_lines(capture.contents(), 1, &ordered), 10);
+    CHECK(ordered);
+
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TEST(Fini) {
     CHECK(f1->unlink() == 0);
     CHECK(f2->unlink() == 0);
@@ -601,10 +872,15 @@ DECLARE_TESTER(LogTest) {
     ADD_TEST(LoggerTest);
     ADD_TEST(FormatterTest);
     ADD_TEST(ReparseTest);
+    ADD_TEST(ReparseStressTest);
     ADD_TEST(ErrnoTest);
     ADD_TEST(FloatingPointTest);
     ADD_TEST(LogpathTest);
     ADD_TEST(MultilineTest);
+    ADD_TEST(LevelCacheTest);
+    ADD_TEST(AsyncTest);
+    ADD_TEST(AsyncDropTest);
+    ADD_TEST(AsyncCrashTest);
     ADD_TEST(Fini);
 #endif
 }
@@ -24,6 +24,8 @@
 #include <serialize/MarshalSerialize.h>
 #include <util/UnitTest.h>
 
+#include "Blob.h"
+
 using namespace std;
 using namespace oasys;
 
@@ -152,7 +154,7 @@ u_char buf[LEN];
 DECLARE_TEST(Marshal) {
     memset(buf, 0, sizeof(char) * LEN);
     Marshal v(Serialize::CONTEXT_LOCAL, buf, LEN);
-    v.logpath("/marshal-test");
+    v.SerializeAction::logpath("/marshal-test");
     CHECK(v.action(&o1) == 0);
 
     return UNIT_TEST_PASSED;
@@ -160,7 +162,7 @@ DECLARE_TEST(Marshal) {
 
 DECLARE_TEST(Unmarshal) {
     Unmarshal uv(Serialize::CONTEXT_LOCAL, buf, LEN);
-    uv.logpath("/marshal-test");
+    uv.SerializeAction::logpath("/marshal-test");
     CHECK(uv.action(&o2) == 0);
 
     return UNIT_TEST_PASSED;
@@ -204,12 +206,39 @@ DECLARE_TEST(Compare) {
 
     return UNIT_TEST_PASSED;
 }
+
+DECLARE_TEST(BorrowBuffers) {
+    Blob p("a payload that is borrowed rather than copied");
+    u_char pbuf[LEN];
+    Marshal m(Serialize::CONTEXT_LOCAL, pbuf, LEN);
+    CHECK(m.action(&p) == 0);
+
+    Blob copy(b);
+    Unmarshal u1(Serialize::CONTEXT_LOCAL, pbuf, LEN);
+    CHECK(u1.action(&copy) == 0);
+    CHECK(! copy.view_);
+    CHECK(copy.buf_ < pbuf || copy.buf_ >= pbuf + LEN);
+    CHECK_EQUAL(copy.len_, p.len_);
+    CHECK_EQUALSTRN(copy.buf_, p.buf_, p.len_);
+
+    Blob view(b);
+    Unmarshal u2(Serialize::CONTEXT_LOCAL, pbuf, LEN,
+                 Serialize::BORROW_BUFFERS);
+    CHECK(u2.action(&view) == 0);
+    CHECK(view.view_);
+    CHECK(view.buf_ >= pbuf && view.buf_ + view.len_ <= pbuf + LEN);
+    CHECK_EQUAL(view.len_, p.len_);
+    CHECK_EQUALSTRN(view.buf_, p.buf_, p.len_);
+
+    return UNIT_TEST_PASSED;
+}
     
 DECLARE_TESTER(MarshalTester) {
     ADD_TEST(Marshal);
     ADD_TEST(Unmarshal);
     ADD_TEST(MarshalSize);
     ADD_TEST(Compare);
+    ADD_TEST(BorrowBuffers);
 }
 
 DECLARE_TEST_FILE(MarshalTester, "marshal unit test");
@@ -20,6 +20,9 @@
 
 #include <string>
 #include "storage/MemoryStore.h"
+#include "thread/SpinLock.h"
+#include "thread/Thread.h"
+#include "util/Time.h"
 
 //
 // globals needed by the generic durable-store-test
@@ -50,6 +53,107 @@ DECLARE_TEST(DBTestInit) {
     return 0;
 }
 
+DECLARE_TEST(DBTestInitSharded) {
+    g_config->mem_shards_ = 16;
+    return 0;
+}
+
+/**
+ * Worker for the bench: a mix of puts and gets over its own slice of
+ * the keys. Without shards, the table needs a lock around it.
+ */
+class BenchThread : public Thread {
+public:
+    BenchThread(StringDurableTable* table, Lock* lock, int base, int count)
+        : Thread("BenchThread", CREATE_JOINABLE),
+          table_(table), lock_(lock), base_(base), count_(count), errors_(0) {}
+
+    StringDurableTable* table_;
+    Lock*               lock_;
+    int                 base_;
+    int                 count_;
+    int                 errors_;
+
+protected:
+    void run() {
+        StringShim data("some data for the bench");
+        for (int i = 0; i < count_; ++i) {
+            IntShim key(base_ + (i % 1000));
+            ScopeLockIf l(lock_, "BenchThread", lock_ != NULL);
+            // every fourth pass over the keys is puts
+            if ((i / 1000) % 4 == 0) {
+                if (table_->put(key, &data, DS_CREATE) != 0) {
+                    ++errors_;
+                }
+            } else {
+                StringShim* got = NULL;
+                int err = table_->get(key, &got);
+                if (err != 0 && err != DS_NOTFOUND) {
+                    ++errors_;
+                }
+                delete got;
+            }
+        }
+    }
+};
+
+/**
+ * Time concurrent gets and puts against one table, first with the
+ * ordered map behind a single lock and then with a sharded table.
+ */
+DECLARE_TEST(BenchConcurrent) {
+    const int nthreads = 4;
+    const int count    = 200000;
+    int shards[2] = { 0, 16 };
+    u_int32_t elapsed[2];
+
+    for (int run = 0; run < 2; ++run) {
+        g_config->tidy_       = true;
+        g_config->mem_shards_ = shards[run];
+
+        DurableStore* store = new DurableStore("/test_storage");
+        CHECK(store->create_store(*g_config) == 0);
+
+        StringDurableTable* table;
+        CHECK(store->get_table(&table, "bench", DS_CREATE | DS_EXCL) == 0);
+
+        SpinLock lock;
+        BenchThread* threads[nthreads];
+        for (int i = 0; i < nthreads; ++i) {
+            threads[i] = new BenchThread(table, shards[run] ? NULL : &lock,
+                                         i * 1000, count);
+        }
+
+        Time start = Time::now();
+        for (int i = 0; i < nthreads; ++i) {
+            threads[i]->start();
+        }
+        int errors = 0;
+        for (int i = 0; i < nthreads; ++i) {
+            threads[i]->join();
+            errors += threads[i]->errors_;
+            delete threads[i];
+        }
+        elapsed[run] = start.elapsed_ms();
+
+        CHECK_EQUAL(errors, 0);
+        CHECK_EQUAL(table->size(), (size_t)(nthreads * 1000));
+
+        delete_z(table);
+        DEL_DS_STORE(store);
+    }
+
+    log_notice_p("/test", "%d threads x %d ops: "
+                 "locked map %u ms (%.0f ops/s), %d shards %u ms (%.0f ops/s)",
+                 nthreads, count,
+                 elapsed[0], elapsed[0] ? nthreads * count * 1000.0 / elapsed[0] : 0.0,
+                 shards[1],
+                 elapsed[1], elapsed[1] ? nthreads * count * 1000.0 / elapsed[1] : 0.0);
+
+    g_config->mem_shards_ = 0;
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TESTER(MemoryStoreTester) {
     ADD_TEST(DBTestInit);
 
@@ -60,14 +164,43 @@ DECLARE_TESTER(MemoryStoreTester) {
 
     ADD_TEST(SingleTypePut);
     ADD_TEST(SingleTypeGet);
+    ADD_TEST(GetView);
     ADD_TEST(SingleTypeDelete);
     ADD_TEST(SingleTypeMultiObject);
     ADD_TEST(SingleTypeIterator);
+    ADD_TEST(SingleTypeBulkIterator);
     ADD_TEST(SingleTypeCache);
 
     ADD_TEST(NonTypedTable);
     ADD_TEST(MultiType);
+    ADD_TEST(MultiTypeBulkIterator);
+    ADD_TEST(LoadTables);
     ADD_TEST(MultiTypeCache);
+
+    // the same again with sharded tables
+    ADD_TEST(DBTestInitSharded);
+    
+    ADD_TEST(TableCreate);
+    ADD_TEST(TableDelete);
+    ADD_TEST(TableGetNames);
+
+    ADD_TEST(SingleTypePut);
+    ADD_TEST(SingleTypeGet);
+    ADD_TEST(GetView);
+    ADD_TEST(SingleTypeDelete);
+    ADD_TEST(SingleTypeMultiObject);
+    ADD_TEST(SingleTypeIterator);
+    ADD_TEST(SingleTypeBulkIterator);
+    ADD_TEST(SingleTypeCache);
+
+    ADD_TEST(NonTypedTable);
+    ADD_TEST(MultiType);
+    ADD_TEST(MultiTypeBulkIterator);
+    ADD_TEST(LoadTables);
+    ADD_TEST(MultiTypeCache);
+
+    ADD_TEST(BenchConcurrent);
+    ADD_TEST(BenchLoadTables);
 }
 
 DECLARE_TEST_FILE(MemoryStoreTester, "memory store test");
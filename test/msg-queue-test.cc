@@ -21,6 +21,8 @@
 #include <limits.h>
 #include "thread/Thread.h"
 #include "thread/MsgQueue.h"
+#include "thread/LockFreeMsgQueue.h"
+#include "util/Time.h"
 #include "util/UnitTest.h"
 
 using namespace std;
@@ -185,12 +187,267 @@ DECLARE_TEST(NotifyWhenEmpty) {
     return UNIT_TEST_PASSED;
 }
 
+/**
+ * Producer used for the throughput benchmarks. Each message encodes
+ * the producer id in the top byte so the consumer can check
+ * per-producer ordering.
+ */
+template<typename _queue_t>
+class BenchProducer : public Thread {
+public:
+    BenchProducer(_queue_t* q, int id, int count)
+        : Thread("BenchProducer", CREATE_JOINABLE),
+          q_(q), id_(id), count_(count) {}
+
+protected:
+    virtual void run() {
+        for (int i = 0; i < count_; ++i) {
+            q_->push((id_ << 24) | i);
+        }
+    }
+
+    _queue_t* q_;
+    int id_;
+    int count_;
+};
+
+template<typename _queue_t>
+int
+bench(const char* what, int nproducers, int total)
+{
+    _queue_t q("/test/queue");
+    std::vector<Thread*> producers;
+    std::vector<int> next(nproducers, 0);
+    int count = total / nproducers;
+    int errno_; const char* strerror_;
+
+    Time start = Time::now();
+
+    for (int i = 0; i < nproducers; ++i) {
+        producers.push_back(new BenchProducer<_queue_t>(&q, i, count));
+        producers.back()->start();
+    }
+
+    int errors = 0;
+    for (int i = 0; i < count * nproducers; ++i) {
+        int elt = q.pop_blocking();
+        int id  = elt >> 24;
+        if ((elt & 0xffffff) != next[id]++) {
+            ++errors;
+        }
+    }
+
+    for (int i = 0; i < nproducers; ++i) {
+        producers[i]->join();
+        delete producers[i];
+    }
+
+    u_int32_t ms = (Time::now() - start).in_milliseconds();
+    log_notice_p("/test", "%s: %d producer(s), %d msgs in %u ms (%.0f msgs/sec)",
+                 what, nproducers, count * nproducers, ms,
+                 ms == 0 ? 0.0 : (count * nproducers * 1000.0) / ms);
+
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(q.size(), 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(LockFreePoll) {
+    LockFreeMsgQueue<int> q("/test/queue", 4);
+    int elt;
+
+    CHECK_EQUAL(q.capacity(), 4);
+    CHECK(! q.wait(0));
+    CHECK(! q.try_pop(&elt));
+
+    CHECK(q.try_push(1));
+    CHECK(q.try_push(2));
+    CHECK(q.try_push(3));
+    CHECK(q.try_push(4));
+    CHECK(! q.try_push(5));
+    CHECK(q.wait(0));
+
+    CHECK(q.try_pop(&elt));
+    CHECK_EQUAL(elt, 1);
+    CHECK(q.wait(0));
+    CHECK_EQUAL(q.pop_blocking(), 2);
+    CHECK_EQUAL(q.pop_blocking(), 3);
+    CHECK(q.try_pop(&elt));
+    CHECK_EQUAL(elt, 4);
+
+    // drained, so the fd must no longer be readable
+    CHECK(! q.wait(0));
+    CHECK(! q.try_pop(&elt));
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(LockFreePushPop10000) {
+    return bench<LockFreeMsgQueue<int> >("lockfree", 1, 10000);
+}
+
+DECLARE_TEST(BenchMsgQueue) {
+    CHECK(bench<MsgQueue<int> >("msgqueue", 1,  160000) == UNIT_TEST_PASSED);
+    CHECK(bench<MsgQueue<int> >("msgqueue", 4,  160000) == UNIT_TEST_PASSED);
+    CHECK(bench<MsgQueue<int> >("msgqueue", 16, 160000) == UNIT_TEST_PASSED);
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(BenchLockFree) {
+    CHECK(bench<LockFreeMsgQueue<int> >("lockfree", 1,  160000) == UNIT_TEST_PASSED);
+    CHECK(bench<LockFreeMsgQueue<int> >("lockfree", 4,  160000) == UNIT_TEST_PASSED);
+    CHECK(bench<LockFreeMsgQueue<int> >("lockfree", 16, 160000) == UNIT_TEST_PASSED);
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(BatchPushPop) {
+    MsgQueue<int> q("/test/queue");
+    std::vector<int> in, out;
+    for (int i = 0; i < 1000; ++i) {
+        in.push_back(i);
+    }
+
+    q.push_batch(in.begin(), in.end());
+    CHECK_EQUAL(q.size(), 1000);
+
+    CHECK_EQUAL(q.drain_into(&out, 10), 10);
+    CHECK_EQUAL(q.pop_blocking(), 10);
+    CHECK_EQUAL(q.pop_all(&out), 989);
+    CHECK_EQUAL(q.size(), 0);
+    CHECK_EQUAL(q.drain_into(&out), 0);
+
+    CHECK_EQUAL(out.size(), 999);
+    for (int i = 0; i < 10; ++i) {
+        CHECK_EQUAL(out[i], i);
+    }
+    for (int i = 10; i < 999; ++i) {
+        CHECK_EQUAL(out[i], i + 1);
+    }
+
+    // the pipe must be fully drained
+    CHECK(! q.wait(NULL, 0));
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(BatchNotifyWhenEmpty) {
+    MsgQueue<int> q("/test/queue");
+    q.notify_when_empty();
+
+    std::vector<int> in, out;
+    for (int i = 0; i < 100; ++i) {
+        in.push_back(i);
+    }
+
+    q.push_batch(in.begin(), in.end());
+    q.push_batch(in.begin(), in.end());
+    CHECK_EQUAL(q.pop_all(&out, 150), 150);
+    CHECK_EQUAL(q.drain_into(&out), 50);
+    CHECK_EQUAL(out.size(), 200);
+    CHECK_EQUAL(out[199], 99);
+    CHECK(! q.wait(NULL, 0, false));
+
+    // pop_all has to wait for the one notification, then put it
+    // back since it leaves messages behind
+    q.push_batch(in.begin(), in.end());
+    out.clear();
+    CHECK_EQUAL(q.pop_all(&out, 10), 10);
+    CHECK(q.wait(NULL, 0, false));
+    CHECK_EQUAL(q.drain_into(&out), 90);
+    CHECK(! q.wait(NULL, 0, false));
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Producer that pushes its messages in batches of batch_ elements,
+ * or one at a time if batch_ is 1.
+ */
+class BatchProducer : public Thread {
+public:
+    BatchProducer(MsgQueue<int>* q, int count, int batch)
+        : Thread("BatchProducer", CREATE_JOINABLE),
+          q_(q), count_(count), batch_(batch) {}
+
+protected:
+    virtual void run() {
+        std::vector<int> v;
+        for (int i = 0; i < count_; ++i) {
+            if (batch_ == 1) {
+                q_->push_back(i);
+                continue;
+            }
+
+            v.push_back(i);
+            if ((int)v.size() == batch_ || i == count_ - 1) {
+                q_->push_batch(v.begin(), v.end());
+                v.clear();
+            }
+        }
+    }
+
+    MsgQueue<int>* q_;
+    int count_;
+    int batch_;
+};
+
+int
+batch_bench(int count, int batch)
+{
+    MsgQueue<int> q("/test/queue");
+    BatchProducer p(&q, count, batch);
+    std::vector<int> out;
+    out.reserve(count);
+    int errno_; const char* strerror_;
+
+    Time start = Time::now();
+    p.start();
+    while ((int)out.size() < count) {
+        if (batch == 1) {
+            out.push_back(q.pop_blocking());
+        } else {
+            q.pop_all(&out);
+        }
+    }
+    p.join();
+    u_int32_t ms = (Time::now() - start).in_milliseconds();
+
+    log_notice_p("/test", "batch size %d: %d msgs in %u ms (%.0f msgs/sec)",
+                 batch, count, ms, ms == 0 ? 0.0 : (count * 1000.0) / ms);
+
+    int errors = 0;
+    for (int i = 0; i < count; ++i) {
+        if (out[i] != i) {
+            ++errors;
+        }
+    }
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(q.size(), 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(BenchBatch) {
+    CHECK(batch_bench(500000, 1)   == UNIT_TEST_PASSED);
+    CHECK(batch_bench(500000, 16)  == UNIT_TEST_PASSED);
+    CHECK(batch_bench(500000, 256) == UNIT_TEST_PASSED);
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TESTER(MsgQueueTester) {
     ADD_TEST(Init);
     ADD_TEST(PushPop1);
     ADD_TEST(PushPop10000);
     ADD_TEST(FullPipe);
     ADD_TEST(NotifyWhenEmpty);
+    ADD_TEST(LockFreePoll);
+    ADD_TEST(LockFreePushPop10000);
+    ADD_TEST(BenchMsgQueue);
+    ADD_TEST(BenchLockFree);
+    ADD_TEST(BatchPushPop);
+    ADD_TEST(BatchNotifyWhenEmpty);
+    ADD_TEST(BenchBatch);
     ADD_TEST(Fini);
 }
 
@@ -0,0 +1,424 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <unistd.h>
+#include <vector>
+#include <sys/socket.h>
+
+#include "io/IO.h"
+#include "io/Reactor.h"
+#include "thread/Notifier.h"
+#include "thread/Thread.h"
+#include "thread/Timer.h"
+#include "util/Random.h"
+#include "util/Time.h"
+#include "util/UnitTest.h"
+
+using namespace oasys;
+
+/**
+ * Handler that counts events and optionally drains the descriptor.
+ */
+class CountingHandler : public Reactor::Handler {
+public:
+    CountingHandler(bool drain = true)
+        : drain_(drain), count_(0), last_fd_(-1), last_revents_(0) {}
+
+    void handle_event(int fd, short revents) {
+        ++count_;
+        last_fd_      = fd;
+        last_revents_ = revents;
+        if (drain_) {
+            char buf[64];
+            while (::read(fd, buf, sizeof(buf)) > 0) {}
+        }
+    }
+
+    bool  drain_;
+    int   count_;
+    int   last_fd_;
+    short last_revents_;
+};
+
+/**
+ * Handler that removes another descriptor from the reactor.
+ */
+class RemovingHandler : public Reactor::Handler {
+public:
+    RemovingHandler(Reactor* r, int victim)
+        : reactor_(r), victim_(victim), count_(0) {}
+
+    void handle_event(int fd, short revents) {
+        (void)fd;
+        (void)revents;
+        ++count_;
+        reactor_->remove(victim_);
+    }
+
+    Reactor* reactor_;
+    int victim_;
+    int count_;
+};
+
+/**
+ * Handler that closes another descriptor and puts the read end of an
+ * empty pipe in its place, registered with a new handler.
+ */
+class ReplacingHandler : public Reactor::Handler {
+public:
+    ReplacingHandler(Reactor* r, int victim, Reactor::Handler* next)
+        : reactor_(r), victim_(victim), next_(next), write_fd_(-1),
+          count_(0) {}
+
+    void handle_event(int fd, short revents) {
+        (void)fd;
+        (void)revents;
+        ++count_;
+        reactor_->remove(victim_);
+
+        int fds[2];
+        if (pipe(fds) != 0 || dup2(fds[0], victim_) != victim_) {
+            return;
+        }
+        close(fds[0]);
+        write_fd_ = fds[1];
+        reactor_->add(victim_, POLLIN, next_);
+    }
+
+    Reactor*          reactor_;
+    int               victim_;
+    Reactor::Handler* next_;
+    int               write_fd_;
+    int               count_;
+};
+
+/**
+ * Handler for a Notifier that drains one notification per event.
+ */
+class NotifierHandler : public Reactor::Handler {
+public:
+    NotifierHandler(Notifier* n) : notifier_(n), count_(0) {}
+
+    void handle_event(int fd, short revents) {
+        (void)fd;
+        (void)revents;
+        notifier_->drain_pipe(1);
+        ++count_;
+    }
+
+    Notifier* notifier_;
+    int count_;
+};
+
+class OneShotTimer : public Timer {
+public:
+    OneShotTimer() : Timer(NO_DELETE), fired_(false) {}
+    void timeout(const struct timeval& now) {
+        (void)now;
+        fired_ = true;
+    }
+    bool fired_;
+};
+
+/**
+ * Thread that stops a reactor after a short delay.
+ */
+class StopThread : public Thread {
+public:
+    StopThread(Reactor* r)
+        : Thread("StopThread", CREATE_JOINABLE), reactor_(r) {}
+
+protected:
+    void run() {
+        usleep(100000);
+        reactor_->stop();
+    }
+
+    Reactor* reactor_;
+};
+
+DECLARE_TEST(LevelTriggered) {
+    Reactor r("/test/reactor");
+    CountingHandler h(false);
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    CHECK(IO::set_nonblocking(fds[0], true) == 0);
+
+    CHECK_EQUAL(r.add(fds[0], POLLIN, &h), 0);
+    CHECK_EQUAL(r.size(), 1);
+    CHECK(r.is_registered(fds[0]));
+    CHECK(r.add(fds[0], POLLIN, &h) != 0);
+    CHECK_EQUAL(r.run_once(10), IOTIMEOUT);
+
+    CHECK_EQUAL(::write(fds[1], "x", 1), 1);
+    CHECK_EQUAL(r.run_once(100), 1);
+    CHECK_EQUAL(h.count_, 1);
+    CHECK_EQUAL(h.last_fd_, fds[0]);
+    CHECK(h.last_revents_ & POLLIN);
+
+    // still readable, so it fires again
+    CHECK_EQUAL(r.run_once(100), 1);
+    CHECK_EQUAL(h.count_, 2);
+
+    CHECK_EQUAL(r.remove(fds[0]), 0);
+    CHECK_EQUAL(r.size(), 0);
+    CHECK(r.remove(fds[0]) != 0);
+    CHECK_EQUAL(r.run_once(10), IOTIMEOUT);
+    CHECK_EQUAL(h.count_, 2);
+
+    close(fds[0]);
+    close(fds[1]);
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(EdgeTriggered) {
+    Reactor r("/test/reactor");
+    CountingHandler h(false);
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+
+    CHECK_EQUAL(r.add(fds[0], POLLIN, &h, Reactor::EDGE_TRIGGERED), 0);
+    CHECK_EQUAL(::write(fds[1], "x", 1), 1);
+    CHECK_EQUAL(r.run_once(100), 1);
+
+#ifdef OASYS_REACTOR_EPOLL
+    // nothing new arrived, so no event even though data is pending
+    CHECK_EQUAL(r.run_once(10), IOTIMEOUT);
+    CHECK_EQUAL(h.count_, 1);
+#else
+    CHECK_EQUAL(r.run_once(10), 1);
+    CHECK_EQUAL(h.count_, 2);
+#endif
+
+    int before = h.count_;
+    CHECK_EQUAL(::write(fds[1], "y", 1), 1);
+    CHECK_EQUAL(r.run_once(100), 1);
+    CHECK_EQUAL(h.count_, before + 1);
+
+    close(fds[0]);
+    close(fds[1]);
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(ModifyWritable) {
+    Reactor r("/test/reactor");
+    CountingHandler h(false);
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+
+    CHECK_EQUAL(r.add(fds[1], 0, &h), 0);
+    CHECK_EQUAL(r.run_once(10), IOTIMEOUT);
+    CHECK_EQUAL(r.modify(fds[1], POLLOUT), 0);
+    CHECK_EQUAL(r.run_once(100), 1);
+    CHECK(h.last_revents_ & POLLOUT);
+
+    close(fds[0]);
+    close(fds[1]);
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(RemoveInHandler) {
+    Reactor r("/test/reactor");
+    int p1[2], p2[2];
+    CHECK(pipe(p1) == 0);
+    CHECK(pipe(p2) == 0);
+
+    // whichever handler runs first removes the other descriptor, so
+    // only one of them runs in this pass
+    RemovingHandler ha(&r, p2[0]);
+    RemovingHandler hb(&r, p1[0]);
+    CHECK_EQUAL(r.add(p1[0], POLLIN, &ha), 0);
+    CHECK_EQUAL(r.add(p2[0], POLLIN, &hb), 0);
+    CHECK_EQUAL(::write(p1[1], "x", 1), 1);
+    CHECK_EQUAL(::write(p2[1], "x", 1), 1);
+    usleep(10000);
+
+    CHECK_EQUAL(r.run_once(100), 1);
+    CHECK_EQUAL(ha.count_ + hb.count_, 1);
+    CHECK_EQUAL(r.size(), 1);
+
+    close(p1[0]); close(p1[1]);
+    close(p2[0]); close(p2[1]);
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(ReuseInHandler) {
+    Reactor r("/test/reactor");
+    int p1[2], p2[2];
+    CHECK(pipe(p1) == 0);
+    CHECK(pipe(p2) == 0);
+
+    // whichever handler runs first replaces the other descriptor with
+    // an empty pipe under the same number, which mustn't get the
+    // event still pending for the old one
+    CountingHandler c(false);
+    ReplacingHandler ha(&r, p2[0], &c);
+    ReplacingHandler hb(&r, p1[0], &c);
+    CHECK_EQUAL(r.add(p1[0], POLLIN, &ha), 0);
+    CHECK_EQUAL(r.add(p2[0], POLLIN, &hb), 0);
+    CHECK_EQUAL(::write(p1[1], "x", 1), 1);
+    CHECK_EQUAL(::write(p2[1], "x", 1), 1);
+    usleep(10000);
+
+    CHECK_EQUAL(r.run_once(100), 1);
+    CHECK_EQUAL(ha.count_ + hb.count_, 1);
+    CHECK_EQUAL(c.count_, 0);
+    CHECK_EQUAL(r.size(), 2);
+
+    // the new registration gets its own events
+    int write_fd = (ha.count_ != 0) ? ha.write_fd_ : hb.write_fd_;
+    CHECK(write_fd >= 0);
+    CHECK_EQUAL(::write(write_fd, "x", 1), 1);
+    r.remove((ha.count_ != 0) ? p1[0] : p2[0]);
+    CHECK_EQUAL(r.run_once(100), 1);
+    CHECK_EQUAL(c.count_, 1);
+
+    close(write_fd);
+    close(p1[0]); close(p1[1]);
+    close(p2[0]); close(p2[1]);
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(NotifierEvents) {
+    Reactor r("/test/reactor");
+    Notifier n("/test/notifier");
+    NotifierHandler h(&n);
+
+    CHECK_EQUAL(r.add(&n, &h), 0);
+    n.notify();
+    n.notify();
+    CHECK_EQUAL(r.run_once(100), 1);
+    CHECK_EQUAL(r.run_once(100), 1);
+    CHECK_EQUAL(r.run_once(10), IOTIMEOUT);
+    CHECK_EQUAL(h.count_, 2);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(Timers) {
+    TimerSystem* timers = new TimerSystem(TimerSystem::WHEEL_BACKEND);
+    Reactor r("/test/reactor", timers);
+    OneShotTimer t;
+    CHECK_EQUAL(r.size(), 0);
+
+    Time start = Time::now();
+    timers->schedule_in(100, &t);
+    while (! t.fired_) {
+        CHECK(r.run_once() != IOERROR);
+        CHECK(start.elapsed_ms() < 1000);
+    }
+    u_int32_t elapsed = start.elapsed_ms();
+    log_notice_p("/test", "timer fired after %u ms", elapsed);
+    CHECK(elapsed >= 99);
+
+    // nothing pending, so the wait is only bounded by the caller
+    CHECK_EQUAL(r.run_once(10), IOTIMEOUT);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(Stop) {
+    Reactor r("/test/reactor");
+    StopThread t(&r);
+    Time start = Time::now();
+    t.start();
+    r.run();
+    t.join();
+    CHECK(start.elapsed_ms() >= 99);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Wake one random descriptor out of npairs at a time, and time how
+ * long it takes to find and handle it with the reactor and with
+ * IO::poll_multiple().
+ */
+DECLARE_TEST(BenchWakeups) {
+    int npairs = 400;
+    int rounds = 20000;
+    std::vector<int> rfds, wfds;
+    Reactor r("/test/reactor");
+    CountingHandler h;
+
+    std::vector<struct pollfd> pollfds(npairs);
+    for (int i = 0; i < npairs; ++i) {
+        int sv[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        CHECK(IO::set_nonblocking(sv[0], true) == 0);
+        rfds.push_back(sv[0]);
+        wfds.push_back(sv[1]);
+        CHECK_EQUAL(r.add(sv[0], POLLIN, &h), 0);
+        pollfds[i].fd     = sv[0];
+        pollfds[i].events = POLLIN;
+    }
+
+    Time start = Time::now();
+    for (int i = 0; i < rounds; ++i) {
+        CHECK_EQUAL(::write(wfds[Random::rand(npairs)], "x", 1), 1);
+        CHECK_EQUAL(r.run_once(1000), 1);
+    }
+    u_int32_t reactor_ms = start.elapsed_ms();
+    CHECK_EQUAL(h.count_, rounds);
+
+    start = Time::now();
+    char buf[64];
+    for (int i = 0; i < rounds; ++i) {
+        CHECK_EQUAL(::write(wfds[Random::rand(npairs)], "x", 1), 1);
+        for (int j = 0; j < npairs; ++j) {
+            pollfds[j].revents = 0;
+        }
+        CHECK_EQUAL(IO::poll_multiple(&pollfds[0], npairs, 1000), 1);
+        for (int j = 0; j < npairs; ++j) {
+            if (pollfds[j].revents & POLLIN) {
+                while (::read(pollfds[j].fd, buf, sizeof(buf)) > 0) {}
+            }
+        }
+    }
+    u_int32_t poll_ms = start.elapsed_ms();
+
+    log_notice_p("/test", "%d wakeups over %d sockets: reactor %u ms "
+                 "(%.0f/sec), poll_multiple %u ms (%.0f/sec)",
+                 rounds, npairs,
+                 reactor_ms, reactor_ms ? rounds * 1000.0 / reactor_ms : 0.0,
+                 poll_ms,    poll_ms    ? rounds * 1000.0 / poll_ms    : 0.0);
+
+    for (int i = 0; i < npairs; ++i) {
+        CHECK_EQUAL(r.remove(rfds[i]), 0);
+        close(rfds[i]);
+        close(wfds[i]);
+    }
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(ReactorTest) {
+    ADD_TEST(LevelTriggered);
+    ADD_TEST(EdgeTriggered);
+    ADD_TEST(ModifyWritable);
+    ADD_TEST(RemoveInHandler);
+    ADD_TEST(ReuseInHandler);
+    ADD_TEST(NotifierEvents);
+    ADD_TEST(Timers);
+    ADD_TEST(Stop);
+    ADD_TEST(BenchWakeups);
+}
+
+DECLARE_TEST_FILE(ReactorTest, "reactor test");
@@ -19,11 +19,16 @@
 #endif
 
 #include <cstdio>
+#include <vector>
 #include <sys/time.h>
 
 #include "debug/Log.h"
+#include <thread/AdaptiveLock.h>
+#include <thread/Mutex.h>
 #include <thread/SpinLock.h>
 #include <thread/Thread.h>
+#include <util/StringBuffer.h>
+#include <util/Time.h>
 #include <util/UnitTest.h>
 
 #ifndef __NO_ATOMIC__
@@ -32,6 +37,8 @@ using namespace oasys;
 
 SpinLock slock;
 SpinLock lock2;
+AdaptiveLock alock;
+AdaptiveLock alock2;
 volatile int nspins = 0;
 volatile int total  = 0;
 volatile int count1 = 0;
@@ -39,7 +46,7 @@ volatile int count2 = 0;
 
 class Thread1 : public Thread {
 public:
-    Thread1(SpinLock* l) : Thread("Thread1", CREATE_JOINABLE), lock_(l) {}
+    Thread1(Lock* l) : Thread("Thread1", CREATE_JOINABLE), lock_(l) {}
     
 protected:
     virtual void run() {
@@ -53,12 +60,12 @@ protected:
         }
     }
 
-    SpinLock* lock_;
+    Lock* lock_;
 };
 
 class Thread2 : public Thread {
 public:
-    Thread2(SpinLock* l) : Thread("Thread2", CREATE_JOINABLE), lock_(l) {}
+    Thread2(Lock* l) : Thread("Thread2", CREATE_JOINABLE), lock_(l) {}
     
 protected:
     virtual void run() {
@@ -73,11 +80,11 @@ protected:
         }
     }
 
-    SpinLock* lock_;
+    Lock* lock_;
 };
 
 int
-test(const char* what, SpinLock* lock1, SpinLock* lock2, int n)
+test(const char* what, Lock* lock1, Lock* lock2, int n)
 {
     (void)what;
     
@@ -138,11 +145,280 @@ DECLARE_TEST(NoLock) {
     return test("shared", NULL, NULL, 10000000);
 }
 
+DECLARE_TEST(AdaptiveSharedLock) {
+    return test("adaptive shared", &alock, &alock, 10000000);
+}
+
+DECLARE_TEST(AdaptiveSeparateLock) {
+    return test("adaptive separate", &alock, &alock2, 10000000);
+}
+
+int
+check_try_lock(Lock* l)
+{
+    int errno_; const char* strerror_;
+
+    CHECK(l->try_lock("check_try_lock") == 0);
+    CHECK(l->is_locked_by_me());
+
+    // recursive
+    CHECK(l->try_lock("check_try_lock") == 0);
+    l->lock("check_try_lock");
+    l->unlock();
+    l->unlock();
+    CHECK(l->is_locked_by_me());
+    l->unlock();
+    CHECK(! l->is_locked());
+
+    return UNIT_TEST_PASSED;
+}
+
+class TryLockThread : public Thread {
+public:
+    TryLockThread(Lock* l)
+        : Thread("TryLockThread", CREATE_JOINABLE), ret_(-1), lock_(l) {}
+    int ret_;
+
+protected:
+    virtual void run() {
+        ret_ = lock_->try_lock("TryLockThread");
+        if (ret_ == 0) {
+            lock_->unlock();
+        }
+    }
+
+    Lock* lock_;
+};
+
+int
+check_try_lock_busy(Lock* l)
+{
+    int errno_; const char* strerror_;
+
+    l->lock("check_try_lock_busy");
+    TryLockThread t(l);
+    t.start();
+    t.join();
+    CHECK_EQUAL(t.ret_, 1);
+    l->unlock();
+
+    TryLockThread t2(l);
+    t2.start();
+    t2.join();
+    CHECK_EQUAL(t2.ret_, 0);
+    CHECK(! l->is_locked());
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(TryLock) {
+    SpinLock s;
+    AdaptiveLock a;
+
+    CHECK(check_try_lock(&s) == UNIT_TEST_PASSED);
+    CHECK(check_try_lock(&a) == UNIT_TEST_PASSED);
+    CHECK(check_try_lock_busy(&s) == UNIT_TEST_PASSED);
+    CHECK(check_try_lock_busy(&a) == UNIT_TEST_PASSED);
+
+    return UNIT_TEST_PASSED;
+}
+
+/*
+ * Contention benchmark: more threads than cpus all beating on one
+ * lock, each holding it for a short critical section. The counter
+ * is deliberately not atomic, so a lost update means the lock let
+ * two threads in at once.
+ */
+int g_bench_threads = 8;
+int g_bench_iters   = 200000;
+volatile int bench_counter = 0;
+
+class ContentionThread : public Thread {
+public:
+    ContentionThread(Lock* l)
+        : Thread("ContentionThread", CREATE_JOINABLE), lock_(l) {}
+
+protected:
+    virtual void run() {
+        for (int i = 0; i < g_bench_iters; ++i) {
+            ScopeLock l(lock_, "ContentionThread");
+            for (int j = 0; j < 10; ++j) {
+                ++bench_counter;
+            }
+        }
+    }
+
+    Lock* lock_;
+};
+
+int
+bench_contention(const char* what, Lock* lock, u_int32_t* elapsed)
+{
+    int errors = 0;
+    std::vector<Thread*> threads;
+    bench_counter = 0;
+
+    Time start = Time::now();
+    for (int i = 0; i < g_bench_threads; ++i) {
+        threads.push_back(new ContentionThread(lock));
+        threads.back()->start();
+    }
+
+    for (int i = 0; i < g_bench_threads; ++i) {
+        threads[i]->join();
+        delete threads[i];
+    }
+    *elapsed = start.elapsed_ms();
+
+    if (bench_counter != g_bench_threads * g_bench_iters * 10) {
+        ++errors;
+    }
+
+    log_notice_p("/test", "%-12s %d threads x %d iterations: %u ms, "
+                 "counter %d, %d errors",
+                 what, g_bench_threads, g_bench_iters, *elapsed,
+                 bench_counter, errors);
+    return errors;
+}
+
+DECLARE_TEST(BenchContention) {
+    SpinLock     s;
+    Mutex        m("/test/mutex", Mutex::TYPE_RECURSIVE, true);
+    AdaptiveLock a;
+    u_int32_t    elapsed[3];
+    int          errors = 0;
+
+    bool warn = SpinLock::warn_on_contention_;
+    SpinLock::warn_on_contention_ = false;
+
+    errors += bench_contention("SpinLock",     &s, &elapsed[0]);
+    errors += bench_contention("Mutex",        &m, &elapsed[1]);
+    errors += bench_contention("AdaptiveLock", &a, &elapsed[2]);
+
+    SpinLock::warn_on_contention_ = warn;
+
+#ifndef NDEBUG
+    log_notice_p("/test", "adaptive lock total spins: %u, sleeps: %u",
+                 AdaptiveLock::total_spins_.value,
+                 AdaptiveLock::total_sleeps_.value);
+#endif
+
+    CHECK_EQUAL(errors, 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+int
+check_lock_stats(Lock* l, const char* name)
+{
+    int errno_; const char* strerror_;
+
+    l->enable_stats(name);
+    LockStats* stats = l->stats();
+    CHECK(stats != NULL);
+    CHECK_EQUALSTR(stats->name(), name);
+
+    // uncontended and recursive holds count once each
+    l->lock("check_lock_stats");
+    l->lock("check_lock_stats");
+    l->unlock();
+    l->unlock();
+    CHECK(l->try_lock("check_lock_stats try") == 0);
+    l->unlock();
+    CHECK_EQUAL_U64(stats->acquisitions(), 2);
+    CHECK_EQUAL_U64(stats->contended(), 0);
+
+    // a thread that has to wait while we hold it for a while
+    l->lock("check_lock_stats long");
+    ContentionThread t(l);
+    int iters = g_bench_iters;
+    g_bench_iters = 1;
+    t.start();
+    usleep(100000);
+    l->unlock();
+    t.join();
+    g_bench_iters = iters;
+
+    CHECK_EQUAL_U64(stats->acquisitions(), 4);
+    CHECK_EQUAL_U64(stats->contended(), 1);
+    CHECK(stats->max_hold_ns() >= 100000000ULL);
+    CHECK(stats->max_wait_ns() >= 50000000ULL);
+    CHECK_EQUALSTR(stats->max_hold_user(), "check_lock_stats long");
+
+    u_int64_t total = 0;
+    for (int i = 0; i < LockStats::NBUCKETS; ++i) {
+        total += stats->hold_hist(i);
+    }
+    CHECK_EQUAL_U64(total, 4);
+
+    StringBuffer buf;
+    LockStats::dump_all(&buf, name);
+    log_notice_p("/test", "%s", buf.c_str());
+    CHECK(strstr(buf.c_str(), "acquisitions 4 contended 1") != NULL);
+
+    LockStats::reset_all(name);
+    CHECK_EQUAL_U64(stats->acquisitions(), 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(LockStats) {
+    CHECK_EQUAL(LockStats::bucket(0), 0);
+    CHECK_EQUAL(LockStats::bucket(1), 0);
+    CHECK_EQUAL(LockStats::bucket(2), 1);
+    CHECK_EQUAL(LockStats::bucket(1023), 9);
+    CHECK_EQUAL(LockStats::bucket(1024), 10);
+    CHECK_EQUAL(LockStats::bucket(~0ULL), LockStats::NBUCKETS - 1);
+
+    SpinLock     s;
+    Mutex        m("/test/mutex", Mutex::TYPE_RECURSIVE, true);
+    AdaptiveLock a;
+
+    CHECK(check_lock_stats(&s, "/test/stats/spin") == UNIT_TEST_PASSED);
+    CHECK(check_lock_stats(&m, "/test/stats/mutex") == UNIT_TEST_PASSED);
+    CHECK(check_lock_stats(&a, "/test/stats/adaptive") == UNIT_TEST_PASSED);
+
+    StringBuffer buf;
+    LockStats::dump_all(&buf, "/test/stats/*");
+    CHECK(strstr(buf.c_str(), "/test/stats/spin:") != NULL);
+    CHECK(strstr(buf.c_str(), "/test/stats/mutex:") != NULL);
+    CHECK(strstr(buf.c_str(), "/test/stats/adaptive:") != NULL);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(BenchLockStats) {
+    AdaptiveLock plain, counted;
+    u_int32_t    elapsed[2];
+    int          errors = 0;
+
+    counted.enable_stats("/test/stats/bench");
+
+    errors += bench_contention("no stats", &plain,   &elapsed[0]);
+    errors += bench_contention("stats",    &counted, &elapsed[1]);
+
+    StringBuffer buf;
+    LockStats::dump_all(&buf, "/test/stats/bench");
+    log_notice_p("/test", "%s", buf.c_str());
+
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL_U64(counted.stats()->acquisitions(),
+                    (u_int64_t)g_bench_threads * g_bench_iters);
+
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TESTER(SpinLockTester) {
     ADD_TEST(SharedLockQuick);
+    ADD_TEST(TryLock);
     ADD_TEST(SharedLock);
     ADD_TEST(SeparateLock);
     ADD_TEST(NoLock);
+    ADD_TEST(AdaptiveSharedLock);
+    ADD_TEST(AdaptiveSeparateLock);
+    ADD_TEST(BenchContention);
+    ADD_TEST(LockStats);
+    ADD_TEST(BenchLockStats);
 }
 
 #else // __NO_ATOMIC__
@@ -0,0 +1,291 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <map>
+#include <vector>
+
+#include "debug/Log.h"
+#include "thread/Mutex.h"
+#include "thread/SXLock.h"
+#include "thread/Thread.h"
+#include "util/Time.h"
+#include "util/UnitTest.h"
+
+using namespace oasys;
+
+DECLARE_TEST(Basic) {
+    SXLock l;
+
+    {
+        ScopeLock_Shared s1(&l, "Basic");
+    }
+    {
+        ScopeLock_Shared s1(&l, "Basic");
+    }
+
+    {
+        ScopeLock_Exclusive x1(&l, "Basic");
+        CHECK(l.is_exclusive_locked_by_me());
+
+        // the writer can recurse, and read what it holds
+        ScopeLock_Exclusive x2(&l, "Basic");
+        ScopeLock_Shared s(&l, "Basic");
+    }
+    CHECK(! l.is_exclusive_locked_by_me());
+
+    return UNIT_TEST_PASSED;
+}
+
+/*
+ * Writers keep two values equal, readers check that they never see
+ * them differ. A non-atomic update is seen if the lock lets a reader
+ * in with a writer.
+ */
+struct Pair {
+    Pair() : a_(0), b_(0) {}
+    volatile int a_;
+    volatile int b_;
+};
+
+class PairThread : public Thread {
+public:
+    PairThread(SXLock* l, Pair* p, bool writer, int count)
+        : Thread("PairThread", CREATE_JOINABLE),
+          errors_(0), l_(l), p_(p), writer_(writer), count_(count) {}
+
+    int errors_;
+
+protected:
+    virtual void run() {
+        for (int i = 0; i < count_; ++i) {
+            if (writer_) {
+                ScopeLock_Exclusive x(l_, "PairThread");
+                ++p_->a_;
+                if ((i % 16) == 0) {
+                    yield();
+                }
+                ++p_->b_;
+            } else {
+                ScopeLock_Shared s(l_, "PairThread");
+                int a = p_->a_;
+                if ((i % 16) == 0) {
+                    yield();
+                }
+                if (p_->b_ != a) {
+                    ++errors_;
+                }
+            }
+        }
+    }
+
+    SXLock* l_;
+    Pair*   p_;
+    bool    writer_;
+    int     count_;
+};
+
+DECLARE_TEST(Exclusion) {
+    SXLock l;
+    Pair   p;
+    std::vector<PairThread*> threads;
+
+    for (int i = 0; i < 6; ++i) {
+        threads.push_back(new PairThread(&l, &p, (i % 3) == 0, 20000));
+        threads.back()->start();
+    }
+
+    int errors = 0;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->join();
+        errors += threads[i]->errors_;
+        delete threads[i];
+    }
+
+    CHECK_EQUAL(errors, 0);
+    CHECK_EQUAL(p.a_, 2 * 20000);
+    CHECK_EQUAL(p.b_, 2 * 20000);
+
+    return UNIT_TEST_PASSED;
+}
+
+/*
+ * Readers that overlap each other so the lock is never free of them.
+ * A writer still has to get in promptly.
+ */
+class OverlapReader : public Thread {
+public:
+    OverlapReader(SXLock* l, volatile bool* done)
+        : Thread("OverlapReader", CREATE_JOINABLE), l_(l), done_(done) {}
+
+protected:
+    virtual void run() {
+        while (! *done_) {
+            ScopeLock_Shared s(l_, "OverlapReader");
+            usleep(1000);
+        }
+    }
+
+    SXLock*        l_;
+    volatile bool* done_;
+};
+
+DECLARE_TEST(WriterPreference) {
+    SXLock l;
+    volatile bool done = false;
+    std::vector<OverlapReader*> readers;
+
+    for (int i = 0; i < 4; ++i) {
+        readers.push_back(new OverlapReader(&l, &done));
+        readers.back()->start();
+    }
+    usleep(100000);
+
+    u_int32_t max_ms = 0;
+    for (int i = 0; i < 10; ++i) {
+        Time start = Time::now();
+        l.exclusive_lock();
+        u_int32_t elapsed = start.elapsed_ms();
+        l.exclusive_unlock();
+
+        if (elapsed > max_ms) {
+            max_ms = elapsed;
+        }
+        usleep(10000);
+    }
+
+    done = true;
+    for (size_t i = 0; i < readers.size(); ++i) {
+        readers[i]->join();
+        delete readers[i];
+    }
+
+    log_notice_p("/test", "max writer wait with overlapping readers: %u ms",
+                 max_ms);
+    CHECK_LT(max_ms, 1000);
+
+    return UNIT_TEST_PASSED;
+}
+
+/*
+ * Read-heavy benchmark: threads look up a shared map, and one
+ * operation in g_bench_write_every is an update. The same workload
+ * runs under an SXLock and under a single Mutex.
+ */
+int g_bench_iters       = 200000;
+int g_bench_write_every = 1000;
+
+typedef std::map<int, int> Table;
+
+class BenchThread : public Thread {
+public:
+    BenchThread(SXLock* sx, Mutex* m, Table* t)
+        : Thread("BenchThread", CREATE_JOINABLE),
+          errors_(0), sx_(sx), m_(m), t_(t) {}
+
+    int errors_;
+
+protected:
+    virtual void run() {
+        for (int i = 0; i < g_bench_iters; ++i) {
+            int key = i & 255;
+            if ((i % g_bench_write_every) == 0) {
+                if (sx_) {
+                    ScopeLock_Exclusive l(sx_, "BenchThread");
+                    (*t_)[key] = key;
+                } else {
+                    ScopeLock l(m_, "BenchThread");
+                    (*t_)[key] = key;
+                }
+            } else {
+                if (sx_) {
+                    ScopeLock_Shared l(sx_, "BenchThread");
+                    lookup(key);
+                } else {
+                    ScopeLock l(m_, "BenchThread");
+                    lookup(key);
+                }
+            }
+        }
+    }
+
+    void lookup(int key) {
+        Table::iterator iter = t_->find(key);
+        if (iter == t_->end() || iter->second != key) {
+            ++errors_;
+        }
+    }
+
+    SXLock* sx_;
+    Mutex*  m_;
+    Table*  t_;
+};
+
+int
+bench_read_heavy(const char* what, SXLock* sx, Mutex* m, int nthreads)
+{
+    Table t;
+    for (int i = 0; i < 256; ++i) {
+        t[i] = i;
+    }
+
+    std::vector<BenchThread*> threads;
+    Time start = Time::now();
+    for (int i = 0; i < nthreads; ++i) {
+        threads.push_back(new BenchThread(sx, m, &t));
+        threads.back()->start();
+    }
+
+    int errors = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i]->join();
+        errors += threads[i]->errors_;
+        delete threads[i];
+    }
+    u_int32_t elapsed = start.elapsed_ms();
+
+    log_notice_p("/test", "%-6s %2d threads x %d ops: %u ms, %d errors",
+                 what, nthreads, g_bench_iters, elapsed, errors);
+    return errors;
+}
+
+DECLARE_TEST(BenchReadHeavy) {
+    int nthreads[] = { 1, 2, 4, 8 };
+    int errors = 0;
+
+    for (size_t i = 0; i < sizeof(nthreads) / sizeof(nthreads[0]); ++i) {
+        SXLock sx;
+        Mutex  m("/test/mutex", Mutex::TYPE_RECURSIVE, true);
+        errors += bench_read_heavy("SXLock", &sx, NULL, nthreads[i]);
+        errors += bench_read_heavy("Mutex",  NULL, &m,  nthreads[i]);
+    }
+
+    CHECK_EQUAL(errors, 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(SXLockTester) {
+    ADD_TEST(Basic);
+    ADD_TEST(Exclusion);
+    ADD_TEST(WriterPreference);
+    ADD_TEST(BenchReadHeavy);
+}
+
+DECLARE_TEST_FILE(SXLockTester, "shared/exclusive lock test");
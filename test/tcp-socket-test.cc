@@ -19,12 +19,17 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 
 #include <debug/DebugUtils.h>
 #include <debug/Log.h>
+#include <thread/Atomic.h>
 #include <thread/Thread.h>
+#include <util/Time.h>
 #include <io/NetUtils.h>
 #include <io/TCPClient.h>
 #include <io/TCPServer.h>
@@ -114,6 +119,111 @@ public:
     }
 };
 
+// Server for the connection rate benchmark, which just counts and
+// closes connections
+class BenchServer : public TCPServerThread {
+public:
+    BenchServer()
+        : TCPServerThread("BenchServer", "/bench-server") {}
+
+    void accepted(int fd, in_addr_t addr, u_int16_t port)
+    {
+        (void)addr;
+        (void)port;
+        ::close(fd);
+        atomic_incr(&count_);
+    }
+
+    atomic_t count_;
+};
+
+// Client that opens and resets count connections as fast as it can
+class BenchClient : public Thread {
+public:
+    BenchClient(u_int16_t port, int count)
+        : Thread("BenchClient", CREATE_JOINABLE),
+          port_(port), count_(count), errors_(0) {}
+
+protected:
+    void run()
+    {
+        struct sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family      = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sa.sin_port        = htons(port_);
+
+        // close with a reset so the client ports don't pile up in
+        // TIME_WAIT
+        struct linger l;
+        l.l_onoff  = 1;
+        l.l_linger = 0;
+
+        for (int i = 0; i < count_; ++i) {
+            int fd = ::socket(PF_INET, SOCK_STREAM, 0);
+            if (fd < 0) {
+                ++errors_;
+                continue;
+            }
+            ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+            if (::connect(fd, (struct sockaddr*)&sa, sizeof(sa)) != 0) {
+                ++errors_;
+            }
+            ::close(fd);
+        }
+    }
+
+    u_int16_t port_;
+    int       count_;
+public:
+    int       errors_;
+};
+
+// Measure how many connections per second a server configuration can
+// accept from nclients threads connecting in a loop
+void
+bench_accept(const char* what, u_int16_t port,
+             int num_acceptors, int batch, int nclients, int total)
+{
+    BenchServer* s = new BenchServer();
+    s->set_accept_options(num_acceptors, batch,
+                          TCPServer::ACCEPT_NONBLOCK |
+                          TCPServer::ACCEPT_CLOEXEC);
+    if (s->bind_listen_start(htonl(INADDR_LOOPBACK), port) != 0) {
+        log_err_p("/test", "%s: can't start server on port %d", what, port);
+        delete s;
+        return;
+    }
+
+    Time start = Time::now();
+
+    std::vector<BenchClient*> clients;
+    for (int i = 0; i < nclients; ++i) {
+        clients.push_back(new BenchClient(port, total / nclients));
+        clients.back()->start();
+    }
+
+    int errors = 0;
+    for (int i = 0; i < nclients; ++i) {
+        clients[i]->join();
+        errors += clients[i]->errors_;
+        delete clients[i];
+    }
+
+    int expected = (total / nclients) * nclients - errors;
+    while ((int)s->count_.value < expected && start.elapsed_ms() < 30000) {
+        usleep(1000);
+    }
+    u_int32_t ms = start.elapsed_ms();
+
+    log_notice_p("/test", "%s: %u connections in %u ms (%.0f/sec), "
+                 "%d client errors",
+                 what, s->count_.value, ms,
+                 ms ? s->count_.value * 1000.0 / ms : 0.0, errors);
+
+    delete s;
+}
+
 int
 main(int argc, const char** argv)
 {
@@ -121,22 +231,31 @@ main(int argc, const char** argv)
 
     Log::init(LOG_INFO);
 
-    log_info("/test", "testing gethostbyname");
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        int total = 20000;
+        bench_accept("1 acceptor",              PORT + 1, 1, 1,  4, total);
+        bench_accept("1 acceptor, batch 64",    PORT + 2, 1, 64, 4, total);
+        bench_accept("4 acceptors",             PORT + 3, 4, 1,  4, total);
+        bench_accept("4 acceptors, batch 64",   PORT + 4, 4, 64, 4, total);
+        return 0;
+    }
+
+    log_info_p("/test", "testing gethostbyname");
     if (gethostbyname("10.0.0.1", &addr) != 0) {
-        log_err("/test", "error: can't gethostbyname 10.0.0.1");
+        log_err_p("/test", "error: can't gethostbyname 10.0.0.1");
     }
     if (addr != inet_addr("10.0.0.1")) {
-        log_err("/test", "error: gethostbyname 10.0.0.1 got %x, "
+        log_err_p("/test", "error: gethostbyname 10.0.0.1 got %x, "
                         "not %x", (u_int32_t)addr,
                         (u_int32_t)inet_addr("10.0.0.1"));
     }
     
     if (gethostbyname("localhost", &addr) != 0) {
-        log_err("/test", "error: can't gethostbyname localhost");
+        log_err_p("/test", "error: can't gethostbyname localhost");
     }
     
     if (ntohl(addr) != INADDR_LOOPBACK) {
-        log_err("/test", "error: gethostbyname(localhost) got %x, "
+        log_err_p("/test", "error: gethostbyname(localhost) got %x, "
                         "not %x", (u_int32_t)addr,
                         (u_int32_t)INADDR_LOOPBACK);
     }
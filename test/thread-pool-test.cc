@@ -0,0 +1,299 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <vector>
+
+#include "debug/Log.h"
+#include "thread/ThreadPool.h"
+#include "thread/Timer.h"
+#include "util/Time.h"
+#include "util/UnitTest.h"
+
+using namespace oasys;
+
+atomic_t g_count(0);
+
+class CountTask : public ThreadPoolTask {
+public:
+    CountTask(DoneQueue* q = NULL) : ThreadPoolTask(q) {}
+    void run() { atomic_incr(&g_count); }
+};
+
+DECLARE_TEST(Basic) {
+    g_count = 0;
+
+    ThreadPool pool("/test/pool", 4);
+    CHECK_EQUAL(pool.num_threads(), 4);
+
+    // tasks submitted before start wait for it
+    for (int i = 0; i < 100; ++i) {
+        pool.submit(new CountTask());
+    }
+    pool.start();
+
+    for (int i = 0; i < 10000; ++i) {
+        pool.submit(new CountTask());
+    }
+    pool.shutdown();
+
+    CHECK_EQUAL(g_count.value, 10100);
+    CHECK_EQUAL(pool.tasks_run(), 10100);
+
+    return UNIT_TEST_PASSED;
+}
+
+class SleepFuture : public ThreadPoolFuture {
+public:
+    SleepFuture(int ms) : ms_(ms), pool_(NULL) {}
+    void run() {
+        pool_ = ThreadPool::current();
+        usleep(ms_ * 1000);
+    }
+
+    int         ms_;
+    ThreadPool* pool_;
+};
+
+DECLARE_TEST(Future) {
+    ThreadPool pool("/test/pool", 2);
+    pool.start();
+
+    SleepFuture* f = new SleepFuture(200);
+    pool.submit(f);
+    CHECK(! f->wait(10));
+    CHECK(f->wait());
+    CHECK(f->is_done());
+    CHECK(f->wait());
+    CHECK(f->pool_ == &pool);
+    CHECK(ThreadPool::current() == NULL);
+    delete f;
+
+    // lots of quick ones, deleted as soon as they're done
+    for (int i = 0; i < 200; ++i) {
+        f = new SleepFuture(0);
+        pool.submit(f);
+        CHECK(f->wait());
+        delete f;
+    }
+
+    pool.shutdown();
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(ShutdownBeforeStart) {
+    g_count = 0;
+
+    // the tasks of a pool that never starts run in shutdown()
+    ThreadPool pool("/test/pool", 2);
+    for (int i = 0; i < 10; ++i) {
+        pool.submit(new CountTask());
+    }
+    SleepFuture* f = new SleepFuture(0);
+    pool.submit(f);
+
+    pool.shutdown();
+
+    CHECK_EQUAL(g_count.value, 10);
+    CHECK(f->is_done());
+    CHECK(f->pool_ == &pool);
+    CHECK(ThreadPool::current() == NULL);
+    delete f;
+
+    return UNIT_TEST_PASSED;
+}
+
+/*
+ * Fork/join: each task submits two children until the given depth,
+ * which is what work stealing is for since every task starts out on
+ * the deque of the worker that ran its parent.
+ */
+class TreeTask : public ThreadPoolTask {
+public:
+    TreeTask(int depth) : depth_(depth) {}
+    void run() {
+        atomic_incr(&g_count);
+        if (depth_ > 0) {
+            ThreadPool::current()->submit(new TreeTask(depth_ - 1));
+            ThreadPool::current()->submit(new TreeTask(depth_ - 1));
+        }
+    }
+
+    int depth_;
+};
+
+DECLARE_TEST(ForkJoin) {
+    g_count = 0;
+
+    ThreadPool pool("/test/pool", 4);
+    pool.start();
+    pool.submit(new TreeTask(14));
+
+    // shutdown() also has to wait for the tasks the tasks submit
+    pool.shutdown();
+
+    CHECK_EQUAL(g_count.value, (1 << 15) - 1);
+    log_notice_p("/test", "fork/join: %u tasks, %u steals",
+                 pool.tasks_run(), pool.steals());
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(DoneQueue) {
+    g_count = 0;
+
+    ThreadPoolTask::DoneQueue q("/test/done");
+    ThreadPool pool("/test/pool", 3);
+    pool.start();
+
+    for (int i = 0; i < 1000; ++i) {
+        pool.submit(new CountTask(&q));
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+        ThreadPoolTask* t = q.pop_blocking();
+        CHECK(t != NULL);
+        delete t;
+    }
+    CHECK_EQUAL(g_count.value, 1000);
+    CHECK_EQUAL(q.size(), 0);
+
+    pool.shutdown();
+
+    return UNIT_TEST_PASSED;
+}
+
+class PoolTimer : public ThreadPoolTimer {
+public:
+    PoolTimer(ThreadPool* pool)
+        : ThreadPoolTimer(pool, NO_DELETE), fired_(0), pool_seen_(NULL) {}
+
+    void pool_timeout(const struct timeval& now) {
+        (void)now;
+        pool_seen_ = ThreadPool::current();
+        atomic_incr(&fired_);
+    }
+
+    atomic_t    fired_;
+    ThreadPool* pool_seen_;
+};
+
+DECLARE_TEST(Timer) {
+    TimerSystem::create();
+    TimerThread::init();
+
+    ThreadPool pool("/test/pool", 2);
+    pool.start();
+
+    std::vector<PoolTimer*> timers;
+    for (int i = 0; i < 20; ++i) {
+        timers.push_back(new PoolTimer(&pool));
+        timers.back()->schedule_in(10 + i);
+    }
+
+    int errors = 0;
+    for (int i = 0; i < 20; ++i) {
+        int n = 0;
+        while (timers[i]->fired_.value == 0 && ++n < 1000) {
+            usleep(1000);
+        }
+        if (timers[i]->fired_.value != 1 || timers[i]->pool_seen_ != &pool) {
+            ++errors;
+        }
+    }
+    CHECK_EQUAL(errors, 0);
+
+    pool.shutdown();
+    for (int i = 0; i < 20; ++i) {
+        delete timers[i];
+    }
+
+    return UNIT_TEST_PASSED;
+}
+
+/*
+ * Benchmark of short tasks, against starting a Thread for each one
+ * the way a server does for every connection.
+ */
+int g_bench_tasks   = 200000;
+int g_bench_threads = 2000;
+
+class CountThread : public Thread {
+public:
+    CountThread() : Thread("CountThread", CREATE_JOINABLE) {}
+protected:
+    void run() { atomic_incr(&g_count); }
+};
+
+DECLARE_TEST(BenchSmallTasks) {
+    int errors = 0;
+
+    g_count = 0;
+    Time start = Time::now();
+    for (int i = 0; i < g_bench_threads; ++i) {
+        CountThread t;
+        t.start();
+        t.join();
+    }
+    u_int32_t thread_ms = start.elapsed_ms();
+    if (g_count.value != (u_int32_t)g_bench_threads) {
+        ++errors;
+    }
+    log_notice_p("/test", "thread per task: %d tasks in %u ms (%.2f us/task)",
+                 g_bench_threads, thread_ms,
+                 (1000.0 * thread_ms) / g_bench_threads);
+
+    int nthreads[] = { 1, 2, 4, 8 };
+    for (size_t i = 0; i < sizeof(nthreads) / sizeof(nthreads[0]); ++i) {
+        g_count = 0;
+        ThreadPool pool("/test/pool", nthreads[i]);
+        pool.start();
+
+        start = Time::now();
+        for (int j = 0; j < g_bench_tasks; ++j) {
+            pool.submit(new CountTask());
+        }
+        pool.shutdown();
+        u_int32_t pool_ms = start.elapsed_ms();
+
+        if (g_count.value != (u_int32_t)g_bench_tasks) {
+            ++errors;
+        }
+        log_notice_p("/test", "pool of %d: %d tasks in %u ms (%.2f us/task), "
+                     "%u steals", nthreads[i], g_bench_tasks, pool_ms,
+                     (1000.0 * pool_ms) / g_bench_tasks, pool.steals());
+    }
+
+    CHECK_EQUAL(errors, 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(ThreadPoolTester) {
+    ADD_TEST(Basic);
+    ADD_TEST(Future);
+    ADD_TEST(ShutdownBeforeStart);
+    ADD_TEST(ForkJoin);
+    ADD_TEST(DoneQueue);
+    ADD_TEST(Timer);
+    ADD_TEST(BenchSmallTasks);
+}
+
+DECLARE_TEST_FILE(ThreadPoolTester, "thread pool test");
@@ -19,10 +19,15 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <thread/Thread.h>
 #include <thread/Timer.h>
 
 #include "debug/Log.h"
+#include "util/Random.h"
+#include "util/Time.h"
 #include "util/UnitTest.h"
 
 using namespace oasys;
@@ -116,9 +121,44 @@ public:
     std::vector<ConcurrentTimer*>* completed_;
 };
 
+/**
+ * Timer that records the order in which it fires.
+ */
+class OrderTimer : public Timer {
+public:
+    OrderTimer(int id, std::vector<int>* fired)
+        : Timer(NO_DELETE), id_(id), fired_(fired) {}
+
+    void timeout(const timeval& now) {
+        (void)now;
+        fired_->push_back(id_);
+    }
+
+    int id_;
+    std::vector<int>* fired_;
+};
+
+/**
+ * Timer that should never fire.
+ */
+class ChurnTimer : public Timer {
+public:
+    void timeout(const timeval& now) {
+        (void)now;
+        PANIC("churn timer fired");
+    }
+};
+
 DECLARE_TEST(Init) {
     OneShotTimer startup;
-    TimerSystem::create();
+
+    // the whole suite can be rerun on the wheel backend
+    const char* backend = getenv("TIMER_BACKEND");
+    if (backend != 0 && !strcmp(backend, "wheel")) {
+        TimerSystem::create(TimerSystem::WHEEL_BACKEND);
+    } else {
+        TimerSystem::create(TimerSystem::HEAP_BACKEND);
+    }
     TimerThread::init();
     startup.schedule_in(10);
     while (! startup.fired_) {
@@ -237,6 +277,402 @@ DECLARE_TEST(Concurrent) {
     return UNIT_TEST_PASSED;
 }
 
+/**
+ * Drive a standalone timer system for the given number of
+ * milliseconds.
+ */
+void
+drive(TimerSystem* sys, int ms)
+{
+    Time start = Time::now();
+    while ((int)start.elapsed_ms() < ms) {
+        int timeout = sys->run_expired_timers();
+        if (timeout < 0 || timeout > 10) {
+            timeout = 10;
+        }
+        usleep(timeout * 1000);
+    }
+    sys->run_expired_timers();
+}
+
+DECLARE_TEST(WheelOrder) {
+    TimerSystem* sys = new TimerSystem(TimerSystem::WHEEL_BACKEND);
+    std::vector<int> fired;
+    std::vector<OrderTimer*> timers;
+
+    // spread across level 0 and level 1 of the wheel, and make sure
+    // timers scheduled for the same time keep their order
+    int delays[] = { 700, 50, 300, 50, 0, 10, 260, 300, 5 };
+    int order[]  = { 4, 8, 5, 1, 3, 6, 2, 7, 0 };
+    int n = sizeof(delays) / sizeof(delays[0]);
+    for (int i = 0; i < n; ++i) {
+        timers.push_back(new OrderTimer(i, &fired));
+        sys->schedule_in(delays[i], timers[i]);
+    }
+    CHECK_EQUAL(sys->num_pending_timers(), (size_t)n);
+
+    drive(sys, 1000);
+
+    CHECK_EQUAL(fired.size(), (size_t)n);
+    for (int i = 0; i < n; ++i) {
+        CHECK_EQUAL(fired[i], order[i]);
+        CHECK(! timers[i]->pending());
+        delete timers[i];
+    }
+    CHECK_EQUAL(sys->num_pending_timers(), 0);
+    CHECK_EQUAL(sys->run_expired_timers(), -1);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(WheelCancel) {
+    TimerSystem* sys = new TimerSystem(TimerSystem::WHEEL_BACKEND);
+    std::vector<int> fired;
+
+    OrderTimer a(1, &fired);
+    OrderTimer b(2, &fired);
+    sys->schedule_in(100, &a);
+    sys->schedule_in(100, &b);
+    CHECK(sys->cancel(&a));
+    CHECK(! a.pending());
+    CHECK(! sys->cancel(&a));
+    CHECK_EQUAL(sys->num_pending_timers(), 1);
+
+    // a NO_DELETE timer can be rescheduled as soon as it's cancelled
+    sys->schedule_in(200, &a);
+    CHECK(a.pending());
+    CHECK_EQUAL(sys->num_pending_timers(), 2);
+
+    drive(sys, 300);
+    CHECK_EQUAL(fired.size(), 2);
+    CHECK_EQUAL(fired[0], 2);
+    CHECK_EQUAL(fired[1], 1);
+
+    // cancelled DELETE_ON_CANCEL timers are deleted by the next run
+    ChurnTimer* c = new ChurnTimer();
+    sys->schedule_in(100000000, c);
+    CHECK(sys->cancel(c));
+    CHECK(c->pending() && c->cancelled());
+    CHECK_EQUAL(sys->num_pending_timers(), 0);
+    sys->run_expired_timers();
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Thread that cancels a timer.
+ */
+class CancelThread : public Thread {
+public:
+    CancelThread(Timer* timer)
+        : Thread("CancelThread", CREATE_JOINABLE),
+          timer_(timer), cancelled_(false) {}
+
+    void run() { cancelled_ = timer_->cancel(); }
+
+    Timer* timer_;
+    bool   cancelled_;
+};
+
+/**
+ * Timer whose handler has another thread cancel a timer, which would
+ * never finish if the handler ran with the timer system's lock held.
+ */
+class CancelOtherTimer : public Timer {
+public:
+    CancelOtherTimer(Timer* other)
+        : Timer(NO_DELETE), other_(other), cancelled_(false) {}
+
+    void timeout(const timeval& now) {
+        (void)now;
+        CancelThread* t = new CancelThread(other_);
+        t->start();
+        t->join();
+        cancelled_ = t->cancelled_;
+        delete t;
+    }
+
+    Timer* other_;
+    bool   cancelled_;
+};
+
+/**
+ * Timer whose handler takes a while, so it can be cancelled while it
+ * runs.
+ */
+class SlowTimer : public Timer {
+public:
+    SlowTimer() : Timer(NO_DELETE), started_(false), done_(false) {}
+
+    void timeout(const timeval& now) {
+        (void)now;
+        started_ = true;
+        usleep(200000);
+        done_ = true;
+    }
+
+    volatile bool started_;
+    volatile bool done_;
+};
+
+/**
+ * Thread that drives a standalone timer system.
+ */
+class DriveThread : public Thread {
+public:
+    DriveThread(TimerSystem* sys, int ms)
+        : Thread("DriveThread", CREATE_JOINABLE), sys_(sys), ms_(ms) {}
+
+    void run() { drive(sys_, ms_); }
+
+    TimerSystem* sys_;
+    int          ms_;
+};
+
+DECLARE_TEST(CancelFromHandler) {
+    TimerSystem* sys   = new TimerSystem(TimerSystem::WHEEL_BACKEND);
+    TimerSystem* other = new TimerSystem(TimerSystem::WHEEL_BACKEND);
+    std::vector<int> fired;
+
+    // a and b expire together, and b's handler has another thread
+    // cancel a before a's handler is called
+    struct timeval when;
+    ::gettimeofday(&when, 0);
+    OrderTimer a(1, &fired);
+    CancelOtherTimer b(&a);
+    sys->schedule_at(&when, &b);
+    sys->schedule_at(&when, &a);
+    drive(sys, 100);
+    CHECK(b.cancelled_);
+    CHECK(! a.pending());
+    CHECK_EQUAL(fired.size(), 0);
+
+    // cancelling a timer whose handler is running waits for it to
+    // return, after which the timer can be deleted
+    SlowTimer c;
+    sys->schedule_in(10, &c);
+    DriveThread* t = new DriveThread(sys, 500);
+    t->start();
+    while (! c.started_) {
+        usleep(1000);
+    }
+    CHECK(! c.cancel());
+    CHECK(c.done_);
+    t->join();
+    delete t;
+
+    // cancelling through the wrong system goes to the right one
+    other->schedule_in(100000, &a);
+    CHECK(sys->cancel(&a));
+    CHECK(! a.pending());
+    CHECK_EQUAL(other->num_pending_timers(), 0);
+    CHECK_EQUAL(fired.size(), 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Schedule and cancel count timers in batches, the way retransmit
+ * timers behave on a healthy link.
+ */
+int
+churn(TimerSystem* sys, const char* what, int count)
+{
+    int batch = 1000;
+    Time start = Time::now();
+
+    std::vector<Timer*> timers(batch);
+    for (int i = 0; i < count; i += batch) {
+        for (int j = 0; j < batch; ++j) {
+            timers[j] = new ChurnTimer();
+            sys->schedule_in(1000 + Random::rand(600000), timers[j]);
+        }
+        for (int j = 0; j < batch; ++j) {
+            sys->cancel(timers[j]);
+        }
+        sys->run_expired_timers();
+    }
+    
+    u_int32_t ms = (Time::now() - start).in_milliseconds();
+    log_notice_p("/test", "%s: %d schedule+cancel in %u ms (%.0f ops/sec)",
+                 what, count, ms, ms == 0 ? 0.0 : (count * 1000.0) / ms);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(BenchChurn) {
+    // seed the heap with long-lived timers so its depth is realistic
+    TimerSystem* heap  = new TimerSystem(TimerSystem::HEAP_BACKEND);
+    TimerSystem* wheel = new TimerSystem(TimerSystem::WHEEL_BACKEND);
+    std::vector<int> fired;
+    std::vector<OrderTimer*> timers;
+    for (int i = 0; i < 100000; ++i) {
+        timers.push_back(new OrderTimer(i, &fired));
+        heap->schedule_in(3600000 + i, timers.back());
+        timers.push_back(new OrderTimer(i, &fired));
+        wheel->schedule_in(3600000 + i, timers.back());
+    }
+
+    churn(heap,  "heap",  1000000);
+    churn(wheel, "wheel", 1000000);
+
+    CHECK_EQUAL(heap->num_pending_timers(), 100000);
+    CHECK_EQUAL(wheel->num_pending_timers(), 100000);
+    CHECK_EQUAL(fired.size(), 0);
+    
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Thread that binds a timer system and schedules timers on it through
+ * the regular Timer interface.
+ */
+class ShardThread : public Thread {
+public:
+    ShardThread(TimerSystem* sys, std::vector<OrderTimer*>* timers)
+        : Thread("ShardThread", CREATE_JOINABLE),
+          sys_(sys), timers_(timers), current_(0) {}
+
+protected:
+    virtual void run() {
+        TimerSystem::set_thread_local(sys_);
+        current_ = TimerSystem::current();
+        for (size_t i = 0; i < timers_->size(); ++i) {
+            (*timers_)[i]->schedule_in(100000);
+        }
+        TimerSystem::set_thread_local(NULL);
+    }
+
+public:
+    TimerSystem* sys_;
+    std::vector<OrderTimer*>* timers_;
+    TimerSystem* current_;
+};
+
+DECLARE_TEST(ThreadLocal) {
+    int nthreads = 4;
+    int count    = 100;
+    std::vector<int> fired;
+    std::vector<TimerSystem*> systems;
+    std::vector< std::vector<OrderTimer*> > timers(nthreads);
+    std::vector<ShardThread*> threads;
+
+    for (int i = 0; i < nthreads; ++i) {
+        systems.push_back(new TimerSystem(TimerSystem::WHEEL_BACKEND));
+        for (int j = 0; j < count; ++j) {
+            timers[i].push_back(new OrderTimer(j, &fired));
+        }
+        threads.push_back(new ShardThread(systems[i], &timers[i]));
+        threads[i]->start();
+    }
+
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i]->join();
+        CHECK(threads[i]->current_ == systems[i]);
+        CHECK_EQUAL(systems[i]->num_pending_timers(), (size_t)count);
+        delete threads[i];
+    }
+
+    // this thread isn't bound, but cancel() still finds the system
+    // each timer was scheduled on
+    CHECK(TimerSystem::current() == TimerSystem::instance());
+    for (int i = 0; i < nthreads; ++i) {
+        for (int j = 0; j < count; ++j) {
+            CHECK(timers[i][j]->cancel());
+            delete timers[i][j];
+        }
+        CHECK_EQUAL(systems[i]->num_pending_timers(), 0);
+    }
+    CHECK_EQUAL(fired.size(), 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Thread that churns through timers on whichever system it's bound to.
+ */
+class ChurnThread : public Thread {
+public:
+    ChurnThread(TimerSystem* sys, int count)
+        : Thread("ChurnThread", CREATE_JOINABLE),
+          sys_(sys), count_(count) {}
+
+protected:
+    virtual void run() {
+        TimerSystem::set_thread_local(sys_);
+
+        int batch = 1000;
+        std::vector<Timer*> timers(batch);
+        for (int i = 0; i < count_; i += batch) {
+            for (int j = 0; j < batch; ++j) {
+                timers[j] = new ChurnTimer();
+                timers[j]->schedule_in(1000 + Random::rand(600000));
+            }
+            for (int j = 0; j < batch; ++j) {
+                timers[j]->cancel();
+            }
+            sys_->run_expired_timers();
+        }
+
+        TimerSystem::set_thread_local(NULL);
+    }
+
+    TimerSystem* sys_;
+    int count_;
+};
+
+/**
+ * Run nthreads churning threads, either all sharing one timer system
+ * or each with its own.
+ */
+int
+churn_threads(int nthreads, bool shared, int total)
+{
+    std::vector<TimerSystem*> systems;
+    std::vector<ChurnThread*> threads;
+
+    for (int i = 0; i < nthreads; ++i) {
+        if (i == 0 || !shared) {
+            systems.push_back(new TimerSystem(TimerSystem::WHEEL_BACKEND));
+        }
+    }
+
+    Time start = Time::now();
+    for (int i = 0; i < nthreads; ++i) {
+        threads.push_back(new ChurnThread(systems[i % systems.size()],
+                                          total / nthreads));
+        threads[i]->start();
+    }
+
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i]->join();
+        delete threads[i];
+    }
+    u_int32_t ms = (Time::now() - start).in_milliseconds();
+
+    log_notice_p("/test", "%d threads, %s: %d schedule+cancel in %u ms "
+                 "(%.0f ops/sec)",
+                 nthreads, shared ? "shared system" : "per-thread systems",
+                 total, ms, ms == 0 ? 0.0 : (total * 1000.0) / ms);
+
+    int errno_; const char* strerror_;
+    for (size_t i = 0; i < systems.size(); ++i) {
+        CHECK_EQUAL(systems[i]->num_pending_timers(), 0);
+    }
+    
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(BenchThreadLocal) {
+    int nthreads[] = { 1, 4, 16 };
+    for (size_t i = 0; i < sizeof(nthreads) / sizeof(nthreads[0]); ++i) {
+        CHECK(churn_threads(nthreads[i], true,  1600000) == UNIT_TEST_PASSED);
+        CHECK(churn_threads(nthreads[i], false, 1600000) == UNIT_TEST_PASSED);
+    }
+    
+    return UNIT_TEST_PASSED;
+}
+
 DECLARE_TESTER(TimerTest) {
     ADD_TEST(Init);
     ADD_TEST(OneSec);
@@ -245,6 +681,12 @@ DECLARE_TESTER(TimerTest) {
     ADD_TEST(Simultaneous);
     ADD_TEST(Many);
     ADD_TEST(Concurrent);
+    ADD_TEST(WheelOrder);
+    ADD_TEST(WheelCancel);
+    ADD_TEST(CancelFromHandler);
+    ADD_TEST(BenchChurn);
+    ADD_TEST(ThreadLocal);
+    ADD_TEST(BenchThreadLocal);
 }
 
 DECLARE_TEST_FILE(TimerTest, "timer test");
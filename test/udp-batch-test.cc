@@ -0,0 +1,238 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <string.h>
+
+#include "io/DatagramBatch.h"
+#include "io/NetUtils.h"
+#include "io/UDPClient.h"
+#include "util/Time.h"
+#include "util/UnitTest.h"
+
+using namespace oasys;
+
+in_addr_t localhost = htonl(INADDR_LOOPBACK);
+
+DECLARE_TEST(BatchAdd) {
+    DatagramBatch batch(2, 16);
+    char buf[32];
+    memset(buf, 'x', sizeof(buf));
+
+    CHECK_EQUAL(batch.size(), 0);
+    CHECK_EQUAL(batch.add(buf, 17), -1);
+    CHECK_EQUAL(batch.add(buf, 16, localhost, 1234), 0);
+    CHECK_EQUAL(batch.add(buf, 4), 0);
+    CHECK_EQUAL(batch.add(buf, 4), -1);
+    CHECK_EQUAL(batch.size(), 2);
+    CHECK_EQUAL(batch.len(0), 16);
+    CHECK_EQUAL(batch.len(1), 4);
+    CHECK_EQUAL(batch.addr(0), localhost);
+    CHECK_EQUAL(batch.port(0), 1234);
+    CHECK(memcmp(batch.data(1), buf, 4) == 0);
+
+    batch.clear();
+    CHECK_EQUAL(batch.size(), 0);
+    CHECK_EQUAL(batch.add(buf, 4), 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(SendRecv) {
+    UDPClient sender("/test/sender");
+    UDPClient receiver("/test/receiver");
+    CHECK_EQUAL(sender.bind(localhost, 0), 0);
+    CHECK_EQUAL(receiver.bind(localhost, 0), 0);
+
+    DatagramBatch out(16);
+    DatagramBatch in(32);
+    char buf[64];
+    for (int i = 0; i < 16; ++i) {
+        int len = snprintf(buf, sizeof(buf), "datagram %d", i);
+        CHECK_EQUAL(out.add(buf, len, localhost, receiver.local_port()), 0);
+    }
+
+    CHECK_EQUAL(sender.sendmmsg(&out, 0), 16);
+
+    int total = 0;
+    while (total < 16) {
+        int cc = receiver.timeout_recvmmsg(&in, 1000);
+        CHECK(cc > 0);
+        CHECK_EQUAL((int)in.size(), cc);
+        for (int i = 0; i < cc; ++i) {
+            int len = snprintf(buf, sizeof(buf), "datagram %d", total + i);
+            CHECK_EQUAL((int)in.len(i), len);
+            CHECK(memcmp(in.data(i), buf, len) == 0);
+            CHECK_EQUAL(in.addr(i), localhost);
+            CHECK_EQUAL(in.port(i), sender.local_port());
+            CHECK_EQUAL(in.segment_size(i), 0);
+        }
+        total += cc;
+    }
+    CHECK_EQUAL(total, 16);
+
+    CHECK_EQUAL(receiver.timeout_recvmmsg(&in, 10), IOTIMEOUT);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TEST(Connected) {
+    UDPClient sender("/test/sender");
+    UDPClient receiver("/test/receiver");
+    CHECK_EQUAL(receiver.bind(localhost, 0), 0);
+    CHECK_EQUAL(sender.connect(localhost, receiver.local_port()), 0);
+
+    DatagramBatch out(4);
+    DatagramBatch in(4);
+    CHECK_EQUAL(out.add("one", 3), 0);
+    CHECK_EQUAL(out.add("two", 3), 0);
+    CHECK_EQUAL(sender.sendmmsg(&out, 0), 2);
+
+    int total = 0;
+    while (total < 2) {
+        int cc = receiver.recvmmsg(&in, 0);
+        CHECK(cc > 0);
+        total += cc;
+    }
+    CHECK(memcmp(in.data(in.size() - 1), "two", 3) == 0);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * With UDP_SEGMENT the kernel splits one buffer into several
+ * datagrams. Kernels without it send a single datagram instead.
+ */
+DECLARE_TEST(Segmentation) {
+    UDPClient sender("/test/sender");
+    UDPClient receiver("/test/receiver");
+    sender.params_.udp_segment_ = 100;
+    CHECK_EQUAL(sender.bind(localhost, 0), 0);
+    CHECK_EQUAL(receiver.bind(localhost, 0), 0);
+
+    DatagramBatch out(1, 1000);
+    DatagramBatch in(16, 1000);
+    char buf[1000];
+    for (size_t i = 0; i < sizeof(buf); ++i) {
+        buf[i] = i % 97;
+    }
+    CHECK_EQUAL(out.add(buf, sizeof(buf), localhost, receiver.local_port()), 0);
+    CHECK_EQUAL(sender.sendmmsg(&out, 0), 1);
+
+    size_t total = 0;
+    int datagrams = 0;
+    while (total < sizeof(buf)) {
+        int cc = receiver.timeout_recvmmsg(&in, 1000);
+        CHECK(cc > 0);
+        for (int i = 0; i < cc; ++i) {
+            CHECK(memcmp(in.data(i), buf + total, in.len(i)) == 0);
+            total += in.len(i);
+            ++datagrams;
+        }
+    }
+    CHECK_EQUAL(total, sizeof(buf));
+    log_notice_p("/test", "1000 byte buffer arrived as %d datagrams",
+                 datagrams);
+    CHECK(datagrams == 1 || datagrams == 10);
+
+    return UNIT_TEST_PASSED;
+}
+
+/**
+ * Push small datagrams over loopback one system call at a time, then
+ * in batches, and compare the packet rates.
+ */
+DECLARE_TEST(BenchLoopback) {
+    UDPClient sender("/test/sender");
+    UDPClient receiver("/test/receiver");
+    sender.params_.send_bufsize_   = 1024 * 1024;
+    receiver.params_.recv_bufsize_ = 1024 * 1024;
+    CHECK_EQUAL(sender.bind(localhost, 0), 0);
+    CHECK_EQUAL(receiver.bind(localhost, 0), 0);
+    u_int16_t port = receiver.local_port();
+
+    const int count = 200000;
+    const int size  = 64;
+    const int nbatch = 32;
+    char buf[size];
+    memset(buf, 'x', size);
+
+    // no CHECKs inside the loops, since logging them would swamp
+    // the cost of the system calls
+    int errors = 0;
+    Time start = Time::now();
+    for (int i = 0; i < count; i += nbatch) {
+        for (int j = 0; j < nbatch; ++j) {
+            if (sender.sendto(buf, size, 0, localhost, port) != size) {
+                ++errors;
+            }
+        }
+        for (int j = 0; j < nbatch; ++j) {
+            if (receiver.recvfrom(buf, size, 0, 0, 0) != size) {
+                ++errors;
+            }
+        }
+    }
+    u_int32_t single_ms = start.elapsed_ms();
+    CHECK_EQUAL(errors, 0);
+
+    DatagramBatch out(nbatch, size);
+    DatagramBatch in(nbatch, size);
+    for (int j = 0; j < nbatch; ++j) {
+        CHECK_EQUAL(out.add(buf, size, localhost, port), 0);
+    }
+
+    start = Time::now();
+    for (int i = 0; i < count; i += nbatch) {
+        if (sender.sendmmsg(&out, 0) != nbatch) {
+            ++errors;
+        }
+        int got = 0;
+        while (got < nbatch) {
+            int cc = receiver.recvmmsg(&in, 0);
+            if (cc <= 0) {
+                ++errors;
+                break;
+            }
+            got += cc;
+        }
+    }
+    u_int32_t batch_ms = start.elapsed_ms();
+    CHECK_EQUAL(errors, 0);
+
+    log_notice_p("/test", "%d datagrams of %d bytes: "
+                 "sendto/recvfrom %u ms (%.0f pps), "
+                 "sendmmsg/recvmmsg x%d %u ms (%.0f pps)",
+                 count, size,
+                 single_ms, single_ms ? count * 1000.0 / single_ms : 0.0,
+                 nbatch,
+                 batch_ms, batch_ms ? count * 1000.0 / batch_ms : 0.0);
+
+    return UNIT_TEST_PASSED;
+}
+
+DECLARE_TESTER(UDPBatchTest) {
+    ADD_TEST(BatchAdd);
+    ADD_TEST(SendRecv);
+    ADD_TEST(Connected);
+    ADD_TEST(Segmentation);
+    ADD_TEST(BenchLoopback);
+}
+
+DECLARE_TEST_FILE(UDPBatchTest, "udp batch test");
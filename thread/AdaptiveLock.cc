@@ -0,0 +1,276 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "AdaptiveLock.h"
+#include "../thread/LockDebugger.h"
+
+namespace oasys {
+
+int      AdaptiveLock::max_spins_(1000);
+#ifndef NDEBUG
+atomic_t AdaptiveLock::total_spins_(0);
+atomic_t AdaptiveLock::total_sleeps_(0);
+#endif
+
+namespace {
+
+/// Let the other hyperthread run while we spin
+inline void
+cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/// Spinning only helps if the holder can run at the same time
+bool
+multiprocessor()
+{
+    static int ncpus = 0;
+    if (ncpus == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        ncpus = (n > 0) ? (int)n : 1;
+    }
+    return ncpus > 1;
+}
+
+#if defined(__linux__)
+/// Sleep as long as *addr == val
+inline void
+futex_wait(volatile u_int32_t* addr, u_int32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+/// Wake up to n sleepers on addr
+inline void
+futex_wake(volatile u_int32_t* addr, int n)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+#endif
+
+} // namespace
+
+//----------------------------------------------------------------------------
+u_int32_t
+AdaptiveLock::swap_state(u_int32_t state)
+{
+    u_int32_t old;
+    do {
+        old = state_.value;
+    } while (atomic_cmpxchg32(&state_, old, state) != old);
+    return old;
+}
+
+//----------------------------------------------------------------------------
+int
+AdaptiveLock::lock(const char* lock_user)
+{
+    if (is_locked_by_me()) {
+        lock_count_.value++;
+
+#if OASYS_DEBUG_LOCKING_ENABLED
+        if (Thread::lock_debugger() != NULL ) {
+            Thread::lock_debugger()->add_lock(this);  // Only do this if the calling
+                                                      // thread is an oasys thread.
+        }
+#endif
+
+        return 0;
+    }
+
+    u_int64_t wait_start = 0;
+    if (atomic_cmpxchg32(&state_, UNLOCKED, LOCKED) != UNLOCKED) {
+        if (stats_ != NULL) {
+            wait_start = LockStats::now();
+        }
+        lock_contended();
+    }
+
+    ASSERT(lock_count_.value == 0);
+
+    lock_holder_      = Thread::current();
+    lock_holder_name_ = lock_user;
+    lock_count_.value = 1;
+
+    if (stats_ != NULL) {
+        stats_->acquired(wait_start);
+    }
+
+#if OASYS_DEBUG_LOCKING_ENABLED
+    if (Thread::lock_debugger() != NULL ) {
+        Thread::lock_debugger()->add_lock(this);  // Only do this if the calling
+                                                  // thread is an oasys thread.
+    }
+#endif
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+void
+AdaptiveLock::lock_contended()
+{
+    // Spin for a bit first, on the theory that the holder is running
+    // on another cpu and will let go soon. The limit tracks about
+    // twice what it has recently taken, so a lock that's held for a
+    // long time quickly stops being spun on. The estimate is updated
+    // without any atomics since it's only a hint.
+    if (multiprocessor()) {
+        int limit = 2 * spin_estimate_ + 10;
+        if (limit > max_spins_) {
+            limit = max_spins_;
+        }
+
+        int nspins;
+        for (nspins = 0; nspins < limit; ++nspins) {
+            if (state_.value == UNLOCKED &&
+                atomic_cmpxchg32(&state_, UNLOCKED, LOCKED) == UNLOCKED)
+            {
+                break;
+            }
+            cpu_relax();
+        }
+
+        spin_estimate_ += (nspins - spin_estimate_) / 8;
+
+#ifndef NDEBUG
+        atomic_add_ret(&total_spins_, nspins);
+#endif
+        if (nspins < limit) {
+            return;
+        }
+    }
+
+    // Now mark the lock as contended so the holder knows to wake us
+    // up, and go to sleep until it's free. Having taken it this way,
+    // it has to stay marked contended since there may be others
+    // asleep, which costs at worst an extra wakeup.
+    while (swap_state(CONTENDED) != UNLOCKED) {
+#ifndef NDEBUG
+        atomic_incr(&total_sleeps_);
+#endif
+
+#if defined(__linux__)
+        futex_wait(&state_.value, CONTENDED);
+#else
+        Thread::yield();
+#endif
+    }
+}
+
+//----------------------------------------------------------------------------
+int
+AdaptiveLock::unlock()
+{
+    ASSERT(is_locked_by_me());
+
+    if (lock_count_.value > 1) {
+        lock_count_.value--;
+
+#if OASYS_DEBUG_LOCKING_ENABLED
+        if (Thread::lock_debugger() != NULL ) {
+            Thread::lock_debugger()->remove_lock(this);  // Only do this if the calling
+                                                         // thread is an oasys thread.
+        }
+#endif
+
+        return 0;
+    }
+
+#if OASYS_DEBUG_LOCKING_ENABLED
+    if (Thread::lock_debugger() != NULL ) {
+        Thread::lock_debugger()->remove_lock(this);   // Only do this if the calling
+                                                      // thread is an oasys thread.
+    }
+#endif
+
+    if (stats_ != NULL) {
+        stats_->released(lock_holder_name_);
+    }
+
+    lock_holder_      = 0;
+    lock_holder_name_ = 0;
+    lock_count_.value = 0;
+
+    // Going from LOCKED to UNLOCKED means nobody is waiting. Otherwise
+    // it was CONTENDED, so clear it and wake up a sleeper, which will
+    // mark it contended again when it gets the lock.
+    if (! atomic_decr_test(&state_)) {
+        swap_state(UNLOCKED);
+#if defined(__linux__)
+        futex_wake(&state_.value, 1);
+#endif
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+int
+AdaptiveLock::try_lock(const char* lock_user)
+{
+    if (is_locked_by_me()) {
+        lock_count_.value++;
+
+#if OASYS_DEBUG_LOCKING_ENABLED
+        if (Thread::lock_debugger() != NULL ) {
+            Thread::lock_debugger()->add_lock(this);  // Only do this if the calling
+                                                      // thread is an oasys thread.
+        }
+#endif
+
+        return 0;
+    }
+
+    if (atomic_cmpxchg32(&state_, UNLOCKED, LOCKED) != UNLOCKED) {
+        return 1; // already locked
+    }
+
+    lock_holder_      = Thread::current();
+    lock_holder_name_ = lock_user;
+    lock_count_.value = 1;
+
+    if (stats_ != NULL) {
+        stats_->acquired(0);
+    }
+
+#if OASYS_DEBUG_LOCKING_ENABLED
+    if (Thread::lock_debugger() != NULL ) {
+        Thread::lock_debugger()->add_lock(this);  // Only do this if the calling
+                                                  // thread is an oasys thread.
+    }
+#endif
+
+    return 0; // success
+}
+
+} // namespace oasys
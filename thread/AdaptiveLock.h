@@ -0,0 +1,83 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_ADAPTIVELOCK_H_
+#define _OASYS_ADAPTIVELOCK_H_
+
+#include "Lock.h"
+
+namespace oasys {
+
+/**
+ * A recursive Lock that spins for a little while when it's contended
+ * and then puts the waiting thread to sleep, rather than spinning
+ * (and yielding) until it gets in the way SpinLock does. That keeps
+ * waiters from eating CPU that the holder may need, which matters
+ * once there are more threads than cores.
+ *
+ * On Linux, waiters sleep on a futex on the lock word, so an
+ * uncontended lock or unlock is a single atomic operation with no
+ * system call. Elsewhere it falls back to yielding between attempts.
+ *
+ * How long to spin adapts per lock: it tracks how many spins it
+ * usually takes to get the lock, and on a uniprocessor it doesn't
+ * spin at all, since the holder can't let go while the waiter runs.
+ */
+class AdaptiveLock : public Lock {
+public:
+    AdaptiveLock(const char* classname = "GENERIC")
+        : Lock(classname), state_(UNLOCKED), spin_estimate_(0) {}
+
+    virtual ~AdaptiveLock() {}
+
+    /// @{
+    /// Virtual override from Lock
+    int lock(const char* lock_user);
+    int unlock();
+    int try_lock(const char* lock_user);
+    /// @}
+
+    /// Upper bound on the number of spins before sleeping
+    static int max_spins_;
+
+private:
+    /// Values of the lock word
+    enum {
+        UNLOCKED  = 0,
+        LOCKED    = 1,
+        CONTENDED = 2       ///< locked, and there may be sleepers
+    };
+
+    atomic_t state_;        ///< the lock word
+    int      spin_estimate_;///< running average of spins needed
+
+    /// The slow path of lock(), once the first attempt failed
+    void lock_contended();
+
+    /// Set the state and return what it was
+    u_int32_t swap_state(u_int32_t state);
+
+#ifndef NDEBUG
+public:
+    static atomic_t total_spins_;	///< debugging variable
+    static atomic_t total_sleeps_;	///< debugging variable
+#endif
+};
+
+} // namespace oasys
+
+#endif /* _OASYS_ADAPTIVELOCK_H_ */
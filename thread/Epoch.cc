@@ -0,0 +1,174 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include "Epoch.h"
+#include "Thread.h"
+
+namespace oasys {
+
+atomic_t Epoch::fence_(0);
+
+/*
+ * The epoch only ever moves from e to e + 1 once the readers counted
+ * in e - 1 are gone, so that its parity is free for the readers of
+ * e + 1. Hence when the current epoch is e, the readers of e - 1 are
+ * the only older ones that can still be around, and once they have
+ * drained, everything retired before e can be freed.
+ */
+
+//----------------------------------------------------------------------------
+Epoch::Epoch()
+    : epoch_(0),
+      lock_("Epoch")
+{
+}
+
+//----------------------------------------------------------------------------
+Epoch::~Epoch()
+{
+    synchronize();
+}
+
+//----------------------------------------------------------------------------
+void
+Epoch::synchronize()
+{
+    DeferredList done;
+    {
+        ScopeLock l(&lock_, "Epoch::synchronize");
+        u_int32_t e = epoch_.value;
+
+        // the incr is a full barrier, so the readers counted in e
+        // are seen from here on, and new ones count themselves in e + 1
+        wait_for_readers(e - 1);
+        atomic_incr(&epoch_);
+        wait_for_readers(e);
+
+        collect(e + 1, &done);
+    }
+    free_all(done);
+}
+
+//----------------------------------------------------------------------------
+void
+Epoch::defer(free_fn_t fn, void* arg)
+{
+    {
+        ScopeLock l(&lock_, "Epoch::defer");
+        deferred_.push_back(Deferred(fn, arg, epoch_.value));
+    }
+    try_reclaim();
+}
+
+//----------------------------------------------------------------------------
+void
+Epoch::try_reclaim()
+{
+    DeferredList done;
+    {
+        ScopeLock l(&lock_, "Epoch::try_reclaim");
+        if (deferred_.empty()) {
+            return;
+        }
+
+        u_int32_t e = epoch_.value;
+        if (! drained(e - 1)) {
+            return;
+        }
+        collect(e, &done);
+
+        // what's left was retired in e, so move on to let its readers
+        // drain by the next time around
+        if (! deferred_.empty()) {
+            atomic_incr(&epoch_);
+        }
+    }
+    free_all(done);
+}
+
+//----------------------------------------------------------------------------
+size_t
+Epoch::pending()
+{
+    ScopeLock l(&lock_, "Epoch::pending");
+    return deferred_.size();
+}
+
+//----------------------------------------------------------------------------
+u_int32_t
+Epoch::stripe()
+{
+    size_t id = (size_t)Thread::current();
+    u_int32_t h = (u_int32_t)(id ^ (id >> 16)) * 2654435761U;
+    return (h >> 16) % NSTRIPES;
+}
+
+//----------------------------------------------------------------------------
+bool
+Epoch::drained(u_int32_t parity)
+{
+    // the barrier orders these reads after whatever the caller
+    // published or retired
+    atomic_add_ret(&fence_, 0);
+    for (int i = 0; i < NSTRIPES; ++i) {
+        if (stripes_[i].readers_[parity & 1].value != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+void
+Epoch::wait_for_readers(u_int32_t parity)
+{
+    int nspins = 0;
+    while (! drained(parity)) {
+        if (++nspins > MAX_SPINS) {
+            Thread::spin_yield();
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+Epoch::collect(u_int32_t keep, DeferredList* out)
+{
+    DeferredList::iterator iter = deferred_.begin();
+    while (iter != deferred_.end()) {
+        if (iter->epoch_ != keep) {
+            out->push_back(*iter);
+            iter = deferred_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+Epoch::free_all(const DeferredList& list)
+{
+    for (size_t i = 0; i < list.size(); ++i) {
+        (*list[i].fn_)(list[i].arg_);
+    }
+}
+
+} // namespace oasys
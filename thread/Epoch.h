@@ -0,0 +1,205 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_EPOCH_H_
+#define _OASYS_EPOCH_H_
+
+#include <vector>
+
+#include "AdaptiveLock.h"
+#include "Atomic.h"
+
+namespace oasys {
+
+/**
+ * Epoch-based reclamation, in the style of RCU, for data that is read
+ * far more often than it is written.
+ *
+ * Readers bracket their accesses with read_lock() / read_unlock() (or
+ * a ScopeEpoch), which never blocks and never waits for a writer. A
+ * writer builds a new version of the data, publishes it with a single
+ * pointer store (see publish()), and hands the old version to
+ * defer() or retire(). The old version is freed only once every
+ * reader that might still be looking at it has left its read
+ * section.
+ *
+ * Readers are counted per epoch parity, in stripes on separate cache
+ * lines picked by a hash of the thread id (as in SXLock). Moving to a
+ * new epoch flips the parity new readers count themselves in, so the
+ * readers of the old epoch drain away and can be waited for. Read
+ * sections can nest, but a thread must not call synchronize() from
+ * inside one, since it would wait on itself.
+ *
+ * Writers have to be serialized among themselves by the caller.
+ */
+class Epoch {
+public:
+    /// Function called to free a retired object
+    typedef void (*free_fn_t)(void* arg);
+
+    Epoch();
+
+    /**
+     * Destructor, which waits for the readers and frees everything
+     * that was retired.
+     */
+    ~Epoch();
+
+    /**
+     * Enter a read section.
+     *
+     * @return token to pass to read_unlock()
+     */
+    u_int32_t read_lock() {
+        u_int32_t s = stripe();
+        while (true) {
+            u_int32_t e = epoch_.value;
+            atomic_incr(&stripes_[s].readers_[e & 1]);
+
+            // If the epoch moved on before we were counted, a writer
+            // may already have stopped waiting for that parity, so
+            // count ourselves in the new one instead.
+            if (epoch_.value == e) {
+                return (s << 1) | (e & 1);
+            }
+            atomic_decr(&stripes_[s].readers_[e & 1]);
+        }
+    }
+
+    /// Leave a read section
+    void read_unlock(u_int32_t token) {
+        atomic_decr(&stripes_[token >> 1].readers_[token & 1]);
+    }
+
+    /**
+     * Wait until every reader that is in a read section now has left
+     * it, then free everything that was retired before the call.
+     */
+    void synchronize();
+
+    /**
+     * Arrange for fn(arg) to be called once the current readers are
+     * gone. This never blocks on readers: things retired earlier are
+     * freed here if their readers have drained, and anything left
+     * waits for a later defer(), try_reclaim() or synchronize().
+     */
+    void defer(free_fn_t fn, void* arg);
+
+    /// Delete the object once the current readers are gone
+    template<typename _Type>
+    void retire(_Type* obj) {
+        defer(&delete_obj<_Type>, obj);
+    }
+
+    /**
+     * Free whatever retired objects can be freed without waiting.
+     */
+    void try_reclaim();
+
+    /**
+     * Store a new pointer for readers to pick up, after everything
+     * written to the object it points to.
+     */
+    template<typename _Type>
+    static void publish(_Type* volatile* ptr, _Type* val) {
+        atomic_add_ret(&fence_, 0);
+        *ptr = val;
+    }
+
+    /// The current epoch
+    u_int32_t epoch() const { return epoch_.value; }
+
+    /// The number of retired objects not yet freed
+    size_t pending();
+
+private:
+    enum {
+        NSTRIPES   = 16,    ///< number of reader stripes
+        CACHE_LINE = 64,    ///< assumed size of a cache line
+        MAX_SPINS  = 100    ///< spins before a writer starts yielding
+    };
+
+    /// The reader counts of each parity, alone on a cache line
+    struct Stripe {
+        Stripe() { readers_[0] = 0; readers_[1] = 0; }
+
+        atomic_t readers_[2];
+        char     pad_[CACHE_LINE - 2 * sizeof(atomic_t)];
+    };
+
+    /// An object waiting to be freed
+    struct Deferred {
+        Deferred(free_fn_t fn, void* arg, u_int32_t epoch)
+            : fn_(fn), arg_(arg), epoch_(epoch) {}
+
+        free_fn_t fn_;
+        void*     arg_;
+        u_int32_t epoch_;   ///< epoch it was retired in
+    };
+    typedef std::vector<Deferred> DeferredList;
+
+    char         pad0_[CACHE_LINE]; ///< keeps the stripes off whatever precedes us
+    Stripe       stripes_[NSTRIPES];
+    atomic_t     epoch_;
+    AdaptiveLock lock_;         ///< protects deferred_ and moving the epoch
+    DeferredList deferred_;
+
+    static atomic_t fence_;     ///< target of the barrier in publish()
+
+    /// The stripe for the calling thread
+    static u_int32_t stripe();
+
+    /// Whether no reader is counted in the given parity
+    bool drained(u_int32_t parity);
+
+    /// Wait for the readers of the given parity to leave
+    void wait_for_readers(u_int32_t parity);
+
+    /// Pull out the objects that weren't retired in the given epoch
+    void collect(u_int32_t keep, DeferredList* out);
+
+    /// Call the free functions, outside of the lock
+    static void free_all(const DeferredList& list);
+
+    template<typename _Type>
+    static void delete_obj(void* obj) {
+        delete static_cast<_Type*>(obj);
+    }
+
+    // Not implemented on purpose -- can't copy
+    Epoch(const Epoch&);
+    Epoch& operator=(const Epoch&);
+};
+
+/**
+ * Read section for the lifetime of the object.
+ */
+class ScopeEpoch {
+public:
+    ScopeEpoch(Epoch* epoch)
+        : epoch_(epoch), token_(epoch->read_lock()) {}
+
+    ~ScopeEpoch() { epoch_->read_unlock(token_); }
+
+private:
+    Epoch*    epoch_;
+    u_int32_t token_;
+};
+
+} // namespace oasys
+
+#endif /* _OASYS_EPOCH_H_ */
@@ -0,0 +1,154 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/poll.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "EventNotifier.h"
+#include "io/IO.h"
+
+namespace oasys {
+
+//----------------------------------------------------------------------------
+EventNotifier::EventNotifier(const char* logpath, bool quiet)
+    : Logger("EventNotifier", "%s", logpath),
+      quiet_(quiet)
+{
+    logpath_appendf("/notifier");
+
+#if defined(__linux__) && defined(EFD_NONBLOCK)
+    fds_[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fds_[0] < 0) {
+        PANIC("can't create eventfd for notifier: %s", strerror(errno));
+    }
+    fds_[1] = fds_[0];
+
+    if (!quiet_) {
+        log_debug("created eventfd %d", fds_[0]);
+    }
+#else
+    if (pipe(fds_) != 0) {
+        PANIC("can't create pipe for notifier");
+    }
+
+    if (!quiet_) {
+        log_debug("created pipe, fds: %d %d", fds_[0], fds_[1]);
+    }
+
+    for (int n = 0; n < 2; ++n) {
+        if (IO::set_nonblocking(fds_[n], true, quiet ? 0 : logpath_) != 0)
+        {
+            PANIC("error setting fd %d to nonblocking: %s",
+                  fds_[n], strerror(errno));
+        }
+        fcntl(fds_[n], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+}
+
+//----------------------------------------------------------------------------
+EventNotifier::~EventNotifier()
+{
+    if (!quiet_) {
+        log_debug("EventNotifier shutting down (closing fds %d %d)",
+                  fds_[0], fds_[1]);
+    }
+
+    close(fds_[0]);
+    if (fds_[1] != fds_[0]) {
+        close(fds_[1]);
+    }
+}
+
+//----------------------------------------------------------------------------
+bool
+EventNotifier::wait(int timeout)
+{
+    int ret = IO::poll_single(read_fd(), POLLIN, 0, timeout, 0,
+                              quiet_ ? 0 : logpath_);
+    if (ret == IOTIMEOUT) {
+        return false;
+    }
+
+    if (ret < 0) {
+        PANIC("fatal: error return from notifier poll: %s",
+              strerror(errno));
+    }
+
+    return true;
+}
+
+//----------------------------------------------------------------------------
+void
+EventNotifier::signal()
+{
+#if defined(__linux__) && defined(EFD_NONBLOCK)
+    u_int64_t val = 1;
+    int cc = ::write(fds_[1], &val, sizeof(val));
+#else
+    char b = 0;
+    int cc = ::write(fds_[1], &b, 1);
+#endif
+
+    // EAGAIN means there's already a wakeup pending, which is all
+    // that a signal() has to guarantee
+    if (cc < 0 && errno != EAGAIN && errno != EINTR) {
+        log_err("unexpected error writing to notifier fd %d: %s",
+                fds_[1], strerror(errno));
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+EventNotifier::clear()
+{
+    // a single read resets an eventfd counter; a pipe may have
+    // collected several bytes so keep going until it runs dry
+    char buf[64];
+    while (true) {
+        int cc = ::read(fds_[0], buf, sizeof(buf));
+        if (cc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                log_err("unexpected error reading notifier fd %d: %s",
+                        fds_[0], strerror(errno));
+            }
+            return;
+        }
+
+#if defined(__linux__) && defined(EFD_NONBLOCK)
+        return;
+#else
+        if (cc < static_cast<int>(sizeof(buf))) {
+            return;
+        }
+#endif
+    }
+}
+
+} // namespace oasys
@@ -0,0 +1,81 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_EVENTNOTIFIER_H_
+#define _OASYS_EVENTNOTIFIER_H_
+
+#include "../debug/Log.h"
+#include "../debug/Logger.h"
+
+namespace oasys {
+
+/**
+ * A lock-free, pollable wakeup flag. On Linux this wraps an eventfd,
+ * elsewhere it falls back to a non-blocking pipe.
+ *
+ * Unlike Notifier, no count of notifications is kept: signal() makes
+ * read_fd() readable (repeated calls are harmless) and clear() makes
+ * it unreadable again. Callers are expected to track their own state
+ * (e.g. a queue length) so that signal() is only called on the
+ * transitions that actually need to wake a waiter, and to re-check
+ * that state after clear() to close the obvious race.
+ */
+class EventNotifier : public Logger {
+public:
+    /**
+     * Constructor that takes the logging path and an optional boolean
+     * to suppress all logging.
+     */
+    EventNotifier(const char* logpath, bool keep_quiet = true);
+
+    /**
+     * Destructor
+     */
+    ~EventNotifier();
+
+    /**
+     * Block the calling thread until the notifier is signalled or the
+     * timeout (in milliseconds) elapses. Does not clear the signal.
+     *
+     * Returns true if the thread was notified, false if a timeout
+     * occurred.
+     */
+    bool wait(int timeout = -1);
+
+    /**
+     * Make read_fd() readable.
+     */
+    void signal();
+
+    /**
+     * Drain any pending signal.
+     */
+    void clear();
+
+    /**
+     * The descriptor to poll() on for POLLIN.
+     */
+    int read_fd() { return fds_[0]; }
+
+protected:
+    int  fds_[2]; ///< both are the same descriptor when using eventfd
+    bool quiet_;  ///< no logging
+};
+
+} // namespace oasys
+
+#endif /* _OASYS_EVENTNOTIFIER_H_ */
@@ -19,6 +19,7 @@
 #define _OASYS_LOCK_H_
 
 #include "Atomic.h"
+#include "LockStats.h"
 #include "Thread.h"
 
 #include "../debug/Logger.h"
@@ -41,7 +42,8 @@ public:
           lock_holder_(0),
           lock_holder_name_(0), 
           class_(lock_class),
-          scope_lock_count_(0) 
+          scope_lock_count_(0),
+          stats_(0)
     {}
 
     /**
@@ -50,6 +52,8 @@ public:
      */
     virtual ~Lock()
     {
+        delete stats_;
+
         /* XXX/bowei -- This really should be nothing. */
         /*
         if (is_locked()) 
@@ -119,6 +123,26 @@ public:
         return class_;
     }
 
+    /**
+     * Start keeping contention statistics for this lock, reported
+     * under the given name (or the lock class if NULL). This should
+     * be called before the lock is shared between threads.
+     */
+    void enable_stats(const char* name = NULL)
+    {
+        if (stats_ == NULL) {
+            stats_ = new LockStats(name ? name : class_);
+        }
+    }
+
+    /**
+     * The lock's statistics, or NULL if they're not enabled.
+     */
+    LockStats* stats()
+    {
+        return stats_;
+    }
+
 protected:
     friend class ScopeLock;
     friend class ScopeLockIf;
@@ -160,6 +184,13 @@ protected:
      * tries to unlock it.
      */
     int scope_lock_count_;
+
+    /**
+     * Contention statistics, if enabled. The derived class calls
+     * stats_->acquired() and stats_->released() around the outermost
+     * (non-recursive) hold of the lock.
+     */
+    LockStats* stats_;
 };
 
 /**
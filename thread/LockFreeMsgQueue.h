@@ -0,0 +1,132 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_LOCK_FREE_MSG_QUEUE_H_
+#define _OASYS_LOCK_FREE_MSG_QUEUE_H_
+
+#include "Atomic.h"
+#include "EventNotifier.h"
+#include "Thread.h"
+#include "../debug/Log.h"
+#include "../debug/DebugUtils.h"
+
+namespace oasys {
+
+/**
+ * A bounded, lock-free variant of MsgQueue, implemented as a ring of
+ * sequence-numbered cells. Any number of threads may push() or
+ * try_pop() concurrently without taking a lock.
+ *
+ * The consumer is woken through an EventNotifier (an eventfd on
+ * Linux) which is only signalled when the queue goes from empty to
+ * non-empty, so a burst of messages costs a single system call
+ * instead of one per message. As with MsgQueue, only one thread may
+ * block in pop_blocking() or poll() on read_fd() at a time.
+ *
+ * If the ring is full, push() yields until a slot frees up; use
+ * try_push() to fail instead.
+ */
+template<typename _elt_t>
+class LockFreeMsgQueue : public EventNotifier {
+public:
+    /**
+     * Constructor. The capacity is rounded up to a power of two.
+     */
+    LockFreeMsgQueue(const char* logpath, size_t capacity = 1024);
+
+    /**
+     * Destructor.
+     */
+    ~LockFreeMsgQueue();
+
+    /**
+     * Add msg to the back of the queue, waiting for space if the
+     * queue is full, and wake the consumer if the queue was empty.
+     */
+    void push(const _elt_t& msg);
+
+    /**
+     * Same as push(), for symmetry with MsgQueue.
+     */
+    void push_back(const _elt_t& msg)
+    {
+        push(msg);
+    }
+
+    /**
+     * Try to add msg to the back of the queue, but don't wait for
+     * space. Return true if the message was queued, false if the
+     * queue was full.
+     */
+    bool try_push(const _elt_t& msg);
+
+    /**
+     * Block and pop msg from the queue.
+     */
+    _elt_t pop_blocking();
+
+    /**
+     * Try to pop a msg from the queue, but don't block. Return
+     * true if there was a message on the queue, false otherwise.
+     */
+    bool try_pop(_elt_t* eltp);
+
+    /**
+     * \return Approximate size of the queue.
+     */
+    size_t size()
+    {
+        int32_t n = static_cast<int32_t>(enqueue_pos_.value -
+                                         dequeue_pos_.value);
+        return (n < 0) ? 0 : n;
+    }
+
+    /**
+     * \return Maximum number of queued messages.
+     */
+    size_t capacity() { return mask_ + 1; }
+
+protected:
+    /// A slot in the ring. The sequence number tells producers and
+    /// consumers whose turn it is to use the slot.
+    struct Cell {
+        atomic_t seq_;
+        _elt_t   elt_;
+    };
+
+    bool enqueue(const _elt_t& msg);
+    bool dequeue(_elt_t* eltp);
+    void pushed();
+    void rearm();
+
+    Cell*     cells_;
+    u_int32_t mask_;
+
+    // keep the producer and consumer cursors on separate cache lines
+    char      pad0_[64];
+    atomic_t  enqueue_pos_;
+    char      pad1_[64];
+    atomic_t  dequeue_pos_;
+    char      pad2_[64];
+    atomic_t  count_;	///< number of messages visible to the consumer
+};
+
+#include "LockFreeMsgQueue.tcc"
+
+} // namespace oasys
+
+#endif //_OASYS_LOCK_FREE_MSG_QUEUE_H_
@@ -0,0 +1,194 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*!
+ * \file
+ *
+ * NOTE: This file is included by LockFreeMsgQueue.h and should _not_
+ * be included in the regular Makefile build, see MsgQueue.tcc.
+ */
+
+template<typename _elt_t>
+LockFreeMsgQueue<_elt_t>::LockFreeMsgQueue(const char* logpath,
+                                           size_t capacity)
+    : EventNotifier(logpath),
+      enqueue_pos_(0),
+      dequeue_pos_(0),
+      count_(0)
+{
+    logpath_appendf("/msgqueue");
+
+    u_int32_t n = 2;
+    while (n < capacity) {
+        n <<= 1;
+    }
+    mask_  = n - 1;
+    cells_ = new Cell[n];
+
+    for (u_int32_t i = 0; i < n; ++i) {
+        cells_[i].seq_.value = i;
+    }
+}
+
+template<typename _elt_t>
+LockFreeMsgQueue<_elt_t>::~LockFreeMsgQueue()
+{
+    if (size() != 0)
+    {
+        log_err("not empty at time of destruction, size=%zu", size());
+    }
+
+    delete[] cells_;
+    cells_ = 0;
+}
+
+template<typename _elt_t>
+bool LockFreeMsgQueue<_elt_t>::enqueue(const _elt_t& msg)
+{
+    u_int32_t pos = enqueue_pos_.value;
+    while (true) {
+        Cell* cell = &cells_[pos & mask_];
+        int32_t diff = static_cast<int32_t>(cell->seq_.value - pos);
+
+        if (diff == 0) {
+            u_int32_t prev = atomic_cmpxchg32(&enqueue_pos_, pos, pos + 1);
+            if (prev == pos) {
+                cell->elt_ = msg;
+
+                // publish the slot; the cmpxchg doubles as the
+                // barrier that makes elt_ visible before seq_
+                u_int32_t seq = atomic_cmpxchg32(&cell->seq_, pos, pos + 1);
+                ASSERT(seq == pos);
+                (void)seq;
+                return true;
+            }
+            pos = prev;
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = enqueue_pos_.value;
+        }
+    }
+}
+
+template<typename _elt_t>
+bool LockFreeMsgQueue<_elt_t>::dequeue(_elt_t* eltp)
+{
+    u_int32_t pos = dequeue_pos_.value;
+    while (true) {
+        Cell* cell = &cells_[pos & mask_];
+        int32_t diff = static_cast<int32_t>(cell->seq_.value - (pos + 1));
+
+        if (diff == 0) {
+            u_int32_t prev = atomic_cmpxchg32(&dequeue_pos_, pos, pos + 1);
+            if (prev == pos) {
+                *eltp = cell->elt_;
+                cell->elt_ = _elt_t();
+
+                // hand the slot back to producers for the next lap
+                u_int32_t seq = atomic_cmpxchg32(&cell->seq_, pos + 1,
+                                                 pos + mask_ + 1);
+                ASSERT(seq == pos + 1);
+                (void)seq;
+                return true;
+            }
+            pos = prev;
+        } else if (diff < 0) {
+            return false; // empty
+        } else {
+            pos = dequeue_pos_.value;
+        }
+    }
+}
+
+template<typename _elt_t>
+void LockFreeMsgQueue<_elt_t>::pushed()
+{
+    /*
+     * Only the producer that takes the visible count from zero to
+     * one pays for the wakeup. The count may briefly dip below zero
+     * if the consumer pops a message before its producer gets here,
+     * in which case the producer correctly skips the notification.
+     */
+    if (atomic_incr_ret(&count_) == 1) {
+        signal();
+    }
+}
+
+template<typename _elt_t>
+void LockFreeMsgQueue<_elt_t>::rearm()
+{
+    /*
+     * Drop the pending wakeup, then re-check the count to catch a
+     * producer that raced in between the consumer finding the queue
+     * empty and the clear().
+     */
+    clear();
+    if (static_cast<int32_t>(count_.value) > 0) {
+        signal();
+    }
+}
+
+template<typename _elt_t>
+void LockFreeMsgQueue<_elt_t>::push(const _elt_t& msg)
+{
+    if (! enqueue(msg)) {
+        log_debug("queue full (capacity %zu), waiting for space",
+                  capacity());
+        do {
+            Thread::spin_yield();
+        } while (! enqueue(msg));
+    }
+
+    pushed();
+}
+
+template<typename _elt_t>
+bool LockFreeMsgQueue<_elt_t>::try_push(const _elt_t& msg)
+{
+    if (! enqueue(msg)) {
+        return false;
+    }
+
+    pushed();
+    return true;
+}
+
+template<typename _elt_t>
+_elt_t LockFreeMsgQueue<_elt_t>::pop_blocking()
+{
+    _elt_t elt;
+    while (! try_pop(&elt)) {
+        wait();
+    }
+    return elt;
+}
+
+template<typename _elt_t>
+bool LockFreeMsgQueue<_elt_t>::try_pop(_elt_t* eltp)
+{
+    if (! dequeue(eltp)) {
+        // leave read_fd() unreadable so a poll() loop doesn't spin
+        rearm();
+        return false;
+    }
+
+    if (atomic_decr_test(&count_)) {
+        rearm();
+    }
+
+    return true;
+}
@@ -0,0 +1,137 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <string.h>
+
+#include "LockStats.h"
+#include "SpinLock.h"
+#include "../util/Glob.h"
+#include "../util/StringBuffer.h"
+
+namespace oasys {
+
+LockStats* LockStats::all_stats_ = 0;
+SpinLock   g_all_lock_stats_lock_;
+
+//----------------------------------------------------------------------------
+LockStats::LockStats(const char* name)
+    : acquired_at_(0), prev_(0), next_(0)
+{
+    strncpy(name_, name, sizeof(name_) - 1);
+    name_[sizeof(name_) - 1] = '\0';
+    reset();
+
+    ScopeLock l(&g_all_lock_stats_lock_, "LockStats::LockStats");
+    next_ = all_stats_;
+    if (next_ != 0) {
+        next_->prev_ = this;
+    }
+    all_stats_ = this;
+}
+
+//----------------------------------------------------------------------------
+LockStats::~LockStats()
+{
+    ScopeLock l(&g_all_lock_stats_lock_, "LockStats::~LockStats");
+    if (prev_ != 0) {
+        prev_->next_ = next_;
+    } else {
+        all_stats_ = next_;
+    }
+    if (next_ != 0) {
+        next_->prev_ = prev_;
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+LockStats::reset()
+{
+    acquisitions_  = 0;
+    contended_     = 0;
+    wait_ns_       = 0;
+    max_wait_ns_   = 0;
+    hold_ns_       = 0;
+    max_hold_ns_   = 0;
+    max_hold_user_ = 0;
+    memset(hold_hist_, 0, sizeof(hold_hist_));
+}
+
+//----------------------------------------------------------------------------
+void
+LockStats::dump(StringBuffer* buf) const
+{
+    // copy the counters first since they can change underneath us
+    u_int64_t acquisitions = acquisitions_;
+    u_int64_t contended    = contended_;
+    u_int64_t wait_ns      = wait_ns_;
+    u_int64_t hold_ns      = hold_ns_;
+    const char* max_user   = max_hold_user_;
+
+    buf->appendf("%s: acquisitions %llu contended %llu (%.1f%%) "
+                 "wait %llu us (max %llu us) "
+                 "hold %llu us (avg %llu ns, max %llu us by %s)\n",
+                 name_,
+                 (unsigned long long)acquisitions,
+                 (unsigned long long)contended,
+                 acquisitions ? (100.0 * contended) / acquisitions : 0.0,
+                 (unsigned long long)(wait_ns / 1000),
+                 (unsigned long long)(max_wait_ns_ / 1000),
+                 (unsigned long long)(hold_ns / 1000),
+                 (unsigned long long)(acquisitions ? hold_ns / acquisitions : 0),
+                 (unsigned long long)(max_hold_ns_ / 1000),
+                 max_user ? max_user : "-");
+
+    buf->append("    hold ns:");
+    for (int i = 0; i < NBUCKETS; ++i) {
+        if (hold_hist_[i] != 0) {
+            buf->appendf(" <%llu:%llu",
+                         (unsigned long long)(2ULL << i),
+                         (unsigned long long)hold_hist_[i]);
+        }
+    }
+    buf->append("\n");
+}
+
+//----------------------------------------------------------------------------
+void
+LockStats::dump_all(StringBuffer* buf, const char* pattern)
+{
+    ScopeLock l(&g_all_lock_stats_lock_, "LockStats::dump_all");
+    for (LockStats* s = all_stats_; s != 0; s = s->next_) {
+        if (pattern == 0 || Glob::fixed_glob(pattern, s->name_)) {
+            s->dump(buf);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+LockStats::reset_all(const char* pattern)
+{
+    ScopeLock l(&g_all_lock_stats_lock_, "LockStats::reset_all");
+    for (LockStats* s = all_stats_; s != 0; s = s->next_) {
+        if (pattern == 0 || Glob::fixed_glob(pattern, s->name_)) {
+            s->reset();
+        }
+    }
+}
+
+} // namespace oasys
@@ -0,0 +1,168 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_LOCKSTATS_H_
+#define _OASYS_LOCKSTATS_H_
+
+#include <time.h>
+#include <sys/time.h>
+
+#include "../compat/inttypes.h"
+
+namespace oasys {
+
+class StringBuffer;
+
+/**
+ * Contention statistics for a single Lock, turned on with
+ * Lock::enable_stats(). It counts acquisitions and how many of them
+ * had to wait, how long they waited, and how long the lock was held,
+ * with a histogram of hold times in power of two buckets.
+ *
+ * All the counters are updated by the lock's holder while it still
+ * holds the lock, so they need no atomics of their own and the cost
+ * is two clock reads per acquisition (plus one more when it has to
+ * wait). A lock without stats only pays for a NULL check. Reading
+ * the counters doesn't take the lock, so a dump taken while the lock
+ * is busy may be a little inconsistent, which is fine for profiling.
+ *
+ * Every LockStats is on a global list so that dump_all() can report
+ * on all of them, e.g. from the "debug lock_stats" tcl command.
+ */
+class LockStats {
+public:
+    /// Number of hold time histogram buckets. Bucket i counts holds
+    /// of [2^i, 2^(i+1)) nanoseconds, and the last one everything
+    /// longer.
+    enum { NBUCKETS = 32 };
+
+    LockStats(const char* name);
+    ~LockStats();
+
+    /// The current time in nanoseconds, from a monotonic clock if
+    /// there is one
+    static u_int64_t now()
+    {
+#if defined(__linux__)
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (u_int64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        return (u_int64_t)tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+#endif
+    }
+
+    /**
+     * Called by the lock when it has been acquired (not recursively).
+     *
+     * @param wait_start When the caller started waiting for the lock,
+     *     or 0 if it got the lock right away
+     */
+    void acquired(u_int64_t wait_start)
+    {
+        u_int64_t t = now();
+        acquired_at_ = t;
+        ++acquisitions_;
+        if (wait_start != 0) {
+            ++contended_;
+            u_int64_t wait = t - wait_start;
+            wait_ns_ += wait;
+            if (wait > max_wait_ns_) {
+                max_wait_ns_ = wait;
+            }
+        }
+    }
+
+    /**
+     * Called by the lock just before it is released (not
+     * recursively), with the lock_user that took it.
+     */
+    void released(const char* lock_user)
+    {
+        u_int64_t hold = now() - acquired_at_;
+        hold_ns_ += hold;
+        if (hold > max_hold_ns_) {
+            max_hold_ns_   = hold;
+            max_hold_user_ = lock_user;
+        }
+        ++hold_hist_[bucket(hold)];
+    }
+
+    /// Zero all the counters
+    void reset();
+
+    /// Append a one line summary and the histogram to the buffer
+    void dump(StringBuffer* buf) const;
+
+    /// @{
+    /// Dump or reset the stats of every lock that has them, with an
+    /// optional glob pattern to match against the names
+    static void dump_all(StringBuffer* buf, const char* pattern = 0);
+    static void reset_all(const char* pattern = 0);
+    /// @}
+
+    /// @{ Accessors
+    const char* name()          const { return name_; }
+    u_int64_t   acquisitions()  const { return acquisitions_; }
+    u_int64_t   contended()     const { return contended_; }
+    u_int64_t   wait_ns()       const { return wait_ns_; }
+    u_int64_t   max_wait_ns()   const { return max_wait_ns_; }
+    u_int64_t   hold_ns()       const { return hold_ns_; }
+    u_int64_t   max_hold_ns()   const { return max_hold_ns_; }
+    const char* max_hold_user() const { return max_hold_user_; }
+    u_int64_t   hold_hist(int i) const { return hold_hist_[i]; }
+    /// @}
+
+    /// Histogram bucket for the given number of nanoseconds
+    static int bucket(u_int64_t ns)
+    {
+        int i = 0;
+        while (ns > 1 && i < NBUCKETS - 1) {
+            ns >>= 1;
+            ++i;
+        }
+        return i;
+    }
+
+private:
+    char        name_[64];
+    u_int64_t   acquisitions_;
+    u_int64_t   contended_;
+    u_int64_t   wait_ns_;
+    u_int64_t   max_wait_ns_;
+    u_int64_t   hold_ns_;
+    u_int64_t   max_hold_ns_;
+    const char* max_hold_user_;
+    u_int64_t   acquired_at_;
+    u_int64_t   hold_hist_[NBUCKETS];
+
+    /// Links for the list of all stats
+    LockStats*  prev_;
+    LockStats*  next_;
+
+    static LockStats* all_stats_;
+
+    // Not implemented on purpose -- can't copy
+    LockStats(const LockStats&);
+    LockStats& operator=(const LockStats&);
+};
+
+} // namespace oasys
+
+#endif /* _OASYS_LOCKSTATS_H_ */
@@ -18,16 +18,29 @@
 #ifndef _OASYS_MSG_QUEUE_H_
 #define _OASYS_MSG_QUEUE_H_
 
+#include <iterator>
 #include <queue>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/poll.h>
 
 #include "Notifier.h"
+#include "AdaptiveLock.h"
 #include "SpinLock.h"
 #include "../debug/Log.h"
 #include "../debug/DebugUtils.h"
 
+/**
+ * Under C++11, elements are moved rather than copied in and out of
+ * the queue.
+ */
+#if __cplusplus >= 201103L
+#include <utility>
+#define OASYS_MSGQUEUE_MOVE(_x) std::move(_x)
+#else
+#define OASYS_MSGQUEUE_MOVE(_x) (_x)
+#endif
+
 namespace oasys {
 
 /**
@@ -42,7 +55,7 @@ public:
      * Constructor.
      */
     MsgQueue(const char* logpath, 
-             SpinLock* lock = NULL, 
+             Lock* lock = NULL, 
              bool delete_lock = true);
         
     /**
@@ -54,13 +67,13 @@ public:
      * Atomically add msg to the back of the queue and signal a
      * waiting thread.
      */
-    void push(_elt_t msg, bool at_back = true);
+    void push(const _elt_t& msg, bool at_back = true);
     
     /**
      * Atomically add msg to the front of the queue, and signal
      * waiting threads.
      */
-    void push_front(_elt_t msg)
+    void push_front(const _elt_t& msg)
     {
         push(msg, false);
     }
@@ -69,11 +82,28 @@ public:
      * Atomically add msg to the back of the queue, and signal
      * waiting threads.
      */
-    void push_back(_elt_t msg)
+    void push_back(const _elt_t& msg)
     {
         push(msg, true);
     }
 
+#if __cplusplus >= 201103L
+    /// @{ Move-semantics variants of the above
+    void push(_elt_t&& msg, bool at_back = true);
+    void push_front(_elt_t&& msg) { push(std::move(msg), false); }
+    void push_back(_elt_t&& msg)  { push(std::move(msg), true); }
+    /// @}
+#endif
+
+    /**
+     * Atomically add all the messages in [begin, end) to the back of
+     * the queue, taking the lock once and posting the notifications
+     * for the whole batch with a single write (or none at all if
+     * notify_when_empty() is set and the queue wasn't empty).
+     */
+    template<typename _iterator_t>
+    void push_batch(_iterator_t begin, _iterator_t end);
+
     /**
      * Block and pop msg from the queue.
      */
@@ -84,6 +114,23 @@ public:
      * true if there was a message on the queue, false otherwise.
      */
     bool try_pop(_elt_t* eltp);
+
+    /**
+     * Pop up to max messages (0 means all of them) into the given
+     * container with a single lock acquisition, without blocking.
+     * The container must support push_back().
+     *
+     * @return The number of messages popped.
+     */
+    template<typename _container_t>
+    size_t drain_into(_container_t* container, size_t max = 0);
+
+    /**
+     * Same as drain_into() but blocks until there is at least one
+     * message on the queue.
+     */
+    template<typename _container_t>
+    size_t pop_all(_container_t* container, size_t max = 0);
     
     /**
      * \return Size of the queue.
@@ -109,7 +156,15 @@ public:
     void notify_when_empty();
 
 protected:
-    SpinLock*          lock_;
+    /**
+     * Pop up to max messages into container with the lock held,
+     * fixing up the pipe to match. used_wait indicates that the
+     * caller already consumed one notification in wait().
+     */
+    template<typename _container_t>
+    size_t pop_locked(_container_t* container, size_t max, bool used_wait);
+
+    Lock*              lock_;
     std::deque<_elt_t> queue_;
     bool               delete_lock_;
     bool               notify_when_empty_;
@@ -28,7 +28,7 @@
  */
 
 template<typename _elt_t>
-MsgQueue<_elt_t>::MsgQueue(const char* logpath, SpinLock* lock, bool delete_lock)
+MsgQueue<_elt_t>::MsgQueue(const char* logpath, Lock* lock, bool delete_lock)
     : Notifier(logpath), delete_lock_(delete_lock), notify_when_empty_(false)
 {
     logpath_appendf("/msgqueue");
@@ -36,7 +36,7 @@ MsgQueue<_elt_t>::MsgQueue(const char* logpath, SpinLock* lock, bool delete_lock
     if (lock != NULL) {
         lock_ = lock;
     } else {
-        lock_ = new SpinLock();
+        lock_ = new AdaptiveLock();
     }
 }
 
@@ -56,7 +56,7 @@ MsgQueue<_elt_t>::~MsgQueue()
 }
 
 template<typename _elt_t> 
-void MsgQueue<_elt_t>::push(_elt_t msg, bool at_back)
+void MsgQueue<_elt_t>::push(const _elt_t& msg, bool at_back)
 {
     ScopeLock l(lock_, "MsgQueue::push");
 
@@ -78,6 +78,66 @@ void MsgQueue<_elt_t>::push(_elt_t msg, bool at_back)
         queue_.push_front(msg);
 }
 
+#if __cplusplus >= 201103L
+template<typename _elt_t> 
+void MsgQueue<_elt_t>::push(_elt_t&& msg, bool at_back)
+{
+    ScopeLock l(lock_, "MsgQueue::push");
+
+    // see above
+    if (notify_when_empty_ == false || queue_.empty()) {
+        notify(lock_);
+    }
+    
+    if (at_back)
+        queue_.push_back(std::move(msg));
+    else
+        queue_.push_front(std::move(msg));
+}
+#endif
+
+template<typename _elt_t> 
+template<typename _iterator_t>
+void MsgQueue<_elt_t>::push_batch(_iterator_t begin, _iterator_t end)
+{
+    if (begin == end) {
+        return;
+    }
+    
+    ScopeLock l(lock_, "MsgQueue::push_batch");
+
+    if (notify_when_empty_) {
+        if (queue_.empty()) {
+            notify(lock_);
+        }
+        queue_.insert(queue_.end(), begin, end);
+        return;
+    }
+
+    /*
+     * As in push(), the notifications have to be in the pipe before
+     * the messages go on the queue. Post as many as the pipe will
+     * take in one write and queue that many messages. If the pipe is
+     * full, fall back to notify(), which drops the lock while waiting
+     * for the consumer to catch up, but only after everything posted
+     * so far is consistent.
+     */
+    size_t remaining = std::distance(begin, end);
+    while (remaining != 0) {
+        size_t posted = try_notify(remaining);
+        if (posted == 0) {
+            notify(lock_);
+            posted = 1;
+        }
+
+        for (size_t i = 0; i < posted; ++i) {
+            queue_.push_back(*begin);
+            ++begin;
+        }
+        remaining -= posted;
+    }
+}
+
 template<typename _elt_t> 
 _elt_t MsgQueue<_elt_t>::pop_blocking()
 {
@@ -100,7 +160,7 @@ _elt_t MsgQueue<_elt_t>::pop_blocking()
      */
     ASSERT(!queue_.empty());
 
-    _elt_t elt  = queue_.front();
+    _elt_t elt  = OASYS_MSGQUEUE_MOVE(queue_.front());
     queue_.pop_front();
     
     if (!used_wait && (notify_when_empty_ == false || queue_.empty())) {
@@ -121,7 +181,7 @@ bool MsgQueue<_elt_t>::try_pop(_elt_t* eltp)
     }
     
     // but if there is something in the queue, then return it
-    *eltp = queue_.front();
+    *eltp = OASYS_MSGQUEUE_MOVE(queue_.front());
     queue_.pop_front();
     
     if (notify_when_empty_ == false || queue_.empty()) {
@@ -131,6 +191,62 @@ bool MsgQueue<_elt_t>::try_pop(_elt_t* eltp)
     return true;
 }
 
+template<typename _elt_t> 
+template<typename _container_t>
+size_t MsgQueue<_elt_t>::pop_locked(_container_t* container, size_t max,
+                                    bool used_wait)
+{
+    ASSERT(lock_->is_locked_by_me());
+    
+    size_t n = 0;
+    while (!queue_.empty() && (max == 0 || n < max)) {
+        container->push_back(OASYS_MSGQUEUE_MOVE(queue_.front()));
+        queue_.pop_front();
+        ++n;
+    }
+
+    if (notify_when_empty_) {
+        // the pipe should hold a byte iff the queue is non-empty
+        if (!used_wait && n != 0 && queue_.empty()) {
+            drain_pipe(1);
+        } else if (used_wait && !queue_.empty()) {
+            notify(lock_);
+        }
+    } else {
+        size_t to_drain = used_wait ? n - 1 : n;
+        if (to_drain != 0) {
+            drain_pipe(to_drain);
+        }
+    }
+    
+    return n;
+}
+
+template<typename _elt_t> 
+template<typename _container_t>
+size_t MsgQueue<_elt_t>::drain_into(_container_t* container, size_t max)
+{
+    ScopeLock l(lock_, "MsgQueue::drain_into");
+    return pop_locked(container, max, false);
+}
+
+template<typename _elt_t> 
+template<typename _container_t>
+size_t MsgQueue<_elt_t>::pop_all(_container_t* container, size_t max)
+{
+    ScopeLock l(lock_, "MsgQueue::pop_all");
+
+    bool used_wait = false;
+    if (queue_.empty()) {
+        wait(lock_);
+        ASSERT(lock_->is_locked_by_me());
+        used_wait = true;
+    }
+
+    ASSERT(!queue_.empty());
+    return pop_locked(container, max, used_wait);
+}
+
 template <typename _elt_t>
 void MsgQueue<_elt_t>::notify_when_empty()
 {
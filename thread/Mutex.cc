@@ -88,7 +88,18 @@ Mutex::~Mutex()
 int
 Mutex::lock(const char* lock_user)
 {
-    int err = pthread_mutex_lock(&mutex_);
+    // With stats on, try first to find out whether we have to wait
+    int err;
+    u_int64_t wait_start = 0;
+    if (stats_ != NULL) {
+        err = pthread_mutex_trylock(&mutex_);
+        if (err == EBUSY) {
+            wait_start = LockStats::now();
+            err = pthread_mutex_lock(&mutex_);
+        }
+    } else {
+        err = pthread_mutex_lock(&mutex_);
+    }
 
 #if OASYS_DEBUG_LOCKING_ENABLED
     if (Thread::lock_debugger() != NULL ) {
@@ -108,6 +119,10 @@ Mutex::lock(const char* lock_user)
     
     lock_holder_      = Thread::current();
     lock_holder_name_ = lock_user;
+
+    if (stats_ != NULL && lock_count_.value == 1) {
+        stats_->acquired(wait_start);
+    }
     
     return err;
 }
@@ -117,6 +132,10 @@ Mutex::unlock()
 {
     ASSERT(is_locked_by_me());
 
+    if (stats_ != NULL && lock_count_.value == 1) {
+        stats_->released(lock_holder_name_);
+    }
+
     if (--lock_count_.value == 0) {
         lock_holder_      = 0;
         lock_holder_name_ = 0;
@@ -167,6 +186,10 @@ Mutex::try_lock(const char* lock_user)
         log_debug("try_lock locked (count %u)", lock_count_.value);
     lock_holder_      = Thread::current();
     lock_holder_name_ = lock_user;
+
+    if (stats_ != NULL && lock_count_.value == 1) {
+        stats_->acquired(0);
+    }
     return 0;
 }
 
@@ -146,7 +146,7 @@ Notifier::drain_pipe(size_t bytes)
 }
 
 bool
-Notifier::wait(SpinLock* lock, int timeout, bool drain_the_pipe)
+Notifier::wait(Lock* lock, int timeout, bool drain_the_pipe)
 {
     if (waiter_) {
         PANIC("Notifier doesn't support multiple waiting threads");
@@ -191,7 +191,7 @@ Notifier::wait(SpinLock* lock, int timeout, bool drain_the_pipe)
 }
 
 void
-Notifier::notify(SpinLock* lock)
+Notifier::notify(Lock* lock)
 {
         atomic_incr(&busy_notifiers_);
     char b = 0;
@@ -263,4 +263,36 @@ Notifier::notify(SpinLock* lock)
     atomic_decr(&busy_notifiers_);
 }
 
+size_t
+Notifier::try_notify(size_t count)
+{
+    atomic_incr(&busy_notifiers_);
+    
+    char buf[256];
+    memset(buf, 0, sizeof(buf));
+    
+    size_t posted = 0;
+    while (posted < count) {
+        int ret = ::write(write_fd(), buf,
+                          std::min(sizeof(buf), count - posted));
+        if (ret <= 0) {
+            if (ret < 0 && errno != EAGAIN) {
+                log_err("unexpected error writing to pipe fd %d: %s",
+                        write_fd(), strerror(errno));
+            }
+            break;
+        }
+        posted += ret;
+    }
+    
+    count_ += posted;
+    if (!quiet_) {
+        log_debug("try_notify posted %zu/%zu, count = %d",
+                  posted, count, count_);
+    }
+    
+    atomic_decr(&busy_notifiers_);
+    return posted;
+}
+
 } // namespace oasys
@@ -23,8 +23,6 @@
 
 namespace oasys {
 
-class SpinLock;
-
 /**
  * Thread notification abstraction that wraps an underlying pipe. This
  * can be used as a generic abstraction to pass messages between
@@ -60,7 +58,7 @@ public:
      * Returns true if the thread was notified, false if a timeout
      * occurred.
      */
-    bool wait(SpinLock* lock      = NULL, 
+    bool wait(Lock* lock          = NULL, 
               int timeout         = -1, 
               bool drain_the_pipe = true);
 
@@ -72,7 +70,16 @@ public:
      * will unlock the given lock (if any) and will block until the
      * notification ends up in the pipe.
      */
-    void notify(SpinLock* lock = NULL);
+    void notify(Lock* lock = NULL);
+
+    /**
+     * Post up to count notifications with a single write to the
+     * pipe. Unlike notify(), this never blocks or releases a lock.
+     *
+     * @return The number of notifications actually posted, which may
+     *     be less than count (or zero) if the pipe is full.
+     */
+    size_t try_notify(size_t count);
 
     /**
      * @param bytes Drain this many bytes from the pipe. 0 means to
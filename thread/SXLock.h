@@ -17,47 +17,60 @@
 #ifndef __RWLOCK_H__
 #define __RWLOCK_H__
 
-#include <cstdio>
+#include <cstddef>
 
+#include "AdaptiveLock.h"
+#include "Atomic.h"
 #include "Lock.h"
-#include "SpinLock.h"
-#include "Mutex.h"
+#include "Thread.h"
 
 namespace oasys {
 
 /*!
- * Lock with shared and exclusive semantics.
+ * Lock with shared and exclusive semantics, for data that is read
+ * far more often than it is written.
  *
- * XXX/bowei -- convert this to use atomic instructions directly
+ * Readers are counted in several stripes, each on its own cache line
+ * and picked by a hash of the thread id, so that readers on different
+ * cpus don't all bounce the same line. Taking the shared lock is an
+ * atomic increment of the reader's stripe and a check that no writer
+ * is around.
+ *
+ * Writers are serialized by an inner lock. A writer first announces
+ * itself, which turns away new readers, and then waits for the
+ * stripes to drain. That gives writers preference: a steady stream
+ * of readers can't hold off an update. Readers that are turned away
+ * sleep on the writer's inner lock until the writer is done.
+ *
+ * The exclusive lock is recursive, and a thread holding it can also
+ * take the shared lock. The shared lock is not recursive, though: a
+ * reader that takes it again while a writer is waiting deadlocks
+ * with the writer.
  */
 class SXLock {
 public:
-    SXLock(Lock* lock)
-        : lock_(lock),
-          scount_(0),
-          xcount_(0)
+    SXLock(const char* classname = "SXLock")
+        : writer_(0),
+          xcount_(0),
+          writer_lock_(classname)
     {}
 
     /*! 
      * Acquire a shared lock. Any number of readers are permitted
      * inside a shared lock.
      */
-    void shared_lock() {
-        lock_->lock();
-        while (xcount_ > 0) {
-            lock_->unlock();
-            Thread::spin_yield();
-            lock_->lock();
+    void shared_lock(const char* lock_user = "SXLock::shared_lock") {
+        (void)lock_user;
+        Stripe* s = &stripes_[stripe()];
+        atomic_incr(&s->readers_);
+        if (writer_.value != 0) {
+            shared_lock_contended(s);
         }
-        ++scount_;
-        lock_->unlock();
     }
 
     //! Drop the shared lock.
     void shared_unlock() {
-        lock_->lock();
-        --scount_;
-        lock_->unlock();
+        atomic_decr(&stripes_[stripe()].readers_);
     }
 
     /*! 
@@ -65,47 +78,91 @@ public:
      * the write lock. No readers are allowed inside when the write
      * lock is held.
      */
-    void exclusive_lock() {
-        lock_->lock();
-        while (xcount_ > 0 && scount_ > 0) {
-            lock_->unlock();
-            Thread::spin_yield();
-            lock_->lock();
+    void exclusive_lock(const char* lock_user = "SXLock::exclusive_lock") {
+        writer_lock_.lock(lock_user);
+        if (++xcount_ > 1) {
+            return;
         }
-        ++xcount_;
 
-        if (xcount_ != 1) {
-            fprintf(stderr, "more than 1 writer (%d writers) entered lock!!", 
-                    xcount_);
-            exit(-1);
+        // The atomic increment orders this before the reads of the
+        // stripes, just as readers check writer_ after incrementing
+        // their stripe, so either the reader sees us or we see it.
+        atomic_incr(&writer_);
+        for (int i = 0; i < NSTRIPES; ++i) {
+            int nspins = 0;
+            while (stripes_[i].readers_.value != 0) {
+                if (++nspins > MAX_SPINS) {
+                    Thread::spin_yield();
+                }
+            }
         }
-
-        lock_->unlock();
     }
 
     //! Drop the write lock.
     void exclusive_unlock() {
-        lock_->lock();
-
-        --xcount_;
-        if (xcount_ != 0) {
-            fprintf(stderr, "more than 1 writer (%d writers) entered lock!!", 
-                    xcount_);
-            exit(-1);
+        ASSERT(writer_lock_.is_locked_by_me());
+        if (--xcount_ == 0) {
+            atomic_decr(&writer_);
         }
+        writer_lock_.unlock();
+    }
 
-        lock_->unlock();        
+    //! Check whether the calling thread holds the write lock
+    bool is_exclusive_locked_by_me() {
+        return writer_lock_.is_locked_by_me();
     }
-    
+
 private:
-    Lock* lock_;
+    enum {
+        NSTRIPES   = 16,    ///< number of reader stripes
+        CACHE_LINE = 64,    ///< assumed size of a cache line
+        MAX_SPINS  = 100    ///< spins before a writer starts yielding
+    };
+
+    /// A reader count alone on its cache line
+    struct Stripe {
+        Stripe() : readers_(0) {}
+
+        atomic_t readers_;
+        char     pad_[CACHE_LINE - sizeof(atomic_t)];
+    };
+
+    char         pad0_[CACHE_LINE]; ///< keeps the stripes off whatever precedes us
+    Stripe       stripes_[NSTRIPES];
+    atomic_t     writer_;       ///< nonzero while a writer holds or wants the lock
+    int          xcount_;       ///< recursion count of the writer
+    AdaptiveLock writer_lock_;  ///< serializes writers, and readers wait on it
+
+    /// The stripe for the calling thread
+    static int stripe() {
+        size_t id = (size_t)Thread::current();
+        u_int32_t h = (u_int32_t)(id ^ (id >> 16)) * 2654435761U;
+        return (h >> 16) % NSTRIPES;
+    }
+
+    /// Wait for the writer to finish, without holding up the writer
+    void shared_lock_contended(Stripe* s) {
+        // a writer can read what it's holding
+        if (writer_lock_.is_locked_by_me()) {
+            return;
+        }
+
+        do {
+            atomic_decr(&s->readers_);
+            writer_lock_.lock("SXLock::shared_lock");
+            writer_lock_.unlock();
+            atomic_incr(&s->readers_);
+        } while (writer_.value != 0);
+    }
 
-    int scount_;
-    int xcount_;
+    // Not implemented on purpose -- can't copy
+    SXLock(const SXLock&);
+    SXLock& operator=(const SXLock&);
 };
 
 #define SCOPE_LOCK_DEFUN(_name, _fcn)                   \
 class ScopeLock_ ## _name {                             \
+public:                                                 \
     ScopeLock_ ## _name (SXLock*     rw_lock,           \
                          const char* lock_user)         \
         : rw_lock_(rw_lock)                             \
@@ -131,7 +188,7 @@ private:                                                \
     SXLock* rw_lock_;                                   \
                                                         \
     void do_lock(const char* lock_user) {               \
-        rw_lock_->_fcn ## _lock();                      \
+        rw_lock_->_fcn ## _lock(lock_user);             \
     }                                                   \
                                                         \
     void do_unlock() {                                  \
@@ -142,8 +199,8 @@ private:                                                \
 /*! @{ 
  * Define ScopeLock_Shared and ScopeLock_Exclusive.
  */
-SCOPE_LOCK_DEFUN(Shared,    shared);
-SCOPE_LOCK_DEFUN(Exclusive, exclusive);
+SCOPE_LOCK_DEFUN(Shared,    shared)
+SCOPE_LOCK_DEFUN(Exclusive, exclusive)
 //! @}
 #undef SCOPE_LOCK_DEFUN
 
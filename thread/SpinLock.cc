@@ -52,8 +52,12 @@ SpinLock::lock(const char* lock_user)
     
     int nspins = 0;
     (void)nspins;
+    u_int64_t wait_start = 0;
     while (atomic_cmpxchg32(&lock_count_, 0, 1) != 0)
     {
+        if (stats_ != NULL && wait_start == 0) {
+            wait_start = LockStats::now();
+        }
         Thread::spin_yield();
         
 #ifndef NDEBUG
@@ -75,6 +79,10 @@ SpinLock::lock(const char* lock_user)
     lock_holder_      = Thread::current();
     lock_holder_name_ = lock_user;
 
+    if (stats_ != NULL) {
+        stats_->acquired(wait_start);
+    }
+
 #if OASYS_DEBUG_LOCKING_ENABLED
     if (Thread::lock_debugger() != NULL ) {
         Thread::lock_debugger()->add_lock(this);  // Only do this if the calling
@@ -112,6 +120,10 @@ SpinLock::unlock()
     }
 #endif
 
+    if (stats_ != NULL) {
+        stats_->released(lock_holder_name_);
+    }
+
     lock_holder_      = 0;
     lock_holder_name_ = 0;
     lock_count_.value = 0;
@@ -132,10 +144,19 @@ SpinLock::try_lock(const char* lock_user)
 {
     if (is_locked_by_me()) {
         lock_count_.value++;
+
+#if OASYS_DEBUG_LOCKING_ENABLED
+        if (Thread::lock_debugger() != NULL ) {
+            Thread::lock_debugger()->add_lock(this);  // Only do this if the calling
+                                                      // thread is an oasys thread.
+        }
+#endif
+
         return 0;
     }
 
-    int got_lock = atomic_cmpxchg32(&lock_count_, 0, 1);
+    // cmpxchg returns the old value, so zero means we got it
+    bool got_lock = (atomic_cmpxchg32(&lock_count_, 0, 1) == 0);
     
     if (got_lock) 
     {
@@ -144,7 +165,11 @@ SpinLock::try_lock(const char* lock_user)
         lock_holder_      = Thread::current();
         lock_holder_name_ = lock_user;
 
-#ifdef OASYS_DEBUG_LOCKING_ENABLED
+        if (stats_ != NULL) {
+            stats_->acquired(0);
+        }
+
+#if OASYS_DEBUG_LOCKING_ENABLED
         // Thread::lock_debugger()->add_lock(this);
         if (Thread::lock_debugger() != NULL ) {
             Thread::lock_debugger()->add_lock(this);  // Only do this if the calling
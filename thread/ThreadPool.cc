@@ -0,0 +1,422 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <deque>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "AdaptiveLock.h"
+#include "ThreadPool.h"
+
+namespace oasys {
+
+#if HAVE_PTHREAD_SETSPECIFIC
+/*
+ * Each worker thread points this key at its Worker, so that submit()
+ * can tell when it's called from one of the pool's own tasks.
+ */
+static pthread_key_t  thread_pool_key;
+static pthread_once_t thread_pool_key_once = PTHREAD_ONCE_INIT;
+
+static void
+create_thread_pool_key()
+{
+    ::pthread_key_create(&thread_pool_key, 0);
+}
+#endif
+
+//----------------------------------------------------------------------------
+void
+ThreadPoolTask::finished()
+{
+    if (done_queue_ != NULL) {
+        done_queue_->push_back(this);
+    } else {
+        delete this;
+    }
+}
+
+//----------------------------------------------------------------------------
+ThreadPoolFuture::ThreadPoolFuture()
+    : done_(0), notifier_("/thread_pool/future", true)
+{
+}
+
+//----------------------------------------------------------------------------
+bool
+ThreadPoolFuture::wait(int timeout)
+{
+    if (is_done()) {
+        return true;
+    }
+
+    if (! notifier_.wait(NULL, timeout)) {
+        return is_done();
+    }
+
+    // finished() sets the flag right after the notification
+    while (! is_done()) {
+        Thread::spin_yield();
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+void
+ThreadPoolFuture::finished()
+{
+    // Notify before setting the flag, since the waiter may delete
+    // the future as soon as it sees the flag
+    notifier_.notify();
+    atomic_incr(&done_);
+}
+
+/**
+ * One of the pool's threads, with its deque of tasks.
+ */
+class ThreadPool::Worker : public Thread {
+public:
+    Worker(ThreadPool* pool, size_t index)
+        : Thread("ThreadPool::Worker", CREATE_JOINABLE),
+          pool_(pool), index_(index),
+          lock_("ThreadPool::Worker"),
+          notifier_("/thread_pool/worker", true),
+          sleeping_(0) {}
+
+    ThreadPool*                 pool_;
+    size_t                      index_;
+    AdaptiveLock                lock_;      ///< protects deque_
+    std::deque<ThreadPoolTask*> deque_;
+    Notifier                    notifier_;  ///< to wake the worker
+    atomic_t                    sleeping_;  ///< 1 while waiting on notifier_
+
+protected:
+    void run() { pool_->work(this); }
+};
+
+//----------------------------------------------------------------------------
+ThreadPool::ThreadPool(const char* logpath, int nthreads, bool affinity)
+    : Logger("ThreadPool", "%s", logpath),
+      affinity_(affinity),
+      started_(false),
+      stopping_(false),
+      next_worker_(0),
+      queued_(0),
+      sleeping_(0),
+      tasks_run_(0),
+      steals_(0)
+{
+    if (nthreads <= 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (ncpus > 0) ? (int)ncpus : 1;
+    }
+
+    for (int i = 0; i < nthreads; ++i) {
+        workers_.push_back(new Worker(this, i));
+    }
+}
+
+//----------------------------------------------------------------------------
+ThreadPool::~ThreadPool()
+{
+    shutdown();
+
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        delete workers_[i];
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+ThreadPool::start()
+{
+    ASSERT(! started_);
+    started_ = true;
+
+    log_debug("starting %zu workers", workers_.size());
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->start();
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+ThreadPool::submit(ThreadPoolTask* task)
+{
+    ASSERT(! stopping_ || current() == this);
+
+    Worker* w = current_worker();
+    if (w == NULL || w->pool_ != this) {
+        w = workers_[atomic_incr_ret(&next_worker_) % workers_.size()];
+    }
+
+    // Count the task before it's visible in the deque, so queued_ is
+    // never less than the number a worker could find
+    atomic_incr(&queued_);
+    {
+        ScopeLock l(&w->lock_, "ThreadPool::submit");
+        w->deque_.push_back(task);
+    }
+
+    // The read has to be atomic to order it after the push, since a
+    // worker going to sleep bumps sleeping_ and then checks queued_.
+    if (atomic_add_ret(&sleeping_, 0) != 0) {
+        wake_one(w->index_);
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+ThreadPool::shutdown()
+{
+    if (stopping_) {
+        return;
+    }
+    stopping_ = true;
+
+    if (! started_) {
+        run_queued();
+        return;
+    }
+
+    log_debug("shutting down, %u tasks queued", queued_.value);
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->notifier_.notify();
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->join();
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+ThreadPool::run_queued()
+{
+    log_debug("shutting down before start, running %u tasks", queued_.value);
+
+    // Stand in for the first worker, so the tasks see this as their
+    // pool and can submit more
+#if HAVE_PTHREAD_SETSPECIFIC
+    ::pthread_once(&thread_pool_key_once, create_thread_pool_key);
+    void* prev = ::pthread_getspecific(thread_pool_key);
+    ::pthread_setspecific(thread_pool_key, workers_[0]);
+#endif
+
+    ThreadPoolTask* task;
+    while ((task = get_task(workers_[0])) != NULL) {
+        task->run();
+        atomic_incr(&tasks_run_);
+        task->finished();
+    }
+
+#if HAVE_PTHREAD_SETSPECIFIC
+    ::pthread_setspecific(thread_pool_key, prev);
+#endif
+}
+
+//----------------------------------------------------------------------------
+ThreadPool*
+ThreadPool::current()
+{
+    Worker* w = current_worker();
+    return (w != NULL) ? w->pool_ : NULL;
+}
+
+//----------------------------------------------------------------------------
+ThreadPool::Worker*
+ThreadPool::current_worker()
+{
+#if HAVE_PTHREAD_SETSPECIFIC
+    ::pthread_once(&thread_pool_key_once, create_thread_pool_key);
+    return reinterpret_cast<Worker*>(::pthread_getspecific(thread_pool_key));
+#else
+    return NULL;
+#endif
+}
+
+//----------------------------------------------------------------------------
+void
+ThreadPool::work(Worker* w)
+{
+#if HAVE_PTHREAD_SETSPECIFIC
+    ::pthread_once(&thread_pool_key_once, create_thread_pool_key);
+    ::pthread_setspecific(thread_pool_key, w);
+#endif
+
+#if defined(__linux__) && defined(CPU_SET)
+    if (affinity_) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(w->index_ % (ncpus > 0 ? ncpus : 1), &cpus);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (err != 0) {
+            log_warn("error setting affinity of worker %zu: %s",
+                     w->index_, strerror(err));
+        }
+    }
+#endif
+
+    while (true) {
+        ThreadPoolTask* task = get_task(w);
+        if (task != NULL) {
+            task->run();
+            atomic_incr(&tasks_run_);
+            task->finished();
+            continue;
+        }
+
+        // Everything has run, since tasks are only submitted during
+        // shutdown by other tasks, whose workers are still going
+        if (stopping_ && queued_.value == 0) {
+            break;
+        }
+
+        sleep(w);
+    }
+
+#if HAVE_PTHREAD_SETSPECIFIC
+    ::pthread_setspecific(thread_pool_key, NULL);
+#endif
+}
+
+//----------------------------------------------------------------------------
+ThreadPoolTask*
+ThreadPool::get_task(Worker* w)
+{
+    ThreadPoolTask* task = NULL;
+    {
+        ScopeLock l(&w->lock_, "ThreadPool::get_task");
+        if (! w->deque_.empty()) {
+            task = w->deque_.back();
+            w->deque_.pop_back();
+        }
+    }
+
+    if (task == NULL) {
+        task = steal(w);
+    }
+
+    if (task != NULL) {
+        atomic_decr(&queued_);
+    }
+    return task;
+}
+
+//----------------------------------------------------------------------------
+ThreadPoolTask*
+ThreadPool::steal(Worker* thief)
+{
+    size_t n = workers_.size();
+    std::vector<ThreadPoolTask*> stolen;
+
+    for (size_t i = 1; i < n && stolen.empty(); ++i) {
+        Worker* victim = workers_[(thief->index_ + i) % n];
+
+        ScopeLock l(&victim->lock_, "ThreadPool::steal");
+        size_t count = (victim->deque_.size() + 1) / 2;
+        for (size_t j = 0; j < count; ++j) {
+            stolen.push_back(victim->deque_.front());
+            victim->deque_.pop_front();
+        }
+    }
+
+    if (stolen.empty()) {
+        return NULL;
+    }
+
+    atomic_incr(&steals_);
+
+    // run the oldest one now, and keep the rest in the same order
+    if (stolen.size() > 1) {
+        ScopeLock l(&thief->lock_, "ThreadPool::steal");
+        thief->deque_.insert(thief->deque_.begin(),
+                             stolen.begin() + 1, stolen.end());
+    }
+    return stolen[0];
+}
+
+//----------------------------------------------------------------------------
+void
+ThreadPool::sleep(Worker* w)
+{
+    w->sleeping_.value = 1;
+    atomic_incr(&sleeping_);
+
+    // Check again, now that a submit is sure to see that we're
+    // asleep. If there turns out to be work, take back the sleeping
+    // flag, unless a waker got to it first, in which case there is a
+    // notification on its way that has to be eaten.
+    if ((atomic_add_ret(&queued_, 0) != 0) || stopping_) {
+        if (atomic_cmpxchg32(&w->sleeping_, 1, 0) == 1) {
+            atomic_decr(&sleeping_);
+            return;
+        }
+    }
+
+    w->notifier_.wait();
+
+    // shutdown() notifies without clearing the flag
+    if (atomic_cmpxchg32(&w->sleeping_, 1, 0) == 1) {
+        atomic_decr(&sleeping_);
+    }
+}
+
+//----------------------------------------------------------------------------
+void
+ThreadPool::wake_one(size_t hint)
+{
+    size_t n = workers_.size();
+    for (size_t i = 0; i < n; ++i) {
+        Worker* w = workers_[(hint + i) % n];
+        if (atomic_cmpxchg32(&w->sleeping_, 1, 0) == 1) {
+            atomic_decr(&sleeping_);
+            w->notifier_.notify();
+            return;
+        }
+    }
+}
+
+/**
+ * The task that a ThreadPoolTimer submits when it fires.
+ */
+class ThreadPoolTimerTask : public ThreadPoolTask {
+public:
+    ThreadPoolTimerTask(ThreadPoolTimer* timer, const struct timeval& now)
+        : timer_(timer), now_(now) {}
+
+    void run() { timer_->pool_timeout(now_); }
+
+private:
+    ThreadPoolTimer* timer_;
+    struct timeval   now_;
+};
+
+//----------------------------------------------------------------------------
+void
+ThreadPoolTimer::timeout(const struct timeval& now)
+{
+    pool_->submit(new ThreadPoolTimerTask(this, now));
+}
+
+} // namespace oasys
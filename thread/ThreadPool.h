@@ -0,0 +1,221 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_THREADPOOL_H_
+#define _OASYS_THREADPOOL_H_
+
+#include <vector>
+
+#include "../debug/Logger.h"
+#include "Atomic.h"
+#include "MsgQueue.h"
+#include "Notifier.h"
+#include "Thread.h"
+#include "Timer.h"
+
+namespace oasys {
+
+class ThreadPool;
+
+/**
+ * A unit of work to run on a ThreadPool. Derived classes override
+ * run(), which is called once on one of the pool's threads.
+ *
+ * By default the pool deletes the task after it has run. If the task
+ * was given a done queue, the pool instead pushes the task onto that
+ * queue, which wakes up whatever thread is waiting on the queue (a
+ * MsgQueue being a Notifier) to pick up the result and delete it.
+ */
+class ThreadPoolTask {
+public:
+    typedef MsgQueue<ThreadPoolTask*> DoneQueue;
+
+    ThreadPoolTask(DoneQueue* done_queue = NULL)
+        : done_queue_(done_queue) {}
+
+    virtual ~ThreadPoolTask() {}
+
+    /// The work to do
+    virtual void run() = 0;
+
+protected:
+    friend class ThreadPool;
+
+    /// Called by the pool after run() returns
+    virtual void finished();
+
+    DoneQueue* done_queue_;
+};
+
+/**
+ * A task that the submitter can wait on. The pool doesn't delete a
+ * future; whoever submitted it does, once wait() has returned true.
+ *
+ * Each future has its own Notifier (i.e. a pipe), so they are meant
+ * for coarse pieces of work, not for every small task.
+ */
+class ThreadPoolFuture : public ThreadPoolTask {
+public:
+    ThreadPoolFuture();
+
+    /**
+     * Block until the task has run, or for at most timeout ms.
+     *
+     * @return true if the task has run, false on timeout
+     */
+    bool wait(int timeout = -1);
+
+    /// Whether the task has run yet
+    bool is_done() { return done_.value != 0; }
+
+protected:
+    void finished();
+
+    atomic_t done_;
+    Notifier notifier_;
+};
+
+/**
+ * A fixed set of threads running ThreadPoolTasks, so that short
+ * pieces of work (e.g. handling a connection) don't each need a
+ * Thread of their own.
+ *
+ * Each worker has its own deque of tasks. A task submitted from a
+ * worker goes on the back of that worker's deque, and the worker
+ * takes work from the back as well, so related work stays on the
+ * same thread and in cache. Tasks submitted from elsewhere are dealt
+ * out round robin. A worker that runs out of work steals half the
+ * tasks from the front of another worker's deque, and if there is
+ * nothing to steal it sleeps on a Notifier until a submit wakes it.
+ *
+ * Workers can optionally be pinned to cpus, worker i to cpu i modulo
+ * the number of cpus (only on Linux for now).
+ */
+class ThreadPool : public Logger {
+public:
+    /**
+     * Constructor, which doesn't start the threads.
+     *
+     * @param logpath  Log path of the pool
+     * @param nthreads Number of worker threads, or 0 for one per cpu
+     * @param affinity Whether to pin the workers to cpus
+     */
+    ThreadPool(const char* logpath, int nthreads = 0, bool affinity = false);
+
+    /**
+     * Destructor, which shuts the pool down if that hasn't been done.
+     */
+    ~ThreadPool();
+
+    /**
+     * Start the worker threads.
+     */
+    void start();
+
+    /**
+     * Queue a task to run on one of the workers. Tasks can be
+     * submitted before start(), and from running tasks.
+     */
+    void submit(ThreadPoolTask* task);
+
+    /**
+     * Stop the pool, after running every task that has already been
+     * submitted (including any those tasks submit in turn), and wait
+     * for the workers to exit. Nothing else may be submitted once
+     * this has been called. If the pool was never started, the tasks
+     * run on the calling thread instead.
+     */
+    void shutdown();
+
+    /**
+     * The pool that the calling thread is a worker of, or NULL.
+     */
+    static ThreadPool* current();
+
+    /// @{ Accessors
+    bool      started()     const { return started_; }
+    size_t    num_threads() const { return workers_.size(); }
+    u_int32_t tasks_run()   const { return tasks_run_.value; }
+    u_int32_t steals()      const { return steals_.value; }
+    /// @}
+
+protected:
+    class Worker;
+    friend class Worker;
+
+    std::vector<Worker*> workers_;
+    bool          affinity_;
+    volatile bool started_;
+    volatile bool stopping_;
+    atomic_t      next_worker_;  ///< round robin for outside submits
+    atomic_t      queued_;       ///< tasks sitting in the deques
+    atomic_t      sleeping_;     ///< workers that are (about to be) asleep
+    atomic_t      tasks_run_;
+    atomic_t      steals_;
+
+    /// The Worker the calling thread is, or NULL
+    static Worker* current_worker();
+
+    /// Worker main loop
+    void work(Worker* w);
+
+    /// Run the tasks of a pool that never started on the calling
+    /// thread, since futures and tasks with a done queue can't just
+    /// be deleted
+    void run_queued();
+
+    /// Take a task from the worker's own deque or from another's
+    ThreadPoolTask* get_task(Worker* w);
+
+    /// Steal half of some other worker's deque
+    ThreadPoolTask* steal(Worker* thief);
+
+    /// Put the worker to sleep until there may be work
+    void sleep(Worker* w);
+
+    /// Wake up a sleeping worker, starting the search at hint
+    void wake_one(size_t hint);
+};
+
+/**
+ * A Timer whose handler runs on a ThreadPool rather than on the
+ * timer thread, so a slow handler doesn't hold up the other timers.
+ * When the timer fires, a task is submitted that calls
+ * pool_timeout().
+ *
+ * The timer has to stay around until pool_timeout() has been called,
+ * which is a fine place to delete it or schedule it again.
+ */
+class ThreadPoolTimer : public Timer {
+public:
+    ThreadPoolTimer(ThreadPool* pool,
+                    cancel_flags_t cancel_flags = DELETE_ON_CANCEL)
+        : Timer(cancel_flags), pool_(pool) {}
+
+    /// Virtual from Timer, hands off to the pool
+    void timeout(const struct timeval& now);
+
+    /// The handler, called on one of the pool's threads
+    virtual void pool_timeout(const struct timeval& now) = 0;
+
+protected:
+    ThreadPool* pool_;
+};
+
+} // namespace oasys
+
+#endif /* _OASYS_THREADPOOL_H_ */
@@ -22,11 +22,13 @@
 #include <cstdlib>
 #include <cerrno>
 #include <climits>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <sys/poll.h>
 
 #include "Timer.h"
+#include "AdaptiveLock.h"
 #include "io/IO.h"
 #include "../util/InitSequencer.h"
 
@@ -34,14 +36,47 @@ namespace oasys {
 
 template <> TimerSystem* Singleton<TimerSystem>::instance_ = 0;
 
+std::vector<TimerSystem*> TimerSystem::shards_;
+atomic_t                  TimerSystem::next_shard_;
+
+#if HAVE_PTHREAD_SETSPECIFIC
+/*
+ * The thread-local binding is a borrowed pointer, so this uses a raw
+ * key rather than TLS<>, which would delete the timer system when the
+ * thread exits.
+ */
+static pthread_key_t  timer_system_key;
+static pthread_once_t timer_system_key_once = PTHREAD_ONCE_INIT;
+
+static void
+create_timer_system_key()
+{
+    ::pthread_key_create(&timer_system_key, 0);
+}
+#endif
+
 //----------------------------------------------------------------------
-TimerSystem::TimerSystem()
+TimerSystem*
+TimerSystem::create(backend_t backend)
+{
+    if (instance_) {
+        PANIC("TimerSystem::create() called more than once");
+    }
+    
+    instance_ = new TimerSystem(backend);
+    return instance_;
+}
+
+//----------------------------------------------------------------------
+TimerSystem::TimerSystem(backend_t backend)
     : Logger("TimerSystem", "/timer"),
-      system_lock_(new SpinLock()),
+      backend_(backend),
+      system_lock_(new AdaptiveLock()),
       notifier_(logpath_),
       timers_(),
       seqno_(0),
-      num_cancelled_(0)
+      num_cancelled_(0),
+      running_(0)
 {
     memset(handlers_, 0, sizeof(handlers_));
     memset(signals_, 0, sizeof(signals_));
@@ -57,10 +92,90 @@ TimerSystem::~TimerSystem()
         timers_.pop();
         delete t;
     }
+    
+    Timer* t;
+    while ((t = wheel_.pop_any()) != NULL) {
+        t->pending_ = false;
+        delete t;
+    }
+    reap_cancelled();
+    
     delete system_lock_;
     printf("Time system destructor run\n");
 }
 
+//----------------------------------------------------------------------
+void
+TimerSystem::create_shards(size_t nshards, backend_t backend)
+{
+    ASSERT(nshards >= 1);
+    ASSERT(shards_.empty());
+    
+    create(backend);
+    for (size_t i = 1; i < nshards; ++i) {
+        shards_.push_back(new TimerSystem(backend));
+    }
+}
+
+//----------------------------------------------------------------------
+size_t
+TimerSystem::num_shards()
+{
+    return shards_.size() + 1;
+}
+
+//----------------------------------------------------------------------
+TimerSystem*
+TimerSystem::shard(size_t i)
+{
+    if (i == 0) {
+        return instance();
+    }
+    
+    ASSERT(i <= shards_.size());
+    return shards_[i - 1];
+}
+
+//----------------------------------------------------------------------
+void
+TimerSystem::set_thread_local(TimerSystem* sys)
+{
+#if HAVE_PTHREAD_SETSPECIFIC
+    ::pthread_once(&timer_system_key_once, create_timer_system_key);
+    ::pthread_setspecific(timer_system_key, sys);
+#else
+    (void)sys;
+    NOTIMPLEMENTED;
+#endif
+}
+
+//----------------------------------------------------------------------
+TimerSystem*
+TimerSystem::current()
+{
+#if HAVE_PTHREAD_SETSPECIFIC
+    ::pthread_once(&timer_system_key_once, create_timer_system_key);
+    TimerSystem* sys = reinterpret_cast<TimerSystem*>(
+        ::pthread_getspecific(timer_system_key));
+    if (sys != 0) {
+        return sys;
+    }
+
+    if (shards_.empty()) {
+        return instance();
+    }
+
+    // stick with the same shard from now on so that the thread's
+    // timers stay together
+    u_int32_t n = atomic_incr_ret(&next_shard_);
+    sys = shard(n % num_shards());
+    ::pthread_setspecific(timer_system_key, sys);
+    return sys;
+#else
+    return instance();
+#endif
+}
+
 //----------------------------------------------------------------------
 void
 TimerSystem::schedule_at(struct timeval *when, Timer* timer)
@@ -94,8 +209,13 @@ TimerSystem::schedule_at(struct timeval *when, Timer* timer)
     timer->pending_ = 1;
     timer->cancelled_ = 0;
     timer->seqno_ = seqno_++;
+    timer->system_ = this;
     
-    timers_.push(timer);
+    if (backend_ == WHEEL_BACKEND) {
+        wheel_.insert(timer);
+    } else {
+        timers_.push(timer);
+    }
 
     notifier_.signal();
 }
@@ -129,6 +249,68 @@ TimerSystem::cancel(Timer* timer)
 {
     ScopeLock l(system_lock_, "TimerSystem::cancel");
 
+    // A pending timer's system_ only changes when it's rescheduled,
+    // which can't happen until it's fired or been cancelled, so if it
+    // names a different system, that's the one that has it.
+    TimerSystem* owner = timer->system_;
+    if (owner != 0 && owner != this) {
+        l.unlock();
+        return owner->cancel(timer);
+    }
+
+    // An expired timer that's still waiting for its handler to be
+    // called can just be dropped from the list
+    if (timer->firing_) {
+        for (size_t i = 0; i < expired_.size(); ++i) {
+            if (expired_[i].timer_ == timer) {
+                timer->firing_ = false;
+                if (timer->cancel_flags_ == Timer::DELETE_ON_CANCEL) {
+                    expired_[i].cancelled_ = true;
+                } else {
+                    expired_[i].timer_ = 0;
+                }
+                return true;
+            }
+        }
+        NOTREACHED;
+    }
+
+    // If the handler is running on another thread, wait for it to
+    // return, since the caller is free to delete the timer as soon as
+    // this returns. A handler cancelling its own timer doesn't wait.
+    if (running_ == timer &&
+        ! Thread::id_equal(running_thread_, Thread::current()))
+    {
+        l.unlock();
+        while (running_ == timer) {
+            Thread::spin_yield();
+        }
+        return false;
+    }
+
+    if (backend_ == WHEEL_BACKEND) {
+        if (! timer->pending_ || timer->cancelled_) {
+            return timer->pending_;
+        }
+        
+        wheel_.remove(timer);
+        timer->cancelled_ = true;
+        
+        // Deleting the timer here would pull it out from under the
+        // caller, so as with the heap, defer that to the timer
+        // thread. Timers that aren't deleted can be rescheduled
+        // right away.
+        if (timer->cancel_flags_ == Timer::DELETE_ON_CANCEL) {
+            if (reap_.empty()) {
+                notifier_.signal();
+            }
+            reap_.push_back(timer);
+        } else {
+            timer->pending_ = false;
+        }
+        return true;
+    }
+
     // There's no good way to get a timer out of a heap, so we let it
     // stay in there and mark it as cancelled so when it bubbles to
     // the top, we don't bother with it. This makes rescheduling a
@@ -146,6 +328,9 @@ TimerSystem::cancel(Timer* timer)
 size_t
 TimerSystem::num_pending_timers()
 {
+    if (backend_ == WHEEL_BACKEND) {
+        return wheel_.size();
+    }
     return timers_.size() - num_cancelled_;
 }
 
@@ -172,7 +357,7 @@ TimerSystem::add_sighandler(int sig, sighandlerfn_t* handler)
 
 //----------------------------------------------------------------------
 void
-TimerSystem::pop_timer(const struct timeval& now)
+TimerSystem::pop_timer(const struct timeval& now, ExpiredList* expired)
 {
     ASSERT(system_lock_->is_locked_by_me());
     
@@ -184,14 +369,7 @@ TimerSystem::pop_timer(const struct timeval& now)
     next_timer->pending_ = 0;
 
     if (! next_timer->cancelled_) {
-        int late = TIMEVAL_DIFF_MSEC(now, next_timer->when());
-        if (late > 2000) {
-            log_warn("timer thread running slow -- timer is %d msecs late", late);
-        }
-        
-        log_debug("popping timer %p at %u.%u", next_timer,
-                  (u_int)now.tv_sec, (u_int)now.tv_usec);
-        next_timer->timeout(now);
+        expire_timer(next_timer, now, expired);
     } else {
         log_debug("popping cancelled timer %p at %u.%u", next_timer,
                   (u_int)now.tv_sec, (u_int)now.tv_usec);
@@ -207,6 +385,72 @@ TimerSystem::pop_timer(const struct timeval& now)
     }
 }
 
+//----------------------------------------------------------------------
+void
+TimerSystem::expire_timer(Timer* timer, const struct timeval& now,
+                          ExpiredList* expired)
+{
+    timer->firing_ = true;
+
+    Expired e;
+    e.timer_     = timer;
+    e.now_       = now;
+    e.cancelled_ = false;
+    expired->push_back(e);
+}
+
+//----------------------------------------------------------------------
+void
+TimerSystem::fire_timer(Timer* timer, const struct timeval& now)
+{
+    int late = TIMEVAL_DIFF_MSEC(now, timer->when());
+    if (late > 2000) {
+        log_warn("timer thread running slow -- timer is %d msecs late", late);
+    }
+    
+    log_debug("popping timer %p at %u.%u", timer,
+              (u_int)now.tv_sec, (u_int)now.tv_usec);
+    timer->timeout(now);
+}
+
+//----------------------------------------------------------------------
+void
+TimerSystem::reap_cancelled()
+{
+    for (size_t i = 0; i < reap_.size(); ++i) {
+        Timer* timer = reap_[i];
+        ASSERT(timer->pending_ && timer->cancelled_);
+        timer->pending_   = false;
+        timer->cancelled_ = false;
+        log_debug("deleting cancelled timer %p", timer);
+        delete timer;
+    }
+    reap_.clear();
+}
+
+//----------------------------------------------------------------------
+int
+TimerSystem::run_expired_wheel(ExpiredList* expired)
+{
+    ASSERT(system_lock_->is_locked_by_me());
+    
+    reap_cancelled();
+
+    struct timeval now;
+    if (::gettimeofday(&now, 0) != 0) {
+        PANIC("gettimeofday");
+    }
+
+    Timer* timer;
+    while ((timer = wheel_.pop_expired(now)) != NULL) {
+        ASSERT(timer->pending_);
+        timer->pending_ = 0;
+        expire_timer(timer, now, expired);
+    }
+
+    return wheel_.next_timeout(now);
+}
+
 //----------------------------------------------------------------------
 void
 TimerSystem::handle_signals()
@@ -231,9 +475,60 @@ TimerSystem::handle_signals()
 int
 TimerSystem::run_expired_timers()
 {
-    ScopeLock l(system_lock_, "TimerSystem::run_expired_timers");
+    int timeout = collect_expired(&expired_);
+
+    // Each handler runs without the lock. In the meantime cancel()
+    // can drop the timers still waiting in expired_, and waits for
+    // the one in running_.
+    //
+    // Handlers that schedule or cancel timers signal the notifier, so
+    // the caller comes back around before the timeout computed above
+    // if it's no longer right.
+    system_lock_->lock("TimerSystem::run_expired_timers");
+    running_thread_ = Thread::current();
+    for (size_t i = 0; i < expired_.size(); ++i) {
+        Expired e = expired_[i];
+        if (e.timer_ == 0) {
+            continue;
+        }
+        
+        e.timer_->firing_ = false;
+        if (e.cancelled_) {
+            log_debug("deleting cancelled timer %p", e.timer_);
+            delete e.timer_;
+            continue;
+        }
+
+        running_ = e.timer_;
+        system_lock_->unlock();
+        fire_timer(e.timer_, e.now_);
+        system_lock_->lock("TimerSystem::run_expired_timers");
+        running_ = 0;
+    }
+    expired_.clear();
+    system_lock_->unlock();
+
+    return timeout;
+}
+
+//----------------------------------------------------------------------
+int
+TimerSystem::collect_expired(ExpiredList* expired)
+{
+    ScopeLock l(system_lock_, "TimerSystem::collect_expired");
+    ASSERT(expired->empty());
+
+    // Any schedule_at() or cancel() from here on will signal the
+    // notifier again, so it's safe to clear it before computing the
+    // next timeout. Otherwise TimerThread's wait() would return
+    // immediately forever after the first signal.
+    notifier_.clear();
     
     handle_signals();
+
+    if (backend_ == WHEEL_BACKEND) {
+        return run_expired_wheel(expired);
+    }
     
     struct timeval now;    
     while (! timers_.empty()) 
@@ -247,7 +542,7 @@ TimerSystem::run_expired_timers()
         // if the next timer is cancelled, pop it immediately,
         // regardless of whether it's time has come or not
         if (next_timer->cancelled()) {
-            pop_timer(now);
+            pop_timer(now, expired);
             continue;
         }
         
@@ -296,7 +591,7 @@ TimerSystem::run_expired_timers()
                 return diff_ms;
             }
         }
-        pop_timer(now);
+        pop_timer(now, expired);
     }
 
     return -1;
@@ -306,11 +601,13 @@ TimerSystem::run_expired_timers()
 void
 TimerThread::run()
 {
-    TimerSystem* sys = TimerSystem::instance();
+    // timers rescheduled from a handler stay on this thread's system
+    TimerSystem::set_thread_local(sys_);
+    
     while (true) 
     {
-        int timeout = sys->run_expired_timers();
-        sys->notifier()->wait(NULL, timeout);
+        int timeout = sys_->run_expired_timers();
+        sys_->notifier()->wait(NULL, timeout);
     }
 
     NOTREACHED;
@@ -320,11 +617,14 @@ TimerThread::run()
 void
 TimerThread::init()
 {
-    ASSERT(instance_ == NULL);
-    instance_ = new TimerThread();
-    instance_->start();
+    ASSERT(instances_.empty());
+    for (size_t i = 0; i < TimerSystem::num_shards(); ++i) {
+        TimerThread* t = new TimerThread(TimerSystem::shard(i));
+        instances_.push_back(t);
+        t->start();
+    }
 }
 
-TimerThread* TimerThread::instance_ = NULL;
+std::vector<TimerThread*> TimerThread::instances_;
 
 } // namespace oasys
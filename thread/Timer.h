@@ -33,9 +33,11 @@
 #include "../debug/Log.h"
 #include "../util/Singleton.h"
 #include "../util/Time.h"
+#include "Atomic.h"
 #include "MsgQueue.h"
 #include "OnOffNotifier.h"
 #include "Thread.h"
+#include "TimerWheel.h"
 
 /**
  * Typedef for a signal handler function. On some (but not all)
@@ -83,7 +85,7 @@ namespace oasys {
         (tv).tv_usec = static_cast<unsigned long>((d - floor(d)) * 1000000); \
     } while (0)
 
-class SpinLock;
+class AdaptiveLock;
 class Timer;
 
 /**
@@ -97,10 +99,93 @@ public:
 /**
  * The main Timer system implementation that needs to be driven by a
  * thread, such as the TimerThread class defined below.
+ *
+ * Pending timers are kept in one of two backends, selected when the
+ * system is created. The default HEAP_BACKEND is a priority queue,
+ * where cancel() only marks a timer and leaves it in the heap until
+ * it bubbles to the top. WHEEL_BACKEND uses a hierarchical TimerWheel
+ * with O(1) schedule and cancel, where cancelled timers are unlinked
+ * right away; it is the better choice when many timers are scheduled
+ * and then cancelled long before they would fire.
+ *
+ * By default there is just the one singleton timer system, which
+ * means every thread that schedules or cancels a timer contends on
+ * the same lock. To spread that load, create_shards() sets up a
+ * number of independent instances, each driven by its own
+ * TimerThread, and threads are spread across them. A thread with its
+ * own event loop can instead bind a private instance with
+ * set_thread_local() and drive it itself. Either way, Timer's
+ * schedule_* methods go to current(), and cancel() goes to whichever
+ * system the timer was last scheduled on.
+ *
+ * Expired timers are taken off the queue with the timer system's lock
+ * held, but their timeout handlers run after it is dropped, so a
+ * handler can schedule or cancel timers on any shard. Cancelling an
+ * expired timer whose handler hasn't started yet still stops it. If
+ * the handler is already running on another thread, cancel() waits
+ * for it to return and then returns false, so the timer can be freed
+ * as usual. Two handlers that are running at the same time on
+ * different shards therefore must not cancel each other's timers.
  */
 class TimerSystem : public Singleton<TimerSystem>,
                     public Logger {
 public:
+    /// Storage for pending timers
+    typedef enum {
+        HEAP_BACKEND,
+        WHEEL_BACKEND
+    } backend_t;
+
+    /**
+     * Create the singleton instance with the given backend. Must be
+     * called before the first call to instance().
+     */
+    static TimerSystem* create(backend_t backend = HEAP_BACKEND);
+
+    /**
+     * Constructor for a standalone (non-singleton) timer system. Such
+     * an instance has to be driven by explicitly calling
+     * run_expired_timers().
+     */
+    TimerSystem(backend_t backend = HEAP_BACKEND);
+    virtual ~TimerSystem();
+
+    /**
+     * Create the singleton plus nshards - 1 more timer systems with
+     * the given backend. TimerThread::init() then starts a thread for
+     * each one. Threads that haven't bound a timer system of their
+     * own are assigned to a shard round-robin the first time they
+     * call current().
+     */
+    static void create_shards(size_t nshards,
+                              backend_t backend = HEAP_BACKEND);
+
+    /**
+     * @return The number of shards (one unless create_shards() was
+     * called with more).
+     */
+    static size_t num_shards();
+
+    /**
+     * @return The i'th shard, where shard 0 is the singleton.
+     */
+    static TimerSystem* shard(size_t i);
+
+    /**
+     * Bind the calling thread to the given timer system, or unbind it
+     * if sys is NULL. A thread with its own poll loop can bind a
+     * standalone instance and call run_expired_timers() whenever
+     * notifier()->read_fd() becomes readable or the previously
+     * returned timeout expires.
+     */
+    static void set_thread_local(TimerSystem* sys);
+
+    /**
+     * @return The timer system for the calling thread: the one bound
+     * with set_thread_local() if any, otherwise its shard.
+     */
+    static TimerSystem* current();
+
     void schedule_at(struct timeval *when, Timer* timer);
     void schedule_in(int milliseconds, Timer* timer);
     void schedule_immediate(Timer* timer);
@@ -134,6 +219,11 @@ public:
      */
     size_t num_pending_timers();
 
+    /**
+     * Return the backend used for this timer system.
+     */
+    backend_t backend() { return backend_; }
+
 private:
     friend class Singleton<TimerSystem>;
     typedef std::priority_queue<Timer*, 
@@ -147,16 +237,38 @@ private:
     bool 	    signals_[NSIG];	///< which signals have fired
     bool	    sigfired_;		///< boolean to check if any fired
 
-    SpinLock*  system_lock_;
+    backend_t  backend_;
+    AdaptiveLock* system_lock_;
     OnOffNotifier notifier_;
     TimerQueue timers_;
+    TimerWheel wheel_;
+    std::vector<Timer*> reap_;  ///< cancelled wheel timers to delete
     u_int32_t   seqno_;       ///< seqno used to break ties
     size_t      num_cancelled_; ///< needed for accurate pending_timer count
 
-    TimerSystem();
-    virtual ~TimerSystem();
-    
-    void pop_timer(const struct timeval& now);
+    static std::vector<TimerSystem*> shards_; ///< all shards but the singleton
+    static atomic_t next_shard_;              ///< for round-robin assignment
+
+    /// A timer taken off the queue, to be fired once the lock is
+    /// dropped
+    struct Expired {
+        Timer*         timer_;     ///< NULL once cancelled
+        struct timeval now_;
+        bool           cancelled_; ///< cancelled, to be deleted
+    };
+    typedef std::vector<Expired> ExpiredList;
+
+    ExpiredList         expired_;        ///< being fired, by one thread
+    Timer* volatile     running_;        ///< timer whose handler is running
+    ThreadId_t          running_thread_; ///< thread running the handlers
+
+    int  collect_expired(ExpiredList* expired);
+    void pop_timer(const struct timeval& now, ExpiredList* expired);
+    void expire_timer(Timer* timer, const struct timeval& now,
+                      ExpiredList* expired);
+    void fire_timer(Timer* timer, const struct timeval& now);
+    void reap_cancelled();
+    int  run_expired_wheel(ExpiredList* expired);
     void handle_signals();
 
 };
@@ -166,13 +278,18 @@ private:
  */
 class TimerThread : public Thread {
 public:
+    /**
+     * Start a thread for each TimerSystem shard.
+     */
     static void init();
 
 private:
-    TimerThread() : Thread("TimerThread") {}
+    TimerThread(TimerSystem* sys) : Thread("TimerThread"), sys_(sys) {}
     void run();
+
+    TimerSystem* sys_;
     
-    static TimerThread* instance_;
+    static std::vector<TimerThread*> instances_;
 };
 
 /**
@@ -190,7 +307,12 @@ public:
     Timer(cancel_flags_t cancel_flags = DELETE_ON_CANCEL)
         : pending_(false),
           cancelled_(false),
-          cancel_flags_(cancel_flags)
+          cancel_flags_(cancel_flags),
+          firing_(false),
+          system_(0),
+          wheel_next_(0),
+          wheel_prev_(0),
+          wheel_list_(-1)
     {}
     
     virtual ~Timer() 
@@ -200,11 +322,12 @@ public:
          * so assert as such.
          */
         ASSERTF(pending_ == false, "can't delete a pending timer");
+        ASSERTF(firing_ == false, "can't delete a timer about to fire");
     }
     
     void schedule_at(struct timeval *when)
     {
-        TimerSystem::instance()->schedule_at(when, this);
+        TimerSystem::current()->schedule_at(when, this);
     }
     
     void schedule_at(const Time& when)
@@ -212,21 +335,28 @@ public:
         struct timeval tv;
         tv.tv_sec  = when.sec_;
         tv.tv_usec = when.usec_;
-        TimerSystem::instance()->schedule_at(&tv, this);
+        TimerSystem::current()->schedule_at(&tv, this);
     }
     
     void schedule_in(int milliseconds)
     {
-        TimerSystem::instance()->schedule_in(milliseconds, this);
+        TimerSystem::current()->schedule_in(milliseconds, this);
     }
     void schedule_immediate()
     {
-        TimerSystem::instance()->schedule_immediate(this);
+        TimerSystem::current()->schedule_immediate(this);
     }
 
     bool cancel()
     {
-        return TimerSystem::instance()->cancel(this);
+        // system_ may change under us if the timer isn't pending, but
+        // TimerSystem::cancel() checks it again under its lock and
+        // passes the call on to the right system
+        TimerSystem* sys = system_;
+        if (sys == 0) {
+            sys = TimerSystem::current();
+        }
+        return sys->cancel(this);
     }
 
     bool pending()
@@ -249,6 +379,7 @@ public:
 protected:
     friend class TimerSystem;
     friend class TimerCompare;
+    friend class TimerWheel;
     
     struct timeval when_;	  ///< When the timer should fire
     bool           pending_;	  ///< Is the timer currently pending
@@ -257,6 +388,15 @@ protected:
                                   ///< or delete it when the cancelled
                                   ///< timer bubbles to the top
     u_int32_t      seqno_;        ///< seqno used to break ties
+    bool           firing_;       ///< expired, handler not yet called
+    TimerSystem*   system_;       ///< system last scheduled on
+
+    /// @{ Linkage used by the TimerWheel backend
+    Timer*         wheel_next_;
+    Timer*         wheel_prev_;
+    int            wheel_list_;
+    u_int64_t      wheel_expires_;
+    /// @}
 };
 
 /**
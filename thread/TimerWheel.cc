@@ -0,0 +1,265 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <oasys-config.h>
+#endif
+
+#include <climits>
+
+#include "Timer.h"
+#include "TimerWheel.h"
+
+namespace oasys {
+
+//----------------------------------------------------------------------
+TimerWheel::TimerWheel()
+    : cur_tick_(0),
+      count_(0)
+{
+    ::gettimeofday(&base_, 0);
+    for (int i = 0; i < NUM_LISTS; ++i) {
+        heads_[i] = 0;
+        tails_[i] = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+u_int64_t
+TimerWheel::to_ticks(const struct timeval& tv, bool round_up)
+{
+    int64_t usecs = ((int64_t)tv.tv_sec - base_.tv_sec) * 1000000 +
+                    ((int64_t)tv.tv_usec - base_.tv_usec);
+    if (usecs <= 0) {
+        return 0;
+    }
+
+    if (round_up) {
+        usecs += 999;
+    }
+    return usecs / 1000;
+}
+
+//----------------------------------------------------------------------
+void
+TimerWheel::link(int list, Timer* timer)
+{
+    timer->wheel_list_ = list;
+    timer->wheel_next_ = 0;
+    timer->wheel_prev_ = tails_[list];
+
+    if (tails_[list] != 0) {
+        tails_[list]->wheel_next_ = timer;
+    } else {
+        heads_[list] = timer;
+    }
+    tails_[list] = timer;
+}
+
+//----------------------------------------------------------------------
+void
+TimerWheel::unlink(Timer* timer)
+{
+    int list = timer->wheel_list_;
+    ASSERT(list >= 0 && list < NUM_LISTS);
+
+    if (timer->wheel_prev_ != 0) {
+        timer->wheel_prev_->wheel_next_ = timer->wheel_next_;
+    } else {
+        heads_[list] = timer->wheel_next_;
+    }
+
+    if (timer->wheel_next_ != 0) {
+        timer->wheel_next_->wheel_prev_ = timer->wheel_prev_;
+    } else {
+        tails_[list] = timer->wheel_prev_;
+    }
+
+    timer->wheel_list_ = -1;
+    timer->wheel_next_ = 0;
+    timer->wheel_prev_ = 0;
+}
+
+//----------------------------------------------------------------------
+void
+TimerWheel::place(Timer* timer)
+{
+    u_int64_t expires = timer->wheel_expires_;
+
+    // anything already due goes in the slot for the current tick
+    if (expires < cur_tick_) {
+        expires = cur_tick_;
+    }
+
+    // park far-away timers in the top level until they come closer
+    u_int64_t delta = expires - cur_tick_;
+    if (delta > 0xffffffffULL) {
+        delta   = 0xffffffffULL;
+        expires = cur_tick_ + delta;
+    }
+
+    int level = 0;
+    while (delta >= ((u_int64_t)1 << (LEVEL_BITS * (level + 1)))) {
+        ++level;
+    }
+    ASSERT(level < LEVELS);
+
+    int slot = (expires >> (LEVEL_BITS * level)) & SLOT_MASK;
+    link(level * SLOTS + slot, timer);
+}
+
+//----------------------------------------------------------------------
+void
+TimerWheel::insert(Timer* timer)
+{
+    timer->wheel_expires_ = to_ticks(timer->when_, true);
+    place(timer);
+    ++count_;
+}
+
+//----------------------------------------------------------------------
+void
+TimerWheel::remove(Timer* timer)
+{
+    unlink(timer);
+    ASSERT(count_ > 0);
+    --count_;
+}
+
+//----------------------------------------------------------------------
+void
+TimerWheel::cascade(int list)
+{
+    Timer* timer = heads_[list];
+    heads_[list] = 0;
+    tails_[list] = 0;
+
+    while (timer != 0) {
+        Timer* next = timer->wheel_next_;
+        place(timer);
+        timer = next;
+    }
+}
+
+//----------------------------------------------------------------------
+void
+TimerWheel::tick()
+{
+    // cascade each level down when the level below wraps around
+    int idx = cur_tick_ & SLOT_MASK;
+    for (int level = 1; idx == 0 && level < LEVELS; ++level) {
+        idx = (cur_tick_ >> (LEVEL_BITS * level)) & SLOT_MASK;
+        cascade(level * SLOTS + idx);
+    }
+
+    int list = cur_tick_ & SLOT_MASK;
+    if (heads_[list] != 0) {
+        // splice the whole slot onto the end of the expired list
+        for (Timer* t = heads_[list]; t != 0; t = t->wheel_next_) {
+            t->wheel_list_ = EXPIRED;
+        }
+
+        if (tails_[EXPIRED] != 0) {
+            tails_[EXPIRED]->wheel_next_ = heads_[list];
+            heads_[list]->wheel_prev_ = tails_[EXPIRED];
+        } else {
+            heads_[EXPIRED] = heads_[list];
+        }
+        tails_[EXPIRED] = tails_[list];
+
+        heads_[list] = 0;
+        tails_[list] = 0;
+    }
+
+    ++cur_tick_;
+}
+
+//----------------------------------------------------------------------
+Timer*
+TimerWheel::pop_expired(const struct timeval& now)
+{
+    if (heads_[EXPIRED] == 0) {
+        u_int64_t now_tick = to_ticks(now, false);
+
+        if (count_ == 0) {
+            // nothing to cascade, so just catch up
+            if (cur_tick_ <= now_tick) {
+                cur_tick_ = now_tick + 1;
+            }
+            return 0;
+        }
+
+        while (cur_tick_ <= now_tick && heads_[EXPIRED] == 0) {
+            tick();
+        }
+    }
+
+    Timer* timer = heads_[EXPIRED];
+    if (timer != 0) {
+        remove(timer);
+    }
+    return timer;
+}
+
+//----------------------------------------------------------------------
+int
+TimerWheel::next_timeout(const struct timeval& now)
+{
+    if (count_ == 0) {
+        return -1;
+    }
+
+    if (heads_[EXPIRED] != 0) {
+        return 0;
+    }
+
+    // find the first non-empty slot before level 0 wraps around; if
+    // there isn't one, the wheel needs to turn at the wrap anyway to
+    // cascade the next level down
+    u_int64_t t = cur_tick_;
+    do {
+        if (heads_[t & SLOT_MASK] != 0) {
+            break;
+        }
+        ++t;
+    } while ((t & SLOT_MASK) != 0);
+
+    int64_t usecs = ((int64_t)t * 1000) -
+                    (((int64_t)now.tv_sec - base_.tv_sec) * 1000000 +
+                     ((int64_t)now.tv_usec - base_.tv_usec));
+    if (usecs <= 0) {
+        return 0;
+    }
+
+    int64_t msecs = (usecs + 999) / 1000;
+    return (msecs > INT_MAX) ? INT_MAX : (int)msecs;
+}
+
+//----------------------------------------------------------------------
+Timer*
+TimerWheel::pop_any()
+{
+    for (int i = 0; i < NUM_LISTS; ++i) {
+        if (heads_[i] != 0) {
+            Timer* timer = heads_[i];
+            remove(timer);
+            return timer;
+        }
+    }
+    return 0;
+}
+
+} // namespace oasys
@@ -0,0 +1,126 @@
+/*
+ *    Copyright 2006 Intel Corporation
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef _OASYS_TIMER_WHEEL_H_
+#define _OASYS_TIMER_WHEEL_H_
+
+#ifndef OASYS_CONFIG_STATE
+#error "MUST INCLUDE oasys-config.h before including this file"
+#endif
+
+#include <sys/time.h>
+
+#include "../compat/inttypes.h"
+
+namespace oasys {
+
+class Timer;
+
+/**
+ * A hierarchical timing wheel with millisecond ticks, used as an
+ * alternative to the priority queue in TimerSystem.
+ *
+ * There are four levels of 256 slots each. A timer due within 256
+ * ticks sits directly in the level 0 slot for its tick; timers that
+ * are further out sit in a coarser slot of a higher level and are
+ * cascaded down as the wheel turns. Anything more than 2^32 ticks
+ * (about 49 days) out is parked in the last slot of the top level and
+ * re-cascaded until it gets close enough.
+ *
+ * Each slot is an intrusive doubly linked list threaded through the
+ * Timer itself, so insert() and remove() are O(1) and a removed timer
+ * is really gone rather than left behind to be skipped later.
+ *
+ * The wheel does no locking of its own; TimerSystem holds its
+ * system_lock_ around every call.
+ */
+class TimerWheel {
+public:
+    TimerWheel();
+
+    /**
+     * Insert a timer to fire at timer->when_.
+     */
+    void insert(Timer* timer);
+
+    /**
+     * Remove a timer that was previously inserted.
+     */
+    void remove(Timer* timer);
+
+    /**
+     * Turn the wheel up to the given time and return the next
+     * expired timer (which is removed from the wheel), or NULL if
+     * none are due. Timers that are due in the same tick are returned
+     * in the order they were inserted.
+     */
+    Timer* pop_expired(const struct timeval& now);
+
+    /**
+     * @return The number of milliseconds from now until the wheel
+     * needs to be turned again, or -1 if it's empty.
+     */
+    int next_timeout(const struct timeval& now);
+
+    /**
+     * @return Number of timers in the wheel.
+     */
+    size_t size() { return count_; }
+
+    /**
+     * Remove and return an arbitrary timer, or NULL if the wheel is
+     * empty. Used for cleanup.
+     */
+    Timer* pop_any();
+
+private:
+    enum {
+        LEVEL_BITS = 8,
+        LEVELS     = 4,
+        SLOTS      = 1 << LEVEL_BITS,
+        SLOT_MASK  = SLOTS - 1,
+        EXPIRED    = LEVELS * SLOTS, ///< list of due timers
+        NUM_LISTS  = EXPIRED + 1,
+    };
+
+    /// Convert an absolute time to ticks since base_, optionally
+    /// rounding up to the next tick.
+    u_int64_t to_ticks(const struct timeval& tv, bool round_up);
+
+    /// Put the timer in the right slot relative to the current tick.
+    void place(Timer* timer);
+
+    /// Append to / unlink from one of the lists.
+    void link(int list, Timer* timer);
+    void unlink(Timer* timer);
+
+    /// Re-place every timer in the given list.
+    void cascade(int list);
+
+    /// Turn the wheel one tick, moving due timers to the expired list.
+    void tick();
+
+    struct timeval base_;      ///< time of tick zero
+    u_int64_t      cur_tick_;  ///< next tick to be processed
+    size_t         count_;     ///< number of timers in all lists
+    Timer*         heads_[NUM_LISTS];
+    Timer*         tails_[NUM_LISTS];
+};
+
+} // namespace oasys
+
+#endif /* _OASYS_TIMER_WHEEL_H_ */
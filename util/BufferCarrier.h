@@ -1,6 +1,9 @@
 #ifndef __BUFFERCARRIER_H__
 #define __BUFFERCARRIER_H__
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "../debug/DebugUtils.h"
 
 namespace oasys {
@@ -26,7 +29,8 @@ public:
     BufferCarrier()
         : buf_(0),
           len_(0),
-          pass_ownership_(false)
+          pass_ownership_(false),
+          view_(false)
     {}
 
     /*!
@@ -36,7 +40,8 @@ public:
     BufferCarrier(_Type* buf, size_t len, bool pass_ownership)
         : buf_(buf), 
           len_(len),
-          pass_ownership_(pass_ownership) 
+          pass_ownership_(pass_ownership),
+          view_(false)
     {}
 
     /*!
@@ -67,6 +72,16 @@ public:
         return pass_ownership_;
     }
 
+    /*!
+     * True if the buffer is a view into the serializer's source
+     * buffer, which stays valid for as long as the source does (see
+     * Serialize::BORROW_BUFFERS).
+     */
+    bool is_view() const
+    {
+        return view_;
+    }
+
     bool is_empty() const
     {
         return buf_ == 0;
@@ -77,6 +92,19 @@ public:
         buf_ = buf;
         len_ = len;
         pass_ownership_ = pass_ownership;
+        view_ = false;
+    }
+
+    /*!
+     * Lend out a buffer that outlives the serialization, so the
+     * receiver can use it in place with take_view().
+     */
+    void set_view(_Type* buf, size_t len)
+    {
+        buf_ = buf;
+        len_ = len;
+        pass_ownership_ = false;
+        view_ = true;
     }
     
     void set_len(size_t len)
@@ -124,6 +152,27 @@ public:
         }
     }
         
+    /*!
+     * Like take_buf(), but a buffer set with set_view() is handed
+     * back as it is instead of being copied. In that case *view is
+     * set, and the caller must neither free the buffer nor use it
+     * after the source is gone.
+     */
+    _Type* take_view(size_t* length, bool* view)
+    {
+        *view = view_ && buf_ != 0;
+        if (! *view)
+        {
+            return take_buf(length);
+        }
+
+        _Type* ret = buf_;
+        *length = len();
+        reset();
+
+        return ret;
+    }
+        
     /*!
      * Reset BufferCarrier to not hold anything.
      */
@@ -132,6 +181,7 @@ public:
         buf_            = 0;
         pass_ownership_ = 0;
         len_            = 0;
+        view_           = false;
     }
     
 
@@ -145,12 +195,14 @@ public:
         out->buf_ = reinterpret_cast<Type*>(in.buf());
         out->len_ = in.len();
         out->pass_ownership_ = in.pass_ownership();
+        out->view_ = in.is_view();
     }
     
 private:
     _Type* buf_;
     size_t len_;
     bool   pass_ownership_;
+    bool   view_;           //!< borrowed from the serializer's source
 };
 
 } // namespace oasys
@@ -19,7 +19,18 @@
 #endif
 
 
+#include <string.h>
+
 #include "CRC32.h"
+#include "../debug/DebugUtils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define OASYS_CRC32_PCLMUL 1
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
 
 /*****************************************************************/
 /*                                                               */
@@ -112,30 +123,281 @@ static u_int32_t CRCTABLE[256] =
  0xB40BBE37L, 0xC30C8EA1L, 0x5A05DF1BL, 0x2D02EF8DL
 };
 
+//----------------------------------------------------------------------
+// Slicing tables: entry k of each table is the CRC of byte k followed
+// by i zero bytes, so that 8 (or 16) bytes can be folded in at once
+// with independent lookups. Table 0 is CRCTABLE itself.
+static u_int32_t    SLICETABLE[16][256];
+static volatile bool slice_tables_ready = false;
+
+static void
+init_slice_tables()
+{
+    if (slice_tables_ready) {
+        return;
+    }
+    
+    // racing threads just compute the same values
+    memcpy(SLICETABLE[0], CRCTABLE, sizeof(CRCTABLE));
+    for (int k = 1; k < 16; ++k) {
+        for (int i = 0; i < 256; ++i) {
+            u_int32_t c = SLICETABLE[k - 1][i];
+            SLICETABLE[k][i] = (c >> 8) ^ CRCTABLE[c & 0xff];
+        }
+    }
+    slice_tables_ready = true;
+}
+
+//----------------------------------------------------------------------
+static inline u_int32_t
+load_le32(const u_char* p)
+{
+    return (u_int32_t)p[0]         | ((u_int32_t)p[1] << 8) |
+           ((u_int32_t)p[2] << 16) | ((u_int32_t)p[3] << 24);
+}
+
+//----------------------------------------------------------------------
+static u_int32_t
+crc_byte(u_int32_t crc, const u_char* buf, size_t length)
+{
+    for (size_t i = 0; i < length; i++, buf++) {
+        crc = CRCTABLE[(crc ^ *buf) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+//----------------------------------------------------------------------
+static u_int32_t
+crc_slice8(u_int32_t crc, const u_char* buf, size_t length)
+{
+    init_slice_tables();
+    const u_int32_t (*t)[256] = SLICETABLE;
+    
+    while (length >= 8) {
+        u_int32_t one = load_le32(buf) ^ crc;
+        u_int32_t two = load_le32(buf + 4);
+        crc = t[7][one & 0xff]         ^ t[6][(one >> 8) & 0xff] ^
+              t[5][(one >> 16) & 0xff] ^ t[4][one >> 24]         ^
+              t[3][two & 0xff]         ^ t[2][(two >> 8) & 0xff] ^
+              t[1][(two >> 16) & 0xff] ^ t[0][two >> 24];
+        buf    += 8;
+        length -= 8;
+    }
+    
+    return crc_byte(crc, buf, length);
+}
+
+//----------------------------------------------------------------------
+static u_int32_t
+crc_slice16(u_int32_t crc, const u_char* buf, size_t length)
+{
+    init_slice_tables();
+    const u_int32_t (*t)[256] = SLICETABLE;
+    
+    while (length >= 16) {
+        u_int32_t one   = load_le32(buf) ^ crc;
+        u_int32_t two   = load_le32(buf + 4);
+        u_int32_t three = load_le32(buf + 8);
+        u_int32_t four  = load_le32(buf + 12);
+        crc = t[15][one & 0xff]          ^ t[14][(one >> 8) & 0xff]   ^
+              t[13][(one >> 16) & 0xff]  ^ t[12][one >> 24]           ^
+              t[11][two & 0xff]          ^ t[10][(two >> 8) & 0xff]   ^
+              t[9][(two >> 16) & 0xff]   ^ t[8][two >> 24]            ^
+              t[7][three & 0xff]         ^ t[6][(three >> 8) & 0xff]  ^
+              t[5][(three >> 16) & 0xff] ^ t[4][three >> 24]          ^
+              t[3][four & 0xff]          ^ t[2][(four >> 8) & 0xff]   ^
+              t[1][(four >> 16) & 0xff]  ^ t[0][four >> 24];
+        buf    += 16;
+        length -= 16;
+    }
+    
+    return crc_byte(crc, buf, length);
+}
+
+#ifdef OASYS_CRC32_PCLMUL
+//----------------------------------------------------------------------
+static bool
+have_pclmul()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (! __get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ecx & bit_PCLMUL) != 0;
+}
+
+//----------------------------------------------------------------------
+/*
+ * Fold 64 bytes at a time with carry-less multiplies, then reduce the
+ * remaining 128 bits with a Barrett reduction. See "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+ * (Gopal et al., Intel, 2009); the constants are for the bit-reflected
+ * 0x04C11DB7 polynomial. Requires length >= 64 and a multiple of 16.
+ */
+__attribute__((target("pclmul,sse2")))
+static u_int32_t
+crc_pclmul_fold(u_int32_t crc, const u_char* buf, size_t length)
+{
+    static const u_int64_t k1k2[] __attribute__((aligned(16))) =
+        { 0x0154442bd4ULL, 0x01c6e41596ULL };
+    static const u_int64_t k3k4[] __attribute__((aligned(16))) =
+        { 0x01751997d0ULL, 0x00ccaa009eULL };
+    static const u_int64_t k5k0[] __attribute__((aligned(16))) =
+        { 0x0163cd6124ULL, 0x0000000000ULL };
+    static const u_int64_t poly[] __attribute__((aligned(16))) =
+        { 0x01db710641ULL, 0x01f7011641ULL };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+
+    buf    += 64;
+    length -= 64;
+
+    // four lanes of 128 bits each, folded forward by 512 bits
+    while (length >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        buf    += 64;
+        length -= 64;
+    }
+
+    // fold the four lanes into one
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // then any remaining 16 byte blocks
+    while (length >= 16) {
+        x2 = _mm_loadu_si128((const __m128i*)buf);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        buf    += 16;
+        length -= 16;
+    }
+
+    // 128 bits down to 64
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction down to 32
+    x0 = _mm_load_si128((const __m128i*)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+//----------------------------------------------------------------------
+static u_int32_t
+crc_pclmul(u_int32_t crc, const u_char* buf, size_t length)
+{
+    if (length >= 64) {
+        size_t chunk = length & ~(size_t)15;
+        crc     = crc_pclmul_fold(crc, buf, chunk);
+        buf    += chunk;
+        length -= chunk;
+    }
+    return crc_slice16(crc, buf, length);
+}
+#endif // OASYS_CRC32_PCLMUL
+
+//----------------------------------------------------------------------
+typedef u_int32_t (*crc_fn_t)(u_int32_t, const u_char*, size_t);
+
+static crc_fn_t
+impl_fn(CRC32::impl_t impl)
+{
+    switch (impl) {
+    case CRC32::IMPL_BYTE:    return crc_byte;
+    case CRC32::IMPL_SLICE8:  return crc_slice8;
+    case CRC32::IMPL_SLICE16: return crc_slice16;
+#ifdef OASYS_CRC32_PCLMUL
+    case CRC32::IMPL_PCLMUL:  return have_pclmul() ? crc_pclmul : 0;
+#endif
+    default:                  return 0;
+    }
+}
+
+static CRC32::impl_t cur_impl = CRC32::IMPL_MAX;
+static crc_fn_t      cur_fn   = 0;
+
+//----------------------------------------------------------------------
 CRC32::CRC32()
 {
     reset();
 }
 
+//----------------------------------------------------------------------
 void
 CRC32::reset()
 {
     crc_ = CRCINIT;
 }
 
+//----------------------------------------------------------------------
 void
 CRC32::update(
     const u_char* buf, 
     size_t        length
     )
 {
-    /* process each byte prior to checksum field */
-    for(size_t i = 0; i<length; i++, buf++) 
-    {
-        crc_ = CRCTABLE[(crc_ ^ *buf) & 0xFF] ^ (crc_ >> 8);
+    if (cur_fn == 0) {
+        set_impl(IMPL_MAX);
     }
+    crc_ = (*cur_fn)(crc_, buf, length);
 }
 
+//----------------------------------------------------------------------
 const CRC32::CRC_t&
 CRC32::value()
 {
@@ -143,6 +405,7 @@ CRC32::value()
     return crc_finished_;
 }
 
+//----------------------------------------------------------------------
 CRC32::CRC_t
 CRC32::from_bytes(u_char* buf)
 {
@@ -152,4 +415,62 @@ CRC32::from_bytes(u_char* buf)
     return crc_val; 
 }
 
+//----------------------------------------------------------------------
+const char*
+CRC32::impl_name(impl_t impl)
+{
+    switch (impl) {
+    case IMPL_BYTE:    return "byte";
+    case IMPL_SLICE8:  return "slice8";
+    case IMPL_SLICE16: return "slice16";
+    case IMPL_PCLMUL:  return "pclmul";
+    default:           return "(unknown)";
+    }
+}
+
+//----------------------------------------------------------------------
+bool
+CRC32::impl_supported(impl_t impl)
+{
+    return impl_fn(impl) != 0;
+}
+
+//----------------------------------------------------------------------
+CRC32::impl_t
+CRC32::impl()
+{
+    if (cur_fn == 0) {
+        set_impl(IMPL_MAX);
+    }
+    return cur_impl;
+}
+
+//----------------------------------------------------------------------
+void
+CRC32::set_impl(impl_t impl)
+{
+    // IMPL_MAX means pick the best one available
+    if (impl == IMPL_MAX) {
+        impl = impl_supported(IMPL_PCLMUL) ? IMPL_PCLMUL : IMPL_SLICE16;
+    }
+
+    crc_fn_t fn = impl_fn(impl);
+    ASSERTF(fn != 0, "CRC32 implementation %s not supported",
+            impl_name(impl));
+    init_slice_tables();
+    
+    cur_impl = impl;
+    cur_fn   = fn;
+}
+
+//----------------------------------------------------------------------
+CRC32::CRC_t
+CRC32::update_impl(impl_t impl, CRC_t crc, const u_char* buf, size_t length)
+{
+    crc_fn_t fn = impl_fn(impl);
+    ASSERTF(fn != 0, "CRC32 implementation %s not supported",
+            impl_name(impl));
+    return (*fn)(crc, buf, length);
+}
+
 }; // namespace oasys
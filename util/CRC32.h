@@ -23,12 +23,33 @@
 #include "../compat/inttypes.h"
 
 namespace oasys {
+
+/**
+ * The standard (IEEE 802.3 / zlib) CRC-32.
+ *
+ * There are several implementations of the inner loop, all producing
+ * identical results. The fastest one the CPU supports is picked the
+ * first time a CRC is computed: carry-less multiply folding on x86
+ * with PCLMULQDQ, slicing-by-16 otherwise.
+ *
+ * Note that the SSE4.2 crc32 instruction can't be used, since it
+ * implements the Castagnoli polynomial (CRC-32C), not this one.
+ */
 class CRC32 {
 public:
     CRC32();
 
     typedef u_int32_t CRC_t;
 
+    /// The implementations of update()
+    typedef enum {
+        IMPL_BYTE = 0,  ///< Classic table lookup, a byte at a time
+        IMPL_SLICE8,    ///< Slicing-by-8
+        IMPL_SLICE16,   ///< Slicing-by-16
+        IMPL_PCLMUL,    ///< PCLMULQDQ folding (x86 only)
+        IMPL_MAX
+    } impl_t;
+
     /** @{
      * Update the crc with the data in the buf 
      */
@@ -43,6 +64,20 @@ public:
 
     static CRC_t from_bytes(u_char* buf);
 
+    /// @{ Implementation selection, mostly for testing and benchmarks
+    static const char* impl_name(impl_t impl);
+    static bool        impl_supported(impl_t impl);
+    static impl_t      impl();
+    static void        set_impl(impl_t impl);
+    /// @}
+
+    /**
+     * Run a particular implementation over the buffer, continuing from
+     * the (not yet finalized) crc value.
+     */
+    static CRC_t update_impl(impl_t impl, CRC_t crc,
+                             const u_char* buf, size_t length);
+
 private:
     CRC_t crc_;
     CRC_t crc_finished_;
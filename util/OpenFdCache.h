@@ -17,6 +17,7 @@
 #ifndef __OPENFDCACHE_H__
 #define __OPENFDCACHE_H__
 
+#include <errno.h>
 #include <map>
 
 #include "../debug/Logger.h"
@@ -47,12 +48,13 @@ public:
         FdListEnt(const _Key& key,
                   int fd        = -1,
                   int pin_count = 0)
-            : key_(key), fd_(fd), pin_count_(pin_count)
+            : key_(key), fd_(fd), pin_count_(pin_count), dirty_(false)
         {}
         
         _Key key_;
         int  fd_;
         int  pin_count_;
+        bool dirty_;    //!< written since the last sync
     };
 
     typedef LRUList<FdListEnt>                        FdList;
@@ -61,7 +63,8 @@ public:
     OpenFdCache(const char* logpath,
                 size_t      max)
         : Logger("OpenFdCache", "%s/%s", logpath, "cache"),
-          max_(max)
+          max_(max),
+          evict_sync_failed_(false)
     {}
 
     /*!
@@ -92,16 +95,30 @@ public:
     }
 
     /*!
-     * Unpin the fd referenced by _Key.
+     * Unpin the fd referenced by _Key. If dirty is set, the file was
+     * written through the fd, and the next sync_all() (or evicting
+     * it) will fsync it.
+     *
+     * Callers that may race with replace() or close() pass the fd
+     * they pinned, since it may no longer be the one cached for the
+     * key. The last unpin of such a fd closes it.
      */
-    void unpin(const _Key& key) 
+    void unpin(const _Key& key, bool dirty = false, int fd = -1) 
     {
         ScopeLock l(&lock_, "OpenFdCache::unpin");
 
         typename FdMap::iterator i = open_fds_map_.find(key);
-        ASSERT(i != open_fds_map_.end());
+        if (i == open_fds_map_.end() ||
+            (fd != -1 && i->second->fd_ != fd))
+        {
+            unpin_retired(key, fd);
+            return;
+        }
         
         --(i->second->pin_count_);
+        if (dirty) {
+            i->second->dirty_ = true;
+        }
 
         log_debug("Unpin entry fd=%d pin_count=%d size=%u", 
                   i->second->fd_, 
@@ -197,23 +214,78 @@ public:
     }
 
     /*!
-     * Close and release all of the cached fds.
+     * Fsync the cached fds that were written since they were last
+     * synced.
+     *
+     * @return 0 on success, -1 if any of the fsyncs failed
      */
-    void sync_all() {
+    int sync_all() {
         ScopeLock l(&lock_, "OpenFdCache::sync_all");
 
         log_debug("There were %u open fds upon sync_all.", open_fds_.size());
 
+        int ret = 0;
+        if (evict_sync_failed_) {
+            evict_sync_failed_ = false;
+            ret = -1;
+        }
+
         for (typename FdList::iterator i = open_fds_.begin();
              i != open_fds_.end(); ++i)
         {
+            if (! i->dirty_) {
+                continue;
+            }
+
             log_debug("Syncing fd=%d", i->fd_);
-            fsync(i->fd_);
+            if (fsync(i->fd_) != 0) {
+                log_err("fsync of fd=%d failed: %s", i->fd_, strerror(errno));
+                ret = -1;
+                continue;
+            }
+            i->dirty_ = false;
         }
+
+        return ret;
+    }
+
+    /*!
+     * Replace the cached fd for the key (if any) with a new one, e.g.
+     * because the file was replaced by a rename. The new fd is pinned
+     * like with put_and_pin(). If the old fd is pinned, it stays open
+     * until the last of its users unpins it.
+     */
+    void replace(const _Key& key, int fd)
+    {
+        ScopeLock l(&lock_, "OpenFdCache::replace");
+
+        ASSERT(fd != -1);
+
+        typename FdMap::iterator i = open_fds_map_.find(key);
+        if (i != open_fds_map_.end())
+        {
+            remove(i);
+        }
+
+        while (open_fds_map_.size() + 1 > max_)
+        {
+            if (evict() == -1)
+            {
+                break;
+            }
+        }
+
+        typename FdList::iterator new_ent = open_fds_.insert(open_fds_.end(),
+                                                             FdListEnt(key, fd, 1));
+        open_fds_map_.insert(typename FdMap::value_type(key, new_ent));
+
+        log_debug("Replaced entry fd=%d size=%u",
+                  fd, (u_int)open_fds_map_.size());
     }
 
     /*!
-     * Close a file fd and remove it from the cache.
+     * Close a file fd and remove it from the cache. If the fd is
+     * pinned, it's closed when the last user unpins it.
      */
     void close(const _Key& key) 
     {
@@ -226,13 +298,7 @@ public:
             return;
         }
 
-        ASSERT(i->second->pin_count_ == 0);
-
-        _CloseFcn::close(i->second->fd_);
-        log_debug("Closed %d size=%u", i->second->fd_, (u_int)open_fds_map_.size());
-
-        open_fds_.erase(i->second);
-        open_fds_map_.erase(i);       
+        remove(i);
     }
     
     /*!
@@ -254,8 +320,16 @@ public:
             _CloseFcn::close(i->fd_);
         }
 
+        for (typename FdList::iterator i = retired_.begin();
+             i != retired_.end(); ++i)
+        {
+            log_warn("replaced fd=%d was busy", i->fd_);
+            _CloseFcn::close(i->fd_);
+        }
+
         open_fds_.clear();
         open_fds_map_.clear();
+        retired_.clear();
     }
 
 private:
@@ -263,9 +337,58 @@ private:
 
     FdList open_fds_;
     FdMap  open_fds_map_;
+    FdList retired_;    //!< replaced or closed fds that are still pinned
 
     size_t max_;
 
+    bool   evict_sync_failed_; //!< reported by the next sync_all()
+
+    /*!
+     * Take an entry out of the cache, closing its fd unless it's
+     * pinned, in which case it waits in retired_ for the last unpin.
+     */
+    void remove(typename FdMap::iterator i)
+    {
+        typename FdList::iterator ent = i->second;
+        open_fds_map_.erase(i);
+
+        if (ent->pin_count_ == 0)
+        {
+            _CloseFcn::close(ent->fd_);
+            log_debug("Closed %d size=%u", ent->fd_,
+                      (u_int)open_fds_map_.size());
+            open_fds_.erase(ent);
+            return;
+        }
+
+        log_debug("Retired pinned fd=%d pin_count=%d",
+                  ent->fd_, ent->pin_count_);
+        retired_.push_back(*ent);
+        open_fds_.erase(ent);
+    }
+
+    /*!
+     * Unpin a fd that was replaced or closed while pinned.
+     */
+    void unpin_retired(const _Key& key, int fd)
+    {
+        typename FdList::iterator i;
+        for (i = retired_.begin(); i != retired_.end(); ++i)
+        {
+            if (i->key_ == key && (fd == -1 || i->fd_ == fd)) {
+                break;
+            }
+        }
+        ASSERT(i != retired_.end());
+
+        if (--(i->pin_count_) == 0)
+        {
+            log_debug("Closing retired fd=%d", i->fd_);
+            _CloseFcn::close(i->fd_);
+            retired_.erase(i);
+        }
+    }
+
     /*!
      * Search from the beginning of the list and throw out a single,
      * unpinned fd.
@@ -290,6 +413,13 @@ private:
             ASSERT(i->fd_ < 8*1024);
             
             log_debug("Evicting fd=%d size=%u", i->fd_, (u_int)open_fds_map_.size());
+            
+            // don't lose writes that are waiting for a sync_all
+            if (i->dirty_ && fsync(i->fd_) != 0) {
+                log_err("fsync of evicted fd=%d failed: %s",
+                        i->fd_, strerror(errno));
+                evict_sync_failed_ = true;
+            }
             _CloseFcn::close(i->fd_);
             open_fds_map_.erase(i->key_);
             open_fds_.erase(i);
@@ -61,12 +61,20 @@ namespace oasys {
 //----------------------------------------------------------------------------
 /**
  * Hashing function class for std::strings.
+ *
+ * This is the function behind __stl_hash_string(), but it covers
+ * the whole string, since keys holding binary data (like a
+ * marshalled integer) often have embedded nulls.
  */
 #if __cplusplus < 201103L
 struct StringHash {
     size_t operator()(const std::string& str) const
     {
-        return _std::__stl_hash_string(str.c_str());
+        size_t h = 0;
+        for (std::string::size_type i = 0; i < str.size(); ++i) {
+            h = 5 * h + static_cast<unsigned char>(str[i]);
+        }
+        return h;
     }
 };
 #else